@@ -0,0 +1,50 @@
+
+//
+// Copy the multisampled scene depth buffer into the (smaller, single sample) blur depth buffer
+//
+
+// Ensure matrices are row-major
+#pragma pack_matrix(row_major)
+
+
+//
+// Textures
+//
+
+Texture2DMS <float> depthTexture : register(t0);
+
+
+//-----------------------------------------------------------------
+// Input / Output structures
+//-----------------------------------------------------------------
+
+struct FragmentInputPacket {
+
+	float2				texCoord		: TEXCOORD;
+	float4				posH			: SV_POSITION;
+};
+
+
+struct FragmentOutputPacket {
+
+	float4				fragmentColour : SV_TARGET;
+	float				fragmentDepth : SV_DEPTH;
+};
+
+
+//-----------------------------------------------------------------
+// Pixel Shader - point sample sample 0 of the scene depth at the matching screen position
+//-----------------------------------------------------------------
+
+FragmentOutputPacket main(FragmentInputPacket IN) {
+
+	FragmentOutputPacket outputFragment;
+
+	// Scale by the actual depth buffer size so the blur target can use any resolution
+	uint width, height, numSamples;
+	depthTexture.GetDimensions(width, height, numSamples);
+
+	outputFragment.fragmentDepth = depthTexture.Load(int2(IN.texCoord * float2(width, height)), 0).r;
+	outputFragment.fragmentColour = float4(0, 0, 0, 0);
+	return outputFragment;
+}
@@ -0,0 +1,61 @@
+
+//
+// Blur pyramid downsample - halves the resolution of the previous level
+//
+
+// Ensure matrices are row-major
+#pragma pack_matrix(row_major)
+
+
+//-----------------------------------------------------------------
+// Globals
+//-----------------------------------------------------------------
+
+cbuffer blurCBuffer : register(b4) {
+	float4				taps[17];
+	float2				texelStep; // Size of one texel of the source (higher resolution) level
+	int					numTaps;
+};
+
+
+//
+// Textures
+//
+
+Texture2D inputTex : register(t0);
+SamplerState clampSampler : register(s1);
+
+
+//-----------------------------------------------------------------
+// Input / Output structures
+//-----------------------------------------------------------------
+
+struct FragmentInputPacket {
+
+	float2				texCoord		: TEXCOORD;
+	float4				posH			: SV_POSITION;
+};
+
+
+struct FragmentOutputPacket {
+
+	float4				fragmentColour : SV_TARGET;
+};
+
+
+//-----------------------------------------------------------------
+// Pixel Shader - 4 bilinear taps cover a 4x4 source footprint to avoid aliasing between levels
+//-----------------------------------------------------------------
+
+FragmentOutputPacket main(FragmentInputPacket IN) {
+
+	FragmentOutputPacket outputFragment;
+
+	float4 sum = inputTex.Sample(clampSampler, IN.texCoord + float2(-texelStep.x, -texelStep.y));
+	sum += inputTex.Sample(clampSampler, IN.texCoord + float2(texelStep.x, -texelStep.y));
+	sum += inputTex.Sample(clampSampler, IN.texCoord + float2(-texelStep.x, texelStep.y));
+	sum += inputTex.Sample(clampSampler, IN.texCoord + float2(texelStep.x, texelStep.y));
+
+	outputFragment.fragmentColour = sum * 0.25;
+	return outputFragment;
+}
@@ -0,0 +1,68 @@
+
+//
+// Separable Gaussian blur - one direction per pass (direction and texel size given by texelStep)
+//
+
+// Ensure matrices are row-major
+#pragma pack_matrix(row_major)
+
+
+//-----------------------------------------------------------------
+// Globals
+//-----------------------------------------------------------------
+
+// Bilinear optimised taps computed on the CPU (see BlurKernel.h)
+cbuffer blurCBuffer : register(b4) {
+	float4				taps[17]; // x = offset in texels, y = weight
+	float2				texelStep;
+	int					numTaps;
+};
+
+
+//
+// Textures
+//
+
+// inputTex - texture being convolved
+Texture2D inputTex : register(t0);
+SamplerState clampSampler : register(s1);
+
+
+//-----------------------------------------------------------------
+// Input / Output structures
+//-----------------------------------------------------------------
+
+// Input fragment - this is the per-fragment packet interpolated by the rasteriser stage
+struct FragmentInputPacket {
+
+	float2				texCoord		: TEXCOORD;
+	float4				posH			: SV_POSITION;
+};
+
+
+struct FragmentOutputPacket {
+
+	float4				fragmentColour : SV_TARGET;
+};
+
+
+//-----------------------------------------------------------------
+// Pixel Shader - Convolve with Gaussian
+//-----------------------------------------------------------------
+
+FragmentOutputPacket main(FragmentInputPacket IN) {
+
+	FragmentOutputPacket outputFragment;
+
+	float4 sum = inputTex.Sample(clampSampler, IN.texCoord) * taps[0].y;
+
+	// Each tap lands between two texels so the bilinear filter blends both discrete weights
+	for (int i = 1; i < numTaps; i++) {
+
+		float2 offset = texelStep * taps[i].x;
+		sum += (inputTex.Sample(clampSampler, IN.texCoord + offset) + inputTex.Sample(clampSampler, IN.texCoord - offset)) * taps[i].y;
+	}
+
+	outputFragment.fragmentColour = sum;
+	return outputFragment;
+}
@@ -0,0 +1,67 @@
+
+//
+// Blur pyramid upsample - tent filters a lower level so it can be added to the level above
+//
+
+// Ensure matrices are row-major
+#pragma pack_matrix(row_major)
+
+
+//-----------------------------------------------------------------
+// Globals
+//-----------------------------------------------------------------
+
+cbuffer blurCBuffer : register(b4) {
+	float4				taps[17];
+	float2				texelStep; // Size of one texel of the source (lower resolution) level
+	int					numTaps;
+};
+
+
+//
+// Textures
+//
+
+Texture2D inputTex : register(t0);
+SamplerState clampSampler : register(s1);
+
+
+//-----------------------------------------------------------------
+// Input / Output structures
+//-----------------------------------------------------------------
+
+struct FragmentInputPacket {
+
+	float2				texCoord		: TEXCOORD;
+	float4				posH			: SV_POSITION;
+};
+
+
+struct FragmentOutputPacket {
+
+	float4				fragmentColour : SV_TARGET;
+};
+
+
+//-----------------------------------------------------------------
+// Pixel Shader - 3x3 tent filter (1 2 1 / 2 4 2 / 1 2 1)
+//-----------------------------------------------------------------
+
+FragmentOutputPacket main(FragmentInputPacket IN) {
+
+	FragmentOutputPacket outputFragment;
+
+	float2 d = texelStep;
+
+	float4 sum = inputTex.Sample(clampSampler, IN.texCoord) * 4.0;
+	sum += (inputTex.Sample(clampSampler, IN.texCoord + float2(-d.x, 0)) + inputTex.Sample(clampSampler, IN.texCoord + float2(d.x, 0))) * 2.0;
+	sum += (inputTex.Sample(clampSampler, IN.texCoord + float2(0, -d.y)) + inputTex.Sample(clampSampler, IN.texCoord + float2(0, d.y))) * 2.0;
+	sum += inputTex.Sample(clampSampler, IN.texCoord + float2(-d.x, -d.y));
+	sum += inputTex.Sample(clampSampler, IN.texCoord + float2(d.x, -d.y));
+	sum += inputTex.Sample(clampSampler, IN.texCoord + float2(-d.x, d.y));
+	sum += inputTex.Sample(clampSampler, IN.texCoord + float2(d.x, d.y));
+
+	// Scaled by the blend factor and added to the destination level (see the "Glow upsample" passes in BlurUtility::addPasses)
+	outputFragment.fragmentColour = sum / 16.0;
+	return outputFragment;
+}
@@ -0,0 +1,38 @@
+//
+// Constant buffers shared by the scene shaders.  Layouts match CBufferModel, CBufferCamera, CBufferLight and CBufferScene in
+// CBufferStructures.h
+//
+
+#ifndef COMMON_CBUFFERS_HLSLI
+#define COMMON_CBUFFERS_HLSLI
+
+cbuffer modelCBuffer : register(b0) {
+	float4x4			worldMatrix;
+	float4x4			worldITMatrix; // Correctly transform normals to world space
+	// Compressed vertices (FEATURE_COMPRESSED_VERTEX) - position = posOffset + quantised position * posScale
+	float4				posOffset;
+	float4				posScale;
+	float4				matDiffuse; // a represents alpha.
+	float4				matSpecular; // a represents specular power.
+};
+cbuffer cameraCbuffer : register(b1) {
+	float4x4			viewMatrix;
+	float4x4			projMatrix;
+	float4				eyePos;
+};
+cbuffer lightCBuffer : register(b2) {
+	float4				lightVec; // w=1: Vec represents position, w=0: Vec  represents direction.
+	float4				lightAmbient;
+	float4				lightDiffuse;
+	float4				lightSpecular;
+};
+cbuffer sceneCBuffer : register(b3) {
+	float4				windDir;
+	float				Time;
+	float				grassHeight;
+	float				fogStart; // Distance from the eye at which fog begins
+	float				fogEnd; // Distance at which fog is opaque
+	float4				fogColour;
+};
+
+#endif
@@ -41,8 +41,8 @@ cbuffer sceneCBuffer : register(b3) {
 // Textures
 //
 
-// Assumes texture bound to texture t0 and sampler bound to sampler s0
-Texture2D flareTexture : register(t0);
+// Assumes flare texture array bound to texture t0 and sampler bound to sampler s0
+Texture2DArray flareTextures : register(t0);
 Texture2DMS  <float>depth: register(t1);
 SamplerState linearSampler : register(s0);
 
@@ -58,6 +58,7 @@ struct FragmentInputPacket {
 
 	float4				colour		: COLOR;
 	float2				texCoord	:TEXCOORD;
+	nointerpolation uint slice		: SLICE;
 	float4				posH			: SV_POSITION;
 };
 
@@ -76,7 +77,7 @@ FragmentOutputPacket main(FragmentInputPacket p) {
 	
 	FragmentOutputPacket outputFragment;
 
-	float g = flareTexture.Sample(linearSampler, p.texCoord).r*0.2;
+	float g = flareTextures.Sample(linearSampler, float3(p.texCoord, p.slice)).r*0.2;
 
 	outputFragment.fragmentColour = float4(g*p.colour);
 	return outputFragment;
@@ -12,11 +12,13 @@ cbuffer cameraCBuffer : register(b1) {
 //----------------------------
 // Input / Output structures
 //----------------------------
+// posL is the per-vertex quad corner, the remaining fields are per-instance (one instance per flare)
 struct vertexInputPacket {
 
+	float2				posL		: LPOS;
 	float3				pos			: POSITION;
-	float3				posL		: LPOS;
 	float4				colour		: COLOR;
+	uint				slice		: SLICE;
 };
 
 
@@ -24,6 +26,7 @@ struct vertexOutputPacket {
 
 	float4				colour		: COLOR;
 	float2				texCoord	:TEXCOORD;
+	nointerpolation uint slice		: SLICE;
 	float4				posH			: SV_POSITION;
 };
 
@@ -61,6 +64,7 @@ vertexOutputPacket main(vertexInputPacket inputVertex) {
 		pos = float4(0, 0, 0, 0);
 	// Transform to homogeneous clip space.
 	outputVertex.colour = inputVertex.colour;
+	outputVertex.slice = inputVertex.slice;
 	outputVertex.posH = pos;// 
 	outputVertex.texCoord = float2((inputVertex.posL.x + 1)*0.5, (inputVertex.posL.y + 1)*0.5);
 
@@ -0,0 +1,71 @@
+
+//
+// Impostor pixel shader - see ImpostorBatch.h.  The albedo and model space normal baked into the atlases are lit as the trees are
+// (lit_ps with a positional light)
+//
+
+// Ensure matrices are row-major
+#pragma pack_matrix(row_major)
+
+//-----------------------------------------------------------------
+// Globals
+//-----------------------------------------------------------------
+#include "common_cbuffers.hlsli"
+
+
+//
+// Textures
+//
+
+// Assumes the albedo atlas is bound to t0, the normal atlas to t1 and a clamped sampler to s0
+Texture2D albedoAtlas : register(t0);
+Texture2D normalAtlas : register(t1);
+SamplerState atlasSampler : register(s0);
+
+
+//-----------------------------------------------------------------
+// Input / Output structures
+//-----------------------------------------------------------------
+
+// Input fragment - this is the per-fragment packet interpolated by the rasteriser stage
+struct FragmentInputPacket {
+
+	float3				posW		: POSITION;
+	float2				texCoord	: TEXCOORD;
+	nointerpolation float2 axis		: AXIS; // World (x, z) direction of the model's x axis
+	float				alpha		: ALPHA; // Fade in beyond the mesh draw distance
+	float4				posH		: SV_POSITION;
+};
+
+
+struct FragmentOutputPacket {
+
+	float4				fragmentColour : SV_TARGET;
+};
+
+
+//-----------------------------------------------------------------
+// Pixel Shader - Lighting
+//-----------------------------------------------------------------
+
+FragmentOutputPacket main(FragmentInputPacket v) {
+
+	FragmentOutputPacket outputFragment;
+
+	float4 baseColour = albedoAtlas.Sample(atlasSampler, v.texCoord);
+
+	// Model space normal to world space (the instance is only turned about the vertical axis)
+	float3 n = normalAtlas.Sample(atlasSampler, v.texCoord).xyz * 2.0 - 1.0;
+	float3 N = n.x * float3(v.axis.x, 0, v.axis.y) + n.y * float3(0, 1, 0) + n.z * float3(-v.axis.y, 0, v.axis.x);
+	N = (dot(N, N) > 0) ? normalize(N) : float3(0, 1, 0);
+
+	//Initialise returned colour to ambient component
+	float3 colour = baseColour.xyz * lightAmbient;
+
+	// Add diffuse light from the positional light
+	float3 lightDir = normalize(lightVec.xyz - v.posW);
+	colour += max(dot(lightDir, N), 0.0f) * baseColour.xyz * lightDiffuse;
+
+	outputFragment.fragmentColour = float4(colour, baseColour.a * v.alpha);
+	return outputFragment;
+}
@@ -0,0 +1,92 @@
+
+//
+// Impostor vertex shader - see ImpostorBatch.h.  Each instance is a quad over the bounding cylinder of the baked model, turned about
+// the vertical axis to face the camera (the fountain billboard held upright), showing the atlas frame baked nearest to the direction
+// the instance is seen from
+//
+
+// Ensure matrices are row-major
+#pragma pack_matrix(row_major)
+
+//-----------------------------------------------------------------
+// Globals
+//-----------------------------------------------------------------
+#include "common_cbuffers.hlsli"
+
+cbuffer impostorCBuffer : register(b4) {
+	float4				bounds; // Model space bounding cylinder - x = centre x, y = centre z, z = radius, w = minY
+	float4				frames; // x = number of views, y = atlas columns, z = 1 / columns, w = 1 / rows
+	float				height; // Height of the bounding cylinder
+	float				nearDistance; // Nearer instances are drawn as meshes
+	float				fadeRange; // Impostors fade in over this distance beyond nearDistance
+};
+
+
+//-----------------------------------------------------------------
+// Input / Output structures
+//-----------------------------------------------------------------
+struct vertexInputPacket {
+
+	float2				posL		: LPOS; // Quad corner - x from -1 to 1 across the cylinder, y from 0 to 1 up it
+	// Per instance (ImpostorInstanceStruct)
+	float3				pos			: POSITION; // World position of the model's origin
+	float				scale		: SCALE;
+	float2				axis		: AXIS; // World (x, z) direction of the model's x axis
+};
+
+
+struct vertexOutputPacket {
+
+	float3				posW		: POSITION;
+	float2				texCoord	: TEXCOORD;
+	nointerpolation float2 axis		: AXIS;
+	float				alpha		: ALPHA;
+	float4				posH		: SV_POSITION;  // in clip space
+};
+
+
+static const float TWO_PI = 6.28318531;
+
+//-----------------------------------------------------------------
+// Vertex Shader
+//-----------------------------------------------------------------
+vertexOutputPacket main(vertexInputPacket vin) {
+
+	vertexOutputPacket vout = (vertexOutputPacket)0;
+
+	// The model's x and z axes in world space
+	float3 axisX = float3(vin.axis.x, 0, vin.axis.y);
+	float3 axisZ = float3(-vin.axis.y, 0, vin.axis.x);
+
+	// Base of the bounding cylinder in world space
+	float3 base = vin.pos + vin.scale * (bounds.x * axisX + bounds.y * axisZ + float3(0, bounds.w, 0));
+	float worldHeight = height * vin.scale;
+
+	// Instances nearer than nearDistance are drawn as meshes - collapse the quad so it is clipped
+	float distance = length(eyePos.xyz - (base + float3(0, 0.5 * worldHeight, 0)));
+	if (distance < nearDistance)
+		return vout;
+	vout.alpha = saturate((distance - nearDistance) / max(fadeRange, 0.001));
+
+	// Horizontal direction to the eye and the billboard's right vector (left handed, as the atlas frames were baked)
+	float3 look = eyePos.xyz - base;
+	look.y = 0;
+	look = (dot(look, look) > 0) ? normalize(look) : axisX;
+	float3 right = cross(look, float3(0, 1, 0));
+
+	// Frame baked nearest to the direction of the eye in model space (frame v looks from angle 2 pi v / number of views)
+	float angle = atan2(dot(look, axisZ), dot(look, axisX));
+	float view = fmod(round(frac(angle / TWO_PI + 1.0) * frames.x), frames.x);
+	float row = floor((view + 0.5) * frames.z);
+	float column = view - row * frames.y;
+
+	// Transform to world space
+	float3 pos = base + right * (vin.posL.x * bounds.z * vin.scale) + float3(0, vin.posL.y * worldHeight, 0);
+	vout.posW = pos;
+	vout.posH = mul(float4(pos, 1.0f), mul(viewMatrix, projMatrix));
+
+	// Texture coordinates within the frame (texture v runs down from the top of the cylinder)
+	vout.texCoord = float2((column + (vin.posL.x + 1) * 0.5) * frames.z, (row + 1 - vin.posL.y) * frames.w);
+	vout.axis = vin.axis;
+	return vout;
+}
@@ -1,50 +1,17 @@
-
 //
-// Model a simple light
+// Lit model pixel shader.  Compiled once per feature combination by ShaderPermutations - see shader_features.hlsli.
+// Replaces basic_texture_ps, per_pixel_lighting_ps and tree_ps
 //
 
 // Ensure matrices are row-major
 #pragma pack_matrix(row_major)
 
-
-//-----------------------------------------------------------------
-// Structures and resources
-//-----------------------------------------------------------------
-
 //-----------------------------------------------------------------
 // Globals
 //-----------------------------------------------------------------
 
-cbuffer modelCBuffer : register(b0) {
-
-	float4x4			worldMatrix;
-	float4x4			worldITMatrix; // Correctly transform normals to world space
-};
-cbuffer cameraCbuffer : register(b1) {
-	float4x4			viewMatrix;
-	float4x4			projMatrix;
-	float4				eyePos;
-}
-cbuffer lightCBuffer : register(b2) {
-	float4				lightVec; // w=1: Vec represents position, w=0: Vec  represents direction.
-	float4				lightAmbient;
-	float4				lightDiffuse;
-	float4				lightSpecular;
-};
-cbuffer sceneCBuffer : register(b3) {
-	float4				windDir;
-	float				Time;
-	float				grassHeight;
-};
-
-//
-// Textures
-//
-
-// Assumes texture bound to texture t0 and sampler bound to sampler s0
-Texture2D myTexture : register(t0);
-SamplerState linearSampler : register(s0);
-
+#include "shader_features.hlsli"
+#include "common_cbuffers.hlsli"
 
 
 //-----------------------------------------------------------------
@@ -71,43 +38,67 @@ struct FragmentOutputPacket {
 };
 
 
+//
+// Textures
+//
+
+#if FEATURE_TEXTURE
+// Assumes texture bound to texture t0 and sampler bound to sampler s0
+Texture2D diffuseTexture : register(t0);
+SamplerState linearSampler : register(s0);
+#endif
+
+
 //-----------------------------------------------------------------
 // Pixel Shader - Lighting 
 //-----------------------------------------------------------------
 
 FragmentOutputPacket main(FragmentInputPacket v) { 
 
-
 	FragmentOutputPacket outputFragment;
 
 	float3 N = normalize(v.normalW);
+
+#if FEATURE_TEXTURE
+	float4 baseColour = diffuseTexture.Sample(linearSampler, v.texCoord);
+#else
 	float4 baseColour = v.matDiffuse;
-	baseColour =  myTexture.Sample(linearSampler, v.texCoord);
+#endif
 
-	// Alpha Test
-	//if (baseColour.a < 0.9)
-		//clip(-1);
+#if FEATURE_ALPHA_TEST
+	if (baseColour.a < 0.9)
+		clip(-1);
+#endif
 
 	//Initialise returned colour to ambient component
 	float3 colour = baseColour.xyz* lightAmbient;
 
 	// Calculate the lambertian term (essentially the brightness of the surface point based on the dot product of the normal vector with the vector pointing from v to the light source's location)
-	float3 lightDir = -lightVec.xyz; // Directional light
-	if (lightVec.w == 1.0) lightDir =lightVec.xyz - v.posW; // Positional light
-	lightDir=normalize(lightDir);
+#if FEATURE_POSITIONAL_LIGHT
+	float3 lightDir = normalize(lightVec.xyz - v.posW);
+#else
+	float3 lightDir = normalize(-lightVec.xyz);
+#endif
 
 	// Add diffuse light if relevant (otherwise we end up just returning the ambient light colour)
 	colour += max(dot(lightDir, N), 0.0f) *baseColour.xyz * lightDiffuse;
 
+#if FEATURE_SPECULAR
 	// Calc specular light
 	float specPower = max(v.matSpecular.a*1000.0, 1.0f);
 	float3 eyeDir = normalize(eyePos - v.posW);
-	float3 R = reflect(-lightDir,N );
+	float3 R = reflect(-lightDir, N);
 	float specFactor = pow(max(dot(R, eyeDir), 0.0f), specPower);
 	colour += specFactor * v.matSpecular.xyz * lightSpecular;
+#endif
 
-	outputFragment.fragmentColour = float4(colour, baseColour.a);
+#if FEATURE_FOG
+	// Linear distance fog
+	float fogFactor = saturate((length(eyePos.xyz - v.posW) - fogStart) / (fogEnd - fogStart));
+	colour = lerp(colour, fogColour.xyz, fogFactor);
+#endif
 
+	outputFragment.fragmentColour = float4(colour, baseColour.a);
 	return outputFragment;
 
 }
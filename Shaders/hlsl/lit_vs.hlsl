@@ -0,0 +1,111 @@
+//
+// Lit model vertex shader.  Compiled once per feature combination by ShaderPermutations - see shader_features.hlsli.
+// Replaces basic_texture_vs, per_pixel_lighting_vs and tree_vs
+//
+
+// Ensure matrices are row-major
+#pragma pack_matrix(row_major)
+
+//-----------------------------------------------------------------
+// Globals
+//-----------------------------------------------------------------
+
+#include "shader_features.hlsli"
+#include "common_cbuffers.hlsli"
+
+//-----------------------------------------------------------------
+// Input / Output structures
+//-----------------------------------------------------------------
+struct vertexInputPacket {
+
+#if FEATURE_COMPRESSED_VERTEX
+	// CompressedVertexStruct (compressedVertexDesc)
+	float4				pos			: POSITION; // xyz quantised within the mesh bounds (UNORM)
+	float2				normal		: NORMAL; // Octahedral (SNORM)
+	float2				texCoord	: TEXCOORD; // Half floats, converted by the input assembler
+#else
+	float3				pos			: POSITION;
+	float3				normal		: NORMAL;
+	float4				matDiffuse	: DIFFUSE; // a represents alpha.
+	float4				matSpecular	: SPECULAR;  // a represents specular power. 
+	float2				texCoord	: TEXCOORD;
+#endif
+#if FEATURE_INSTANCING
+	// Per instance world matrix (slot 1, see extInstancedVertexDesc)
+	float4x4			instanceWorld	: WORLD;
+#endif
+};
+
+
+struct vertexOutputPacket {
+
+	// Vertex in world coords
+	float3				posW			: POSITION;
+	// Normal in world coords
+	float3				normalW			: NORMAL;
+	float4				matDiffuse		: DIFFUSE;
+	float4				matSpecular		: SPECULAR;
+	float2				texCoord		: TEXCOORD;
+	float4				posH			: SV_POSITION;
+};
+#if FEATURE_COMPRESSED_VERTEX
+// Unit vector from its octahedral encoding (see encodeOctahedral in VertexCompression.cpp)
+float3 decodeOctahedral(float2 e) {
+
+	float3 n = float3(e.x, e.y, 1.0f - abs(e.x) - abs(e.y));
+	// The lower hemisphere is folded over the diagonals
+	float t = saturate(-n.z);
+	n.xy += (n.xy >= 0.0f) ? -t : t;
+	return normalize(n);
+}
+#endif
+
+//-----------------------------------------------------------------
+// Vertex Shader
+//-----------------------------------------------------------------
+vertexOutputPacket main(vertexInputPacket inputVertex) {
+
+	vertexOutputPacket outputVertex;
+
+#if FEATURE_INSTANCING
+	// Instances are rigid (no non-uniform scale) so the world matrix also transforms normals
+	float4x4 world = inputVertex.instanceWorld;
+	float4x4 worldIT = inputVertex.instanceWorld;
+#else
+	float4x4 world = worldMatrix;
+	float4x4 worldIT = worldITMatrix;
+#endif
+	float4x4 WVP = mul(world, mul(viewMatrix, projMatrix));
+#if FEATURE_COMPRESSED_VERTEX
+	float3 pos = posOffset.xyz + inputVertex.pos.xyz * posScale.xyz;
+	float3 normal = decodeOctahedral(inputVertex.normal);
+	float4 diffuse = matDiffuse;
+	float4 specular = matSpecular;
+#else
+	float3 pos = inputVertex.pos;
+	float3 normal = inputVertex.normal;
+	float4 diffuse = inputVertex.matDiffuse;
+	float4 specular = inputVertex.matSpecular;
+#endif
+
+#if FEATURE_WIND
+	// Sway in the wind - the top of the model moves more than the base
+	float k = pow(pos.y / 2, 3);
+	float3 gWindDir = float3(sin(Time)*0.05, 0, 0);
+	pos = pos + gWindDir*k;
+#endif
+
+	// Lighting is calculated in world space.
+	outputVertex.posW = mul(float4(pos, 1.0f), world).xyz;
+	// Transform normals to world space with gWorldIT.
+	outputVertex.normalW = mul(float4(normal, 1.0f), worldIT).xyz;
+	// Pass through material properties
+	outputVertex.matDiffuse = diffuse;
+	outputVertex.matSpecular = specular;
+	// .. and texture coordinates.
+	outputVertex.texCoord = inputVertex.texCoord;
+	// Finally transform/project pos to screen/clip space posH
+	outputVertex.posH = mul(float4(pos, 1.0), WVP);
+
+	return outputVertex;
+}
@@ -30,27 +30,7 @@ SamplerState gTriLinearSam : register(s1);
 
 // Globals
 
-cbuffer modelCBuffer : register(b0) {
-
-	float4x4			worldMatrix;
-	float4x4			worldITMatrix; // Correctly transform normals to world space
-};
-cbuffer cameraCbuffer : register(b1) {
-	float4x4			viewMatrix;
-	float4x4			projMatrix;
-	float4				eyePos;
-}
-cbuffer lightCBuffer : register(b2) {
-	float4				lightVec; // w=1: Vec represents position, w=0: Vec  represents direction.
-	float4				lightAmbient;
-	float4				lightDiffuse;
-	float4				lightSpecular;
-};
-cbuffer sceneCBuffer : register(b3) {
-	float4						windDir;
-	float						Time;
-	float						grassHeight;
-};
+#include "common_cbuffers.hlsli"
 
 //-----------------------------------------------------------------
 // Input / Output structures
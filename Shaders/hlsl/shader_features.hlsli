@@ -0,0 +1,34 @@
+//
+// Permutation feature flags.  ShaderPermutations defines FEATURE_* to 1 for each bit set in a variant's feature mask (see
+// ShaderFeature in ShaderPermutations.h); flags that are not defined default to 0 here
+//
+
+#ifndef SHADER_FEATURES_HLSLI
+#define SHADER_FEATURES_HLSLI
+
+#ifndef FEATURE_TEXTURE
+#define FEATURE_TEXTURE 0			// Sample the diffuse texture (t0, s0) instead of the material diffuse colour
+#endif
+#ifndef FEATURE_ALPHA_TEST
+#define FEATURE_ALPHA_TEST 0		// Discard fragments with alpha < 0.9
+#endif
+#ifndef FEATURE_POSITIONAL_LIGHT
+#define FEATURE_POSITIONAL_LIGHT 0	// lightVec is a position (otherwise a direction)
+#endif
+#ifndef FEATURE_SPECULAR
+#define FEATURE_SPECULAR 0			// Add the specular term
+#endif
+#ifndef FEATURE_FOG
+#define FEATURE_FOG 0				// Linear distance fog (fogStart, fogEnd, fogColour)
+#endif
+#ifndef FEATURE_INSTANCING
+#define FEATURE_INSTANCING 0		// World matrix comes from the per instance stream
+#endif
+#ifndef FEATURE_WIND
+#define FEATURE_WIND 0				// Animate vertices in the wind
+#endif
+#ifndef FEATURE_COMPRESSED_VERTEX
+#define FEATURE_COMPRESSED_VERTEX 0	// Decode CompressedVertexStruct (material colours from the model cbuffer)
+#endif
+
+#endif
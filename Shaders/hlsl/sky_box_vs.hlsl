@@ -5,16 +5,7 @@
 // Globals
 //-----------------------------------------------------------------
 
-cbuffer modelCBuffer : register(b0) {
-	float4x4			worldMatrix;
-	float4x4			worldITMatrix; // Correctly transform normals to world space
-};
-
-cbuffer cameraCbuffer : register(b1) {
-	float4x4			viewMatrix;
-	float4x4			projMatrix;
-	float4				eyePos;
-};
+#include "common_cbuffers.hlsli"
 
 //-----------------------------------------------------------------
 // Input / Output structures
@@ -0,0 +1,287 @@
+#include "stdafx.h"
+#include "AssetLoader.h"
+#include <Texture.h>
+#include <Model.h>
+#include <BaseModel.h>
+#include <ImpostorBatch.h>
+#include <algorithm>
+
+using namespace std;
+
+typedef chrono::high_resolution_clock LoadClock;
+
+static double millisecondsSince(const LoadClock::time_point &start)
+{
+	return chrono::duration<double, milli>(LoadClock::now() - start).count();
+}
+
+
+AssetLoader::AssetLoader(ID3D11Device *_device, JobSystem *_jobSystem, double _frameBudget)
+{
+	device = _device;
+	jobSystem = _jobSystem;
+	frameBudget = _frameBudget;
+	startTime = LoadClock::now();
+}
+
+AssetLoader::~AssetLoader()
+{
+	// The loads write to the textures and models - finish them (on this thread too) before those can be deleted
+	while (!loadsRunning.isDone()) {
+		if (!jobSystem->runBackgroundJob())
+			this_thread::yield();
+	}
+
+	for (size_t i = 0; i < ready.size(); i++)
+		delete ready[i];
+	for (size_t i = 0; i < waiting.size(); i++)
+		delete waiting[i];
+	for (map<D3D11_SRV_DIMENSION, ID3D11ShaderResourceView*>::iterator i = placeholders.begin(); i != placeholders.end(); i++)
+		if (i->second)
+			i->second->Release();
+}
+
+
+ID3D11ShaderResourceView *AssetLoader::createPlaceholder(D3D11_SRV_DIMENSION dimension)
+{
+	// 1x1 opaque grey (a cube has 6 faces)
+	static const uint32_t grey = 0xff808080;
+	uint32_t pixels[6] = { grey, grey, grey, grey, grey, grey };
+	bool cube = dimension == D3D11_SRV_DIMENSION_TEXTURECUBE;
+
+	D3D11_TEXTURE2D_DESC desc;
+	ZeroMemory(&desc, sizeof(D3D11_TEXTURE2D_DESC));
+	desc.Width = 1;
+	desc.Height = 1;
+	desc.MipLevels = 1;
+	desc.ArraySize = cube ? 6 : 1;
+	desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.SampleDesc.Count = 1;
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = cube ? D3D11_RESOURCE_MISC_TEXTURECUBE : 0;
+
+	D3D11_SUBRESOURCE_DATA initData[6];
+	for (int i = 0; i < 6; i++) {
+		initData[i].pSysMem = &pixels[i];
+		initData[i].SysMemPitch = sizeof(uint32_t);
+		initData[i].SysMemSlicePitch = 0;
+	}
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+	ZeroMemory(&viewDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+	viewDesc.Format = desc.Format;
+	viewDesc.ViewDimension = dimension;
+	if (cube)
+		viewDesc.TextureCube.MipLevels = 1;
+	else if (dimension == D3D11_SRV_DIMENSION_TEXTURE2DARRAY) {
+		viewDesc.Texture2DArray.MipLevels = 1;
+		viewDesc.Texture2DArray.ArraySize = 1;
+	}
+	else {
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+		viewDesc.Texture2D.MipLevels = 1;
+	}
+
+	ID3D11Texture2D *texture = nullptr;
+	ID3D11ShaderResourceView *view = nullptr;
+	if (!device || !SUCCEEDED(device->CreateTexture2D(&desc, initData, &texture)) || !SUCCEEDED(device->CreateShaderResourceView(texture, &viewDesc, &view)))
+		cout << "AssetLoader: cannot create placeholder texture" << endl;
+	// The view keeps the texture alive
+	if (texture)
+		texture->Release();
+	return view;
+}
+
+
+void AssetLoader::load(const function<Request*()> &fn)
+{
+	numRequested++;
+	jobSystem->runBackground([this, fn] {
+		Request *request = fn();
+		lock_guard<mutex> guard(readyLock);
+		ready.push_back(request);
+	}, &loadsRunning);
+}
+
+Texture *AssetLoader::loadTextureFiles(const vector<wstring> &filenames, D3D11_SRV_DIMENSION dimension)
+{
+	if (placeholders.find(dimension) == placeholders.end())
+		placeholders[dimension] = createPlaceholder(dimension);
+
+	Texture *texture = new Texture(filenames, placeholders[dimension]);
+	string name(filenames[0].begin(), filenames[0].end());
+
+	load([texture, name] {
+		texture->decode();
+		Request *request = new Request;
+		request->name = name;
+		request->texture = texture;
+		request->finalise = [texture](ID3D11Device *device, ID3D11DeviceContext *context) { texture->create(device); };
+		return request;
+	});
+	return texture;
+}
+
+Texture *AssetLoader::loadTexture(const wstring &filename, D3D11_SRV_DIMENSION dimension)
+{
+	return loadTextureFiles(vector<wstring>(1, filename), dimension);
+}
+
+Texture *AssetLoader::loadTextureArray(const vector<wstring> &filenames)
+{
+	return loadTextureFiles(filenames, D3D11_SRV_DIMENSION_TEXTURE2DARRAY);
+}
+
+void AssetLoader::loadModel(Model *model, const wstring &filename)
+{
+	string name(filename.begin(), filename.end());
+
+	load([model, filename, name] {
+		model->import(filename);
+		Request *request = new Request;
+		request->name = name;
+		request->finalise = [model](ID3D11Device *device, ID3D11DeviceContext *context) { model->createBuffers(device); };
+		return request;
+	});
+}
+
+void AssetLoader::loadImpostors(ImpostorBatch *impostors, const wstring &modelFilename, const wstring &textureFilename)
+{
+	string name = "Impostors " + string(modelFilename.begin(), modelFilename.end());
+
+	load([impostors, modelFilename, textureFilename, name] {
+		impostors->bake(modelFilename, textureFilename);
+		Request *request = new Request;
+		request->name = name;
+		request->finalise = [impostors](ID3D11Device *device, ID3D11DeviceContext *context) { impostors->createAtlas(device); };
+		return request;
+	});
+}
+
+
+void AssetLoader::bindTextures(BaseModel *model, Texture *textures[], int numTextures)
+{
+	TextureBinding binding;
+	binding.model = model;
+	binding.textures.assign(textures, textures + min(numTextures, MAX_TEXTURES));
+	bindings.push_back(binding);
+
+	ID3D11ShaderResourceView *views[MAX_TEXTURES];
+	for (size_t i = 0; i < binding.textures.size(); i++)
+		views[i] = binding.textures[i]->getShaderResourceView();
+	model->setTextures(views, (int)binding.textures.size());
+}
+
+void AssetLoader::whenReady(Texture *textures[], int numTextures, const FinaliseFn &fn)
+{
+	Request *request = new Request;
+	request->name = "whenReady";
+	request->finalise = fn;
+	for (int i = 0; i < numTextures; i++)
+		if (finishedTextures.find(textures[i]) == finishedTextures.end())
+			request->dependencies.push_back(textures[i]);
+	numRequested++;
+
+	if (request->dependencies.empty()) {
+		lock_guard<mutex> guard(readyLock);
+		ready.push_back(request);
+	}
+	else
+		waiting.push_back(request);
+}
+
+
+void AssetLoader::finalise(Request *request, ID3D11DeviceContext *context)
+{
+	LoadClock::time_point start = LoadClock::now();
+	if (request->finalise)
+		request->finalise(device, context);
+	double time = millisecondsSince(start);
+	if (time > slowestTime) {
+		slowestTime = time;
+		slowestName = request->name;
+	}
+
+	Texture *texture = request->texture;
+	if (texture) {
+		finishedTextures.insert(texture);
+
+		// Swap the texture's view into the models that use it
+		for (size_t i = 0; i < bindings.size(); i++) {
+			TextureBinding &binding = bindings[i];
+			if (find(binding.textures.begin(), binding.textures.end(), texture) == binding.textures.end())
+				continue;
+			ID3D11ShaderResourceView *views[MAX_TEXTURES];
+			for (size_t j = 0; j < binding.textures.size(); j++)
+				views[j] = binding.textures[j]->getShaderResourceView();
+			binding.model->setTextures(views, (int)binding.textures.size());
+		}
+
+		// Release the whenReady work that was waiting for it
+		for (size_t i = 0; i < waiting.size();) {
+			vector<Texture*> &dependencies = waiting[i]->dependencies;
+			dependencies.erase(remove(dependencies.begin(), dependencies.end(), texture), dependencies.end());
+			if (dependencies.empty()) {
+				{
+					lock_guard<mutex> guard(readyLock);
+					ready.push_back(waiting[i]);
+				}
+				waiting.erase(waiting.begin() + i);
+			}
+			else
+				i++;
+		}
+	}
+
+	numFinished++;
+	delete request;
+}
+
+void AssetLoader::update(ID3D11DeviceContext *context)
+{
+	LoadClock::time_point start = LoadClock::now();
+	UINT finished = 0;
+
+	// With no other workers the loads run here, one a frame
+	if (jobSystem->getNumThreads() == 1)
+		jobSystem->runBackgroundJob();
+
+	// Always finalise one request so loading progresses however long each takes
+	do {
+		Request *request = nullptr;
+		{
+			lock_guard<mutex> guard(readyLock);
+			if (!ready.empty()) {
+				request = ready.front();
+				ready.pop_front();
+			}
+		}
+		if (!request)
+			break;
+		finalise(request, context);
+		finished++;
+	} while (millisecondsSince(start) < frameBudget);
+
+	lastFrameTime = millisecondsSince(start);
+	lastFrameFinished = finished;
+	maxFrameTime = max(maxFrameTime, lastFrameTime);
+
+	if (finished > 0 && isFinished()) {
+		allFinishedTime = millisecondsSince(startTime);
+		cout << "AssetLoader: " << numRequested << " assets loaded in " << allFinishedTime << " ms" << endl;
+	}
+}
+
+
+void AssetLoader::reportData() const
+{
+	cout << "AssetLoader: " << numFinished << " of " << numRequested << " assets loaded";
+	if (isFinished() && numRequested > 0)
+		cout << " in " << allFinishedTime << " ms";
+	cout << ", Frame budget = " << frameBudget << " ms" << endl;
+	cout << "Last frame: Finalised = " << lastFrameFinished << ", Time = " << lastFrameTime << " ms (max " << maxFrameTime << " ms)";
+	if (!slowestName.empty())
+		cout << ", Slowest = " << slowestName << " (" << slowestTime << " ms)";
+	cout << endl;
+}
@@ -0,0 +1,117 @@
+//
+// AssetLoader.h
+//
+
+// Asynchronous loading of textures and models.  Each load runs in two stages: the file is read and decoded (textures) or imported
+// (meshes) into system memory by a background job, then the D3D resource is created on the render thread by update(), which is called
+// once a frame and stops finalising loads when the frame's time budget is spent.  Until then textures are bound as 1x1 grey
+// placeholders of the right dimension and models draw nothing, so the scene can render from the first frame however many assets it
+// has.
+//
+// Models reference textures as views, which change when a texture is created, so bindTextures() records the Texture objects a model
+// uses and resets its views whenever one of them is finalised.  whenReady() runs work that needs the real textures (eg. the terrain,
+// built from its height map) on the render thread once they have been loaded.
+#pragma once
+
+#include <d3d11_2.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <JobSystem.h>
+
+class Texture;
+class Model;
+class BaseModel;
+class ImpostorBatch;
+
+class AssetLoader {
+
+public:
+
+	// Create resources on the render thread
+	typedef std::function<void(ID3D11Device *device, ID3D11DeviceContext *context)> FinaliseFn;
+
+private:
+
+	typedef std::chrono::high_resolution_clock LoadClock;
+
+	struct Request {
+		std::string							name;
+		FinaliseFn							finalise;
+		Texture								*texture = nullptr; // Texture created by finalise (nullptr for models and whenReady work)
+		std::vector<Texture*>				dependencies; // whenReady: textures that must be finalised first
+	};
+
+	struct TextureBinding {
+		BaseModel							*model = nullptr;
+		std::vector<Texture*>				textures;
+	};
+
+	ID3D11Device							*device = nullptr;
+	JobSystem								*jobSystem = nullptr;
+	double									frameBudget = 2.0; // ms
+
+	// Placeholder views by dimension (TEXTURE2D, TEXTURE2DARRAY, TEXTURECUBE)
+	std::map<D3D11_SRV_DIMENSION, ID3D11ShaderResourceView*>	placeholders;
+
+	// Background loads running and the requests they have completed, waiting for update()
+	JobCounter								loadsRunning;
+	std::mutex								readyLock;
+	std::deque<Request*>					ready;
+
+	// Render thread only
+	std::vector<Request*>					waiting; // whenReady requests with unfinished dependencies
+	std::set<Texture*>						finishedTextures; // Finalised (or failed) textures
+	std::vector<TextureBinding>				bindings;
+
+	// Statistics (render thread)
+	UINT									numRequested = 0;
+	UINT									numFinished = 0;
+	UINT									lastFrameFinished = 0;
+	double									lastFrameTime = 0.0; // ms spent in the last update()
+	double									maxFrameTime = 0.0;
+	double									allFinishedTime = 0.0; // ms from construction until the last request was finalised
+	std::string								slowestName; // Longest finalise (eg. a large texture that may need splitting)
+	double									slowestTime = 0.0;
+	LoadClock::time_point					startTime;
+
+	ID3D11ShaderResourceView *createPlaceholder(D3D11_SRV_DIMENSION dimension);
+	// Run fn as a background job and queue the request it returns for update() to finalise
+	void load(const std::function<Request*()> &fn);
+	Texture *loadTextureFiles(const std::vector<std::wstring> &filenames, D3D11_SRV_DIMENSION dimension);
+	void finalise(Request *request, ID3D11DeviceContext *context);
+
+public:
+
+	// frameBudget is the time (ms) update() may spend creating resources each frame.  At least one load is finalised per frame
+	AssetLoader(ID3D11Device *_device, JobSystem *_jobSystem, double _frameBudget = 2.0);
+	// Waits for the background loads (their results are discarded)
+	~AssetLoader();
+
+	// Start loading a texture.  The returned texture's view is a placeholder of the given dimension until it has been finalised
+	Texture *loadTexture(const std::wstring &filename, D3D11_SRV_DIMENSION dimension = D3D11_SRV_DIMENSION_TEXTURE2D);
+	// Start loading a texture array with a slice per file (equally sized, not DDS)
+	Texture *loadTextureArray(const std::vector<std::wstring> &filenames);
+	// Start importing the mesh of a model created without a filename
+	void loadModel(Model *model, const std::wstring &filename);
+	// Start baking the impostor atlas of a model (see ImpostorBatch).  The batch draws nothing until its atlas has been created
+	void loadImpostors(ImpostorBatch *impostors, const std::wstring &modelFilename, const std::wstring &textureFilename);
+
+	// Set a model's textures now (placeholders while loading) and again as each is finalised
+	void bindTextures(BaseModel *model, Texture *textures[], int numTextures);
+	// Call fn on the render thread once every texture in textures has been finalised
+	void whenReady(Texture *textures[], int numTextures, const FinaliseFn &fn);
+
+	// Finalise loaded assets on the render thread until the frame budget is spent.  Call once a frame
+	void update(ID3D11DeviceContext *context);
+
+	bool isFinished() const { return numFinished == numRequested; };
+	UINT getNumPending() const { return numRequested - numFinished; };
+	void reportData() const;
+};
@@ -1,6 +1,7 @@
 
 #include "stdafx.h"
 #include <BaseModel.h>
+#include <StateCache.h>
 
 BaseModel::BaseModel(ID3D11Device *device, Effect *_effect, Material *_materials[], int _numMaterials, ID3D11ShaderResourceView **_textures, int _numTextures) {
 
@@ -12,7 +13,10 @@ BaseModel::BaseModel(ID3D11Device *device, Effect *_effect, Material *_materials
 	if (_numTextures != 0) setTextures(_textures, _numTextures);
 	if (_numMaterials != 0) setMaterials(_materials, _numMaterials);
 	effect = _effect;
+	// The model keeps its own reference to the layout, released by ~BaseModel
 	inputLayout = effect->getVSInputLayout();
+	if (inputLayout)
+		inputLayout->AddRef();
 	createDefaultLinearSampler(device);
 	initCBuffer(device);
 	//init(device);
@@ -26,6 +30,8 @@ BaseModel::BaseModel(ID3D11Device *device, ID3D11InputLayout *_inputLayout, Mate
 	if (_numTextures != 0) setTextures(_textures, _numTextures);
 	if (_numMaterials != 0) setMaterials(_materials, _numMaterials);
 	inputLayout = _inputLayout;
+	if (inputLayout)
+		inputLayout->AddRef();
 	createDefaultLinearSampler(device);
 	initCBuffer(device);
 	
@@ -35,56 +41,58 @@ void BaseModel::initCBuffer(ID3D11Device *device){
 	// Allocate 16 byte aligned block of memory for "main memory" copy of cBufferBasic
 	cBufferModelCPU = (CBufferModel*)_aligned_malloc(sizeof(CBufferModel), 16);
 
-	// Fill out cBufferModelCPU
-
+	// Fill out cBufferModelCPU.  Every member is uploaded, so models that never set the compressed vertex decode or material colours
+	// get an identity decode (offset 0, scale 1) and a white, non-specular material rather than uninitialised memory
+	ZeroMemory(cBufferModelCPU, sizeof(CBufferModel));
 	cBufferModelCPU->worldMatrix = XMMatrixIdentity();
 	cBufferModelCPU->worldITMatrix = XMMatrixIdentity();
+	cBufferModelCPU->posScale = XMFLOAT4(1, 1, 1, 0);
+	cBufferModelCPU->matDiffuse = XMFLOAT4(1, 1, 1, 1);
 
-	// Create GPU resource memory copy of cBufferBasic
-	// fill out description (Note if we want to update the CBuffer we need  D3D11_CPU_ACCESS_WRITE)
-	D3D11_BUFFER_DESC cbufferDesc;
-	D3D11_SUBRESOURCE_DATA cbufferInitData;
-	ZeroMemory(&cbufferDesc, sizeof(D3D11_BUFFER_DESC));
-	ZeroMemory(&cbufferInitData, sizeof(D3D11_SUBRESOURCE_DATA));
-
-	cbufferDesc.ByteWidth = sizeof(CBufferModel);
-	cbufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	cbufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	cbufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cbufferInitData.pSysMem = cBufferModelCPU;// Initialise GPU CBuffer with data from CPU CBuffer
-
-	HRESULT hr = device->CreateBuffer(&cbufferDesc, &cbufferInitData,
-		&cBufferModelGPU);
+	// Create GPU resource memory copy of cBufferBasic (initialised from cBufferModelCPU).  It is only mapped again when the world matrix changes
+	cBufferManager = CBufferManager::getDefault(device);
+	cBufferModel = cBufferManager->add(cBufferModelCPU, sizeof(CBufferModel), 0, CBufferLayout::PerDraw);
 
 }
 void BaseModel::setWorldMatrix(XMMATRIX _worldMatrix){
 	cBufferModelCPU->worldMatrix = _worldMatrix;
-	XMVECTOR det=XMMatrixDeterminant(_worldMatrix);
-	cBufferModelCPU->worldITMatrix = XMMatrixInverse(&det, XMMatrixTranspose(_worldMatrix));
+
+	// Normals need the inverse transpose only under non-uniform scale.  If the rows are orthogonal and the same length s the matrix is
+	// a rotation scaled by s, whose inverse transpose is the matrix itself (without the translation) divided by s squared
+	XMVECTOR lengthSq = XMVector3LengthSq(_worldMatrix.r[0]);
+	XMVECTOR tolerance = XMVectorScale(lengthSq, 1e-4f);
+	XMVECTOR lengthError = XMVectorMax(XMVectorAbs(XMVectorSubtract(XMVector3LengthSq(_worldMatrix.r[1]), lengthSq)), XMVectorAbs(XMVectorSubtract(XMVector3LengthSq(_worldMatrix.r[2]), lengthSq)));
+	XMVECTOR dotError = XMVectorMax(XMVectorAbs(XMVector3Dot(_worldMatrix.r[0], _worldMatrix.r[1])),
+		XMVectorMax(XMVectorAbs(XMVector3Dot(_worldMatrix.r[0], _worldMatrix.r[2])), XMVectorAbs(XMVector3Dot(_worldMatrix.r[1], _worldMatrix.r[2]))));
+	uniformScale = XMVector3Greater(lengthSq, XMVectorZero()) && XMVector3LessOrEqual(XMVectorMax(lengthError, dotError), tolerance);
+	if (uniformScale) {
+		XMVECTOR inverseLengthSq = XMVectorReciprocal(lengthSq);
+		cBufferModelCPU->worldITMatrix = XMMATRIX(XMVectorMultiply(_worldMatrix.r[0], inverseLengthSq), XMVectorMultiply(_worldMatrix.r[1], inverseLengthSq),
+			XMVectorMultiply(_worldMatrix.r[2], inverseLengthSq), g_XMIdentityR3);
+	}
+	else {
+		XMVECTOR det = XMMatrixDeterminant(_worldMatrix);
+		cBufferModelCPU->worldITMatrix = XMMatrixInverse(&det, XMMatrixTranspose(_worldMatrix));
+	}
+	markCBufferDirty();
 }
 
+// Upload the model cbuffer if it has changed since it was last uploaded.  render() binds it
 void BaseModel::update(ID3D11DeviceContext *context) {
-	mapCbuffer(context, cBufferModelCPU, cBufferModelGPU, sizeof(CBufferModel));
-	context->PSSetConstantBuffers(0, 1, &cBufferModelGPU);
-	context->VSSetConstantBuffers(0, 1, &cBufferModelGPU);
+	cBufferManager->upload(context, cBufferModel);
+}
+
+void BaseModel::computeBounds(const XMFLOAT3 *positions, size_t numVertices, size_t stride) {
+	if (positions && numVertices > 0) {
+		BoundingSphere::CreateFromPoints(bounds, numVertices, positions, stride);
+		BoundingBox::CreateFromPoints(box, numVertices, positions, stride);
+	}
 }
 
 void BaseModel::createDefaultLinearSampler(ID3D11Device *device){
 	
-	// If textures are used a sampler is required for the pixel shader to sample the texture
-	D3D11_SAMPLER_DESC linearDesc;
-
-	ZeroMemory(&linearDesc, sizeof(D3D11_SAMPLER_DESC));
-	linearDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-	linearDesc.AddressU = D3D11_TEXTURE_ADDRESS_MIRROR;
-	linearDesc.AddressV = D3D11_TEXTURE_ADDRESS_MIRROR;
-	linearDesc.AddressW = D3D11_TEXTURE_ADDRESS_MIRROR;
-	linearDesc.MinLOD = 0.0f;
-	linearDesc.MaxLOD = 0.0f;
-	linearDesc.MipLODBias = 0.0f;
-	linearDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-
-	device->CreateSamplerState(&linearDesc, &sampler);
+	// If textures are used a sampler is required for the pixel shader to sample the texture.  All models share one linear mirror sampler
+	sampler = StateCache::getDefault(device)->getSamplerState(StateCache::defaultSamplerDesc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_MIRROR));
 }
 
 void BaseModel::setTextures(ID3D11ShaderResourceView *_textures[], int _numTextures){
@@ -112,4 +120,9 @@ BaseModel::~BaseModel() {
 
 	if (inputLayout)
 		inputLayout->Release();
+
+	if (cBufferManager)
+		cBufferManager->remove(cBufferModel);
+	if (cBufferModelCPU)
+		_aligned_free(cBufferModelCPU);
 }
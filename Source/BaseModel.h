@@ -2,9 +2,12 @@
 #pragma once
 
 #include <d3d11_2.h>
+#include <DirectXCollision.h>
 #include <Effect.h>
 #include <Material.h>
 #include <Texture.h>
+#include <CBufferManager.h>
+#include <OcclusionCuller.h>
 
 #define MAX_TEXTURES 8
 #define MAX_MATERIALS 8
@@ -25,14 +28,27 @@ protected:
 	int							numTextures = 0;
 	int							numMaterials = 0;
 	CBufferModel* cBufferModelCPU = nullptr;
-	ID3D11Buffer *cBufferModelGPU = nullptr;
+	// GPU copy of cBufferModelCPU (register b0), owned by the cbuffer manager.  Mark it dirty when cBufferModelCPU changes
+	CBufferManager				*cBufferManager = nullptr;
+	int							cBufferModel = -1;
+	// Model space bounding sphere (radius 0 if it has not been computed) and box, and whether the scene's culling left the model visible
+	DirectX::BoundingSphere		bounds = DirectX::BoundingSphere(DirectX::XMFLOAT3(0, 0, 0), 0);
+	DirectX::BoundingBox		box = DirectX::BoundingBox(DirectX::XMFLOAT3(0, 0, 0), DirectX::XMFLOAT3(0, 0, 0));
+	bool						visible = true;
+	// Set by setWorldMatrix when the world matrix is a uniformly scaled rotation, so the normal matrix was taken from it directly
+	bool						uniformScale = true;
+
+	// Bind the model cbuffer (uploaded first if it has changed)
+	void bindCBuffer(ID3D11DeviceContext *context) { cBufferManager->bind(context, cBufferModel); };
+	void markCBufferDirty() { cBufferManager->markDirty(cBufferModel); };
 
 public:
 
 	BaseModel(ID3D11Device *device, Effect *_effect, Material *_materials[] = nullptr, int _numMaterials = 0, ID3D11ShaderResourceView *_textures[] = nullptr, int _numTextures = 0);
 	BaseModel(ID3D11Device *device, ID3D11InputLayout *_inputLayout, Material *_materials[] = nullptr, int _numMaterials = 0, ID3D11ShaderResourceView *_textures[] = nullptr, int _numTextures = 0);
 	
-	~BaseModel();
+	// Virtual so the scene can delete its models through BaseModel pointers
+	virtual ~BaseModel();
 
 	virtual void render(ID3D11DeviceContext *context) = 0;
 	virtual HRESULT init(ID3D11Device *device) = 0;
@@ -46,7 +62,18 @@ public:
 	int getEffect(Effect *_effect){ _effect = effect;};
 	void initCBuffer(ID3D11Device *device);
 	void createDefaultLinearSampler(ID3D11Device *device);
-	void setWorldMatrix(XMMATRIX _worldMatrix);
+	virtual void setWorldMatrix(XMMATRIX _worldMatrix);
 	XMMATRIX getWorldMatrix(){ return cBufferModelCPU->worldMatrix; };
+	bool hasUniformScale() const { return uniformScale; };
+
+	// Fit the bounding sphere and box to the vertex positions (stride bytes apart)
+	void computeBounds(const DirectX::XMFLOAT3 *positions, size_t numVertices, size_t stride);
+	bool hasBounds() const { return bounds.Radius > 0.0f; };
+	const DirectX::BoundingBox &getBox() const { return box; };
+	// Set from the flags of the model's entity once the scene has culled it (see SceneStore)
+	void setVisible(bool _visible) { visible = _visible; };
+	bool isVisible() const { return visible; };
+	// Low-poly stand in for the model, in model space, to rasterise as an occluder.  False if the model has none
+	virtual bool getOccluder(OccluderMesh *mesh) const { return false; };
 
 };
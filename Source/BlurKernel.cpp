@@ -0,0 +1,41 @@
+#include "stdafx.h"
+#include "BlurKernel.h"
+#include <cmath>
+
+void computeBlurKernel(int radius, float sigma, BlurKernel *kernel)
+{
+	if (radius < 1)
+		radius = 1;
+	if (radius > MAX_BLUR_RADIUS)
+		radius = MAX_BLUR_RADIUS;
+	if (sigma <= 0.0f)
+		sigma = (float)radius / 3.0f;
+
+	kernel->radius = radius;
+	kernel->sigma = sigma;
+
+	// Sample the Gaussian at each integer texel distance and normalise so the full (two sided) kernel sums to 1
+	float sum = 0.0f;
+	for (int i = 0; i <= radius; i++) {
+		kernel->discreteWeights[i] = expf(-(float)(i * i) / (2.0f * sigma * sigma));
+		sum += (i == 0) ? kernel->discreteWeights[i] : 2.0f * kernel->discreteWeights[i];
+	}
+	for (int i = 0; i <= radius; i++)
+		kernel->discreteWeights[i] /= sum;
+
+	// Centre tap is sampled on its own
+	kernel->offsets[0] = 0.0f;
+	kernel->weights[0] = kernel->discreteWeights[0];
+	kernel->numTaps = 1;
+
+	// Merge texel pairs (i, i+1) into one bilinear tap placed at their weighted centre
+	for (int i = 1; i <= radius; i += 2) {
+		float w0 = kernel->discreteWeights[i];
+		float w1 = (i + 1 <= radius) ? kernel->discreteWeights[i + 1] : 0.0f;
+		float w = w0 + w1;
+
+		kernel->offsets[kernel->numTaps] = (w > 0.0f) ? ((float)i * w0 + (float)(i + 1) * w1) / w : (float)i;
+		kernel->weights[kernel->numTaps] = w;
+		kernel->numTaps++;
+	}
+}
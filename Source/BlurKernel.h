@@ -0,0 +1,26 @@
+//
+// BlurKernel.h
+//
+
+// Precomputed separable Gaussian kernel shared by the GPU blur passes (BlurUtility) and any CPU code that has to match them.
+// Adjacent discrete taps are merged into a single bilinear sample so a kernel of radius r needs only 1 + ceil(r/2) texture reads per side.
+#pragma once
+
+#define MAX_BLUR_RADIUS 32
+#define MAX_BLUR_TAPS (MAX_BLUR_RADIUS / 2 + 1)
+
+struct BlurKernel {
+	int										radius;
+	float									sigma;
+	// Number of one-sided bilinear taps including the centre tap (taps other than 0 are applied at +offset and -offset)
+	int										numTaps;
+	// Offset of each tap in texels from the centre texel
+	float									offsets[MAX_BLUR_TAPS];
+	// Weight of each tap - weights[0] + 2 * sum(weights[1..numTaps-1]) == 1
+	float									weights[MAX_BLUR_TAPS];
+	// Normalised discrete weights before bilinear merging (index = distance in texels from the centre)
+	float									discreteWeights[MAX_BLUR_RADIUS + 1];
+};
+
+// Build a normalised Gaussian kernel of the given radius (clamped to [1, MAX_BLUR_RADIUS]).  sigma <= 0 selects radius / 3
+void computeBlurKernel(int radius, float sigma, BlurKernel *kernel);
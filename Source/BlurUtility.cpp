@@ -4,230 +4,281 @@
 #include <Quad.h>
 #include <Effect.h>
 #include <VertexStructures.h>
+#include <string>
 
-BlurUtility::BlurUtility(ID3D11Device *deviceIn, ID3D11DeviceContext *contextIn)
+using namespace std;
+
+BlurUtility::BlurUtility(ID3D11Device *deviceIn, UINT backBufferWidth, UINT backBufferHeight, int _numLevels, float _resolutionScale)
 {
 	device = deviceIn;
-	context = contextIn;
-	setupBlurRenderTargets();
-	char *tmpShaderBytecode = nullptr;
+	requestedLevels = min(max(_numLevels, 1), maxLevels);
+	resolutionScale = _resolutionScale;
+	setupBlurRenderTargets(backBufferWidth, backBufferHeight);
+	ShaderPack *shaderPack = ShaderPack::getDefault();
+	const void *tmpShaderBytecode = nullptr;
+	SIZE_T shaderBytes = 0;
 
 	ID3D11InputLayout	*screenQuadVSInputLayout = nullptr;
-	SIZE_T shaderBytes = LoadShader("Shaders\\cso\\screen_quad_vs.cso", &tmpShaderBytecode);
-	device->CreateVertexShader(tmpShaderBytecode, shaderBytes, NULL, &screenQuadVS);
-	device->CreateInputLayout(basicVertexDesc, ARRAYSIZE(basicVertexDesc), tmpShaderBytecode, shaderBytes, &screenQuadVSInputLayout);
+	shaderPack->createVertexShader(device, "Shaders\\cso\\screen_quad_vs.cso", &screenQuadVS, &tmpShaderBytecode, &shaderBytes);
+	screenQuadVSInputLayout = StateCache::getDefault(device)->getInputLayout(basicVertexDesc, ARRAYSIZE(basicVertexDesc), tmpShaderBytecode, shaderBytes);
 	screenQuad = new Quad(device, screenQuadVSInputLayout);
-	shaderBytes=LoadShader("Shaders\\cso\\per_pixel_lighting_vs.cso", &tmpShaderBytecode);
-	device->CreateVertexShader(tmpShaderBytecode, shaderBytes, NULL, &perPixelLightingVS);
-	shaderBytes = LoadShader("Shaders\\cso\\convolve_u_ps.cso", &tmpShaderBytecode);
-	device->CreatePixelShader(tmpShaderBytecode, shaderBytes, NULL, &horizontalBlurPS);
-	shaderBytes = LoadShader("Shaders\\cso\\convolve_v_ps.cso", &tmpShaderBytecode);
-	device->CreatePixelShader(tmpShaderBytecode, shaderBytes, NULL, &verticalBlurPS);
-	shaderBytes = LoadShader("Shaders\\cso\\emissive_ps.cso", &tmpShaderBytecode);
-	device->CreatePixelShader(tmpShaderBytecode, shaderBytes, NULL, &emissivePS);
-	shaderBytes = LoadShader("Shaders\\cso\\copy_ps.cso", &tmpShaderBytecode);
-	device->CreatePixelShader(tmpShaderBytecode, shaderBytes, NULL, &textureCopyPS);
-	shaderBytes = LoadShader("Shaders\\cso\\copy_depth_ps.cso", &tmpShaderBytecode);
-	device->CreatePixelShader(tmpShaderBytecode, shaderBytes, NULL, &depthCopyPS);
+	shaderPack->createPixelShader(device, "Shaders\\cso\\blur_gaussian_ps.cso", &gaussianPS);
+	shaderPack->createPixelShader(device, "Shaders\\cso\\blur_downsample_ps.cso", &downsamplePS);
+	shaderPack->createPixelShader(device, "Shaders\\cso\\blur_upsample_ps.cso", &upsamplePS);
+	shaderPack->createPixelShader(device, "Shaders\\cso\\copy_ps.cso", &textureCopyPS);
+	shaderPack->createPixelShader(device, "Shaders\\cso\\blur_depth_copy_ps.cso", &depthCopyPS);
 	
 	defaultEffect = new Effect(device, "Shaders\\cso\\basic_colour_vs.cso", "Shaders\\cso\\basic_colour_ps.cso", basicVertexDesc, ARRAYSIZE(basicVertexDesc));
 	
-	D3D11_BLEND_DESC blendDesc;
-	defaultEffect->getBlendState()->GetDesc(&blendDesc);//the effect is initialised with the default blend state
+	// States are shared through the state cache
+	StateCache *stateCache = StateCache::getDefault(device);
+
+	D3D11_BLEND_DESC blendDesc = StateCache::defaultBlendDesc();
 	blendDesc.AlphaToCoverageEnable = FALSE; // Use pixel coverage info from rasteriser (default)
 	blendDesc.RenderTarget[0].BlendEnable = TRUE;
 	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
 	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
-	device->CreateBlendState(&blendDesc, &alphaOnBlendState);
+	alphaOnBlendState = stateCache->getBlendState(blendDesc);
+
+	// Upsampled levels are added to the level above, scaled by the blend factor: dest = factor * src + dest.  Level 0 ends up holding
+	// the sum of every level (each weighted by a further factor per level below 0) rather than a mix that fades out the sharp levels
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_BLEND_FACTOR;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_BLEND_FACTOR;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ONE;
+	upsampleBlendState = stateCache->getBlendState(blendDesc);
+
+	// The depth copy must overwrite whatever the blur depth buffer holds so it does not need clearing first
+	D3D11_DEPTH_STENCIL_DESC dsDesc = StateCache::defaultDepthStencilDesc();
+	dsDesc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+	depthAlwaysState = stateCache->getDepthStencilState(dsDesc);
+
+	// Blur passes sample at fractional offsets so clamp at the borders to avoid bleeding from the opposite edge
+	clampSampler = stateCache->getSamplerState(StateCache::defaultSamplerDesc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_CLAMP));
+
+	// Add a CBuffer to store the blur kernel
+	cBufferBlurCPU = (CBufferBlur*)_aligned_malloc(sizeof(CBufferBlur), 16);
+	ZeroMemory(cBufferBlurCPU, sizeof(CBufferBlur));
+
+	cBufferManager = CBufferManager::getDefault(device);
+	cBufferBlur = cBufferManager->add(cBufferBlurCPU, sizeof(CBufferBlur), 4, CBufferLayout::PerPass, CBufferManager::PixelStage);
+
+	// Equivalent to the original fixed 13 tap (2 texel spacing) kernel
+	setKernel(12);
 }
 
-void BlurUtility::blurModel(Model*obj, ID3D11ShaderResourceView	*depthSRV)
+void BlurUtility::setKernel(int radius, float sigma)
 {
-	// Draw the Orb 
-	if (obj) {
+	// Weights only change here - drawPass just updates texelStep
+	computeBlurKernel(radius, sigma, &kernel);
 
-		// Ensure default states
-		FLOAT			blendFactor[] = { 1, 1, 1, 1 };
-		context->OMSetDepthStencilState(defaultEffect->getDepthStencilState(), 0);
-		context->OMSetBlendState(defaultEffect->getBlendState(), blendFactor, 0xFFFFFFFF);
+	for (int i = 0; i < MAX_BLUR_TAPS; i++)
+		cBufferBlurCPU->taps[i] = (i < kernel.numTaps) ? XMFLOAT4(kernel.offsets[i], kernel.weights[i], 0.0f, 0.0f) : XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f);
+	cBufferBlurCPU->numTaps = kernel.numTaps;
+}
 
-		// Store Scene render target and depth buffer to restore when finished
-		ID3D11RenderTargetView		* tempRT[1] = { 0 };
-		ID3D11DepthStencilView		*tempDS = nullptr;
-		context->OMGetRenderTargets(1, tempRT, &tempDS);
-
-		// Clear off screen render targets
-		FLOAT clearColorBlur[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-		context->ClearRenderTargetView(intermedRTV, clearColorBlur);
-		context->ClearRenderTargetView(intermedHRTV, clearColorBlur);
-		context->ClearRenderTargetView(intermedVRTV, clearColorBlur);
-		context->ClearDepthStencilView(depthStencilViewOrb, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-
-		// Store Scene viewport to put them back when finished
-		D3D11_VIEWPORT 		currentVP;
-		UINT nCurrentVP = 1;
-		context->RSGetViewports(&nCurrentVP, &currentVP);
-		// Set Viewport Offscreen 
-		context->RSSetViewports(1, &offScreenViewport);
-		
-		//copy multisample depth stencil (depthSRV) to non-ms depth stencil (depthStencilViewOrb)
-		context->OMSetRenderTargets(1, &intermedRTV, depthStencilViewOrb);
-		context->PSSetShaderResources(0, 1, &depthSRV);
-		// Set depth copy vertex and pixel shaders
-		context->VSSetShader(screenQuadVS, 0, 0);
-		context->PSSetShader(depthCopyPS, 0, 0);
-		screenQuad->render(context);
+void BlurUtility::beginScreenPass(ID3D11DeviceContext *context, ID3D11PixelShader *pixelShader, ID3D11BlendState *blendState, const FLOAT *blendFactor)
+{
+	// No depth buffer is bound to the screen space passes so the depth test is skipped
+	context->OMSetDepthStencilState(defaultEffect->getDepthStencilState(), 0);
+	context->OMSetBlendState(blendState, blendFactor, 0xFFFFFFFF);
+	context->VSSetShader(screenQuadVS, 0, 0);
+	context->PSSetShader(pixelShader, 0, 0);
+	context->PSSetSamplers(1, 1, &clampSampler);
+}
 
-		//Render object offscreen
-		obj->render(context);
+void BlurUtility::drawPass(ID3D11DeviceContext *context, ID3D11ShaderResourceView *source, float texelStepX, float texelStepY)
+{
+	cBufferBlurCPU->texelStep = XMFLOAT2(texelStepX, texelStepY);
+	cBufferManager->markDirty(cBufferBlur);
+	cBufferManager->bind(context, cBufferBlur);
 
-		//Blur of screen render target in x2 passes
-		//Horizontal blur
-		context->OMSetRenderTargets(1, &intermedHRTV, nullptr);
-		context->PSSetShaderResources(0, 1, &intermedSRV);
-		context->VSSetShader(screenQuadVS, 0, 0);
-		context->PSSetShader(horizontalBlurPS, 0, 0);
-		screenQuad->render(context);
-		//Vertical blur
-		context->OMSetRenderTargets(1, &intermedVRTV, nullptr);
-		context->PSSetShaderResources(0, 1, &intermedHSRV);
-		context->VSSetShader(screenQuadVS, 0, 0);
-		context->PSSetShader(verticalBlurPS, 0, 0);
-		screenQuad->render(context);
+	context->PSSetShaderResources(0, 1, &source);
+	screenQuad->render(context);
+}
+
+void BlurUtility::addPasses(FrameGraph *graph, FGResource target, FGResource depth, Model *obj)
+{
+	if (!graph || !obj || numLevels <= 0)
+		return;
+
+	FGTextureDesc desc;
+	desc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	desc.bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	// Non multisampled depth buffer for level 0 (the scene depth is copied here so the object is occluded by the scene)
+	FGTextureDesc depthDesc;
+	depthDesc.width = levels[0].width;
+	depthDesc.height = levels[0].height;
+	depthDesc.format = DXGI_FORMAT_R24G8_TYPELESS;
+	depthDesc.bindFlags = D3D11_BIND_DEPTH_STENCIL;
+
+	FGResource levelTargets[maxLevels];
+
+	// Render the object offscreen into level 0
+	graph->addPass("Glow model",
+		[&](FrameGraph::PassBuilder &builder) {
+			desc.width = levels[0].width;
+			desc.height = levels[0].height;
+			// The depth copy covers every pixel and writes transparent black, so level 0 is only cleared when there is no depth to copy
+			static const FLOAT clearColour[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			levelTargets[0] = builder.writeColour(builder.create("Glow level 0", desc), (depth == FG_INVALID_RESOURCE) ? clearColour : nullptr);
+			builder.writeDepth(builder.create("Glow depth", depthDesc), depth == FG_INVALID_RESOURCE);
+			if (depth != FG_INVALID_RESOURCE)
+				builder.read(depth);
+		},
+		[this, depth, obj](ID3D11DeviceContext *context, const FrameGraph &graph) {
+
+		FLOAT blendFactor[] = { 1, 1, 1, 1 };
+		context->OMSetBlendState(defaultEffect->getBlendState(), blendFactor, 0xFFFFFFFF);
 
-		// Restore Scene rendertarget dont need depth buffer here 
-		context->OMSetRenderTargets(1, tempRT, nullptr);
+		if (depth != FG_INVALID_RESOURCE) {
 
-		// Restore Scene viewport 
-		context->RSSetViewports(1, &currentVP);
-		context->PSSetShader(textureCopyPS, 0, 0);
+			// Copy the multisampled scene depth into the blur depth buffer
+			ID3D11ShaderResourceView *depthSRV = graph.getSRV(depth);
+			context->OMSetDepthStencilState(depthAlwaysState, 0);
+			context->PSSetShaderResources(0, 1, &depthSRV);
+			context->VSSetShader(screenQuadVS, 0, 0);
+			context->PSSetShader(depthCopyPS, 0, 0);
+			screenQuad->render(context);
 
-		// Copy blurred orb (intermedVSRV) back to Scene frame buffer
-		context->PSSetShaderResources(0, 1, &intermedVSRV);
-		context->OMSetBlendState(alphaOnBlendState, blendFactor, 0xFFFFFFFF);
-		screenQuad->render(context);
+			ID3D11ShaderResourceView *nullSRV[1] = { nullptr };
+			context->PSSetShaderResources(0, 1, nullSRV);
+		}
+
+		obj->render(context);
+	});
+
+	// Progressive downsample (texel step is that of the source level)
+	for (int i = 1; i < numLevels; i++) {
+		FGResource source = levelTargets[i - 1];
+		graph->addPass("Glow downsample " + to_string(i),
+			[&](FrameGraph::PassBuilder &builder) {
+				desc.width = levels[i].width;
+				desc.height = levels[i].height;
+				builder.read(source);
+				levelTargets[i] = builder.writeColour(builder.create("Glow level " + to_string(i), desc));
+			},
+			[this, source, i](ID3D11DeviceContext *context, const FrameGraph &graph) {
+			static const FLOAT blendFactor[] = { 1, 1, 1, 1 };
+			beginScreenPass(context, downsamplePS, defaultEffect->getBlendState(), blendFactor);
+			drawPass(context, graph.getSRV(source), 1.0f / levels[i - 1].width, 1.0f / levels[i - 1].height);
+		});
+	}
 
-		// Create "nullSRV"  to release intermedVSRV shader resource view
-		ID3D11ShaderResourceView	*nullSRV[1]; nullSRV[0] = NULL;
-		context->PSSetShaderResources(0, 1, nullSRV);
+	// Blur each level in x2 passes.  The horizontal pass writes a temp target at the level's resolution
+	for (int i = 0; i < numLevels; i++) {
+		FGResource level = levelTargets[i];
+		FGResource temp = FG_INVALID_RESOURCE;
+		graph->addPass("Glow blur H " + to_string(i),
+			[&](FrameGraph::PassBuilder &builder) {
+				desc.width = levels[i].width;
+				desc.height = levels[i].height;
+				builder.read(level);
+				temp = builder.writeColour(builder.create("Glow temp " + to_string(i), desc));
+			},
+			[this, level, i](ID3D11DeviceContext *context, const FrameGraph &graph) {
+			static const FLOAT blendFactor[] = { 1, 1, 1, 1 };
+			beginScreenPass(context, gaussianPS, defaultEffect->getBlendState(), blendFactor);
+			drawPass(context, graph.getSRV(level), 1.0f / levels[i].width, 0.0f);
+		});
+		graph->addPass("Glow blur V " + to_string(i),
+			[&](FrameGraph::PassBuilder &builder) {
+				builder.read(temp);
+				builder.writeColour(level);
+			},
+			[this, temp, i](ID3D11DeviceContext *context, const FrameGraph &graph) {
+			static const FLOAT blendFactor[] = { 1, 1, 1, 1 };
+			beginScreenPass(context, gaussianPS, defaultEffect->getBlendState(), blendFactor);
+			drawPass(context, graph.getSRV(temp), 0.0f, 1.0f / levels[i].height);
+		});
+	}
 
-		// Restore Scene depth buffer.
-		context->OMSetRenderTargets(1, tempRT, tempDS);
-		tempRT[0]->Release();
-		tempDS->Release();
+	// Upsample each level and add it to the level above, finishing at level 0
+	for (int i = numLevels - 1; i > 0; i--) {
+		FGResource source = levelTargets[i];
+		graph->addPass("Glow upsample " + to_string(i),
+			[&](FrameGraph::PassBuilder &builder) {
+				builder.read(source);
+				builder.writeColour(levelTargets[i - 1]);
+			},
+			[this, source, i](ID3D11DeviceContext *context, const FrameGraph &graph) {
+			FLOAT upsampleFactor[] = { upsampleWeight, upsampleWeight, upsampleWeight, upsampleWeight };
+			beginScreenPass(context, upsamplePS, upsampleBlendState, upsampleFactor);
+			drawPass(context, graph.getSRV(source), 1.0f / levels[i].width, 1.0f / levels[i].height);
+		});
 	}
+
+	// Composite the blurred object (level 0, premultiplied alpha) onto the target
+	FGResource top = levelTargets[0];
+	graph->addPass("Glow composite",
+		[&](FrameGraph::PassBuilder &builder) {
+			builder.read(top);
+			builder.writeColour(target);
+		},
+		[this, top](ID3D11DeviceContext *context, const FrameGraph &graph) {
+		static const FLOAT blendFactor[] = { 1, 1, 1, 1 };
+		beginScreenPass(context, textureCopyPS, alphaOnBlendState, blendFactor);
+		ID3D11ShaderResourceView *source = graph.getSRV(top);
+		context->PSSetShaderResources(0, 1, &source);
+		screenQuad->render(context);
+	});
 }
 
 
+HRESULT BlurUtility::setupBlurRenderTargets(UINT backBufferWidth, UINT backBufferHeight){
 
+	// Level 0 is relative to the back buffer, each further level halves it.  Stop before levels get too small to be useful
+	// The targets themselves are transients of the frame graph so there is nothing to release here
+	int width = max((int)(backBufferWidth * resolutionScale), 1);
+	int height = max((int)(backBufferHeight * resolutionScale), 1);
 
-HRESULT BlurUtility::setupBlurRenderTargets(){
-
-	if (!device || !context)
-		return E_FAIL;
-
-
-	// Release as we might be resizing
-	if (intermedSRV)
-		intermedSRV->Release();
-	if (intermedRTV)
-		intermedRTV->Release();
-	if (intermedHSRV)
-		intermedHSRV->Release();
-	if (intermedHRTV)
-		intermedHRTV->Release();
-	if (intermedVSRV)
-		intermedVSRV->Release();
-	if (intermedVRTV)
-		intermedVRTV->Release();
-
-	// Setup Render Targets
-
-	HRESULT hr;
-
-	// Setup viewport for offscreen rendering
-	blurWidth = 512;
-	blurHeight = 512;
-	offScreenViewport.TopLeftX = 0;
-	offScreenViewport.TopLeftY = 0;
-	offScreenViewport.Width = blurWidth;
-	offScreenViewport.Height = blurHeight;
-	offScreenViewport.MinDepth = 0.0f;
-	offScreenViewport.MaxDepth = 1.0f;
-
-	// Setup texture description for offscreen rendering
-	D3D11_TEXTURE2D_DESC texDesc;
-	texDesc.Width = blurWidth;
-	texDesc.Height = blurHeight;
-	texDesc.MipLevels = 1;
-	texDesc.ArraySize = 1;
-	texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-	texDesc.SampleDesc.Count = 1;
-	texDesc.SampleDesc.Quality = 0;
-	texDesc.Usage = D3D11_USAGE_DEFAULT;
-	texDesc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-	texDesc.CPUAccessFlags = 0;
-	texDesc.MiscFlags = 0;
-	ID3D11Texture2D* tex = 0;
-
-	// Setup shader resource view description for offscreen rendering.
-	D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
-	viewDesc.Format = texDesc.Format;
-	viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-	viewDesc.Texture2D.MipLevels = 1;
-	viewDesc.Texture2D.MostDetailedMip = 0;
-	// Setup render targetview  description for offscreen rendering.
-	D3D11_RENDER_TARGET_VIEW_DESC rtvDesc;
-	rtvDesc.Format = texDesc.Format;
-	rtvDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
-	rtvDesc.Texture2D.MipSlice = 0;
-
-	//Create offscreeen Textures, ShaderResourceViews and RenderTargetViews
-	hr = device->CreateTexture2D(&texDesc, 0, &tex);
-	hr = device->CreateShaderResourceView(tex, &viewDesc, &intermedHSRV);
-	hr = device->CreateRenderTargetView(tex, &rtvDesc, &intermedHRTV);
-
-	hr = device->CreateTexture2D(&texDesc, 0, &tex);
-	hr = device->CreateShaderResourceView(tex, &viewDesc, &intermedVSRV);
-	hr = device->CreateRenderTargetView(tex, &rtvDesc, &intermedVRTV);
-
-	hr = device->CreateTexture2D(&texDesc, 0, &tex);
-	hr = device->CreateShaderResourceView(tex, &viewDesc, &intermedSRV);
-	hr = device->CreateRenderTargetView(tex, &rtvDesc, &intermedRTV);
-
-	// Setup the Depth Stencil buffer and Depth Stencil View (DSV)
-	// Setup DepthStencilTexture description
-	D3D11_TEXTURE2D_DESC		depthStencilDesc;
-	depthStencilDesc.Width = blurWidth;
-	depthStencilDesc.Height = blurHeight;
-	depthStencilDesc.MipLevels = 1;
-	depthStencilDesc.ArraySize = 1;
-	depthStencilDesc.Format = DXGI_FORMAT_R24G8_TYPELESS;
-	depthStencilDesc.SampleDesc.Count = 1; // Multi-sample properties much match the above DXGI_SWAP_CHAIN_DESC structure
-	depthStencilDesc.SampleDesc.Quality = 0;
-	depthStencilDesc.Usage = D3D11_USAGE_DEFAULT;
-	depthStencilDesc.BindFlags = D3D11_BIND_DEPTH_STENCIL;
-	depthStencilDesc.CPUAccessFlags = 0;
-	depthStencilDesc.MiscFlags = 0;
-
-	// Create DepthStencilTexture
-	if (SUCCEEDED(hr))
-		hr = device->CreateTexture2D(&depthStencilDesc, 0, &tex);
-	// Setup DepthStencilView description
-	D3D11_DEPTH_STENCIL_VIEW_DESC descDSV;
-	ZeroMemory(&descDSV, sizeof(descDSV));
-	descDSV.Format = DXGI_FORMAT_D24_UNORM_S8_UINT;
-	descDSV.ViewDimension = D3D11_DSV_DIMENSION_TEXTURE2D;
-	descDSV.Texture2D.MipSlice = 0;
-	// Create DepthStencilView
-	if (SUCCEEDED(hr))
-		hr = device->CreateDepthStencilView(tex, &descDSV, &depthStencilViewOrb);
-	// Cleanup--we only need the views.
-	tex->Release();
+	numLevels = 0;
+	for (int i = 0; i < requestedLevels; i++) {
+
+		if (i > 0 && (width < 8 || height < 8))
+			break;
+
+		levels[i].width = width;
+		levels[i].height = height;
+		numLevels = i + 1;
+
+		width = max(width / 2, 1);
+		height = max(height / 2, 1);
+	}
 
+	return S_OK;
 }
 
 
 BlurUtility::~BlurUtility()
 {
+	if (cBufferManager)
+		cBufferManager->remove(cBufferBlur);
+	if (cBufferBlurCPU)
+		_aligned_free(cBufferBlurCPU);
+	if (clampSampler)
+		clampSampler->Release();
+	if (alphaOnBlendState)
+		alphaOnBlendState->Release();
+	if (upsampleBlendState)
+		upsampleBlendState->Release();
+	if (depthAlwaysState)
+		depthAlwaysState->Release();
+	if (screenQuadVS)
+		screenQuadVS->Release();
+	if (gaussianPS)
+		gaussianPS->Release();
+	if (downsamplePS)
+		downsamplePS->Release();
+	if (upsamplePS)
+		upsamplePS->Release();
+	if (textureCopyPS)
+		textureCopyPS->Release();
+	if (depthCopyPS)
+		depthCopyPS->Release();
+	if (screenQuad)
+		delete screenQuad;
+	if (defaultEffect)
+		delete defaultEffect;
 }
@@ -1,42 +1,73 @@
 #pragma once
+#include <BlurKernel.h>
+#include <CBufferStructures.h>
+#include <FrameGraph.h>
+#include <CBufferManager.h>
 class Model;
 class Quad;
 class Effect;
+
+// Blurs (glows) a model with a mip-chain: the model is rendered offscreen at a fraction of the back buffer size, progressively
+// downsampled, each level is blurred with a separable Gaussian (BlurKernel) and the levels are upsampled and added back into level 0
+// before being composited onto the scene render target.  Every step is a frame graph pass and the pyramid levels are transients of
+// the graph, so the graph binds the targets and viewport of each step and shares the textures with other passes.
 class BlurUtility
 {
+	static const int						maxLevels = 6;
+
+	// Size of one level of the blur pyramid.  The level's target and the temp target holding its horizontal pass are declared in
+	// the graph each frame by addPasses
+	struct BlurLevel {
+		int									width = 0;
+		int									height = 0;
+	};
 
-	int										blurWidth = 512;
-	int										blurHeight = 512;
-	D3D11_VIEWPORT							offScreenViewport;
-	ID3D11ShaderResourceView				*intermedHSRV = nullptr;
-	ID3D11RenderTargetView					*intermedHRTV = nullptr;
-	ID3D11ShaderResourceView				*intermedVSRV = nullptr;
-	ID3D11RenderTargetView					*intermedVRTV = nullptr;
-	ID3D11ShaderResourceView				*intermedSRV = nullptr;
-	ID3D11RenderTargetView					*intermedRTV = nullptr;
-	ID3D11Texture2D							*depthStencilBufferOrb = nullptr;
-	ID3D11DepthStencilView					*depthStencilViewOrb = nullptr;
-	ID3D11DeviceContext						*context = nullptr;
+	int										numLevels = 0;
+	int										requestedLevels = 4;
+	// Size of level 0 relative to the back buffer
+	float									resolutionScale = 0.5f;
+	// Scale of each lower level when it is upsampled and added to the level above
+	float									upsampleWeight = 0.5f;
+	BlurLevel								levels[maxLevels];
 	ID3D11Device							*device = nullptr;
 	Quad									*screenQuad = nullptr;
 
+	BlurKernel								kernel;
+	CBufferBlur								*cBufferBlurCPU = nullptr;
+	// GPU copy (register b4, pixel shader only), uploaded by the cbuffer manager
+	CBufferManager							*cBufferManager = nullptr;
+	int										cBufferBlur = -1;
+	ID3D11SamplerState						*clampSampler = nullptr;
+
 	// from glow tutorial
-	//ID3D11DepthStencilState					*orbDSstate = nullptr;
 	ID3D11BlendState						*alphaOnBlendState = nullptr;
+	ID3D11BlendState						*upsampleBlendState = nullptr;
+	ID3D11DepthStencilState					*depthAlwaysState = nullptr;
 	ID3D11VertexShader						*screenQuadVS = nullptr;
-	ID3D11PixelShader						*emissivePS = nullptr;
-	ID3D11PixelShader						*horizontalBlurPS = nullptr;
-	ID3D11PixelShader						*verticalBlurPS = nullptr;
+	ID3D11PixelShader						*gaussianPS = nullptr;
+	ID3D11PixelShader						*downsamplePS = nullptr;
+	ID3D11PixelShader						*upsamplePS = nullptr;
 	ID3D11PixelShader						*textureCopyPS = nullptr;
 	ID3D11PixelShader						*depthCopyPS = nullptr;
-	ID3D11VertexShader						*perPixelLightingVS = nullptr;
 
 	Effect									*defaultEffect = nullptr;
 
+	// Set the states shared by the screen space passes and select the pixel shader
+	void beginScreenPass(ID3D11DeviceContext *context, ID3D11PixelShader *pixelShader, ID3D11BlendState *blendState, const FLOAT *blendFactor);
+	// Draw a screen quad sampling source into the pass's target (texelStep is passed to the pixel shader through CBufferBlur)
+	void drawPass(ID3D11DeviceContext *context, ID3D11ShaderResourceView *source, float texelStepX, float texelStepY);
+
 public:
-	BlurUtility(ID3D11Device *deviceIn, ID3D11DeviceContext *contextIn);
-	HRESULT setupBlurRenderTargets();
-	void blurModel(Model*orb, ID3D11ShaderResourceView	*depthSRV);
+	BlurUtility(ID3D11Device *deviceIn, UINT backBufferWidth, UINT backBufferHeight, int _numLevels = 4, float _resolutionScale = 0.5f);
+	// Size the pyramid levels for the given back buffer size - call in response to a window resize
+	HRESULT setupBlurRenderTargets(UINT backBufferWidth, UINT backBufferHeight);
+	// Radius is measured in texels of each pyramid level.  sigma <= 0 selects radius / 3
+	void setKernel(int radius, float sigma = 0.0f);
+	void setUpsampleWeight(float _upsampleWeight){ upsampleWeight = _upsampleWeight; };
+	int getNumLevels(){ return numLevels; };
+	const BlurKernel *getKernel(){ return &kernel; };
+	// Declare the passes that draw obj blurred onto target.  If depth is valid obj is occluded by a copy of it (read as a multisampled
+	// texture), otherwise obj is drawn without occlusion
+	void addPasses(FrameGraph *graph, FGResource target, FGResource depth, Model *obj);
 	~BlurUtility();
 };
-
@@ -157,8 +157,7 @@ HRESULT Box::init(ID3D11Device *device) {
 
 void Box::render(ID3D11DeviceContext *context) {
 
-	context->PSSetConstantBuffers(0, 1, &cBufferModelGPU);
-	context->VSSetConstantBuffers(0, 1, &cBufferModelGPU);
+	bindCBuffer(context);
 
 	// Validate object before rendering 
 	if (!context || !vertexBuffer || !inputLayout)
@@ -198,8 +197,5 @@ void Box::render(ID3D11DeviceContext *context) {
 
 Box::~Box() {
 
-	if (vertexBuffer)
-		vertexBuffer->Release();
-	if (inputLayout)
-		inputLayout->Release();
+	// The vertex and index buffers and the input layout are released by ~BaseModel
 }
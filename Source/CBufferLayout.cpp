@@ -0,0 +1,505 @@
+#include "stdafx.h"
+#include "CBufferLayout.h"
+#include <CBufferStructures.h>
+#include <Utils.h>
+#include <ShaderPack.h>
+#include <d3dcompiler.h>
+#include <d3d11shader.h>
+#include <algorithm>
+#include <set>
+#include <sstream>
+
+using namespace std;
+
+
+// D3D11 requires constant buffer sizes (ByteWidth) to be a multiple of 16
+static_assert(sizeof(CBufferModel) % 16 == 0, "CBufferModel size must be a multiple of 16 bytes");
+static_assert(sizeof(CBufferCamera) % 16 == 0, "CBufferCamera size must be a multiple of 16 bytes");
+static_assert(sizeof(CBufferLight) % 16 == 0, "CBufferLight size must be a multiple of 16 bytes");
+static_assert(sizeof(CBufferScene) % 16 == 0, "CBufferScene size must be a multiple of 16 bytes");
+static_assert(sizeof(CBufferBlur) % 16 == 0, "CBufferBlur size must be a multiple of 16 bytes");
+static_assert(sizeof(CBufferParticles) % 16 == 0, "CBufferParticles size must be a multiple of 16 bytes");
+static_assert(sizeof(CBufferImpostor) % 16 == 0, "CBufferImpostor size must be a multiple of 16 bytes");
+
+#define CBUFFER_MEMBER(s, m) { #m, (UINT)offsetof(s, m), (UINT)sizeof(((s*)nullptr)->m) }
+
+static const CBufferLayout::Member modelMembers[] = {
+	CBUFFER_MEMBER(CBufferModel, worldMatrix),
+	CBUFFER_MEMBER(CBufferModel, worldITMatrix),
+	CBUFFER_MEMBER(CBufferModel, posOffset),
+	CBUFFER_MEMBER(CBufferModel, posScale),
+	CBUFFER_MEMBER(CBufferModel, matDiffuse),
+	CBUFFER_MEMBER(CBufferModel, matSpecular)
+};
+static const CBufferLayout::Member cameraMembers[] = {
+	CBUFFER_MEMBER(CBufferCamera, viewMatrix),
+	CBUFFER_MEMBER(CBufferCamera, projMatrix),
+	CBUFFER_MEMBER(CBufferCamera, eyePos)
+};
+static const CBufferLayout::Member lightMembers[] = {
+	CBUFFER_MEMBER(CBufferLight, lightVec),
+	CBUFFER_MEMBER(CBufferLight, lightAmbient),
+	CBUFFER_MEMBER(CBufferLight, lightDiffuse),
+	CBUFFER_MEMBER(CBufferLight, lightSpecular)
+};
+static const CBufferLayout::Member sceneMembers[] = {
+	CBUFFER_MEMBER(CBufferScene, windDir),
+	CBUFFER_MEMBER(CBufferScene, Time),
+	CBUFFER_MEMBER(CBufferScene, grassHeight),
+	CBUFFER_MEMBER(CBufferScene, fogStart),
+	CBUFFER_MEMBER(CBufferScene, fogEnd),
+	CBUFFER_MEMBER(CBufferScene, fogColour)
+};
+static const CBufferLayout::Member blurMembers[] = {
+	CBUFFER_MEMBER(CBufferBlur, taps),
+	CBUFFER_MEMBER(CBufferBlur, texelStep),
+	CBUFFER_MEMBER(CBufferBlur, numTaps)
+};
+static const CBufferLayout::Member particlesMembers[] = {
+	CBUFFER_MEMBER(CBufferParticles, worldMatrix),
+	CBUFFER_MEMBER(CBufferParticles, speedFactor),
+	CBUFFER_MEMBER(CBufferParticles, scaleFactor),
+	CBUFFER_MEMBER(CBufferParticles, timeOffset)
+};
+static const CBufferLayout::Member impostorMembers[] = {
+	CBUFFER_MEMBER(CBufferImpostor, bounds),
+	CBUFFER_MEMBER(CBufferImpostor, frames),
+	CBUFFER_MEMBER(CBufferImpostor, height),
+	CBUFFER_MEMBER(CBufferImpostor, nearDistance),
+	CBUFFER_MEMBER(CBufferImpostor, fadeRange)
+};
+
+// Every C++ struct uploaded to a cbuffer.  Add new cbuffer structs here so the shaders are checked against them
+const CBufferLayout::Description CBufferLayout::descriptions[] = {
+	{ "modelCBuffer", 0, "CBufferModel", sizeof(CBufferModel), PerDraw, modelMembers, ARRAYSIZE(modelMembers) },
+	{ "cameraCBuffer", 1, "CBufferCamera", sizeof(CBufferCamera), PerFrame, cameraMembers, ARRAYSIZE(cameraMembers) },
+	{ "lightCBuffer", 2, "CBufferLight", sizeof(CBufferLight), Static, lightMembers, ARRAYSIZE(lightMembers) },
+	{ "sceneCBuffer", 3, "CBufferScene", sizeof(CBufferScene), PerFrame, sceneMembers, ARRAYSIZE(sceneMembers) },
+	{ "blurCBuffer", 4, "CBufferBlur", sizeof(CBufferBlur), PerPass, blurMembers, ARRAYSIZE(blurMembers) },
+	{ "particlesCBuffer", 4, "CBufferParticles", sizeof(CBufferParticles), PerDraw, particlesMembers, ARRAYSIZE(particlesMembers) },
+	{ "impostorCBuffer", 4, "CBufferImpostor", sizeof(CBufferImpostor), PerDraw, impostorMembers, ARRAYSIZE(impostorMembers) }
+};
+const UINT CBufferLayout::numDescriptions = ARRAYSIZE(descriptions);
+
+
+const CBufferLayout::Description *CBufferLayout::getDescriptions(UINT *count)
+{
+	*count = numDescriptions;
+	return descriptions;
+}
+
+const CBufferLayout::Description *CBufferLayout::findDescription(const string &hlslName)
+{
+	for (UINT i = 0; i < numDescriptions; i++)
+		if (_stricmp(descriptions[i].hlslName, hlslName.c_str()) == 0)
+			return &descriptions[i];
+	return nullptr;
+}
+
+const char *CBufferLayout::frequencyName(Frequency frequency)
+{
+	switch (frequency) {
+	case PerDraw: return "PerDraw";
+	case PerPass: return "PerPass";
+	case PerFrame: return "PerFrame";
+	default: return "Static";
+	}
+}
+
+
+HRESULT CBufferLayout::reflectShader(const string &name, const void *bytecode, SIZE_T size)
+{
+	ID3D11ShaderReflection *reflector = nullptr;
+	HRESULT hr = D3DReflect(bytecode, size, IID_ID3D11ShaderReflection, (void**)&reflector);
+	if (!SUCCEEDED(hr))
+		return hr;
+
+	if (members.empty()) {
+		members.resize(numDescriptions);
+		for (UINT i = 0; i < numDescriptions; i++)
+			members[i].resize(descriptions[i].numMembers);
+	}
+	numShaders++;
+
+	D3D11_SHADER_DESC shaderDesc;
+	reflector->GetDesc(&shaderDesc);
+
+	for (UINT i = 0; i < shaderDesc.ConstantBuffers; i++) {
+
+		ID3D11ShaderReflectionConstantBuffer *cb = reflector->GetConstantBufferByIndex(i);
+		D3D11_SHADER_BUFFER_DESC cbDesc;
+		if (!SUCCEEDED(cb->GetDesc(&cbDesc)) || cbDesc.Type != D3D_CT_CBUFFER)
+			continue;
+		D3D11_SHADER_INPUT_BIND_DESC bindDesc;
+		if (!SUCCEEDED(reflector->GetResourceBindingDescByName(cbDesc.Name, &bindDesc)))
+			continue;
+
+		ReflectedCBuffer c;
+		c.shader = name;
+		c.name = cbDesc.Name;
+		c.slot = bindDesc.BindPoint;
+		c.size = cbDesc.Size;
+
+		for (UINT v = 0; v < cbDesc.Variables; v++) {
+
+			ID3D11ShaderReflectionVariable *var = cb->GetVariableByIndex(v);
+			D3D11_SHADER_VARIABLE_DESC varDesc;
+			D3D11_SHADER_TYPE_DESC typeDesc;
+			if (!SUCCEEDED(var->GetDesc(&varDesc)) || !SUCCEEDED(var->GetType()->GetDesc(&typeDesc)))
+				continue;
+
+			ReflectedVariable r;
+			r.name = varDesc.Name;
+			r.offset = varDesc.StartOffset;
+			r.info.declared = true;
+			r.info.used = (varDesc.uFlags & D3D_SVF_USED) != 0;
+			r.info.size = varDesc.Size;
+			r.info.typeClass = typeDesc.Class;
+			r.info.type = typeDesc.Type;
+			r.info.rows = typeDesc.Rows;
+			r.info.columns = typeDesc.Columns;
+			r.info.elements = typeDesc.Elements;
+			r.info.hlslType = typeDesc.Name ? typeDesc.Name : "";
+			c.variables.push_back(r);
+		}
+
+		// Record which members of the C++ struct the shader declares and reads.  Members are matched on offset since that is what
+		// decides the data the shader sees (names are checked by validate())
+		const Description *d = findDescription(c.name);
+		if (d) {
+			vector<ReflectedMember> &m = members[d - descriptions];
+			for (size_t v = 0; v < c.variables.size(); v++) {
+				const ReflectedVariable &r = c.variables[v];
+				for (UINT k = 0; k < d->numMembers; k++) {
+					if (d->members[k].offset != r.offset)
+						continue;
+					bool used = m[k].used || r.info.used;
+					if (!m[k].declared)
+						m[k] = r.info;
+					m[k].used = used;
+					break;
+				}
+			}
+		}
+		cbuffers.push_back(c);
+	}
+
+	reflector->Release();
+	return S_OK;
+}
+
+HRESULT CBufferLayout::reflect(const char *csoDirectory)
+{
+	ShaderPack *pack = ShaderPack::getDefault();
+	HRESULT result = E_FAIL;
+
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((string(csoDirectory) + "*.cso").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+		return E_FAIL;
+	do {
+		string path = string(csoDirectory) + findData.cFileName;
+		const void *bytecode = nullptr;
+		SIZE_T size = 0;
+		if (pack->getBytecode(path.c_str(), &bytecode, &size) && SUCCEEDED(reflectShader(findData.cFileName, bytecode, size)))
+			result = S_OK;
+		else
+			cout << "CBufferLayout: cannot reflect " << path << endl;
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+
+	return result;
+}
+
+
+int CBufferLayout::checkCBuffer(const ReflectedCBuffer &c, const Description &d) const
+{
+	int errors = 0;
+
+	if (c.slot != d.slot) {
+		cout << "CBufferLayout: " << c.shader << ": " << c.name << " is bound to b" << c.slot << " but " << d.structName << " is uploaded to b" << d.slot << endl;
+		errors++;
+	}
+	if (c.size > cbufferByteWidth(d.size)) {
+		cout << "CBufferLayout: " << c.shader << ": " << c.name << " is " << c.size << " bytes but " << d.structName << " is " << d.size << " bytes" << endl;
+		errors++;
+	}
+
+	for (size_t v = 0; v < c.variables.size(); v++) {
+
+		const ReflectedVariable &r = c.variables[v];
+		const Member *m = nullptr;
+		for (UINT k = 0; k < d.numMembers && !m; k++)
+			if (d.members[k].offset == r.offset)
+				m = &d.members[k];
+
+		if (!m) {
+			cout << "CBufferLayout: " << c.shader << ": " << c.name << "." << r.name << " (offset " << r.offset << ") does not start at a member of " << d.structName << endl;
+			errors++;
+			continue;
+		}
+		// The last element of an HLSL array is not padded to 16 bytes so the C++ array may be larger
+		bool sizeMatches = r.info.elements ? m->size >= r.info.size : m->size == r.info.size;
+		if (!sizeMatches) {
+			cout << "CBufferLayout: " << c.shader << ": " << c.name << "." << r.name << " is " << r.info.size << " bytes but " << d.structName << "::" << m->name << " is " << m->size << " bytes" << endl;
+			errors++;
+		}
+		else if (_stricmp(m->name, r.name.c_str()) != 0)
+			cout << "CBufferLayout: warning: " << c.shader << ": " << c.name << "." << r.name << " is at the offset of " << d.structName << "::" << m->name << endl;
+	}
+	return errors;
+}
+
+int CBufferLayout::validate() const
+{
+	int errors = 0;
+
+	// Permutation variants (and shaders sharing an include) declare identical cbuffers, so each distinct layout is checked once
+	set<string> checked;
+
+	for (size_t i = 0; i < cbuffers.size(); i++) {
+
+		const ReflectedCBuffer &c = cbuffers[i];
+		ostringstream key;
+		key << c.name << ":" << c.slot << ":" << c.size;
+		for (size_t v = 0; v < c.variables.size(); v++)
+			key << ":" << c.variables[v].name << "@" << c.variables[v].offset << "+" << c.variables[v].info.size;
+		if (!checked.insert(key.str()).second)
+			continue;
+
+		const Description *d = findDescription(c.name);
+		if (d) {
+			errors += checkCBuffer(c, *d);
+			continue;
+		}
+
+		// A cbuffer with no description reads whichever struct is bound to its register
+		string bound;
+		for (UINT k = 0; k < numDescriptions; k++)
+			if (descriptions[k].slot == c.slot)
+				bound += string(bound.empty() ? "" : ", ") + descriptions[k].structName;
+		if (!bound.empty()) {
+			cout << "CBufferLayout: " << c.shader << ": " << c.name << " (b" << c.slot << ") has no C++ description but b" << c.slot << " holds " << bound << endl;
+			errors++;
+		}
+	}
+
+	cout << "CBufferLayout: " << cbuffers.size() << " cbuffers in " << numShaders << " shaders, " << errors << " layout errors" << endl;
+	return errors;
+}
+
+void CBufferLayout::reportSlack() const
+{
+	if (members.empty())
+		return;
+
+	UINT totalWidth = 0;
+	UINT totalRead = 0;
+	cout << "CBufferLayout: bytes uploaded / read by the shaders" << endl;
+
+	for (UINT i = 0; i < numDescriptions; i++) {
+
+		const Description &d = descriptions[i];
+		UINT width = cbufferByteWidth(d.size);
+		UINT read = 0;
+		string unused;
+		for (UINT k = 0; k < d.numMembers; k++) {
+			if (members[i][k].used)
+				read += min(d.members[k].size, members[i][k].size);
+			else
+				unused += string(unused.empty() ? "" : ", ") + d.members[k].name;
+		}
+		totalWidth += width;
+		totalRead += read;
+
+		cout << d.structName << " (b" << d.slot << ", " << frequencyName(d.frequency) << "): " << width << " bytes, " << read << " read, " << (width - read) << " slack";
+		if (!unused.empty())
+			cout << " - unused: " << unused;
+		cout << endl;
+	}
+	cout << "Total = " << totalWidth << " bytes, Read = " << totalRead << ", Slack = " << (totalWidth - totalRead) << endl;
+}
+
+
+string CBufferLayout::cppDeclaration(const string &name, const ReflectedMember &m)
+{
+	static const char *vectorPrefix[] = { "DirectX::XMFLOAT", "DirectX::XMINT", "DirectX::XMUINT" };
+	int base = (m.type == D3D_SVT_INT) ? 1 : ((m.type == D3D_SVT_UINT || m.type == D3D_SVT_BOOL) ? 2 : 0);
+	bool matrix = m.typeClass == D3D_SVC_MATRIX_ROWS || m.typeClass == D3D_SVC_MATRIX_COLUMNS;
+
+	string type;
+	string suffix;
+	if (matrix && m.rows == 4 && m.columns == 4)
+		type = "DirectX::XMMATRIX";
+	else if (matrix || (m.elements && m.columns < 4)) {
+		// HLSL arrays (and matrix rows) have a 16 byte stride
+		type = "DirectX::XMFLOAT4";
+		UINT registers = (m.size + 15) / 16;
+		suffix = "[" + to_string(registers) + "]";
+	}
+	else if (m.columns > 1)
+		type = vectorPrefix[base] + to_string(m.columns);
+	else
+		type = (base == 1) ? "INT" : ((base == 2) ? "UINT" : "FLOAT");
+
+	if (m.elements && suffix.empty())
+		suffix = "[" + to_string(m.elements) + "]";
+
+	string tabs((type.size() < 40) ? (43 - type.size()) / 4 : 1, '\t');
+	return type + tabs + name + suffix + ";";
+}
+
+string CBufferLayout::hlslDeclaration(const string &name, const ReflectedMember &m)
+{
+	string type = m.hlslType;
+	if (type.empty()) {
+		type = (m.type == D3D_SVT_INT) ? "int" : ((m.type == D3D_SVT_UINT) ? "uint" : ((m.type == D3D_SVT_BOOL) ? "bool" : "float"));
+		if (m.typeClass == D3D_SVC_MATRIX_ROWS || m.typeClass == D3D_SVC_MATRIX_COLUMNS)
+			type += to_string(m.rows) + "x" + to_string(m.columns);
+		else if (m.columns > 1)
+			type += to_string(m.columns);
+	}
+	string tabs((type.size() < 16) ? (19 - type.size()) / 4 : 1, '\t');
+	return type + tabs + name + (m.elements ? "[" + to_string(m.elements) + "]" : "");
+}
+
+void CBufferLayout::writePacked(ostream &out) const
+{
+	if (members.empty())
+		return;
+
+	struct Item {
+		string								name;
+		ReflectedMember						info;
+		UINT								offset;
+	};
+
+	// Structs are listed by update frequency.  Each keeps its own HLSL cbuffer name and register - structs sharing a register (eg. the
+	// blur, particle and impostor cbuffers at b4) are bound as alternatives and structs of one frequency at different registers are
+	// read together with the other registers, so merging either would give a layout no shader declares
+	for (int f = 0; f < NumFrequencies; f++) {
+
+		UINT originalWidth = 0;
+		UINT packedWidth = 0;
+		ostringstream structs;
+
+		for (UINT i = 0; i < numDescriptions; i++) {
+
+			const Description &d = descriptions[i];
+			if (d.frequency != f)
+				continue;
+
+			// Members read by any shader
+			vector<Item> items;
+			for (UINT k = 0; k < d.numMembers; k++) {
+				if (!members[i][k].used)
+					continue;
+				Item item;
+				item.name = d.members[k].name;
+				item.info = members[i][k];
+				item.offset = 0;
+				items.push_back(item);
+			}
+			originalWidth += cbufferByteWidth(d.size);
+			if (items.empty()) {
+				structs << "// " << d.structName << " (b" << d.slot << "): no member is read" << endl << endl;
+				continue;
+			}
+
+			// HLSL packing: arrays and matrices start a new 16 byte register, other variables may share a register but cannot
+			// straddle two.  Whole-register variables are placed first, then the smaller ones (largest first) in the first register
+			// with room.  Nothing is packed after the last element of an array so the C++ struct can declare it with whole 16 byte
+			// elements
+			vector<UINT> registerUsed;
+			for (size_t j = 0; j < items.size(); j++) {
+				const ReflectedMember &m = items[j].info;
+				bool matrix = m.typeClass == D3D_SVC_MATRIX_ROWS || m.typeClass == D3D_SVC_MATRIX_COLUMNS;
+				if (!m.elements && !matrix && m.size < 16)
+					continue;
+				items[j].offset = (UINT)registerUsed.size() * 16;
+				registerUsed.resize(registerUsed.size() + (m.size + 15) / 16, 16);
+			}
+			vector<size_t> small;
+			for (size_t j = 0; j < items.size(); j++) {
+				const ReflectedMember &m = items[j].info;
+				if (!m.elements && m.typeClass != D3D_SVC_MATRIX_ROWS && m.typeClass != D3D_SVC_MATRIX_COLUMNS && m.size < 16)
+					small.push_back(j);
+			}
+			stable_sort(small.begin(), small.end(), [&items](size_t a, size_t b) { return items[a].info.size > items[b].info.size; });
+			for (size_t s = 0; s < small.size(); s++) {
+				Item &item = items[small[s]];
+				size_t r = 0;
+				while (r < registerUsed.size() && 16 - registerUsed[r] < item.info.size)
+					r++;
+				if (r == registerUsed.size())
+					registerUsed.push_back(0);
+				item.offset = (UINT)r * 16 + registerUsed[r];
+				registerUsed[r] += item.info.size;
+			}
+			stable_sort(items.begin(), items.end(), [](const Item &a, const Item &b) { return a.offset < b.offset; });
+			UINT width = (UINT)registerUsed.size() * 16;
+			packedWidth += width;
+
+			structs << "// " << d.structName << " (b" << d.slot << "): " << width << " bytes (" << cbufferByteWidth(d.size) << " bytes)" << endl;
+
+			// C++ struct, padded to the HLSL offsets
+			structs << "__declspec(align(16)) struct " << d.structName << "Packed {" << endl;
+			UINT offset = 0;
+			int numPadding = 0;
+			for (size_t j = 0; j < items.size(); j++) {
+				if (items[j].offset > offset) {
+					structs << "\tFLOAT\t\t\t\t\t\t\t\t\tpadding" << numPadding++ << "[" << (items[j].offset - offset) / 4 << "];" << endl;
+					offset = items[j].offset;
+				}
+				structs << "\t" << cppDeclaration(items[j].name, items[j].info) << endl;
+				bool matrix = items[j].info.typeClass == D3D_SVC_MATRIX_ROWS || items[j].info.typeClass == D3D_SVC_MATRIX_COLUMNS;
+				offset += (items[j].info.elements || matrix) ? ((items[j].info.size + 15) / 16) * 16 : items[j].info.size;
+			}
+			if (width > offset)
+				structs << "\tFLOAT\t\t\t\t\t\t\t\t\tpadding" << numPadding++ << "[" << (width - offset) / 4 << "];" << endl;
+			structs << "};" << endl << endl;
+
+			// HLSL cbuffer with explicit offsets, at the name and register the shaders declare
+			structs << "cbuffer " << d.hlslName << " : register(b" << d.slot << ") {" << endl;
+			for (size_t j = 0; j < items.size(); j++) {
+				UINT component = (items[j].offset % 16) / 4;
+				structs << "\t" << hlslDeclaration(items[j].name, items[j].info) << " : packoffset(c" << items[j].offset / 16;
+				if (component)
+					structs << "." << "xyzw"[component];
+				structs << ");" << endl;
+			}
+			structs << "};" << endl << endl;
+		}
+
+		if (originalWidth == 0)
+			continue;
+		out << "// " << frequencyName((Frequency)f) << ": " << packedWidth << " bytes (" << originalWidth << " bytes)" << endl << endl;
+		out << structs.str();
+	}
+}
+
+HRESULT CBufferLayout::writePacked(const char *filename) const
+{
+	ofstream out(filename);
+	if (!out.is_open())
+		return E_FAIL;
+	out << "//" << endl << "// Packed cbuffer layouts generated by CBufferLayout::writePacked from the compiled shaders, listed by update frequency." << endl;
+	out << "// Each cbuffer keeps the name and register the shaders declare" << endl << "//" << endl << endl;
+	writePacked(out);
+	return S_OK;
+}
+
+
+int CBufferLayout::check(const char *csoDirectory, const char *packedFilename)
+{
+	CBufferLayout layout;
+	if (!SUCCEEDED(layout.reflect(csoDirectory))) {
+		cout << "CBufferLayout: no shaders reflected in " << csoDirectory << endl;
+		return 0;
+	}
+	int errors = layout.validate();
+	layout.reportSlack();
+	if (packedFilename && !SUCCEEDED(layout.writePacked(packedFilename)))
+		cout << "CBufferLayout: cannot write " << packedFilename << endl;
+	return errors;
+}
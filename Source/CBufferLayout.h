@@ -0,0 +1,109 @@
+//
+// CBufferLayout.h
+//
+
+// Constant buffer layout validation.  The C++ cbuffer structs in CBufferStructures.h are matched by hand to the cbuffers declared in
+// the HLSL, so each struct is described here (HLSL cbuffer name, register, member offsets and sizes from offsetof / sizeof) together
+// with how often it is updated.  reflect() reads the cbuffer layouts of the compiled shaders with D3DReflect and validate() checks
+// every reflected cbuffer against its C++ description - a variable at a different offset or size, a cbuffer larger than the struct
+// uploaded to it, or a cbuffer with no description on a register a described struct is bound to would otherwise silently read the
+// wrong data.  reportSlack() lists the bytes uploaded but never read (padding and members no shader uses), and writePacked() writes,
+// for each struct, a C++ struct and HLSL cbuffer that hold only the used members packed into as few 16 byte registers as the HLSL
+// packing rules allow.  They are listed by update frequency and keep the cbuffer name and register the shaders declare.
+#pragma once
+
+#include <d3d11_2.h>
+#include <string>
+#include <vector>
+#include <ostream>
+
+class CBufferLayout {
+
+public:
+
+	// How often a cbuffer is written
+	enum Frequency { PerDraw, PerPass, PerFrame, Static, NumFrequencies };
+
+	struct Member {
+		const char							*name;
+		UINT								offset;
+		UINT								size;
+	};
+
+	// A C++ cbuffer struct and the HLSL cbuffer it is uploaded to
+	struct Description {
+		const char							*hlslName; // Compared without case (eg. cameraCbuffer and cameraCBuffer)
+		UINT								slot; // Register b<slot>
+		const char							*structName;
+		UINT								size; // sizeof(struct)
+		Frequency							frequency;
+		const Member						*members;
+		UINT								numMembers;
+	};
+
+private:
+
+	// A member as declared in the HLSL (from the first shader that declares it)
+	struct ReflectedMember {
+		bool								declared = false;
+		bool								used = false; // Read by at least one shader
+		UINT								size = 0;
+		D3D_SHADER_VARIABLE_CLASS			typeClass = D3D_SVC_SCALAR;
+		D3D_SHADER_VARIABLE_TYPE			type = D3D_SVT_FLOAT;
+		UINT								rows = 0;
+		UINT								columns = 0;
+		UINT								elements = 0;
+		std::string							hlslType;
+	};
+
+	struct ReflectedVariable {
+		std::string							name;
+		UINT								offset;
+		ReflectedMember						info;
+	};
+
+	// A cbuffer declared by one shader
+	struct ReflectedCBuffer {
+		std::string							shader;
+		std::string							name;
+		UINT								slot;
+		UINT								size;
+		std::vector<ReflectedVariable>		variables;
+	};
+
+	static const Description				descriptions[];
+	static const UINT						numDescriptions;
+
+	std::vector<ReflectedCBuffer>			cbuffers;
+	// Per description, per member
+	std::vector<std::vector<ReflectedMember> >	members;
+	UINT									numShaders = 0;
+
+	static const Description *findDescription(const std::string &hlslName);
+	static std::string cppDeclaration(const std::string &name, const ReflectedMember &m);
+	static std::string hlslDeclaration(const std::string &name, const ReflectedMember &m);
+
+	// Check one reflected cbuffer against a description.  Returns the number of errors
+	int checkCBuffer(const ReflectedCBuffer &c, const Description &d) const;
+
+public:
+
+	static const Description *getDescriptions(UINT *count);
+	static const char *frequencyName(Frequency frequency);
+
+	// Reflect the cbuffers of every .cso file in csoDirectory.  Bytecode is read through the default ShaderPack
+	HRESULT reflect(const char *csoDirectory);
+	// Reflect one shader
+	HRESULT reflectShader(const std::string &name, const void *bytecode, SIZE_T size);
+
+	// Print every layout mismatch.  Returns the number of errors (0 if the C++ structs match the shaders)
+	int validate() const;
+	// Print the ByteWidth, bytes read by the shaders and slack of each described cbuffer
+	void reportSlack() const;
+	// Write packed C++ structs and HLSL cbuffers for the members the shaders use, listed by update frequency
+	void writePacked(std::ostream &out) const;
+	HRESULT writePacked(const char *filename) const;
+
+	// Reflect, validate and report in one call (the packed layouts are written if packedFilename is given).  Returns the number of errors
+	static int check(const char *csoDirectory, const char *packedFilename = nullptr);
+};
@@ -0,0 +1,241 @@
+#include "stdafx.h"
+#include "CBufferManager.h"
+#include <Utils.h>
+
+using namespace std;
+
+
+CBufferManager *CBufferManager::defaultManager = nullptr;
+
+
+CBufferManager::CBufferManager(ID3D11Device *_device)
+{
+	device = _device;
+	contexts.resize(1);
+	invalidate(contexts[0]);
+}
+
+CBufferManager::~CBufferManager()
+{
+	for (size_t i = 0; i < entries.size(); i++)
+		if (entries[i].buffer)
+			entries[i].buffer->Release();
+	if (defaultManager == this)
+		defaultManager = nullptr;
+}
+
+CBufferManager *CBufferManager::getDefault(ID3D11Device *device)
+{
+	if (!defaultManager)
+		defaultManager = new CBufferManager(device);
+	return defaultManager;
+}
+
+void CBufferManager::setDefault(CBufferManager *manager)
+{
+	defaultManager = manager;
+}
+
+
+int CBufferManager::add(const void *data, UINT size, UINT slot, CBufferLayout::Frequency frequency, UINT stages)
+{
+	if (!data || !size || slot >= numSlots)
+		return -1;
+
+	D3D11_BUFFER_DESC cbufferDesc;
+	D3D11_SUBRESOURCE_DATA cbufferInitData;
+	ZeroMemory(&cbufferDesc, sizeof(D3D11_BUFFER_DESC));
+	ZeroMemory(&cbufferInitData, sizeof(D3D11_SUBRESOURCE_DATA));
+	cbufferDesc.ByteWidth = cbufferByteWidth(size);
+	cbufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	cbufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	cbufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+	// The initial data must cover the whole ByteWidth
+	vector<char> initData(cbufferDesc.ByteWidth, 0);
+	memcpy(&initData[0], data, size);
+	cbufferInitData.pSysMem = &initData[0];
+
+	Entry e;
+	HRESULT hr = device->CreateBuffer(&cbufferDesc, &cbufferInitData, &e.buffer);
+	if (!SUCCEEDED(hr))
+		return -1;
+	e.data = data;
+	e.size = size;
+	e.slot = slot;
+	e.frequency = frequency;
+	e.stages = stages;
+
+	lock_guard<mutex> guard(entriesLock);
+	int handle;
+	if (!freeEntries.empty()) {
+		handle = freeEntries.back();
+		freeEntries.pop_back();
+		entries[handle] = e;
+	}
+	else {
+		handle = (int)entries.size();
+		entries.push_back(e);
+	}
+	return handle;
+}
+
+void CBufferManager::remove(int handle)
+{
+	lock_guard<mutex> guard(entriesLock);
+	if (!validHandle(handle))
+		return;
+	Entry &e = entries[handle];
+	for (size_t c = 0; c < contexts.size(); c++) {
+		for (UINT i = 0; i < numSlots; i++) {
+			if (contexts[c].boundVS[i] == e.buffer)
+				contexts[c].boundVS[i] = nullptr;
+			if (contexts[c].boundPS[i] == e.buffer)
+				contexts[c].boundPS[i] = nullptr;
+		}
+	}
+	e.buffer->Release();
+	e = Entry();
+	freeEntries.push_back(handle);
+}
+
+
+void CBufferManager::markDirty(int handle)
+{
+	if (validHandle(handle))
+		entries[handle].dirty = true;
+}
+
+bool CBufferManager::upload(ID3D11DeviceContext *context, int handle)
+{
+	if (!validHandle(handle))
+		return false;
+	Entry &e = entries[handle];
+	Stats &stats = stateFor(context).frameStats;
+	if (!e.dirty) {
+		stats.numSkippedUploads++;
+		return false;
+	}
+	if (!SUCCEEDED(mapCbuffer(context, (void*)e.data, e.buffer, e.size)))
+		return false;
+	e.dirty = false;
+	stats.numUploads++;
+	stats.bytesUploaded += e.size;
+	return true;
+}
+
+void CBufferManager::bind(ID3D11DeviceContext *context, int handle)
+{
+	if (!validHandle(handle))
+		return;
+	upload(context, handle);
+
+	Entry &e = entries[handle];
+	ContextState &state = stateFor(context);
+	if (e.stages & VertexStage) {
+		if (state.boundVS[e.slot] != e.buffer) {
+			context->VSSetConstantBuffers(e.slot, 1, &e.buffer);
+			state.boundVS[e.slot] = e.buffer;
+			state.frameStats.numBinds++;
+		}
+		else
+			state.frameStats.numSkippedBinds++;
+	}
+	if (e.stages & PixelStage) {
+		if (state.boundPS[e.slot] != e.buffer) {
+			context->PSSetConstantBuffers(e.slot, 1, &e.buffer);
+			state.boundPS[e.slot] = e.buffer;
+			state.frameStats.numBinds++;
+		}
+		else
+			state.frameStats.numSkippedBinds++;
+	}
+}
+
+
+CBufferManager::ContextState &CBufferManager::stateFor(ID3D11DeviceContext *context)
+{
+	for (size_t i = 1; i < contexts.size(); i++)
+		if (contexts[i].context == context)
+			return contexts[i];
+	return contexts[0];
+}
+
+void CBufferManager::invalidate(ContextState &state)
+{
+	for (UINT i = 0; i < numSlots; i++) {
+		state.boundVS[i] = nullptr;
+		state.boundPS[i] = nullptr;
+	}
+}
+
+void CBufferManager::invalidateBindings()
+{
+	for (size_t i = 0; i < contexts.size(); i++)
+		invalidate(contexts[i]);
+}
+
+void CBufferManager::addContext(ID3D11DeviceContext *context)
+{
+	if (!context || &stateFor(context) != &contexts[0])
+		return;
+	ContextState state;
+	state.context = context;
+	invalidate(state);
+	contexts.push_back(state);
+}
+
+void CBufferManager::beginFrame(ID3D11DeviceContext *context)
+{
+	// Sum the counters of every context into the frame totals
+	if (numFrames > 0) {
+		Stats frameStats;
+		for (size_t i = 0; i < contexts.size(); i++) {
+			const Stats &s = contexts[i].frameStats;
+			frameStats.bytesUploaded += s.bytesUploaded;
+			frameStats.numUploads += s.numUploads;
+			frameStats.numSkippedUploads += s.numSkippedUploads;
+			frameStats.numBinds += s.numBinds;
+			frameStats.numSkippedBinds += s.numSkippedBinds;
+		}
+		lastFrameStats = frameStats;
+		totalStats.bytesUploaded += frameStats.bytesUploaded;
+		totalStats.numUploads += frameStats.numUploads;
+		totalStats.numSkippedUploads += frameStats.numSkippedUploads;
+		totalStats.numBinds += frameStats.numBinds;
+		totalStats.numSkippedBinds += frameStats.numSkippedBinds;
+	}
+	for (size_t i = 0; i < contexts.size(); i++)
+		contexts[i].frameStats = Stats();
+	numFrames++;
+
+	invalidateBindings();
+	bindFrame(context);
+}
+
+void CBufferManager::bindFrame(ID3D11DeviceContext *context)
+{
+	invalidate(stateFor(context));
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry &e = entries[i];
+		if (e.buffer && (e.frequency == CBufferLayout::PerFrame || e.frequency == CBufferLayout::Static))
+			bind(context, (int)i);
+	}
+}
+
+void CBufferManager::uploadDirty(ID3D11DeviceContext *context)
+{
+	for (size_t i = 0; i < entries.size(); i++)
+		if (entries[i].buffer && entries[i].dirty)
+			upload(context, (int)i);
+}
+
+
+void CBufferManager::reportData() const
+{
+	UINT numBuffers = (UINT)(entries.size() - freeEntries.size());
+	UINT frames = max(numFrames, 2u) - 1;
+	cout << "CBufferManager: " << numBuffers << " cbuffers" << endl;
+	cout << "Last frame: Bytes uploaded = " << lastFrameStats.bytesUploaded << ", Maps = " << lastFrameStats.numUploads << " (" << lastFrameStats.numSkippedUploads << " skipped), Binds = " << lastFrameStats.numBinds << " (" << lastFrameStats.numSkippedBinds << " skipped)" << endl;
+	cout << "Average per frame: Bytes uploaded = " << totalStats.bytesUploaded / frames << ", Maps = " << totalStats.numUploads / frames << ", Binds = " << totalStats.numBinds / frames << endl;
+}
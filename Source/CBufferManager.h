@@ -0,0 +1,118 @@
+//
+// CBufferManager.h
+//
+
+// Constant buffer scheduling.  Each cbuffer is registered with its CPU copy, register and update frequency (see CBufferLayout) and the
+// manager owns the GPU buffer.  Writers mark a buffer dirty when they change its CPU copy and the manager only maps buffers that are
+// dirty, so static objects (the castle, terrain etc) upload their model cbuffer once instead of every time they are drawn.  The
+// register each buffer was last bound to is tracked per stage, so a buffer is only bound when a different buffer occupies its slot.
+// beginFrame() uploads and binds the per-frame and static buffers once for the whole frame, per-pass and per-draw buffers are bound
+// with bind() when they are used.  Bytes uploaded, maps and binds (and the ones skipped) are counted per frame.
+//
+// Deferred contexts (see CommandRecorder) are registered with addContext() and get their own binding tracking and counters, so
+// threads recording different contexts can bind concurrently.  Buffers must not be marked dirty while recording - uploadDirty() on
+// the immediate context first, then each deferred context starts its command list with bindFrame().  add() and remove() are
+// serialised by a lock so models can be created on several threads, but not while buffers are being bound.
+#pragma once
+
+#include <d3d11_2.h>
+#include <vector>
+#include <mutex>
+#include <CBufferLayout.h>
+
+class CBufferManager {
+
+public:
+
+	// Stages a buffer is bound to
+	enum Stage { VertexStage = 0x1, PixelStage = 0x2 };
+
+private:
+
+	struct Entry {
+		ID3D11Buffer						*buffer = nullptr;
+		const void							*data = nullptr; // CPU copy (owned by the caller)
+		UINT								size = 0;
+		UINT								slot = 0;
+		CBufferLayout::Frequency			frequency = CBufferLayout::PerDraw;
+		UINT								stages = 0;
+		bool								dirty = false;
+	};
+
+	struct Stats {
+		UINT64								bytesUploaded = 0;
+		UINT								numUploads = 0;
+		UINT								numSkippedUploads = 0; // Upload requests for buffers that had not changed
+		UINT								numBinds = 0;
+		UINT								numSkippedBinds = 0; // Binds of a buffer already in its slot
+	};
+
+	static const UINT						numSlots = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+
+	// Binding tracking and counters of one context.  Only the thread recording the context touches them
+	struct ContextState {
+		ID3D11DeviceContext					*context = nullptr;
+		// Buffer last bound to each slot (nullptr if unknown)
+		ID3D11Buffer						*boundVS[numSlots];
+		ID3D11Buffer						*boundPS[numSlots];
+		Stats								frameStats;
+	};
+
+	ID3D11Device							*device = nullptr;
+	std::vector<Entry>						entries;
+	std::vector<int>						freeEntries;
+	std::mutex								entriesLock;
+
+	// contexts[0] is used for every context that has not been registered (the immediate context)
+	std::vector<ContextState>				contexts;
+
+	Stats									lastFrameStats;
+	Stats									totalStats;
+	UINT									numFrames = 0;
+
+	static CBufferManager					*defaultManager;
+
+	bool validHandle(int handle) const { return handle >= 0 && handle < (int)entries.size() && entries[handle].buffer; };
+	ContextState &stateFor(ID3D11DeviceContext *context);
+	static void invalidate(ContextState &state);
+
+public:
+
+	CBufferManager(ID3D11Device *_device);
+	~CBufferManager();
+
+	// Manager used by models and cameras.  Created for the given device on first use if none has been set
+	static CBufferManager *getDefault(ID3D11Device *device);
+	static void setDefault(CBufferManager *manager);
+
+	// Create the GPU buffer for a cbuffer whose CPU copy is data (which must stay valid until remove).  The buffer is initialised from
+	// data.  Returns a handle, or -1 if the buffer cannot be created
+	int add(const void *data, UINT size, UINT slot, CBufferLayout::Frequency frequency, UINT stages = VertexStage | PixelStage);
+	void remove(int handle);
+
+	// The CPU copy has changed and must be uploaded before the buffer is next used
+	void markDirty(int handle);
+	// Copy the CPU copy to the GPU buffer if it is dirty.  Returns true if the buffer was mapped
+	bool upload(ID3D11DeviceContext *context, int handle);
+	// Upload if dirty and bind the buffer to its slot unless it is already bound there
+	void bind(ID3D11DeviceContext *context, int handle);
+
+	// Start a frame: forget the tracked bindings (other code may have changed them), then upload and bind every per-frame and static
+	// buffer.  Per-draw and per-pass buffers are bound as they are used
+	void beginFrame(ID3D11DeviceContext *context);
+	// Forget the tracked bindings of context and bind the per-frame and static buffers to it, eg. at the start of a deferred context's
+	// command list or after executing command lists (which clears the immediate context state)
+	void bindFrame(ID3D11DeviceContext *context);
+	// Upload every dirty buffer, so deferred contexts recorded afterwards only need to bind
+	void uploadDirty(ID3D11DeviceContext *context);
+	// Forget the tracked bindings of every context, eg. after ClearState or after binding cbuffers without the manager
+	void invalidateBindings();
+
+	// Track bindings of a deferred context separately.  Call before any thread records into it
+	void addContext(ID3D11DeviceContext *context);
+
+	ID3D11Buffer *getBuffer(int handle) const { return validHandle(handle) ? entries[handle].buffer : nullptr; };
+
+	UINT64 getLastFrameBytesUploaded() const { return lastFrameStats.bytesUploaded; };
+	void reportData() const;
+};
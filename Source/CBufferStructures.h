@@ -1,4 +1,5 @@
 #pragma once
+#include <BlurKernel.h>
 using namespace DirectX;
 using namespace DirectX::PackedVector;
 // CBuffer struct
@@ -17,6 +18,9 @@ __declspec(align(16)) struct CBufferScene {
 	DirectX::XMFLOAT4						windDir;
 	FLOAT									Time;
 	FLOAT									grassHeight;
+	FLOAT									fogStart; // Distance from the eye at which fog begins
+	FLOAT									fogEnd; // Distance at which fog is opaque
+	DirectX::XMFLOAT4						fogColour;
 };
 
 
@@ -63,6 +67,11 @@ __declspec(align(16)) struct CBufferModel {
 //	DirectX::XMMATRIX						WVPMatrix;
 	DirectX::XMMATRIX						worldMatrix;
 	DirectX::XMMATRIX						worldITMatrix; // Correctly transform normals to world space
+	// Compressed vertices (VERTEX_FORMAT_COMPRESSED): position = posOffset + quantised position * posScale, and the material colours
+	DirectX::XMFLOAT4						posOffset;
+	DirectX::XMFLOAT4						posScale;
+	DirectX::XMFLOAT4						matDiffuse; // a represents alpha
+	DirectX::XMFLOAT4						matSpecular; // a represents specular power
 	//FLOAT									USE_SHADOW_MAP=1; 
 };
 __declspec(align(16)) struct CBufferShadow {
@@ -83,6 +92,26 @@ __declspec(align(16)) struct CBufferLight {
 };
 
 
+// Blur pass parameters (register b4) - see BlurKernel.h
+__declspec(align(16)) struct CBufferBlur {
+	DirectX::XMFLOAT4						taps[MAX_BLUR_TAPS]; // x = offset in texels, y = weight
+	DirectX::XMFLOAT2						texelStep; // Size of one source texel along the blur direction (uv units)
+	INT										numTaps;
+	FLOAT									padding;
+};
+
+
+// Impostor batch parameters (register b4) - see ImpostorBatch.h
+__declspec(align(16)) struct CBufferImpostor {
+	DirectX::XMFLOAT4						bounds; // Model space bounding cylinder of the baked model - x = centre x, y = centre z, z = radius, w = minY
+	DirectX::XMFLOAT4						frames; // x = number of views, y = atlas columns, z = 1 / columns, w = 1 / rows
+	FLOAT									height; // Height of the bounding cylinder
+	FLOAT									nearDistance; // Instances nearer the eye are drawn as meshes, not impostors
+	FLOAT									fadeRange; // Impostors fade in over this distance beyond nearDistance
+	FLOAT									padding;
+};
+
+
 __declspec(align(16)) struct projMatrixStruct  {
 	DirectX::XMMATRIX						projMatrix;
 };
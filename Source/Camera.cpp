@@ -22,34 +22,28 @@ void Camera::initCBuffer(ID3D11Device *device){
 	cBufferCPU->projMatrix = getProjMatrix();
 	XMStoreFloat4(&(cBufferCPU->eyePos), getPos());
 
-	D3D11_BUFFER_DESC cbufferDesc;
-	D3D11_SUBRESOURCE_DATA cbufferInitData;
-	ZeroMemory(&cbufferDesc, sizeof(D3D11_BUFFER_DESC));
-	ZeroMemory(&cbufferInitData, sizeof(D3D11_SUBRESOURCE_DATA));
-	cbufferDesc.ByteWidth = sizeof(CBufferCamera);
-	cbufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	cbufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	cbufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cbufferInitData.pSysMem = cBufferCPU;
-	device->CreateBuffer(&cbufferDesc, &cbufferInitData, &cBufferGPU);
+	cBufferManager = CBufferManager::getDefault(device);
+	cBuffer = cBufferManager->add(cBufferCPU, sizeof(CBufferCamera), 1, CBufferLayout::PerFrame);
 }
 
 Camera::~Camera()
 {
 }
+// Refresh the CPU cbuffer.  The GPU copy is only uploaded (by the cbuffer manager at the start of the frame) if the camera has moved
 void Camera::update(ID3D11DeviceContext *context) {
+	if (!cBufferCPU)
+		return;
+	CBufferCamera previous = *cBufferCPU;
 	cBufferCPU->viewMatrix = getViewMatrix();
 	cBufferCPU->projMatrix = getProjMatrix();
 	XMStoreFloat4(&(cBufferCPU->eyePos), getPos());
 
-	mapCbuffer(context, cBufferCPU, cBufferGPU, sizeof(CBufferCamera));
-	context->PSSetConstantBuffers(1, 1, &cBufferGPU);
-	context->VSSetConstantBuffers(1, 1, &cBufferGPU);
-
+	if (memcmp(&previous, cBufferCPU, sizeof(CBufferCamera)) != 0)
+		cBufferManager->markDirty(cBuffer);
 }
 
 ID3D11Buffer* Camera::getCBuffer() {
-	return cBufferGPU;
+	return cBufferManager ? cBufferManager->getBuffer(cBuffer) : nullptr;
 }
 
 //
@@ -73,6 +67,12 @@ DirectX::XMMATRIX Camera::getViewMatrix() {
 DirectX::XMMATRIX Camera::getProjMatrix() {
 	return 		projMatrix;
 }
+DirectX::BoundingFrustum Camera::getFrustum() {
+	DirectX::BoundingFrustum frustum(projMatrix);
+	DirectX::XMVECTOR det;
+	frustum.Transform(frustum, DirectX::XMMatrixInverse(&det, getViewMatrix()));
+	return frustum;
+}
 DirectX::XMVECTOR Camera::getPos() {
 	return pos;
 }
@@ -1,7 +1,9 @@
 #pragma once
 #include <DirectXMath.h>
+#include <DirectXCollision.h>
 #include<CBufferStructures.h>
 #include<Utils.h>
+#include<CBufferManager.h>
 class Camera
 {
 protected:
@@ -9,8 +11,10 @@ protected:
 	DirectX::XMVECTOR up;
 	DirectX::XMVECTOR lookAt;
 	DirectX::XMMATRIX projMatrix;
-	ID3D11Buffer					*cBufferGPU = nullptr;
 	CBufferCamera					*cBufferCPU = nullptr;
+	// GPU copy of cBufferCPU (register b1, bound once per frame by the cbuffer manager)
+	CBufferManager					*cBufferManager = nullptr;
+	int								cBuffer = -1;
 	void Camera::initCBuffer(ID3D11Device *device);
 public:
 	Camera();
@@ -29,6 +33,8 @@ public:
 	DirectX::XMVECTOR getLookAt();
 	DirectX::XMVECTOR getUp();
 	ID3D11Buffer* getCBuffer();
+	// View frustum in world space (for culling)
+	DirectX::BoundingFrustum getFrustum();
 
 
 
@@ -0,0 +1,147 @@
+#include "stdafx.h"
+#include "CommandRecorder.h"
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+typedef chrono::high_resolution_clock RecordClock;
+
+static double millisecondsSince(const RecordClock::time_point &start)
+{
+	return chrono::duration<double, milli>(RecordClock::now() - start).count();
+}
+
+
+CommandRecorder::CommandRecorder(ID3D11Device *_device, JobSystem *_jobSystem)
+{
+	device = _device;
+	jobSystem = _jobSystem ? _jobSystem : JobSystem::getDefault();
+
+	if (device) {
+		// Without driver command lists the runtime emulates them - recording still runs in parallel but executing costs more
+		D3D11_FEATURE_DATA_THREADING threading;
+		if (SUCCEEDED(device->CheckFeatureSupport(D3D11_FEATURE_THREADING, &threading, sizeof(threading))))
+			driverCommandLists = threading.DriverCommandLists != FALSE;
+
+		for (UINT i = 0; i < jobSystem->getNumThreads(); i++) {
+			ID3D11DeviceContext *deferredContext = nullptr;
+			if (!SUCCEEDED(device->CreateDeferredContext(0, &deferredContext))) {
+				cout << "CommandRecorder: cannot create deferred context " << i << " - the device must not be created single threaded" << endl;
+				break;
+			}
+			deferredContexts.push_back(deferredContext);
+		}
+	}
+}
+
+CommandRecorder::~CommandRecorder()
+{
+	for (size_t i = 0; i < jobs.size(); i++)
+		if (jobs[i].commandList)
+			jobs[i].commandList->Release();
+	for (size_t i = 0; i < deferredContexts.size(); i++)
+		deferredContexts[i]->Release();
+}
+
+
+void CommandRecorder::begin(const RecordFn &_setup)
+{
+	setup = _setup;
+	jobs.clear();
+}
+
+void CommandRecorder::addJob(const string &name, const RecordFn &record)
+{
+	Job job;
+	job.name = name;
+	job.record = record;
+	jobs.push_back(job);
+}
+
+
+void CommandRecorder::recordJob(Job &job, UINT worker)
+{
+	ID3D11DeviceContext *context = getDeferredContext(worker);
+	RecordClock::time_point start = RecordClock::now();
+
+	if (setup)
+		setup(context);
+	job.record(context);
+
+	// FALSE - the deferred context starts the next job from default state rather than restoring this job's state
+	if (context && !SUCCEEDED(context->FinishCommandList(FALSE, &job.commandList)))
+		job.commandList = nullptr;
+
+	job.recordTime = millisecondsSince(start);
+	job.worker = worker;
+}
+
+
+HRESULT CommandRecorder::execute(ID3D11DeviceContext *immediateContext)
+{
+	if (jobs.empty())
+		return S_OK;
+
+	RecordClock::time_point start = RecordClock::now();
+
+	// Each job records into the deferred context of the worker that runs it.  A worker runs one job at a time and recording jobs never
+	// wait, so no two jobs share a context.  If a worker has no context (or the caller is not a worker) the jobs are recorded serially
+	// into worker 0's context
+	int caller = jobSystem->currentWorker();
+	if (caller >= 0 && (!device || deferredContexts.size() == jobSystem->getNumThreads())) {
+		jobSystem->parallelFor(0, jobs.size(), 1, [this](size_t first, size_t last) {
+			UINT worker = (UINT)jobSystem->currentWorker();
+			for (size_t i = first; i < last; i++)
+				recordJob(jobs[i], worker);
+		});
+	}
+	else {
+		for (size_t i = 0; i < jobs.size(); i++)
+			recordJob(jobs[i], 0);
+	}
+
+	Stats stats;
+	stats.wallTime = millisecondsSince(start);
+	stats.numJobs = (UINT)jobs.size();
+
+	// Play the command lists back in submission order
+	HRESULT hr = S_OK;
+	start = RecordClock::now();
+	lastFrameJobs.clear();
+	for (size_t i = 0; i < jobs.size(); i++) {
+		Job &job = jobs[i];
+		if (job.commandList) {
+			immediateContext->ExecuteCommandList(job.commandList, FALSE);
+			job.commandList->Release();
+			job.commandList = nullptr;
+		}
+		else if (device)
+			hr = E_FAIL;
+		stats.jobTime += job.recordTime;
+		lastFrameJobs.push_back(make_pair(job.name, job.recordTime));
+	}
+	stats.executeTime = millisecondsSince(start);
+
+	lastFrameStats = stats;
+	totalStats.wallTime += stats.wallTime;
+	totalStats.jobTime += stats.jobTime;
+	totalStats.executeTime += stats.executeTime;
+	totalStats.numJobs += stats.numJobs;
+	numFrames++;
+
+	jobs.clear();
+	setup = nullptr;
+	return hr;
+}
+
+
+void CommandRecorder::reportData() const
+{
+	cout << "CommandRecorder: " << getNumThreads() << " job system workers, " << deferredContexts.size() << " deferred contexts" << (device ? (driverCommandLists ? " (driver command lists)" : " (emulated command lists)") : " (headless)") << endl;
+	cout << "Last frame: Jobs = " << lastFrameStats.numJobs << ", Record = " << lastFrameStats.wallTime << " ms (" << lastFrameStats.jobTime << " ms on one thread, scaling " << getLastFrameScaling() << "x), Execute = " << lastFrameStats.executeTime << " ms" << endl;
+	for (size_t i = 0; i < lastFrameJobs.size(); i++)
+		cout << "    " << lastFrameJobs[i].first << ": " << lastFrameJobs[i].second << " ms" << endl;
+	if (numFrames > 0 && totalStats.wallTime > 0.0)
+		cout << "Average per frame: Record = " << totalStats.wallTime / numFrames << " ms, Execute = " << totalStats.executeTime / numFrames << " ms, Scaling = " << totalStats.jobTime / totalStats.wallTime << "x" << endl;
+}
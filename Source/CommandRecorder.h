@@ -0,0 +1,87 @@
+//
+// CommandRecorder.h
+//
+
+// Multithreaded command recording.  A frame's draw submission is split into jobs (eg. the terrain, groups of trees, the particles)
+// which are recorded in parallel on the job system's workers, each worker into its own deferred context.  Every job is closed into its own command list and
+// execute() runs the lists on the immediate context in the order the jobs were added, so the frame draws exactly as it would if it
+// was recorded on one thread.  A command list starts from default pipeline state, so each job first runs the setup function given to
+// begin() (render targets, viewport, per-frame cbuffers).  Jobs may only read shared scene data - cbuffer uploads and anything else
+// the jobs depend on are done on the immediate context before execute().  execute() is called on a worker (normally the main thread,
+// worker 0), which records jobs too, so a job system with one thread records serially on the caller.
+//
+// Without a device (the headless backend) jobs are called with a null context and execute() only runs and times them, so the
+// scaling of the recording work across threads (serial job time / wall time) can be measured without D3D.
+#pragma once
+
+#include <d3d11_2.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <JobSystem.h>
+
+class CommandRecorder {
+
+public:
+
+	// Record draws into context (nullptr with the headless backend)
+	typedef std::function<void(ID3D11DeviceContext *context)> RecordFn;
+
+private:
+
+	struct Job {
+		std::string							name;
+		RecordFn							record;
+		ID3D11CommandList					*commandList = nullptr;
+		double								recordTime = 0.0; // ms
+		UINT								worker = 0;
+	};
+
+	struct Stats {
+		double								wallTime = 0.0; // ms from the start of recording until every job has been recorded
+		double								jobTime = 0.0; // Sum of the job record times (the time recording would take on one thread)
+		double								executeTime = 0.0; // ms spent in ExecuteCommandList
+		UINT								numJobs = 0;
+	};
+
+	ID3D11Device							*device = nullptr;
+	JobSystem								*jobSystem = nullptr;
+	// Deferred context of each job system worker.  Empty without a device
+	std::vector<ID3D11DeviceContext*>		deferredContexts;
+	bool									driverCommandLists = false;
+
+	RecordFn								setup;
+	std::vector<Job>						jobs;
+
+	// Statistics
+	Stats									lastFrameStats;
+	Stats									totalStats;
+	UINT									numFrames = 0;
+	std::vector<std::pair<std::string, double> >	lastFrameJobs;
+
+	// Record a job into the deferred context of the worker running it
+	void recordJob(Job &job, UINT worker);
+
+public:
+
+	// Jobs are recorded on jobSystem's workers (JobSystem::getDefault if null)
+	CommandRecorder(ID3D11Device *_device, JobSystem *_jobSystem = nullptr);
+	~CommandRecorder();
+
+	UINT getNumThreads() const { return jobSystem->getNumThreads(); };
+	// Deferred context a worker records into (eg. to register it with the cbuffer manager).  nullptr with the headless backend
+	ID3D11DeviceContext *getDeferredContext(UINT worker) const { return worker < deferredContexts.size() ? deferredContexts[worker] : nullptr; };
+
+	// Start a batch of jobs.  setup is called at the start of every job to set the state the job's draws depend on
+	void begin(const RecordFn &_setup);
+	void addJob(const std::string &name, const RecordFn &record);
+
+	// Record the jobs in parallel on the job system and execute their command lists on immediateContext in the order they were added.  Executing a command
+	// list clears the immediate context state, so the caller rebinds anything the following draws need.  Returns E_FAIL if a job's
+	// command list could not be created (its draws are missing from the frame)
+	HRESULT execute(ID3D11DeviceContext *immediateContext);
+
+	// Speed-up of the last frame's recording over recording it on one thread
+	double getLastFrameScaling() const { return lastFrameStats.wallTime > 0.0 ? lastFrameStats.jobTime / lastFrameStats.wallTime : 1.0; };
+	void reportData() const;
+};
@@ -18,95 +18,52 @@ void Effect::bindPipeline(ID3D11DeviceContext *context){
 
 void Effect::initDefaultStates(ID3D11Device *device ){
 	
-	// Rasteriser Stage
-
-	// Initialise default Rasteriser state
-	D3D11_RASTERIZER_DESC			RSdesc;
-	ZeroMemory(&RSdesc, sizeof(D3D11_RASTERIZER_DESC));
-	
-	// Add code here (Initialise default Rasteriser state)
-	// Setup default rasteriser state descriptor
-
-	RSdesc.FillMode = D3D11_FILL_SOLID;
-	RSdesc.CullMode = D3D11_CULL_NONE;  //disable culling
-	RSdesc.FrontCounterClockwise = FALSE;
-	RSdesc.DepthBias = 0;
-	RSdesc.SlopeScaledDepthBias = 0.0f;
-	RSdesc.DepthBiasClamp = 0.0f;
-	RSdesc.DepthClipEnable = TRUE;
-	RSdesc.ScissorEnable = FALSE;
-	RSdesc.MultisampleEnable = TRUE;
-	RSdesc.AntialiasedLineEnable = FALSE;
-	// Setup default rasteriser state
-
-	// Create Rasterizer State (RasterizerState) object based on the given descriptor
-	HRESULT hr = device->CreateRasterizerState(&RSdesc, &RasterizerState);
-
+	// Default states come from the state cache so every effect created with the defaults shares one object per stage.  The
+	// default descriptions themselves are defined in StateCache
+	StateCache *stateCache = StateCache::getDefault(device);
 
-	if (!SUCCEEDED(hr))
+	// Rasteriser Stage
+	RasterizerState = stateCache->getRasterizerState(StateCache::defaultRasterizerDesc());
+	if (!RasterizerState)
 		throw std::exception("Cannot create Rasterise state interface");
 
-
-
 	// Output - Merger Stage
-
-	// Initialise default depth-stencil state object
-	D3D11_DEPTH_STENCIL_DESC	dsDesc;
-	ZeroMemory(&dsDesc, sizeof(D3D11_DEPTH_STENCIL_DESC));
-
-	// Add code here (Initialise default depth-stencil state)
-	// Setup default depth-stencil descriptor
-
-
-	// Setup default depth-stencil descriptor
-	dsDesc.DepthEnable = TRUE;
-	dsDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
-	dsDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;		//render all objects in the scene
-	dsDesc.StencilEnable = FALSE;
-	dsDesc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
-	dsDesc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
-	dsDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-	dsDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
-	dsDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-	dsDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-	dsDesc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
-	dsDesc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
-	dsDesc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
-	dsDesc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
-
-
-	
-	// Create depth-stencil state object (DepthStencilState) based on the given descriptor
-	hr = device->CreateDepthStencilState(&dsDesc, &DepthStencilState);
-
-
-	if (!SUCCEEDED(hr))
+	DepthStencilState = stateCache->getDepthStencilState(StateCache::defaultDepthStencilDesc());
+	if (!DepthStencilState)
 		throw std::exception("Cannot create DepthStencil state interface");
 
-	// Initialise default blend state object (Alpha Blending On)
-	D3D11_BLEND_DESC	blendDesc;
-	ZeroMemory(&blendDesc, sizeof(D3D11_BLEND_DESC));
-
-	// Setup default blend state descriptor 
-	blendDesc.AlphaToCoverageEnable = FALSE; // Use pixel coverage info from rasteriser (default FALSE)
-	blendDesc.IndependentBlendEnable = FALSE; // The following array of render target blend properties uses the blend properties from RenderTarget[0] for ALL render targets
-	blendDesc.RenderTarget[0].BlendEnable = TRUE;
-	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
-	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ZERO;
-	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
-	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
-	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
-	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
-	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
-
-	// Create blendState object (BlendState) based on the given descriptor
-	hr = device->CreateBlendState(&blendDesc, &BlendState);
-	if (!SUCCEEDED(hr))
+	BlendState = stateCache->getBlendState(StateCache::defaultBlendDesc());
+	if (!BlendState)
 		throw std::exception("Cannot create Blend state interface");
 
 	blendFactor[0] = blendFactor[1] = blendFactor[2] = blendFactor[3] = 1.0f;
 	sampleMask = 0xFFFFFFFF; // Bitwise flags to determine which samples to process in an MSAA context
 }
+
+uint64_t Effect::computePipelineKey(const uint64_t shaderHashes[3], uint64_t vertexDescHash, const D3D11_RASTERIZER_DESC &RSdesc, const D3D11_DEPTH_STENCIL_DESC &dsDesc, const D3D11_BLEND_DESC &blendDesc)
+{
+	uint64_t parts[7] = { shaderHashes[0], shaderHashes[1], shaderHashes[2], vertexDescHash,
+		StateCache::hashDesc(RSdesc), StateCache::hashDesc(dsDesc), StateCache::hashDesc(blendDesc) };
+	return StateCache::hash(parts, sizeof(parts));
+}
+
+void Effect::updatePipelineKey()
+{
+	D3D11_RASTERIZER_DESC RSdesc;
+	D3D11_DEPTH_STENCIL_DESC dsDesc;
+	D3D11_BLEND_DESC blendDesc;
+	ZeroMemory(&RSdesc, sizeof(D3D11_RASTERIZER_DESC));
+	ZeroMemory(&dsDesc, sizeof(D3D11_DEPTH_STENCIL_DESC));
+	ZeroMemory(&blendDesc, sizeof(D3D11_BLEND_DESC));
+	if (RasterizerState)
+		RasterizerState->GetDesc(&RSdesc);
+	if (DepthStencilState)
+		DepthStencilState->GetDesc(&dsDesc);
+	if (BlendState)
+		BlendState->GetDesc(&blendDesc);
+	pipelineKey = computePipelineKey(shaderHashes, vertexDescHash, RSdesc, dsDesc, blendDesc);
+}
+
 Effect::Effect(ID3D11Device *device, ID3D11VertexShader	*_VertexShader, ID3D11PixelShader *_PixelShader, ID3D11InputLayout *_VSInputLayout)
 {
 	VertexShader = _VertexShader;
@@ -118,27 +75,107 @@ Effect::Effect(ID3D11Device *device, ID3D11VertexShader	*_VertexShader, ID3D11Pi
 	PixelShader->AddRef();
 	VSInputLayout->AddRef();
 
+	// No bytecode is available for pre-created objects so they are identified by address
+	shaderHashes[0] = (uint64_t)(UINT_PTR)VertexShader;
+	shaderHashes[1] = (uint64_t)(UINT_PTR)PixelShader;
+	shaderHashes[2] = 0;
+	vertexDescHash = (uint64_t)(UINT_PTR)VSInputLayout;
+	updatePipelineKey();
 }
 
 Effect::Effect(ID3D11Device *device, const char *vertexShaderPath, const char * pixelShaderPath, const D3D11_INPUT_ELEMENT_DESC vertexDesc[], UINT numVertexElements)
 {
-	char *tmpShaderBytecode = nullptr;
-
-	uint32_t tmpVSSizeBytes = CreateVertexShader(device, vertexShaderPath, &tmpShaderBytecode, &VertexShader);
+	// Bytecode is owned by the shader pack so there is nothing to free here
+	const void *tmpShaderBytecode = nullptr;
 
-	// Add code here (Create an input layout)
-	// Create an input layout object(VSInputLayout)
+	SIZE_T tmpVSSizeBytes = CreateVertexShader(device, vertexShaderPath, &tmpShaderBytecode, &VertexShader);
+	shaderHashes[0] = ShaderPack::hashBytecode(tmpShaderBytecode, tmpVSSizeBytes);
 
+	// Get the input layout object (VSInputLayout) from the state cache - effects with the same vertex description and vertex shader share it
+	VSInputLayout = StateCache::getDefault(device)->getInputLayout(vertexDesc, numVertexElements, tmpShaderBytecode, tmpVSSizeBytes);
+	vertexDescHash = StateCache::hashDesc(vertexDesc, numVertexElements);
 
-	device->CreateInputLayout(vertexDesc, numVertexElements, tmpShaderBytecode, tmpVSSizeBytes, &VSInputLayout);
+	const void *PSBytecode = nullptr;
+	SIZE_T PSSizeBytes = 0;
+	CreatePixelShader(device, pixelShaderPath, nullptr, &PixelShader);
+	ShaderPack::getDefault()->getBytecode(pixelShaderPath, &PSBytecode, &PSSizeBytes);
+	shaderHashes[1] = ShaderPack::hashBytecode(PSBytecode, PSSizeBytes);
+	shaderHashes[2] = 0;
 
-
-	CreatePixelShader(device, pixelShaderPath, &tmpShaderBytecode, &PixelShader);
 	initDefaultStates(device);
+	setSourceFiles(vertexShaderPath, pixelShaderPath, nullptr, vertexDesc, numVertexElements);
+	updatePipelineKey();
+}
+
+Effect::Effect(ID3D11VertexShader *_VertexShader, ID3D11PixelShader *_PixelShader, ID3D11GeometryShader *_GeometryShader, ID3D11InputLayout *_VSInputLayout,
+	ID3D11RasterizerState *_RasterizerState, ID3D11DepthStencilState *_DepthStencilState, ID3D11BlendState *_BlendState, const uint64_t _shaderHashes[3], uint64_t _vertexDescHash)
+{
+	VertexShader = _VertexShader;
+	PixelShader = _PixelShader;
+	GeometryShader = _GeometryShader;
+	VSInputLayout = _VSInputLayout;
+	RasterizerState = _RasterizerState;
+	DepthStencilState = _DepthStencilState;
+	BlendState = _BlendState;
+	blendFactor[0] = blendFactor[1] = blendFactor[2] = blendFactor[3] = 1.0f;
+	sampleMask = 0xFFFFFFFF;
+	for (int i = 0; i < 3; i++)
+		shaderHashes[i] = _shaderHashes[i];
+	vertexDescHash = _vertexDescHash;
+	updatePipelineKey();
 }
 
+void Effect::setSourceFiles(const char *_vertexShaderPath, const char *_pixelShaderPath, const char *_geometryShaderPath, const D3D11_INPUT_ELEMENT_DESC _vertexDesc[], UINT _numVertexElements)
+{
+	vertexShaderPath = _vertexShaderPath ? _vertexShaderPath : "";
+	pixelShaderPath = _pixelShaderPath ? _pixelShaderPath : "";
+	geometryShaderPath = _geometryShaderPath ? _geometryShaderPath : "";
+	vertexDesc = _vertexDesc;
+	numVertexElements = _numVertexElements;
+}
 
+// Replace a pipeline object, releasing the one it replaces
+template <class T> static void replaceObject(T **current, T *replacement)
+{
+	if (*current == replacement)
+		return;
+	if (*current)
+		(*current)->Release();
+	*current = replacement;
+}
 
+void Effect::setPixelShader(ID3D11PixelShader *_PixelShader, uint64_t hash){
+	replaceObject(&PixelShader, _PixelShader);
+	shaderHashes[1] = hash ? hash : (uint64_t)(UINT_PTR)PixelShader;
+	updatePipelineKey();
+}
+void Effect::setGeometryShader(ID3D11GeometryShader *_GeometryShader, uint64_t hash){
+	replaceObject(&GeometryShader, _GeometryShader);
+	shaderHashes[2] = hash ? hash : (uint64_t)(UINT_PTR)GeometryShader;
+	updatePipelineKey();
+}
+void Effect::setVertexShader(ID3D11VertexShader *_VertexShader, uint64_t hash){
+	replaceObject(&VertexShader, _VertexShader);
+	shaderHashes[0] = hash ? hash : (uint64_t)(UINT_PTR)VertexShader;
+	updatePipelineKey();
+}
+void Effect::setVSInputLayout(ID3D11InputLayout *_VSInputLayout, uint64_t hash){
+	replaceObject(&VSInputLayout, _VSInputLayout);
+	vertexDescHash = hash ? hash : (uint64_t)(UINT_PTR)VSInputLayout;
+	updatePipelineKey();
+}
+void Effect::setRasterizerState(ID3D11RasterizerState *_RasterizerState){
+	replaceObject(&RasterizerState, _RasterizerState);
+	updatePipelineKey();
+}
+void Effect::setDepthStencilState(ID3D11DepthStencilState *_DepthStencilState){
+	replaceObject(&DepthStencilState, _DepthStencilState);
+	updatePipelineKey();
+}
+void Effect::setBlendState(ID3D11BlendState *_BlendState){
+	replaceObject(&BlendState, _BlendState);
+	updatePipelineKey();
+}
 
 Effect::~Effect()
 {
@@ -152,86 +189,162 @@ Effect::~Effect()
 		VertexShader->Release();
 	if (PixelShader)
 		PixelShader->Release();
+	if (GeometryShader)
+		GeometryShader->Release();
+	if (HullShader)
+		HullShader->Release();
+	if (DomainShader)
+		DomainShader->Release();
 	if (VSInputLayout)
 		VSInputLayout->Release();
 }
 
-uint32_t Effect::CreateVertexShader(ID3D11Device *device, const char *filename, char **VSBytecode, ID3D11VertexShader **vertexShader){
+SIZE_T Effect::CreateVertexShader(ID3D11Device *device, const char *filename, const void **VSBytecode, ID3D11VertexShader **vertexShader){
 
 	cout << "Loading Vertex Shader" << endl;
-	// Add code here (Load compiled Vertex Shader bytecode and create the "ID3D11VertexShader" object)
-	
-	//Load the compiled vertex shader byte code.
-
-	uint32_t shaderBytes = LoadShader(filename, VSBytecode);
-	// Create the "ID3D11VertexShader" object
-
-	HRESULT hr = device->CreateVertexShader(*VSBytecode, shaderBytes, NULL, vertexShader);
 
+	// Get the compiled vertex shader byte code and the shared "ID3D11VertexShader" object from the shader pack
+	SIZE_T shaderBytes = 0;
+	HRESULT hr = ShaderPack::getDefault()->createVertexShader(device, filename, vertexShader, VSBytecode, &shaderBytes);
 
 	if (!SUCCEEDED(hr))
 		throw std::exception("Cannot create VertexShader interface");
 	return shaderBytes;
 }
 
-HRESULT Effect::CreatePixelShader(ID3D11Device *device, const char *filename, char **PSBytecode, ID3D11PixelShader **pixelShader)
+HRESULT Effect::CreatePixelShader(ID3D11Device *device, const char *filename, const void **PSBytecode, ID3D11PixelShader **pixelShader)
 {
 	// Initialise programmable pipeline stages  Pixel Shader
 	cout << "Loading Vertex Pixel" << endl;
 
-	//Load the compiled pixel shader byte code.
-	uint32_t shaderBytes = LoadShader(filename, PSBytecode);
-
-	// Create the "ID3D11PixelShader" object
-	HRESULT hr = device->CreatePixelShader(*PSBytecode, shaderBytes, NULL, pixelShader);
+	// Get the compiled pixel shader byte code and the shared "ID3D11PixelShader" object from the shader pack
+	HRESULT hr = ShaderPack::getDefault()->createPixelShader(device, filename, pixelShader, PSBytecode);
 
 	if (!SUCCEEDED(hr))
 		throw std::exception("Cannot create PixelShader interface");
 	return hr;
 }
-HRESULT Effect::CreateGeometryShader(ID3D11Device *device, const char *filename, char **GSBytecode, ID3D11GeometryShader **geometryShader)
+HRESULT Effect::CreateGeometryShader(ID3D11Device *device, const char *filename, const void **GSBytecode, ID3D11GeometryShader **geometryShader)
 {
-	//char *GSBytecodeLocal = nullptr;
-	//GSBytecode = &GSBytecodeLocal;
 	cout << "Loading Geometry Shader" << endl;
 
-	//Load the compiled shader byte code.
-	uint32_t shaderBytes = LoadShader(filename, GSBytecode);
-
-	cout << "Done: GShader memory bytes = " << shaderBytes << endl;
-	// Create shader objects
-	HRESULT hr = device->CreateGeometryShader(*GSBytecode, shaderBytes, NULL, geometryShader);
+	HRESULT hr = ShaderPack::getDefault()->createGeometryShader(device, filename, geometryShader, GSBytecode);
 	if (!SUCCEEDED(hr))
 		throw std::exception("Cannot create GeometryShader interface");
 	return hr;
 }
 
-HRESULT Effect::CreateHullShader(ID3D11Device *device, const char *filename, char **HSBytecode, ID3D11HullShader **hullShader)
+HRESULT Effect::CreateHullShader(ID3D11Device *device, const char *filename, const void **HSBytecode, ID3D11HullShader **hullShader)
 {
-	//char *HSBytecodeLocal = nullptr;
-	//HSBytecode = &HSBytecodeLocal;
-
 	cout << "Loading Hull Shader" << endl;
 
-	//Load the compiled shader byte code.
-	uint32_t shaderBytes = LoadShader(filename, HSBytecode);
-
-	// Create shader objects
-	HRESULT hr = device->CreateHullShader(*HSBytecode, shaderBytes, NULL, hullShader);
+	HRESULT hr = ShaderPack::getDefault()->createHullShader(device, filename, hullShader, HSBytecode);
 	if (!SUCCEEDED(hr))
 		throw std::exception("Cannot create hullShader interface");
 	return hr;
 }
 
-HRESULT Effect::CreateDomainShader(ID3D11Device *device, const char *filename, char **DSBytecode, ID3D11DomainShader **domainShader)
+HRESULT Effect::CreateDomainShader(ID3D11Device *device, const char *filename, const void **DSBytecode, ID3D11DomainShader **domainShader)
 {
 	cout << "Loading Domain Shader" << endl;
-	//Load the compiled shader byte code.
-	uint32_t shaderBytes = LoadShader(filename, DSBytecode);
 
-	// Create shader objects
-	HRESULT hr = device->CreateDomainShader(*DSBytecode, shaderBytes, NULL, domainShader);
+	HRESULT hr = ShaderPack::getDefault()->createDomainShader(device, filename, domainShader, DSBytecode);
 	if (!SUCCEEDED(hr))
 		throw std::exception("Cannot create hullShader interface");
 	return hr;
 }
+
+
+
+EffectBuilder::EffectBuilder(ID3D11Device *_device, StateCache *_stateCache, ShaderPack *_shaderPack)
+{
+	device = _device;
+	stateCache = _stateCache ? _stateCache : StateCache::getDefault(device);
+	shaderPack = _shaderPack ? _shaderPack : ShaderPack::getDefault();
+	RSdesc = StateCache::defaultRasterizerDesc();
+	dsDesc = StateCache::defaultDepthStencilDesc();
+	blendDesc = StateCache::defaultBlendDesc();
+}
+
+EffectBuilder &EffectBuilder::vertexShader(const char *path, const D3D11_INPUT_ELEMENT_DESC _vertexDesc[], UINT _numVertexElements)
+{
+	vertexShaderPath = path;
+	vertexDesc = _vertexDesc;
+	numVertexElements = _numVertexElements;
+	return *this;
+}
+
+EffectBuilder &EffectBuilder::pixelShader(const char *path)
+{
+	pixelShaderPath = path;
+	return *this;
+}
+
+EffectBuilder &EffectBuilder::geometryShader(const char *path)
+{
+	geometryShaderPath = path;
+	return *this;
+}
+
+EffectBuilder &EffectBuilder::alphaBlending(D3D11_BLEND srcBlend, D3D11_BLEND destBlend)
+{
+	blendDesc.RenderTarget[0].BlendEnable = TRUE;
+	blendDesc.RenderTarget[0].SrcBlend = srcBlend;
+	blendDesc.RenderTarget[0].DestBlend = destBlend;
+	return *this;
+}
+
+uint64_t EffectBuilder::shaderHash(const std::string &path) const
+{
+	const void *bytecode = nullptr;
+	SIZE_T size = 0;
+	if (path.empty() || !shaderPack->getBytecode(path.c_str(), &bytecode, &size))
+		return 0;
+	return ShaderPack::hashBytecode(bytecode, size);
+}
+
+uint64_t EffectBuilder::getPipelineKey() const
+{
+	uint64_t shaderHashes[3] = { shaderHash(vertexShaderPath), shaderHash(pixelShaderPath), shaderHash(geometryShaderPath) };
+	uint64_t vertexDescHash = vertexDesc ? StateCache::hashDesc(vertexDesc, numVertexElements) : 0;
+	return Effect::computePipelineKey(shaderHashes, vertexDescHash, RSdesc, dsDesc, blendDesc);
+}
+
+Effect *EffectBuilder::build() const
+{
+	if (vertexShaderPath.empty() || pixelShaderPath.empty() || !vertexDesc)
+		throw std::exception("EffectBuilder requires a vertex shader, vertex description and pixel shader");
+
+	ID3D11VertexShader *VS = nullptr;
+	ID3D11PixelShader *PS = nullptr;
+	ID3D11GeometryShader *GS = nullptr;
+	const void *VSBytecode = nullptr;
+	SIZE_T VSBytes = 0;
+
+	if (!SUCCEEDED(shaderPack->createVertexShader(device, vertexShaderPath.c_str(), &VS, &VSBytecode, &VSBytes)))
+		throw std::exception("Cannot create VertexShader interface");
+	if (!SUCCEEDED(shaderPack->createPixelShader(device, pixelShaderPath.c_str(), &PS))) {
+		VS->Release();
+		throw std::exception("Cannot create PixelShader interface");
+	}
+	if (!geometryShaderPath.empty() && !SUCCEEDED(shaderPack->createGeometryShader(device, geometryShaderPath.c_str(), &GS))) {
+		VS->Release();
+		PS->Release();
+		throw std::exception("Cannot create GeometryShader interface");
+	}
+
+	uint64_t shaderHashes[3] = { ShaderPack::hashBytecode(VSBytecode, VSBytes), shaderHash(pixelShaderPath), shaderHash(geometryShaderPath) };
+
+	// The Effect takes ownership of these references (and releases any that could not be created) so a failed state is reported
+	// after the Effect is deleted
+	Effect *effect = new Effect(VS, PS, GS, stateCache->getInputLayout(vertexDesc, numVertexElements, VSBytecode, VSBytes),
+		stateCache->getRasterizerState(RSdesc), stateCache->getDepthStencilState(dsDesc), stateCache->getBlendState(blendDesc),
+		shaderHashes, StateCache::hashDesc(vertexDesc, numVertexElements));
+
+	if (!effect->getVSInputLayout() || !effect->getRasterizerState() || !effect->getDepthStencilState() || !effect->getBlendState()) {
+		delete effect;
+		throw std::exception("Cannot create Effect pipeline state");
+	}
+	effect->setSourceFiles(vertexShaderPath.c_str(), pixelShaderPath.c_str(), geometryShaderPath.c_str(), vertexDesc, numVertexElements);
+	return effect;
+}
@@ -1,5 +1,8 @@
 #pragma once
 #include <Utils.h>
+#include <ShaderPack.h>
+#include <StateCache.h>
+#include <string>
 
 class Effect
 {
@@ -19,6 +22,22 @@ class Effect
 	ID3D11BlendState						*BlendState = nullptr;
 	FLOAT			blendFactor[4];
 	UINT			sampleMask;
+
+	// Hash of the full pipeline description (shaders, input layout and states) - effects with equal keys set up identical pipelines
+	uint64_t		pipelineKey = 0;
+	// Content hashes of the shader bytecode and vertex description (or object addresses for shaders passed in pre-created)
+	uint64_t		shaderHashes[3];
+	uint64_t		vertexDescHash = 0;
+
+	// Shader files and vertex description the effect was created from (empty for effects created from pre-loaded shaders).  Used by
+	// ShaderReloader to recompile and swap the shaders
+	std::string								vertexShaderPath;
+	std::string								pixelShaderPath;
+	std::string								geometryShaderPath;
+	const D3D11_INPUT_ELEMENT_DESC			*vertexDesc = nullptr;
+	UINT									numVertexElements = 0;
+
+	void updatePipelineKey();
 	
 public:
 	// Setup pipeline for this effect
@@ -33,6 +52,13 @@ public:
 	//Load shaders given shader path
 	Effect(ID3D11Device *device, const char *vertexShaderPath, const char *pixelShaderPath, const D3D11_INPUT_ELEMENT_DESC vertexDesc[], UINT numVertexElements);
 
+	// Used by EffectBuilder - takes ownership of the given references
+	Effect(ID3D11VertexShader *_VertexShader, ID3D11PixelShader *_PixelShader, ID3D11GeometryShader *_GeometryShader, ID3D11InputLayout *_VSInputLayout,
+		ID3D11RasterizerState *_RasterizerState, ID3D11DepthStencilState *_DepthStencilState, ID3D11BlendState *_BlendState, const uint64_t _shaderHashes[3], uint64_t _vertexDescHash);
+
+	// Combine the parts of a pipeline description into a single key
+	static uint64_t computePipelineKey(const uint64_t shaderHashes[3], uint64_t vertexDescHash, const D3D11_RASTERIZER_DESC &RSdesc, const D3D11_DEPTH_STENCIL_DESC &dsDesc, const D3D11_BLEND_DESC &blendDesc);
+
 	// Getter and setter methods
 	ID3D11InputLayout		*getVSInputLayout(){ return VSInputLayout; };
 	ID3D11VertexShader		*getVertexShader(){ return VertexShader; };
@@ -41,22 +67,82 @@ public:
 	ID3D11RasterizerState	*getRasterizerState(){ return RasterizerState; };
 	ID3D11DepthStencilState	*getDepthStencilState(){ return DepthStencilState; };
 	ID3D11BlendState		*getBlendState(){ return BlendState; };
+	uint64_t				getPipelineKey(){ return pipelineKey; };
+	const std::string		&getVertexShaderPath(){ return vertexShaderPath; };
+	const std::string		&getPixelShaderPath(){ return pixelShaderPath; };
+	const std::string		&getGeometryShaderPath(){ return geometryShaderPath; };
+	const D3D11_INPUT_ELEMENT_DESC *getVertexDesc(){ return vertexDesc; };
+	UINT					getNumVertexElements(){ return numVertexElements; };
+
+	// Record the files the shaders were loaded from.  vertexDesc must outlive the effect (the descriptions in VertexStructures.h are static)
+	void setSourceFiles(const char *_vertexShaderPath, const char *_pixelShaderPath, const char *_geometryShaderPath, const D3D11_INPUT_ELEMENT_DESC _vertexDesc[], UINT _numVertexElements);
 
-	void setPixelShader(ID3D11PixelShader	*_PixelShader){ PixelShader = _PixelShader; };
-	void setGeometryShader(ID3D11GeometryShader	*_GeometryShader){ GeometryShader = _GeometryShader; };
-	void setVertexShader(ID3D11VertexShader	*_VertexShader){ VertexShader = _VertexShader; };
-	void setVSInputLayout(ID3D11InputLayout	*_VSInputLayout){ VSInputLayout = _VSInputLayout; };
-	void setRasterizerState(ID3D11RasterizerState	*_RasterizerState){ RasterizerState = _RasterizerState; };
-	void setDepthStencilState(ID3D11DepthStencilState	*_DepthStencilState){ DepthStencilState = _DepthStencilState; };
-	void setBlendState(ID3D11BlendState	*_BlendState){ BlendState = _BlendState; };
-
-	// Shader Creation Wrapper methods
-	uint32_t Effect::CreateVertexShader(ID3D11Device *device, const char *filename, char **VSBytecode, ID3D11VertexShader **vertexShader);
-	HRESULT Effect::CreatePixelShader(ID3D11Device *device, const char *filename, char **PSBytecode, ID3D11PixelShader **pixelShader);
-	HRESULT Effect::CreateGeometryShader(ID3D11Device *device, const char *filename, char **GSBytecode, ID3D11GeometryShader **geometryShader);
-	HRESULT Effect::CreateHullShader(ID3D11Device *device, const char *filename, char **GSBytecode, ID3D11HullShader **hullShader);
-	HRESULT Effect::CreateDomainShader(ID3D11Device *device, const char *filename, char **GSBytecode, ID3D11DomainShader **domainShader);
+	// Setters take ownership of the given reference and release the object they replace.  hash identifies the shader bytecode (or
+	// vertex description) in the pipeline key - if 0 the object address is used
+	void setPixelShader(ID3D11PixelShader	*_PixelShader, uint64_t hash = 0);
+	void setGeometryShader(ID3D11GeometryShader	*_GeometryShader, uint64_t hash = 0);
+	void setVertexShader(ID3D11VertexShader	*_VertexShader, uint64_t hash = 0);
+	void setVSInputLayout(ID3D11InputLayout	*_VSInputLayout, uint64_t hash = 0);
+	void setRasterizerState(ID3D11RasterizerState	*_RasterizerState);
+	void setDepthStencilState(ID3D11DepthStencilState	*_DepthStencilState);
+	void setBlendState(ID3D11BlendState	*_BlendState);
+
+	// Shader Creation Wrapper methods.  Shaders come from the default ShaderPack; the returned bytecode belongs to the pack and must not be freed
+	SIZE_T Effect::CreateVertexShader(ID3D11Device *device, const char *filename, const void **VSBytecode, ID3D11VertexShader **vertexShader);
+	HRESULT Effect::CreatePixelShader(ID3D11Device *device, const char *filename, const void **PSBytecode, ID3D11PixelShader **pixelShader);
+	HRESULT Effect::CreateGeometryShader(ID3D11Device *device, const char *filename, const void **GSBytecode, ID3D11GeometryShader **geometryShader);
+	HRESULT Effect::CreateHullShader(ID3D11Device *device, const char *filename, const void **HSBytecode, ID3D11HullShader **hullShader);
+	HRESULT Effect::CreateDomainShader(ID3D11Device *device, const char *filename, const void **DSBytecode, ID3D11DomainShader **domainShader);
 
 	~Effect();
 };
 
+
+
+// Composes a complete pipeline description and builds an Effect from shared shaders (ShaderPack) and states (StateCache).  States start
+// from the Effect defaults and are modified through the builder, eg.
+//	Effect *e = EffectBuilder(device).vertexShader("vs.cso", desc, n).pixelShader("ps.cso").alphaBlending(D3D11_BLEND_ONE, D3D11_BLEND_ONE).build();
+class EffectBuilder
+{
+	ID3D11Device							*device = nullptr;
+	StateCache								*stateCache = nullptr;
+	ShaderPack								*shaderPack = nullptr;
+
+	std::string								vertexShaderPath;
+	std::string								pixelShaderPath;
+	std::string								geometryShaderPath;
+	const D3D11_INPUT_ELEMENT_DESC			*vertexDesc = nullptr;
+	UINT									numVertexElements = 0;
+
+	D3D11_RASTERIZER_DESC					RSdesc;
+	D3D11_DEPTH_STENCIL_DESC				dsDesc;
+	D3D11_BLEND_DESC						blendDesc;
+
+	uint64_t shaderHash(const std::string &path) const;
+
+public:
+	// stateCache and shaderPack default to StateCache::getDefault and ShaderPack::getDefault
+	EffectBuilder(ID3D11Device *_device, StateCache *_stateCache = nullptr, ShaderPack *_shaderPack = nullptr);
+
+	EffectBuilder &vertexShader(const char *path, const D3D11_INPUT_ELEMENT_DESC _vertexDesc[], UINT _numVertexElements);
+	EffectBuilder &pixelShader(const char *path);
+	EffectBuilder &geometryShader(const char *path);
+
+	// Replace a whole state description
+	EffectBuilder &rasterizer(const D3D11_RASTERIZER_DESC &desc){ RSdesc = desc; return *this; };
+	EffectBuilder &depthStencil(const D3D11_DEPTH_STENCIL_DESC &desc){ dsDesc = desc; return *this; };
+	EffectBuilder &blend(const D3D11_BLEND_DESC &desc){ blendDesc = desc; return *this; };
+
+	// Common changes to the default states
+	EffectBuilder &alphaBlending(D3D11_BLEND srcBlend, D3D11_BLEND destBlend);
+	EffectBuilder &alphaToCoverage(BOOL enable){ blendDesc.AlphaToCoverageEnable = enable; return *this; };
+	EffectBuilder &depthWrite(BOOL enable){ dsDesc.DepthWriteMask = enable ? D3D11_DEPTH_WRITE_MASK_ALL : D3D11_DEPTH_WRITE_MASK_ZERO; return *this; };
+	EffectBuilder &depthFunc(D3D11_COMPARISON_FUNC func){ dsDesc.DepthFunc = func; return *this; };
+	EffectBuilder &cullMode(D3D11_CULL_MODE mode){ RSdesc.CullMode = mode; return *this; };
+
+	// Key of the described pipeline (equal to getPipelineKey() of the built Effect)
+	uint64_t getPipelineKey() const;
+
+	// Create the Effect.  Throws if a shader or state cannot be created (as the Effect constructors do)
+	Effect *build() const;
+};
@@ -0,0 +1,166 @@
+#include "stdafx.h"
+#include "FlareBatch.h"
+
+using namespace std;
+
+
+HRESULT FlareBatch::init(ID3D11Device *device)
+{
+	try
+	{
+		if (!device || !effect || maxFlares == 0)
+			throw exception("Invalid parameters for flare batch instantiation");
+
+		// Quad corners shared by every flare instance (drawn as a triangle strip)
+		XMFLOAT2 corners[] = {
+
+			XMFLOAT2(-1.0f, -1.0f),
+			XMFLOAT2(-1.0f, 1.0f),
+			XMFLOAT2(1.0f, -1.0f),
+			XMFLOAT2(1.0f, 1.0f)
+		};
+
+		// Setup corner vertex buffer
+		D3D11_BUFFER_DESC vertexDesc;
+		D3D11_SUBRESOURCE_DATA vertexData;
+
+		ZeroMemory(&vertexDesc, sizeof(D3D11_BUFFER_DESC));
+		ZeroMemory(&vertexData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+		vertexDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		vertexDesc.ByteWidth = sizeof(XMFLOAT2) * 4;
+		vertexDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexData.pSysMem = corners;
+
+		HRESULT hr = device->CreateBuffer(&vertexDesc, &vertexData, &vertexBuffer);
+
+		if (!SUCCEEDED(hr))
+			throw exception("Flare corner buffer cannot be created");
+
+		// Setup instance buffer large enough for maxFlares - rewritten on the GPU only when flares change
+		D3D11_BUFFER_DESC instanceDesc;
+		ZeroMemory(&instanceDesc, sizeof(D3D11_BUFFER_DESC));
+
+		instanceDesc.Usage = D3D11_USAGE_DEFAULT;
+		instanceDesc.ByteWidth = sizeof(FlareInstanceStruct) * maxFlares;
+		instanceDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+		hr = device->CreateBuffer(&instanceDesc, NULL, &instanceBuffer);
+
+		if (!SUCCEEDED(hr))
+			throw exception("Flare instance buffer cannot be created");
+
+		// Changed instances are staged in the shared upload heap
+		uploadHeap = UploadHeap::getDefault(device);
+
+		flares.reserve(maxFlares);
+	}
+	catch (exception& e)
+	{
+		cout << "Flare batch could not be instantiated due to:\n";
+		cout << e.what() << endl;
+
+		if (vertexBuffer)
+			vertexBuffer->Release();
+		if (instanceBuffer)
+			instanceBuffer->Release();
+
+		vertexBuffer = nullptr;
+		instanceBuffer = nullptr;
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+
+FlareBatch::~FlareBatch()
+{
+	if (instanceBuffer)
+		instanceBuffer->Release();
+}
+
+
+int FlareBatch::addFlare(XMFLOAT3 position, XMCOLOR colour, UINT slice)
+{
+	if (flares.size() >= maxFlares)
+		return -1;
+
+	FlareInstanceStruct flare = { position, colour, slice };
+	flares.push_back(flare);
+	dirty = true;
+	return (int)flares.size() - 1;
+}
+
+void FlareBatch::setFlarePos(int index, XMFLOAT3 position)
+{
+	flares[index].pos = position;
+	dirty = true;
+}
+
+void FlareBatch::setFlareColour(int index, XMCOLOR colour)
+{
+	flares[index].colour = colour;
+	dirty = true;
+}
+
+void FlareBatch::clear()
+{
+	flares.clear();
+	dirty = true;
+}
+
+
+void FlareBatch::uploadInstances(ID3D11DeviceContext *context)
+{
+	if (!dirty || flares.empty())
+		return;
+
+	// Stage the instances in the upload heap (closing the mapping before the copy) and copy them into instanceBuffer
+	UINT instanceBytes = (UINT)(flares.size() * sizeof(FlareInstanceStruct));
+	UploadHeap::Allocation staging;
+	if (!uploadHeap->allocate(context, instanceBytes, 16, &staging))
+		return;
+	memcpy(staging.data, flares.data(), instanceBytes);
+	uploadHeap->unmap(context);
+
+	if (staging.buffer) {
+		D3D11_BOX sourceBox = { staging.offset, 0, 0, staging.offset + instanceBytes, 1, 1 };
+		context->CopySubresourceRegion(instanceBuffer, 0, 0, 0, 0, staging.buffer, 0, &sourceBox);
+	}
+	dirty = false;
+}
+
+
+void FlareBatch::render(ID3D11DeviceContext *context)
+{
+	// Validate object before rendering (see notes in constructor)
+	if (!context || !vertexBuffer || !instanceBuffer || !uploadHeap || !effect || flares.empty())
+		return;
+
+	uploadInstances(context);
+
+	effect->bindPipeline(context);
+
+	// Bind the flare texture array and sampler to the PS stage of the pipeline
+	if (numTextures > 0 && sampler) {
+
+		context->PSSetShaderResources(0, numTextures, textures);
+		context->PSSetSamplers(0, 1, &sampler);
+	}
+
+	// Set vertex layout
+	context->IASetInputLayout(inputLayout);
+
+	// Set corner (slot 0) and instance (slot 1) buffers for IA
+	ID3D11Buffer* vertexBuffers[] = { vertexBuffer, instanceBuffer };
+	UINT vertexStrides[] = { sizeof(XMFLOAT2), sizeof(FlareInstanceStruct) };
+	UINT vertexOffsets[] = { 0, 0 };
+
+	context->IASetVertexBuffers(0, 2, vertexBuffers, vertexStrides, vertexOffsets);
+
+	// Set primitive topology for IA
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+	// One draw call for every flare in the batch
+	context->DrawInstanced(4, (UINT)flares.size(), 0, 0);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include<Utils.h>
+#include <BaseModel.h>
+#include<Effect.h>
+#include<VertexStructures.h>
+#include <UploadHeap.h>
+
+
+
+// Renders every lens flare in the scene with a single instanced draw.
+// The shared quad corners live in vertexBuffer (slot 0) and each flare is one FlareInstanceStruct in instanceBuffer (slot 1).  The
+// instance buffer is only rewritten when the flares change, by staging them in the upload heap and copying them across on the GPU.
+// The flare textures are expected as a single Texture2DArray and FlareInstanceStruct::slice selects the texture for each flare.
+class FlareBatch : public BaseModel {
+
+protected:
+
+	ID3D11Buffer						*instanceBuffer = nullptr;
+	std::vector<FlareInstanceStruct>	flares;
+	UINT								maxFlares = 0;
+	UploadHeap							*uploadHeap = nullptr;
+	// Set when flares has changed since instanceBuffer was written
+	bool								dirty = false;
+
+	void uploadInstances(ID3D11DeviceContext *context);
+
+public:
+	FlareBatch(UINT _maxFlares, ID3D11Device *device, Effect *_effect, Material *_materials[] = nullptr, int _numMaterials = 0, ID3D11ShaderResourceView **textures = nullptr, int numTextures = 0) : BaseModel(device, _effect, _materials, _numMaterials, textures, numTextures){ maxFlares = _maxFlares; init(device); }
+	~FlareBatch();
+
+	// Add a flare to the batch and return its index (-1 if the batch is full)
+	int addFlare(XMFLOAT3 position, XMCOLOR colour, UINT slice = 0);
+	void setFlarePos(int index, XMFLOAT3 position);
+	void setFlareColour(int index, XMCOLOR colour);
+	void clear();
+	UINT getNumFlares(){ return (UINT)flares.size(); };
+	UINT getMaxFlares(){ return maxFlares; };
+
+	void render(ID3D11DeviceContext *context);
+	HRESULT init(ID3D11Device *device);
+};
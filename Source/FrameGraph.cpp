@@ -0,0 +1,378 @@
+#include "stdafx.h"
+#include "FrameGraph.h"
+#include <algorithm>
+
+using namespace std;
+
+//
+// PassBuilder
+//
+
+FGResource FrameGraph::PassBuilder::create(const string &name, const FGTextureDesc &desc)
+{
+	Resource res;
+	res.name = name;
+	res.desc = desc;
+	graph->resources.push_back(res);
+	FGResource handle = (FGResource)graph->resources.size() - 1;
+	graph->passes[passIndex].creates.push_back(handle);
+	return handle;
+}
+
+FGResource FrameGraph::PassBuilder::read(FGResource res)
+{
+	if (res >= 0 && res < (FGResource)graph->resources.size())
+		graph->passes[passIndex].reads.push_back(res);
+	return res;
+}
+
+FGResource FrameGraph::PassBuilder::writeColour(FGResource res, const FLOAT *clearColour)
+{
+	Pass &pass = graph->passes[passIndex];
+	if (res < 0 || res >= (FGResource)graph->resources.size() || pass.numColourWrites >= maxColourTargets)
+		return FG_INVALID_RESOURCE;
+
+	int slot = pass.numColourWrites++;
+	pass.colourWrites[slot] = res;
+	pass.clearColour[slot] = (clearColour != nullptr);
+	for (int i = 0; i < 4; i++)
+		pass.clearColours[slot][i] = clearColour ? clearColour[i] : 0.0f;
+	return res;
+}
+
+FGResource FrameGraph::PassBuilder::writeDepth(FGResource res, bool clear)
+{
+	if (res < 0 || res >= (FGResource)graph->resources.size())
+		return FG_INVALID_RESOURCE;
+
+	graph->passes[passIndex].depthWrite = res;
+	graph->passes[passIndex].clearDepth = clear;
+	return res;
+}
+
+void FrameGraph::PassBuilder::setSideEffect()
+{
+	graph->passes[passIndex].sideEffect = true;
+}
+
+
+//
+// FrameGraph
+//
+
+FrameGraph::FrameGraph(RenderTargetPool *_pool)
+{
+	pool = _pool;
+}
+
+void FrameGraph::reset()
+{
+	resources.clear();
+	passes.clear();
+	executionOrder.clear();
+	physicalDescs.clear();
+	physicalFirstPass.clear();
+	physicalLastPass.clear();
+	compiled = false;
+}
+
+FGResource FrameGraph::importTexture(const string &name, UINT width, UINT height, ID3D11RenderTargetView *RTV, ID3D11DepthStencilView *DSV, ID3D11ShaderResourceView *SRV)
+{
+	Resource res;
+	res.name = name;
+	res.desc.width = width;
+	res.desc.height = height;
+	res.imported = true;
+	res.RTV = RTV;
+	res.DSV = DSV;
+	res.SRV = SRV;
+	resources.push_back(res);
+	return (FGResource)resources.size() - 1;
+}
+
+void FrameGraph::addPass(const string &name, const SetupFn &setup, const ExecuteFn &execute)
+{
+	Pass pass;
+	pass.name = name;
+	pass.execute = execute;
+	for (int i = 0; i < maxColourTargets; i++) {
+		pass.colourWrites[i] = FG_INVALID_RESOURCE;
+		pass.clearColour[i] = false;
+	}
+	passes.push_back(pass);
+	compiled = false;
+
+	PassBuilder builder(this, (int)passes.size() - 1);
+	if (setup)
+		setup(builder);
+}
+
+HRESULT FrameGraph::compile()
+{
+	executionOrder.clear();
+	physicalDescs.clear();
+	physicalFirstPass.clear();
+	physicalLastPass.clear();
+
+	for (size_t i = 0; i < resources.size(); i++) {
+		resources[i].producers.clear();
+		// Imported resources are consumed outside the graph so they are never culled
+		resources[i].refCount = resources[i].imported ? 1 : 0;
+		resources[i].firstPass = -1;
+		resources[i].lastPass = -1;
+		resources[i].physical = -1;
+	}
+
+	// Reference counts.  Passes are declared in execution order so every read must follow a write (or be of an imported resource)
+	for (size_t p = 0; p < passes.size(); p++) {
+
+		Pass &pass = passes[p];
+		pass.culled = false;
+		pass.refCount = 0;
+
+		for (size_t i = 0; i < pass.reads.size(); i++) {
+			Resource &res = resources[pass.reads[i]];
+			if (!res.imported && res.producers.empty()) {
+				cout << "FrameGraph: pass \"" << pass.name << "\" reads \"" << res.name << "\" before it is written\n";
+				return E_FAIL;
+			}
+			res.refCount++;
+		}
+		for (int i = 0; i < pass.numColourWrites; i++) {
+			resources[pass.colourWrites[i]].producers.push_back((int)p);
+			pass.refCount++;
+		}
+		if (pass.depthWrite != FG_INVALID_RESOURCE) {
+			resources[pass.depthWrite].producers.push_back((int)p);
+			pass.refCount++;
+		}
+		for (size_t i = 0; i < pass.creates.size(); i++) {
+			if (find(resources[pass.creates[i]].producers.begin(), resources[pass.creates[i]].producers.end(), (int)p) == resources[pass.creates[i]].producers.end()) {
+				cout << "FrameGraph: pass \"" << pass.name << "\" creates \"" << resources[pass.creates[i]].name << "\" but does not write it\n";
+				return E_FAIL;
+			}
+		}
+	}
+
+	// Cull - a pass with no consumed outputs is removed and releases its inputs, which may in turn leave their producers unused
+	vector<FGResource> unreferenced;
+	vector<int> culledPasses;
+	for (size_t p = 0; p < passes.size(); p++)
+		if (passes[p].refCount == 0 && !passes[p].sideEffect)
+			culledPasses.push_back((int)p);
+	for (size_t i = 0; i < resources.size(); i++)
+		if (resources[i].refCount == 0)
+			unreferenced.push_back((FGResource)i);
+
+	while (!culledPasses.empty() || !unreferenced.empty()) {
+
+		if (!culledPasses.empty()) {
+
+			Pass &pass = passes[culledPasses.back()];
+			culledPasses.pop_back();
+			pass.culled = true;
+			for (size_t i = 0; i < pass.reads.size(); i++)
+				if (--resources[pass.reads[i]].refCount == 0)
+					unreferenced.push_back(pass.reads[i]);
+		}
+		else {
+
+			Resource &res = resources[unreferenced.back()];
+			unreferenced.pop_back();
+			for (size_t i = 0; i < res.producers.size(); i++) {
+				Pass &producer = passes[res.producers[i]];
+				if (!producer.culled && --producer.refCount == 0 && !producer.sideEffect)
+					culledPasses.push_back(res.producers[i]);
+			}
+		}
+	}
+
+	for (size_t p = 0; p < passes.size(); p++)
+		if (!passes[p].culled)
+			executionOrder.push_back((int)p);
+
+	// Lifetimes (measured in positions in executionOrder)
+	for (size_t o = 0; o < executionOrder.size(); o++) {
+
+		const Pass &pass = passes[executionOrder[o]];
+		vector<FGResource> used(pass.reads);
+		used.insert(used.end(), pass.colourWrites, pass.colourWrites + pass.numColourWrites);
+		if (pass.depthWrite != FG_INVALID_RESOURCE)
+			used.push_back(pass.depthWrite);
+
+		for (size_t i = 0; i < used.size(); i++) {
+			Resource &res = resources[used[i]];
+			if (res.firstPass < 0)
+				res.firstPass = (int)o;
+			res.lastPass = (int)o;
+		}
+	}
+
+	// Alias - transients are visited in order of first use and take the first physical texture with the same description that is
+	// free by then
+	for (size_t o = 0; o < executionOrder.size(); o++) {
+
+		const Pass &pass = passes[executionOrder[o]];
+		for (size_t i = 0; i < pass.creates.size(); i++) {
+
+			Resource &res = resources[pass.creates[i]];
+			for (size_t s = 0; s < physicalDescs.size() && res.physical < 0; s++)
+				if (physicalDescs[s] == res.desc && physicalLastPass[s] < res.firstPass)
+					res.physical = (int)s;
+
+			if (res.physical < 0) {
+				res.physical = (int)physicalDescs.size();
+				physicalDescs.push_back(res.desc);
+				physicalFirstPass.push_back(res.firstPass);
+				physicalLastPass.push_back(-1);
+			}
+			physicalLastPass[res.physical] = res.lastPass;
+		}
+	}
+
+	compiled = true;
+	return S_OK;
+}
+
+HRESULT FrameGraph::execute(ID3D11DeviceContext *context)
+{
+	if (!compiled || !context || !pool)
+		return E_FAIL;
+
+	HRESULT hr = S_OK;
+	vector<PooledRenderTarget*> physicalTargets(physicalDescs.size(), nullptr);
+
+	for (size_t o = 0; o < executionOrder.size() && SUCCEEDED(hr); o++) {
+
+		Pass &pass = passes[executionOrder[o]];
+
+		// Acquire the physical textures first used by this pass
+		for (size_t s = 0; s < physicalDescs.size(); s++) {
+			if (physicalFirstPass[s] == (int)o) {
+				physicalTargets[s] = pool->acquire(physicalDescs[s]);
+				if (!physicalTargets[s])
+					hr = E_FAIL;
+			}
+		}
+		if (!SUCCEEDED(hr))
+			break;
+
+		for (size_t i = 0; i < pass.creates.size(); i++) {
+			Resource &res = resources[pass.creates[i]];
+			PooledRenderTarget *target = physicalTargets[res.physical];
+			res.SRV = target->SRV;
+			res.RTV = target->RTV;
+			res.DSV = target->DSV;
+		}
+
+		// Bind outputs and set the viewport to cover the first output
+		if (pass.numColourWrites > 0 || pass.depthWrite != FG_INVALID_RESOURCE) {
+
+			ID3D11RenderTargetView *RTVs[maxColourTargets] = { 0 };
+			for (int i = 0; i < pass.numColourWrites; i++)
+				RTVs[i] = resources[pass.colourWrites[i]].RTV;
+			ID3D11DepthStencilView *DSV = (pass.depthWrite != FG_INVALID_RESOURCE) ? resources[pass.depthWrite].DSV : nullptr;
+			context->OMSetRenderTargets(pass.numColourWrites, RTVs, DSV);
+
+			const FGTextureDesc &desc = resources[(pass.numColourWrites > 0) ? pass.colourWrites[0] : pass.depthWrite].desc;
+			D3D11_VIEWPORT viewport;
+			viewport.TopLeftX = 0;
+			viewport.TopLeftY = 0;
+			viewport.Width = (FLOAT)desc.width;
+			viewport.Height = (FLOAT)desc.height;
+			viewport.MinDepth = 0.0f;
+			viewport.MaxDepth = 1.0f;
+			context->RSSetViewports(1, &viewport);
+
+			for (int i = 0; i < pass.numColourWrites; i++)
+				if (pass.clearColour[i] && RTVs[i])
+					context->ClearRenderTargetView(RTVs[i], pass.clearColours[i]);
+			if (pass.clearDepth && DSV)
+				context->ClearDepthStencilView(DSV, D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
+		}
+
+		if (pass.execute)
+			pass.execute(context, *this);
+
+		// Release shader inputs so the next pass can write them
+		if (!pass.reads.empty()) {
+			ID3D11ShaderResourceView *nullSRV[8] = { 0 };
+			context->VSSetShaderResources(0, 8, nullSRV);
+			context->PSSetShaderResources(0, 8, nullSRV);
+		}
+
+		// Return physical textures whose last use was this pass
+		for (size_t s = 0; s < physicalDescs.size(); s++) {
+			if (physicalLastPass[s] == (int)o && physicalTargets[s]) {
+				pool->release(physicalTargets[s]);
+				physicalTargets[s] = nullptr;
+			}
+		}
+	}
+
+	// Return anything still held if a pass failed
+	for (size_t s = 0; s < physicalTargets.size(); s++)
+		if (physicalTargets[s])
+			pool->release(physicalTargets[s]);
+
+	// Views of released textures must not be used after this frame
+	for (size_t i = 0; i < resources.size(); i++) {
+		if (!resources[i].imported) {
+			resources[i].SRV = nullptr;
+			resources[i].RTV = nullptr;
+			resources[i].DSV = nullptr;
+		}
+	}
+
+	return hr;
+}
+
+ID3D11ShaderResourceView *FrameGraph::getSRV(FGResource res) const
+{
+	return (res >= 0 && res < (FGResource)resources.size()) ? resources[res].SRV : nullptr;
+}
+
+ID3D11RenderTargetView *FrameGraph::getRTV(FGResource res) const
+{
+	return (res >= 0 && res < (FGResource)resources.size()) ? resources[res].RTV : nullptr;
+}
+
+ID3D11DepthStencilView *FrameGraph::getDSV(FGResource res) const
+{
+	return (res >= 0 && res < (FGResource)resources.size()) ? resources[res].DSV : nullptr;
+}
+
+int FrameGraph::getNumTransients() const
+{
+	int n = 0;
+	for (size_t i = 0; i < resources.size(); i++)
+		if (!resources[i].imported && resources[i].physical >= 0)
+			n++;
+	return n;
+}
+
+UINT64 FrameGraph::getTransientBytes() const
+{
+	UINT64 bytes = 0;
+	for (size_t i = 0; i < resources.size(); i++)
+		if (!resources[i].imported && resources[i].physical >= 0)
+			bytes += RenderTargetPool::targetBytes(resources[i].desc);
+	return bytes;
+}
+
+UINT64 FrameGraph::getAliasedBytes() const
+{
+	UINT64 bytes = 0;
+	for (size_t i = 0; i < physicalDescs.size(); i++)
+		bytes += RenderTargetPool::targetBytes(physicalDescs[i]);
+	return bytes;
+}
+
+void FrameGraph::reportCompileData() const
+{
+	cout << "FrameGraph: " << getNumPasses() << " passes (" << getNumCulledPasses() << " culled), ";
+	cout << getNumTransients() << " transients in " << getNumPhysicalTextures() << " textures, ";
+	cout << getAliasedBytes() / 1024 << "KB (" << getTransientBytes() / 1024 << "KB without aliasing)\n";
+	for (size_t o = 0; o < executionOrder.size(); o++)
+		cout << "  " << o << ": " << passes[executionOrder[o]].name << endl;
+}
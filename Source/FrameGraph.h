@@ -0,0 +1,132 @@
+//
+// FrameGraph.h
+//
+
+// Frame graph - each frame the renderer declares its passes in execution order together with the resources every pass reads and writes.
+// compile() culls passes whose output is never consumed, computes the lifetime of each transient texture and aliases transients with
+// matching descriptions and non-overlapping lifetimes onto the same physical texture.  compile() only touches descriptions so it can be
+// run and validated without a device.  execute() acquires each physical texture from the RenderTargetPool before its first use and
+// returns it after its last, binds each pass's render targets, depth buffer and viewport, performs the requested clears and then calls
+// the pass, so passes no longer save and restore pipeline state.
+#pragma once
+
+#include <d3d11_2.h>
+#include <string>
+#include <vector>
+#include <functional>
+#include <RenderTargetPool.h>
+
+// Handle to a resource declared in the current frame (index into the graph's resource list)
+typedef int FGResource;
+static const FGResource FG_INVALID_RESOURCE = -1;
+
+// Description of a transient texture.  Two transients may alias only if their descriptions are equal
+typedef RenderTargetDesc FGTextureDesc;
+
+class FrameGraph {
+
+public:
+
+	// Passed to a pass's setup function to declare the resources it uses
+	class PassBuilder {
+		FrameGraph							*graph;
+		int									passIndex;
+	public:
+		PassBuilder(FrameGraph *_graph, int _passIndex) : graph(_graph), passIndex(_passIndex) {};
+		// Declare a transient texture owned by this pass (the pass must also write it)
+		FGResource create(const std::string &name, const FGTextureDesc &desc);
+		// Read a resource as a shader resource
+		FGResource read(FGResource res);
+		// Write a resource as a render target.  clearColour != nullptr clears the target before the pass runs
+		FGResource writeColour(FGResource res, const FLOAT *clearColour = nullptr);
+		// Write a resource as the depth stencil buffer
+		FGResource writeDepth(FGResource res, bool clear = false);
+		// Keep the pass even if nothing reads its output
+		void setSideEffect();
+	};
+
+	typedef std::function<void(PassBuilder&)> SetupFn;
+	typedef std::function<void(ID3D11DeviceContext*, const FrameGraph&)> ExecuteFn;
+
+private:
+
+	static const int						maxColourTargets = 4;
+
+	struct Resource {
+		std::string							name;
+		FGTextureDesc						desc;
+		bool								imported = false;
+		// Views - set on import or when the physical texture is assigned in execute()
+		ID3D11ShaderResourceView			*SRV = nullptr;
+		ID3D11RenderTargetView				*RTV = nullptr;
+		ID3D11DepthStencilView				*DSV = nullptr;
+		// Compile results
+		std::vector<int>					producers;
+		int									refCount = 0;
+		int									firstPass = -1;
+		int									lastPass = -1;
+		int									physical = -1;
+	};
+
+	struct Pass {
+		std::string							name;
+		ExecuteFn							execute;
+		std::vector<FGResource>				creates;
+		std::vector<FGResource>				reads;
+		FGResource							colourWrites[maxColourTargets];
+		FLOAT								clearColours[maxColourTargets][4];
+		bool								clearColour[maxColourTargets];
+		int									numColourWrites = 0;
+		FGResource							depthWrite = FG_INVALID_RESOURCE;
+		bool								clearDepth = false;
+		bool								sideEffect = false;
+		int									refCount = 0;
+		bool								culled = false;
+	};
+
+	RenderTargetPool						*pool = nullptr;
+	std::vector<Resource>					resources;
+	std::vector<Pass>						passes;
+	std::vector<int>						executionOrder;
+	// Descriptions and first / last use (position in executionOrder) of the physical textures needed by the compiled frame
+	// (index = Resource::physical)
+	std::vector<FGTextureDesc>				physicalDescs;
+	std::vector<int>						physicalFirstPass;
+	std::vector<int>						physicalLastPass;
+	bool									compiled = false;
+
+public:
+
+	FrameGraph(RenderTargetPool *_pool);
+
+	// Start declaring a new frame
+	void reset();
+
+	// Add an externally owned render target, depth buffer or texture.  Passes writing imported resources are never culled
+	FGResource importTexture(const std::string &name, UINT width, UINT height, ID3D11RenderTargetView *RTV, ID3D11DepthStencilView *DSV = nullptr, ID3D11ShaderResourceView *SRV = nullptr);
+
+	// Declare a pass.  setup is called immediately to declare the pass's resources; execute is called from execute() if the pass survives culling
+	void addPass(const std::string &name, const SetupFn &setup, const ExecuteFn &execute);
+
+	// Cull, order and alias.  Returns E_FAIL if a pass reads a resource that no earlier pass writes
+	HRESULT compile();
+
+	// Run the compiled passes
+	HRESULT execute(ID3D11DeviceContext *context);
+
+	// View accessors for use inside pass execute functions
+	ID3D11ShaderResourceView *getSRV(FGResource res) const;
+	ID3D11RenderTargetView *getRTV(FGResource res) const;
+	ID3D11DepthStencilView *getDSV(FGResource res) const;
+	const FGTextureDesc &getDesc(FGResource res) const { return resources[res].desc; };
+
+	// Compile statistics
+	int getNumPasses() const { return (int)passes.size(); };
+	int getNumCulledPasses() const { return (int)(passes.size() - executionOrder.size()); };
+	int getNumTransients() const;
+	int getNumPhysicalTextures() const { return (int)physicalDescs.size(); };
+	// Bytes the transients would need without aliasing and bytes actually needed after aliasing
+	UINT64 getTransientBytes() const;
+	UINT64 getAliasedBytes() const;
+	void reportCompileData() const;
+};
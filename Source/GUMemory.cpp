@@ -6,6 +6,7 @@
 #include <stdafx.h>
 #include <GUMemory.h>
 #include <iostream>
+#include <atomic>
 
 
 using namespace std;
@@ -15,8 +16,9 @@ using namespace std;
 // Memory allocation / free counters
 //
 
-static unsigned long			total_malloc_calls = 0;
-static unsigned long			total_free_calls = 0;
+// Atomic as models are loaded on several threads
+static std::atomic<unsigned long>	total_malloc_calls(0);
+static std::atomic<unsigned long>	total_free_calls(0);
 
 
 
@@ -119,21 +119,13 @@ HRESULT  Grid::init(ID3D11Device *device, UINT widthl, UINT heightl)//, Effect *
 
 Grid::~Grid() {
 
-	if (vertexBuffer)
-		vertexBuffer->Release();
-	if (indexBuffer)
-		indexBuffer->Release();
-	//if (inputLayout)
-	//	inputLayout->Release();
-
-
+	// The vertex and index buffers and the input layout are released by ~BaseModel
 }
 
 
 void Grid::render(ID3D11DeviceContext *context) {
 
-	context->PSSetConstantBuffers(0, 1, &cBufferModelGPU);
-	context->VSSetConstantBuffers(0, 1, &cBufferModelGPU);
+	bindCBuffer(context);
 
 	// Validate object before rendering 
 	if (!context || !vertexBuffer || !inputLayout)
@@ -0,0 +1,252 @@
+#include "stdafx.h"
+#include "ImageBlur.h"
+#include <JobSystem.h>
+#include <emmintrin.h>
+#include <cmath>
+
+using namespace std;
+
+// Width (in pixels) of the column strips processed by the vertical pass.  A strip of 64 RGBA float pixels is 1KB per row so the
+// 2 * MAX_BLUR_RADIUS + 1 rows read for each output row fit in L2
+static const int blurStripWidth = 64;
+
+// Rows per job.  Each horizontal job expands its rows into one padded row buffer
+static const size_t blurRowsPerJob = 16;
+
+// Per format pixel load / store.  Pixels are always processed as 4 floats (RGBA) in an SSE register
+struct PixelRGBA8 {
+	typedef uint8_t type;
+	static __m128 load(const uint8_t *p) {
+		__m128i zero = _mm_setzero_si128();
+		__m128i i = _mm_cvtsi32_si128(*(const int*)p);
+		i = _mm_unpacklo_epi8(i, zero);
+		i = _mm_unpacklo_epi16(i, zero);
+		return _mm_cvtepi32_ps(i);
+	}
+	static void store(uint8_t *p, __m128 v) {
+		// Round to nearest (as the GPU does when writing UNORM) and saturate to [0, 255]
+		__m128i i = _mm_cvtps_epi32(v);
+		i = _mm_packs_epi32(i, i);
+		i = _mm_packus_epi16(i, i);
+		*(int*)p = _mm_cvtsi128_si32(i);
+	}
+};
+
+struct PixelFloat {
+	typedef float type;
+	static __m128 load(const float *p) { return _mm_loadu_ps(p); }
+	static void store(float *p, __m128 v) { _mm_storeu_ps(p, v); }
+};
+
+
+// Run rowFn(firstRow, endRow) over [0, height) on jobs, or on the calling thread if there is no job system
+static void parallelRows(int height, JobSystem *jobs, const function<void(int, int)> &rowFn)
+{
+	if (!jobs) {
+		rowFn(0, height);
+		return;
+	}
+	jobs->parallelFor(0, (size_t)height, blurRowsPerJob, [&](size_t first, size_t last) { rowFn((int)first, (int)last); });
+}
+
+
+template <class Pixel>
+static void blurImage(const typename Pixel::type *src, int srcStride, typename Pixel::type *dst, int dstStride, int width, int height, const BlurKernel *kernel, JobSystem *jobs)
+{
+	if (!src || !dst || !kernel || width <= 0 || height <= 0)
+		return;
+
+	const int r = kernel->radius;
+	__m128 w[MAX_BLUR_RADIUS + 1];
+	for (int k = 0; k <= r; k++)
+		w[k] = _mm_set1_ps(kernel->discreteWeights[k]);
+
+	// Intermediate result of the horizontal pass (RGBA float, tightly packed)
+	float *temp = (float*)_aligned_malloc(sizeof(float) * 4 * width * height, 16);
+	gu_memAssert(temp);
+
+	// Horizontal pass.  Each row is first expanded into a float row padded by r clamped pixels at each end so the
+	// inner loop needs no edge tests
+	parallelRows(height, jobs, [&](int y0, int y1) {
+
+		float *row = (float*)_aligned_malloc(sizeof(float) * 4 * (width + 2 * r), 16);
+		gu_memAssert(row);
+
+		for (int y = y0; y < y1; y++) {
+
+			const typename Pixel::type *s = (const typename Pixel::type*)((const uint8_t*)src + (size_t)y * srcStride);
+			__m128 first = Pixel::load(s);
+			__m128 last = Pixel::load(s + 4 * (width - 1));
+			for (int x = 0; x < r; x++) {
+				_mm_store_ps(row + 4 * x, first);
+				_mm_store_ps(row + 4 * (width + r + x), last);
+			}
+			for (int x = 0; x < width; x++)
+				_mm_store_ps(row + 4 * (x + r), Pixel::load(s + 4 * x));
+
+			float *t = temp + (size_t)4 * width * y;
+			for (int x = 0; x < width; x++) {
+				const float *c = row + 4 * (x + r);
+				__m128 acc = _mm_mul_ps(w[0], _mm_load_ps(c));
+				for (int k = 1; k <= r; k++)
+					acc = _mm_add_ps(acc, _mm_mul_ps(w[k], _mm_add_ps(_mm_load_ps(c - 4 * k), _mm_load_ps(c + 4 * k))));
+				_mm_store_ps(t + 4 * x, acc);
+			}
+		}
+		_aligned_free(row);
+	});
+
+	// Vertical pass.  All rows of temp are complete so dst may alias src
+	parallelRows(height, jobs, [&](int y0, int y1) {
+
+		const float *rows[2 * MAX_BLUR_RADIUS + 1];
+
+		for (int x0 = 0; x0 < width; x0 += blurStripWidth) {
+
+			int x1 = min(x0 + blurStripWidth, width);
+
+			for (int y = y0; y < y1; y++) {
+
+				// Clamp the kernel at the top and bottom edges
+				for (int k = -r; k <= r; k++)
+					rows[k + r] = temp + (size_t)4 * width * min(max(y + k, 0), height - 1);
+
+				typename Pixel::type *d = (typename Pixel::type*)((uint8_t*)dst + (size_t)y * dstStride);
+				for (int x = x0; x < x1; x++) {
+					__m128 acc = _mm_mul_ps(w[0], _mm_load_ps(rows[r] + 4 * x));
+					for (int k = 1; k <= r; k++)
+						acc = _mm_add_ps(acc, _mm_mul_ps(w[k], _mm_add_ps(_mm_load_ps(rows[r - k] + 4 * x), _mm_load_ps(rows[r + k] + 4 * x))));
+					Pixel::store(d + 4 * x, acc);
+				}
+			}
+		}
+	});
+
+	_aligned_free(temp);
+}
+
+
+void blurImageRGBA8(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, const BlurKernel *kernel, JobSystem *jobs)
+{
+	blurImage<PixelRGBA8>(src, srcStride, dst, dstStride, width, height, kernel, jobs);
+}
+
+void blurImageFloat(const float *src, int srcStride, float *dst, int dstStride, int width, int height, const BlurKernel *kernel, JobSystem *jobs)
+{
+	blurImage<PixelFloat>(src, srcStride, dst, dstStride, width, height, kernel, jobs);
+}
+
+
+// One pass of blur_gaussian_ps on an RGBA8 image: the centre texel and numTaps - 1 pairs of bilinear taps at +-offsets along
+// (stepX, stepY) with clamp addressing.  The result is rounded to RGBA8 as the pass writes an R8G8B8A8_UNORM target
+static void gaussianPassRGBA8(const uint8_t *src, uint8_t *dst, int width, int height, const BlurKernel *kernel, int stepX, int stepY)
+{
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			for (int c = 0; c < 4; c++) {
+
+				float sum = 0.0f;
+				for (int t = 0; t < kernel->numTaps; t++) {
+					for (int side = (t == 0) ? 1 : -1; side <= 1; side += 2) {
+
+						// Bilinear filter between the two texels either side of the sample position
+						float position = side * kernel->offsets[t];
+						int i0 = (int)floorf(position);
+						float f = position - (float)i0;
+						int x0 = min(max(x + i0 * stepX, 0), width - 1), x1 = min(max(x + (i0 + 1) * stepX, 0), width - 1);
+						int y0 = min(max(y + i0 * stepY, 0), height - 1), y1 = min(max(y + (i0 + 1) * stepY, 0), height - 1);
+						float texel = (1.0f - f) * src[4 * ((size_t)y0 * width + x0) + c] + f * src[4 * ((size_t)y1 * width + x1) + c];
+						sum += kernel->weights[t] * texel;
+					}
+				}
+				dst[4 * ((size_t)y * width + x) + c] = (uint8_t)min(max((int)floorf(sum + 0.5f), 0), 255);
+			}
+		}
+	}
+}
+
+// Largest per channel difference between blurImageRGBA8 and the GPU passes (horizontal then vertical, through an RGBA8 temp target)
+// on a width x height image
+static int compareWithGPUKernel(int width, int height, const BlurKernel *kernel, JobSystem *jobs)
+{
+	size_t numBytes = (size_t)width * height * 4;
+	vector<uint8_t> image(numBytes), gpuTemp(numBytes), gpuResult(numBytes), cpuResult(numBytes);
+
+	// Soft noise over hard edges so both the smooth and the discontinuous parts of the kernel are compared
+	for (int y = 0; y < height; y++)
+		for (int x = 0; x < width; x++)
+			for (int c = 0; c < 4; c++)
+				image[4 * ((size_t)y * width + x) + c] = (uint8_t)((((x / 16 + y / 16 + c) & 1) ? 192 : 32) + (((x * 7 + y * 13 + c * 5) * 37) & 31));
+
+	gaussianPassRGBA8(image.data(), gpuTemp.data(), width, height, kernel, 1, 0);
+	gaussianPassRGBA8(gpuTemp.data(), gpuResult.data(), width, height, kernel, 0, 1);
+	blurImageRGBA8(image.data(), width * 4, cpuResult.data(), width * 4, width, height, kernel, jobs);
+
+	int maxDifference = 0;
+	for (size_t i = 0; i < numBytes; i++)
+		maxDifference = max(maxDifference, abs((int)gpuResult[i] - (int)cpuResult[i]));
+	return maxDifference;
+}
+
+
+void benchmarkImageBlur(int width, int height, int radius, int iterations, int numThreads)
+{
+	if (width <= 0 || height <= 0 || iterations <= 0)
+		return;
+	JobSystem jobs((UINT)max(numThreads, 0));
+	numThreads = (int)jobs.getNumThreads();
+
+	BlurKernel kernel;
+	computeBlurKernel(radius, 0.0f, &kernel);
+
+	// The GPU passes read the kernel through bilinear taps, the CPU applies the discrete weights they were merged from.  They
+	// should only differ by the rounding of the GPU's RGBA8 temp target
+	int maxDifference = compareWithGPUKernel(256, 256, &kernel, &jobs);
+	cout << "Blur radius " << kernel.radius << ": largest difference from the GPU kernel " << maxDifference << " / 255" << (maxDifference <= 1 ? "" : " - MISMATCH") << "\n";
+
+	size_t numPixels = (size_t)width * height;
+	uint8_t *imageRGBA8 = (uint8_t*)_aligned_malloc(numPixels * 4, 16);
+	float *imageFloat = (float*)_aligned_malloc(numPixels * 4 * sizeof(float), 16);
+	gu_memAssert(imageRGBA8);
+	gu_memAssert(imageFloat);
+
+	// Any non-constant pattern will do - throughput does not depend on content
+	for (size_t i = 0; i < numPixels * 4; i++) {
+		imageRGBA8[i] = (uint8_t)((i * 37) & 0xFF);
+		imageFloat[i] = (float)imageRGBA8[i] / 255.0f;
+	}
+
+	// Untimed first run so neither timing includes faulting in the images
+	blurImageRGBA8(imageRGBA8, width * 4, imageRGBA8, width * 4, width, height, &kernel, nullptr);
+	blurImageFloat(imageFloat, width * 4 * sizeof(float), imageFloat, width * 4 * sizeof(float), width, height, &kernel, nullptr);
+
+	double mpixels = (double)numPixels * iterations / 1000000.0;
+	cout << "Blur " << width << "x" << height << " radius " << kernel.radius << " (" << iterations << " iterations)\n";
+
+	// On the calling thread and on the job system
+	for (int pass = 0; pass < 2; pass++) {
+
+		JobSystem *passJobs = (pass == 0) ? nullptr : &jobs;
+		if (pass == 1 && numThreads <= 1)
+			break;
+
+		gu_time_index start = CGDClock::ActualTime();
+		for (int i = 0; i < iterations; i++)
+			blurImageRGBA8(imageRGBA8, width * 4, imageRGBA8, width * 4, width, height, &kernel, passJobs);
+		gu_seconds rgba8Time = CGDClock::ConvertTimeIntervalToSeconds(CGDClock::ActualTime() - start);
+
+		start = CGDClock::ActualTime();
+		for (int i = 0; i < iterations; i++)
+			blurImageFloat(imageFloat, width * 4 * sizeof(float), imageFloat, width * 4 * sizeof(float), width, height, &kernel, passJobs);
+		gu_seconds floatTime = CGDClock::ConvertTimeIntervalToSeconds(CGDClock::ActualTime() - start);
+
+		int threads = (pass == 0) ? 1 : numThreads;
+		if (rgba8Time > 0.0)
+			cout << "RGBA8 " << threads << " thread(s): " << mpixels / rgba8Time << " Mpixels/s\n";
+		if (floatTime > 0.0)
+			cout << "Float " << threads << " thread(s): " << mpixels / floatTime << " Mpixels/s\n";
+	}
+
+	_aligned_free(imageRGBA8);
+	_aligned_free(imageFloat);
+}
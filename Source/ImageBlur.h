@@ -0,0 +1,24 @@
+//
+// ImageBlur.h
+//
+
+// CPU implementation of the separable Gaussian blur applied by BlurUtility.  Each pass samples the same clamped, normalised kernel
+// (BlurKernel::discreteWeights) that the GPU reads through bilinear taps so the results can be used as a reference for the shaders or
+// as a software fallback.  Pixels are RGBA and processed 4 channels at a time with SSE2; rows are split into bands run as jobs and
+// the vertical pass works on column strips so the rows covered by the kernel stay in cache.
+#pragma once
+
+#include <cstdint>
+#include <BlurKernel.h>
+
+class JobSystem;
+
+// Blur an RGBA8 image.  src and dst may be the same buffer.  Strides are in bytes.  jobs == nullptr blurs on the calling thread
+void blurImageRGBA8(const uint8_t *src, int srcStride, uint8_t *dst, int dstStride, int width, int height, const BlurKernel *kernel, JobSystem *jobs = nullptr);
+
+// Blur an RGBA float image (4 floats per pixel).  src and dst may be the same buffer.  Strides are in bytes
+void blurImageFloat(const float *src, int srcStride, float *dst, int dstStride, int width, int height, const BlurKernel *kernel, JobSystem *jobs = nullptr);
+
+// Check blurImageRGBA8 against the GPU blur passes' bilinear taps, then time blurImageRGBA8 and blurImageFloat on a width x height
+// test image on one thread and on a job system of numThreads threads (0 = hardware threads) and report throughput (Mpixels/s)
+void benchmarkImageBlur(int width = 1920, int height = 1080, int radius = 12, int iterations = 10, int numThreads = 0);
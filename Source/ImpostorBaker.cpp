@@ -0,0 +1,257 @@
+#include "stdafx.h"
+#include "ImpostorBaker.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+
+// Passes of colour dilation into the uncovered texels - enough for the mip levels a distant impostor is drawn with
+static const int dilationPasses = 16;
+
+
+static uint32_t packColour(float r, float g, float b, float a)
+{
+	uint32_t c[4] = { (uint32_t)(min(max(r, 0.0f), 1.0f) * 255.0f + 0.5f), (uint32_t)(min(max(g, 0.0f), 1.0f) * 255.0f + 0.5f),
+		(uint32_t)(min(max(b, 0.0f), 1.0f) * 255.0f + 0.5f), (uint32_t)(min(max(a, 0.0f), 1.0f) * 255.0f + 0.5f) };
+	return c[0] | (c[1] << 8) | (c[2] << 16) | (c[3] << 24);
+}
+
+// Texture coordinate wrapped with mirroring, as the models' samplers address textures
+static float mirror(float t)
+{
+	t = fmod(fabs(t), 2.0f);
+	return t > 1.0f ? 2.0f - t : t;
+}
+
+// Bilinear RGBA sample (0 to 1)
+static void sampleImage(const ImpostorImage &image, float u, float v, float result[4])
+{
+	float x = mirror(u) * image.width - 0.5f;
+	float y = mirror(v) * image.height - 0.5f;
+	float fx = x - floor(x), fy = y - floor(y);
+	int x0 = (int)floor(x), y0 = (int)floor(y);
+	int xs[2] = { min(max(x0, 0), (int)image.width - 1), min(max(x0 + 1, 0), (int)image.width - 1) };
+	int ys[2] = { min(max(y0, 0), (int)image.height - 1), min(max(y0 + 1, 0), (int)image.height - 1) };
+	float weights[4] = { (1.0f - fx) * (1.0f - fy), fx * (1.0f - fy), (1.0f - fx) * fy, fx * fy };
+	for (int k = 0; k < 4; k++)
+		result[k] = 0.0f;
+	for (int s = 0; s < 4; s++) {
+		const uint8_t *texel = image.pixels + ((size_t)ys[s >> 1] * image.width + xs[s & 1]) * 4;
+		for (int k = 0; k < 4; k++)
+			result[k] += weights[s] * texel[k] * (1.0f / 255.0f);
+	}
+}
+
+// Fill the uncovered texels of one frame with the average colour of their filled neighbours, a ring of texels per pass.  Alpha stays 0
+static void dilateFrame(uint32_t *pixels, size_t rowPitch, uint32_t size, vector<bool> &filled)
+{
+	vector<size_t> ring;
+	vector<uint32_t> ringColour;
+	for (int pass = 0; pass < dilationPasses; pass++) {
+		ring.clear();
+		ringColour.clear();
+		for (uint32_t y = 0; y < size; y++) {
+			for (uint32_t x = 0; x < size; x++) {
+				if (filled[y * size + x])
+					continue;
+				uint32_t sum[3] = { 0, 0, 0 }, count = 0;
+				for (int dy = -1; dy <= 1; dy++) {
+					for (int dx = -1; dx <= 1; dx++) {
+						int nx = (int)x + dx, ny = (int)y + dy;
+						if (nx < 0 || ny < 0 || nx >= (int)size || ny >= (int)size || !filled[ny * size + nx])
+							continue;
+						uint32_t c = pixels[ny * rowPitch + nx];
+						sum[0] += c & 0xff;
+						sum[1] += (c >> 8) & 0xff;
+						sum[2] += (c >> 16) & 0xff;
+						count++;
+					}
+				}
+				if (count == 0)
+					continue;
+				ring.push_back(y * size + x);
+				ringColour.push_back((sum[0] / count) | ((sum[1] / count) << 8) | ((sum[2] / count) << 16));
+			}
+		}
+		if (ring.empty())
+			break;
+		for (size_t i = 0; i < ring.size(); i++) {
+			filled[ring[i]] = true;
+			pixels[(ring[i] / size) * rowPitch + ring[i] % size] = ringColour[i];
+		}
+	}
+}
+
+
+bool bakeImpostorAtlas(const ImpostorMesh &mesh, const ImpostorImage *texture, const float colour[4], uint32_t numViews, uint32_t viewSize, ImpostorAtlas *atlas)
+{
+	if (!atlas || !mesh.positions || !mesh.normals || !mesh.indices || mesh.numIndices % 3 != 0 || numViews == 0 || viewSize == 0)
+		return false;
+	for (size_t i = 0; i < mesh.numIndices; i++)
+		if (mesh.indices[i] >= mesh.numVertices)
+			return false;
+	if (texture && (!texture->pixels || texture->width == 0 || texture->height == 0 || !mesh.texCoords))
+		texture = nullptr;
+
+	const char *positionBytes = (const char*)mesh.positions;
+	const char *normalBytes = (const char*)mesh.normals;
+	const char *texCoordBytes = (const char*)mesh.texCoords;
+
+	// Bounding cylinder of the vertices the triangles use
+	float minX = FLT_MAX, maxX = -FLT_MAX, minY = FLT_MAX, maxY = -FLT_MAX, minZ = FLT_MAX, maxZ = -FLT_MAX;
+	for (size_t i = 0; i < mesh.numIndices; i++) {
+		const float *p = (const float*)(positionBytes + mesh.indices[i] * mesh.stride);
+		minX = min(minX, p[0]); maxX = max(maxX, p[0]);
+		minY = min(minY, p[1]); maxY = max(maxY, p[1]);
+		minZ = min(minZ, p[2]); maxZ = max(maxZ, p[2]);
+	}
+	if (mesh.numIndices == 0 || maxY <= minY)
+		return false;
+	float centreX = (minX + maxX) * 0.5f, centreZ = (minZ + maxZ) * 0.5f;
+	float radiusSq = 0.0f;
+	for (size_t i = 0; i < mesh.numIndices; i++) {
+		const float *p = (const float*)(positionBytes + mesh.indices[i] * mesh.stride);
+		radiusSq = max(radiusSq, (p[0] - centreX) * (p[0] - centreX) + (p[2] - centreZ) * (p[2] - centreZ));
+	}
+	if (radiusSq <= 0.0f)
+		return false;
+
+	atlas->numViews = numViews;
+	atlas->viewSize = viewSize;
+	atlas->columns = (uint32_t)ceil(sqrt((double)numViews));
+	atlas->rows = (numViews + atlas->columns - 1) / atlas->columns;
+	atlas->width = atlas->columns * viewSize;
+	atlas->height = atlas->rows * viewSize;
+	atlas->centreX = centreX;
+	atlas->centreZ = centreZ;
+	atlas->radius = sqrt(radiusSq);
+	atlas->minY = minY;
+	atlas->maxY = maxY;
+	atlas->albedo.assign((size_t)atlas->width * atlas->height, 0);
+	atlas->normals.assign((size_t)atlas->width * atlas->height, packColour(0.5f, 0.5f, 0.5f, 0.0f));
+
+	// Screen position (texels, y down) and depth (towards the viewer) of each vertex in the current view
+	struct Projected {
+		float							x, y, depth;
+	};
+	vector<Projected> projected(mesh.numVertices);
+	vector<float> depthBuffer((size_t)viewSize * viewSize);
+	vector<bool> covered((size_t)viewSize * viewSize);
+	float xScale = viewSize * 0.5f / atlas->radius;
+	float yScale = viewSize / (maxY - minY);
+
+	for (uint32_t view = 0; view < numViews; view++) {
+
+		// Orthographic camera looking back along d = (cos a, 0, sin a) with right = d x up (left handed, as the scene's cameras)
+		float angle = 6.28318531f * view / numViews;
+		float dx = cos(angle), dz = sin(angle);
+		float rightX = -dz, rightZ = dx;
+		for (size_t v = 0; v < mesh.numVertices; v++) {
+			const float *p = (const float*)(positionBytes + v * mesh.stride);
+			float x = p[0] - centreX, z = p[2] - centreZ;
+			projected[v].x = (x * rightX + z * rightZ) * xScale + viewSize * 0.5f;
+			projected[v].y = (maxY - p[1]) * yScale;
+			projected[v].depth = x * dx + z * dz;
+		}
+
+		fill(depthBuffer.begin(), depthBuffer.end(), -FLT_MAX);
+		fill(covered.begin(), covered.end(), false);
+		size_t frameOffset = (size_t)(view / atlas->columns) * viewSize * atlas->width + (view % atlas->columns) * viewSize;
+		uint32_t *albedo = &atlas->albedo[frameOffset];
+		uint32_t *normals = &atlas->normals[frameOffset];
+
+		for (size_t t = 0; t < mesh.numIndices; t += 3) {
+			uint32_t i0 = mesh.indices[t], i1 = mesh.indices[t + 1], i2 = mesh.indices[t + 2];
+			const Projected &a = projected[i0], &b = projected[i1], &c = projected[i2];
+
+			// Clockwise on screen is front facing (y is down, so the signed area of a front face is positive)
+			float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+			if (area <= 0.0f)
+				continue;
+
+			int x0 = max((int)floor(min(a.x, min(b.x, c.x))), 0);
+			int x1 = min((int)ceil(max(a.x, max(b.x, c.x))), (int)viewSize - 1);
+			int y0 = max((int)floor(min(a.y, min(b.y, c.y))), 0);
+			int y1 = min((int)ceil(max(a.y, max(b.y, c.y))), (int)viewSize - 1);
+			const float *n[3] = { (const float*)(normalBytes + i0 * mesh.stride), (const float*)(normalBytes + i1 * mesh.stride), (const float*)(normalBytes + i2 * mesh.stride) };
+			const float *uv[3] = { nullptr, nullptr, nullptr };
+			if (texture) {
+				uv[0] = (const float*)(texCoordBytes + i0 * mesh.stride);
+				uv[1] = (const float*)(texCoordBytes + i1 * mesh.stride);
+				uv[2] = (const float*)(texCoordBytes + i2 * mesh.stride);
+			}
+
+			for (int y = y0; y <= y1; y++) {
+				float py = y + 0.5f;
+				for (int x = x0; x <= x1; x++) {
+					float px = x + 0.5f;
+					// Barycentric weights from the edge functions at the texel centre
+					float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) / area;
+					float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) / area;
+					float w2 = 1.0f - w0 - w1;
+					if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+						continue;
+					float depth = w0 * a.depth + w1 * b.depth + w2 * c.depth;
+					size_t texel = (size_t)y * viewSize + x;
+					if (depth <= depthBuffer[texel])
+						continue;
+
+					float rgba[4] = { colour[0], colour[1], colour[2], colour[3] };
+					if (texture) {
+						sampleImage(*texture, w0 * uv[0][0] + w1 * uv[1][0] + w2 * uv[2][0], w0 * uv[0][1] + w1 * uv[1][1] + w2 * uv[2][1], rgba);
+						if (rgba[3] < 0.5f)
+							continue;
+					}
+					float normal[3];
+					for (int k = 0; k < 3; k++)
+						normal[k] = w0 * n[0][k] + w1 * n[1][k] + w2 * n[2][k];
+					float length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+					if (length > 0.0f)
+						for (int k = 0; k < 3; k++)
+							normal[k] /= length;
+
+					depthBuffer[texel] = depth;
+					covered[texel] = true;
+					albedo[y * atlas->width + x] = packColour(rgba[0], rgba[1], rgba[2], 1.0f);
+					normals[y * atlas->width + x] = packColour(normal[0] * 0.5f + 0.5f, normal[1] * 0.5f + 0.5f, normal[2] * 0.5f + 0.5f, 1.0f);
+				}
+			}
+		}
+
+		vector<bool> filled(covered);
+		dilateFrame(albedo, atlas->width, viewSize, filled);
+		filled = covered;
+		dilateFrame(normals, atlas->width, viewSize, filled);
+	}
+	return true;
+}
+
+void buildImpostorMips(const ImpostorAtlas &atlas, const vector<uint32_t> &image, vector<vector<uint32_t> > *mips)
+{
+	mips->clear();
+	const uint32_t *source = image.data();
+	uint32_t width = atlas.width, height = atlas.height;
+	for (uint32_t size = atlas.viewSize; size > 1 && (size & 1) == 0; size >>= 1) {
+		uint32_t levelWidth = width / 2, levelHeight = height / 2;
+		mips->push_back(vector<uint32_t>((size_t)levelWidth * levelHeight));
+		uint32_t *level = mips->back().data();
+		for (uint32_t y = 0; y < levelHeight; y++) {
+			for (uint32_t x = 0; x < levelWidth; x++) {
+				const uint32_t *texels = source + (size_t)(2 * y) * width + 2 * x;
+				uint32_t quad[4] = { texels[0], texels[1], texels[width], texels[width + 1] };
+				uint32_t result = 0;
+				for (int shift = 0; shift < 32; shift += 8) {
+					uint32_t sum = 0;
+					for (int k = 0; k < 4; k++)
+						sum += (quad[k] >> shift) & 0xff;
+					result |= ((sum + 2) / 4) << shift;
+				}
+				level[(size_t)y * levelWidth + x] = result;
+			}
+		}
+		source = level;
+		width = levelWidth;
+		height = levelHeight;
+	}
+}
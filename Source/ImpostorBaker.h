@@ -0,0 +1,60 @@
+//
+// ImpostorBaker.h
+//
+
+// Impostor atlas baking for distant models (see ImpostorBatch).  A mesh is drawn from numViews directions evenly spaced around its
+// vertical axis into the frames of an atlas by a small CPU rasteriser - each frame is an orthographic view of the mesh's bounding
+// cylinder, depth buffered, with back faces culled as the mesh's own effect does and the texture alpha tested at 0.5.  The albedo
+// atlas holds the texture colour (or the material colour) with coverage in alpha, the normal atlas the model space normal scaled to
+// [0, 1] so an impostor can be lit like its mesh.  The colour of uncovered texels is pushed out from the covered ones so bilinear
+// filtering and mip maps do not pull black into the silhouette.  Only the CPU is used, so baking runs on any thread.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Triangle list with positions, normals and texture coordinates (3, 3 and 2 floats) in vertices stride bytes apart
+struct ImpostorMesh {
+	const float							*positions = nullptr;
+	const float							*normals = nullptr;
+	const float							*texCoords = nullptr; // nullptr if the mesh is not textured
+	size_t								stride = 0;
+	size_t								numVertices = 0;
+	const uint32_t						*indices = nullptr;
+	size_t								numIndices = 0;
+};
+
+// RGBA image (8 bits per channel) sampled with the mesh's texture coordinates
+struct ImpostorImage {
+	const uint8_t						*pixels = nullptr;
+	uint32_t							width = 0;
+	uint32_t							height = 0;
+};
+
+struct ImpostorAtlas {
+	uint32_t							numViews = 0;
+	uint32_t							viewSize = 0; // Each frame is viewSize x viewSize texels
+	uint32_t							columns = 0; // Frames per row of the atlas
+	uint32_t							rows = 0;
+	uint32_t							width = 0;
+	uint32_t							height = 0;
+	std::vector<uint32_t>				albedo; // RGBA8, R in the low byte (DXGI_FORMAT_R8G8B8A8_UNORM)
+	std::vector<uint32_t>				normals;
+	// Bounding cylinder of the mesh in model space - vertical axis through (centreX, centreZ) from minY to maxY.  A frame covers the
+	// cylinder's width (2 * radius) and height
+	float								centreX = 0.0f;
+	float								centreZ = 0.0f;
+	float								radius = 0.0f;
+	float								minY = 0.0f;
+	float								maxY = 0.0f;
+};
+
+// Bake the frames of atlas.  Frame v views the mesh from the direction (cos a, 0, sin a), a = 2 pi v / numViews, in model space and
+// is stored at column v % columns, row v / columns.  colour is the RGBA albedo (0 to 1) of untextured meshes.  Returns false if the
+// mesh is invalid or has no extent
+bool bakeImpostorAtlas(const ImpostorMesh &mesh, const ImpostorImage *texture, const float colour[4], uint32_t numViews, uint32_t viewSize, ImpostorAtlas *atlas);
+
+// Mip levels 1 onwards of an atlas image (albedo or normals) - a 2x2 box filter of the level above, down to one texel per frame.  With
+// viewSize a power of 2 the frames stay aligned to the filter so no level mixes neighbouring frames
+void buildImpostorMips(const ImpostorAtlas &atlas, const std::vector<uint32_t> &image, std::vector<std::vector<uint32_t> > *mips);
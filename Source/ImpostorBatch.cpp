@@ -0,0 +1,299 @@
+#include "stdafx.h"
+#include "ImpostorBatch.h"
+#include <Model.h>
+#include <Texture.h>
+#include <StateCache.h>
+#include <iostream>
+#include <exception>
+#include <chrono>
+
+using namespace std;
+using namespace DirectX;
+
+
+HRESULT ImpostorBatch::init(ID3D11Device *device)
+{
+	atlasViews[0] = atlasViews[1] = nullptr;
+
+	try
+	{
+		if (!device || !effect || maxInstances == 0)
+			throw exception("Invalid parameters for impostor batch instantiation");
+
+		// Quad corners shared by every impostor (drawn as a triangle strip) - x across the bounding cylinder, y from its base to its top
+		XMFLOAT2 corners[] = {
+
+			XMFLOAT2(-1.0f, 0.0f),
+			XMFLOAT2(-1.0f, 1.0f),
+			XMFLOAT2(1.0f, 0.0f),
+			XMFLOAT2(1.0f, 1.0f)
+		};
+
+		// Setup corner vertex buffer
+		D3D11_BUFFER_DESC vertexDesc;
+		D3D11_SUBRESOURCE_DATA vertexData;
+
+		ZeroMemory(&vertexDesc, sizeof(D3D11_BUFFER_DESC));
+		ZeroMemory(&vertexData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+		vertexDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		vertexDesc.ByteWidth = sizeof(XMFLOAT2) * 4;
+		vertexDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexData.pSysMem = corners;
+
+		HRESULT hr = device->CreateBuffer(&vertexDesc, &vertexData, &vertexBuffer);
+
+		if (!SUCCEEDED(hr))
+			throw exception("Impostor corner buffer cannot be created");
+
+		// The instances rarely change (unlike flares) so they are kept in a default buffer and only rewritten after instances are added
+		D3D11_BUFFER_DESC instanceDesc;
+		ZeroMemory(&instanceDesc, sizeof(D3D11_BUFFER_DESC));
+		instanceDesc.Usage = D3D11_USAGE_DEFAULT;
+		instanceDesc.ByteWidth = sizeof(ImpostorInstanceStruct) * maxInstances;
+		instanceDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+
+		hr = device->CreateBuffer(&instanceDesc, nullptr, &instanceBuffer);
+
+		if (!SUCCEEDED(hr))
+			throw exception("Impostor instance buffer cannot be created");
+
+		// The atlas frames are clamped so the edge of one frame does not filter in the next.  The default desc stops at mip 0, so the
+		// LOD range is opened up to sample the CPU built mip chain at a distance
+		D3D11_SAMPLER_DESC samplerDesc = StateCache::defaultSamplerDesc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_CLAMP);
+		samplerDesc.MaxLOD = D3D11_FLOAT32_MAX;
+		sampler = StateCache::getDefault(device)->getSamplerState(samplerDesc);
+
+		cBufferImpostorCPU = (CBufferImpostor*)_aligned_malloc(sizeof(CBufferImpostor), 16);
+		ZeroMemory(cBufferImpostorCPU, sizeof(CBufferImpostor));
+		cBufferImpostor = cBufferManager->add(cBufferImpostorCPU, sizeof(CBufferImpostor), 4, CBufferLayout::PerDraw);
+		setDistances(150.0f, 25.0f);
+
+		instances.reserve(maxInstances);
+	}
+	catch (exception& e)
+	{
+		cout << "Impostor batch could not be instantiated due to:\n";
+		cout << e.what() << endl;
+
+		if (vertexBuffer)
+			vertexBuffer->Release();
+		if (instanceBuffer)
+			instanceBuffer->Release();
+
+		vertexBuffer = nullptr;
+		instanceBuffer = nullptr;
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+
+ImpostorBatch::~ImpostorBatch()
+{
+	if (instanceBuffer)
+		instanceBuffer->Release();
+	for (int i = 0; i < 2; i++)
+		if (atlasViews[i])
+			atlasViews[i]->Release();
+	if (cBufferImpostorCPU) {
+		cBufferManager->remove(cBufferImpostor);
+		_aligned_free(cBufferImpostorCPU);
+	}
+}
+
+
+int ImpostorBatch::addInstance(FXMMATRIX world)
+{
+	if (instances.size() >= maxInstances)
+		return -1;
+
+	// The model's x axis (row 0) gives the scale and the turn about the vertical axis, the translation (row 3) its origin
+	XMFLOAT3 axisX;
+	XMStoreFloat3(&axisX, world.r[0]);
+	float horizontal = sqrt(axisX.x * axisX.x + axisX.z * axisX.z);
+
+	ImpostorInstanceStruct instance;
+	XMStoreFloat3(&instance.pos, world.r[3]);
+	instance.scale = XMVectorGetX(XMVector3Length(world.r[0]));
+	instance.axis = (horizontal > 0.0f) ? XMFLOAT2(axisX.x / horizontal, axisX.z / horizontal) : XMFLOAT2(1.0f, 0.0f);
+	instances.push_back(instance);
+	instancesDirty = true;
+	return (int)instances.size() - 1;
+}
+
+void ImpostorBatch::clear()
+{
+	instances.clear();
+	instancesDirty = true;
+}
+
+void ImpostorBatch::setDistances(float nearDistance, float fadeRange)
+{
+	cBufferImpostorCPU->nearDistance = nearDistance;
+	cBufferImpostorCPU->fadeRange = fadeRange;
+	cBufferManager->markDirty(cBufferImpostor);
+}
+
+
+HRESULT ImpostorBatch::bake(const wstring &modelFilename, const wstring &textureFilename, UINT numViews, UINT viewSize)
+{
+	typedef chrono::high_resolution_clock BakeClock;
+	BakeClock::time_point start = BakeClock::now();
+
+	vector<ExtendedVertexStruct> vertices;
+	vector<uint32_t> indices;
+	HRESULT hr = Model::importMesh(modelFilename, &vertices, &indices);
+	if (!SUCCEEDED(hr) || vertices.empty()) {
+		cout << "ImpostorBatch: " << string(modelFilename.begin(), modelFilename.end()) << " could not be imported" << endl;
+		return E_FAIL;
+	}
+
+	// The texture is only decoded - it is not needed on the GPU
+	Texture texture(vector<wstring>(1, textureFilename), nullptr);
+	ImpostorImage image;
+	UINT width = 0, height = 0;
+	if (!textureFilename.empty() && SUCCEEDED(texture.decode()))
+		image.pixels = texture.getImage(0, &width, &height);
+	image.width = width;
+	image.height = height;
+
+	ImpostorMesh mesh;
+	mesh.positions = &vertices[0].pos.x;
+	mesh.normals = &vertices[0].normal.x;
+	mesh.texCoords = &vertices[0].texCoord.x;
+	mesh.stride = sizeof(ExtendedVertexStruct);
+	mesh.numVertices = vertices.size();
+	mesh.indices = indices.data();
+	mesh.numIndices = indices.size();
+
+	// Power of 2 frames keep the mip levels from mixing frames
+	UINT frameSize = 1;
+	while (frameSize < viewSize)
+		frameSize <<= 1;
+
+	static const float white[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	if (!bakeImpostorAtlas(mesh, image.pixels ? &image : nullptr, white, numViews, frameSize, &atlas)) {
+		cout << "ImpostorBatch: " << string(modelFilename.begin(), modelFilename.end()) << " could not be baked" << endl;
+		return E_FAIL;
+	}
+
+	bakeTime = chrono::duration<double, milli>(BakeClock::now() - start).count();
+	return S_OK;
+}
+
+HRESULT ImpostorBatch::createAtlas(ID3D11Device *device)
+{
+	if (atlas.albedo.empty())
+		return E_FAIL;
+
+	const vector<uint32_t> *images[] = { &atlas.albedo, &atlas.normals };
+	for (int i = 0; i < 2; i++) {
+
+		// Full mip chain down to a texel per frame, built on the CPU so the texture can be immutable
+		vector<vector<uint32_t> > mips;
+		buildImpostorMips(atlas, *images[i], &mips);
+
+		vector<D3D11_SUBRESOURCE_DATA> levels(mips.size() + 1);
+		levels[0].pSysMem = images[i]->data();
+		levels[0].SysMemPitch = atlas.width * 4;
+		for (size_t level = 1; level < levels.size(); level++) {
+			levels[level].pSysMem = mips[level - 1].data();
+			levels[level].SysMemPitch = (atlas.width >> level) * 4;
+		}
+
+		D3D11_TEXTURE2D_DESC textureDesc;
+		ZeroMemory(&textureDesc, sizeof(D3D11_TEXTURE2D_DESC));
+		textureDesc.Width = atlas.width;
+		textureDesc.Height = atlas.height;
+		textureDesc.MipLevels = (UINT)levels.size();
+		textureDesc.ArraySize = 1;
+		textureDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		textureDesc.SampleDesc.Count = 1;
+		textureDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		textureDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		ID3D11Texture2D *texture = nullptr;
+		HRESULT hr = device->CreateTexture2D(&textureDesc, levels.data(), &texture);
+		if (SUCCEEDED(hr)) {
+			hr = device->CreateShaderResourceView(texture, nullptr, &atlasViews[i]);
+			texture->Release();
+		}
+		if (!SUCCEEDED(hr)) {
+			cout << "ImpostorBatch: atlas textures cannot be created" << endl;
+			for (int j = 0; j < 2; j++) {
+				if (atlasViews[j])
+					atlasViews[j]->Release();
+				atlasViews[j] = nullptr;
+			}
+			return hr;
+		}
+	}
+
+	cBufferImpostorCPU->bounds = XMFLOAT4(atlas.centreX, atlas.centreZ, atlas.radius, atlas.minY);
+	cBufferImpostorCPU->frames = XMFLOAT4((float)atlas.numViews, (float)atlas.columns, 1.0f / atlas.columns, 1.0f / atlas.rows);
+	cBufferImpostorCPU->height = atlas.maxY - atlas.minY;
+	cBufferManager->markDirty(cBufferImpostor);
+
+	// Keep the description for reportData and release the images
+	atlas.albedo = vector<uint32_t>();
+	atlas.normals = vector<uint32_t>();
+	return S_OK;
+}
+
+
+void ImpostorBatch::uploadInstances(ID3D11DeviceContext *context)
+{
+	if (!context || !instanceBuffer || !instancesDirty)
+		return;
+
+	if (!instances.empty()) {
+		D3D11_BOX box = { 0, 0, 0, (UINT)(instances.size() * sizeof(ImpostorInstanceStruct)), 1, 1 };
+		context->UpdateSubresource(instanceBuffer, 0, &box, instances.data(), 0, 0);
+	}
+	numUploadedInstances = (UINT)instances.size();
+	instancesDirty = false;
+}
+
+
+void ImpostorBatch::render(ID3D11DeviceContext *context)
+{
+	// Validate object before rendering (see notes in constructor)
+	if (!context || !vertexBuffer || !instanceBuffer || !effect || !isReady() || numUploadedInstances == 0)
+		return;
+
+	effect->bindPipeline(context);
+	cBufferManager->bind(context, cBufferImpostor);
+
+	// Bind the atlases and sampler to the PS stage of the pipeline
+	context->PSSetShaderResources(0, 2, atlasViews);
+	context->PSSetSamplers(0, 1, &sampler);
+
+	// Set vertex layout
+	context->IASetInputLayout(inputLayout);
+
+	// Set corner (slot 0) and instance (slot 1) buffers for IA
+	ID3D11Buffer* vertexBuffers[] = { vertexBuffer, instanceBuffer };
+	UINT vertexStrides[] = { sizeof(XMFLOAT2), sizeof(ImpostorInstanceStruct) };
+	UINT vertexOffsets[] = { 0, 0 };
+
+	context->IASetVertexBuffers(0, 2, vertexBuffers, vertexStrides, vertexOffsets);
+
+	// Set primitive topology for IA
+	context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP);
+
+	// One draw call for every impostor in the batch
+	context->DrawInstanced(4, numUploadedInstances, 0, 0);
+}
+
+
+void ImpostorBatch::reportData() const
+{
+	cout << "ImpostorBatch: " << instances.size() << " of " << maxInstances << " instances in 1 draw";
+	if (isReady())
+		cout << ", " << atlas.numViews << " views of " << atlas.viewSize << "x" << atlas.viewSize << " in a " << atlas.width << "x" << atlas.height
+			<< " atlas baked in " << bakeTime << " ms";
+	else
+		cout << ", atlas not ready";
+	cout << endl;
+}
@@ -0,0 +1,67 @@
+//
+// ImpostorBatch.h
+//
+
+// Distant copies of one model drawn as impostors.  bake() renders the model into an atlas of views around its vertical axis (see
+// ImpostorBaker.h) and each instance is a quad turned about the vertical axis to face the camera - the fountain_vs billboard held
+// upright - showing the frame baked nearest to the direction the instance is seen from, lit with the baked normals.  The instances
+// live in one GPU buffer that is only rewritten after instances are added, and the whole batch is one instanced draw, so the CPU cost
+// does not grow with the number of instances.  The vertex shader drops instances nearer the eye than nearDistance, where the model's
+// own mesh is drawn (see Model::setDrawDistance), and fades impostors in with alpha to coverage over fadeRange beyond it.
+#pragma once
+#include <BaseModel.h>
+#include <Effect.h>
+#include <VertexStructures.h>
+#include <CBufferStructures.h>
+#include <ImpostorBaker.h>
+#include <string>
+#include <vector>
+
+
+class ImpostorBatch : public BaseModel {
+
+protected:
+
+	std::vector<ImpostorInstanceStruct>	instances;
+	UINT								maxInstances = 0;
+	ID3D11Buffer						*instanceBuffer = nullptr; // Sized for maxInstances
+	bool								instancesDirty = false;
+	UINT								numUploadedInstances = 0; // Instances in instanceBuffer, drawn by render()
+
+	// Atlas baked by bake() and waiting for createAtlas(), and the views of the atlas textures (albedo at t0, normals at t1)
+	ImpostorAtlas						atlas;
+	ID3D11ShaderResourceView			*atlasViews[2];
+	double								bakeTime = 0.0; // ms
+
+	// Impostor parameters (register b4)
+	CBufferImpostor						*cBufferImpostorCPU = nullptr;
+	int									cBufferImpostor = -1;
+
+public:
+	ImpostorBatch(UINT _maxInstances, ID3D11Device *device, Effect *_effect) : BaseModel(device, _effect) { maxInstances = _maxInstances; init(device); }
+	~ImpostorBatch();
+
+	// Add an instance of the model with the given world matrix (a uniform scale and a rotation about the vertical axis) and return its
+	// index (-1 if the batch is full)
+	int addInstance(DirectX::FXMMATRIX world);
+	void clear();
+	UINT getNumInstances() const { return (UINT)instances.size(); };
+	UINT getMaxInstances() const { return maxInstances; };
+
+	// Instances nearer than nearDistance are not drawn and impostors fade in over fadeRange beyond it.  Not while recording
+	void setDistances(float nearDistance, float fadeRange);
+
+	// Import the model and its texture and bake an atlas of numViews frames of viewSize x viewSize texels (viewSize is rounded up to a
+	// power of 2).  Any thread
+	HRESULT bake(const std::wstring &modelFilename, const std::wstring &textureFilename, UINT numViews = 16, UINT viewSize = 128);
+	// Create the atlas textures from the baked atlas and release it.  Render thread.  The batch draws nothing until then
+	HRESULT createAtlas(ID3D11Device *device);
+	bool isReady() const { return atlasViews[0] != nullptr; };
+
+	// Rewrite the instance buffer if instances have changed since the last upload.  Immediate context, before the batch is recorded
+	void uploadInstances(ID3D11DeviceContext *context);
+	// Draw the uploaded instances.  Only reads the batch so it can be recorded on any thread
+	void render(ID3D11DeviceContext *context);
+	HRESULT init(ID3D11Device *device);
+	void reportData() const;
+};
@@ -0,0 +1,471 @@
+#include "stdafx.h"
+#include "JobSystem.h"
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+
+
+// Marks a counter's continuation list as closed - the counter is at zero so runAfter() queues its job straight away
+static JobSystem::Job closedListMarker;
+static JobSystem::Job *const closedList = &closedListMarker;
+
+// The system and worker index of the calling thread
+static __declspec(thread) JobSystem *currentSystem = nullptr;
+static __declspec(thread) int currentWorkerIndex = -1;
+
+
+JobCounter::JobCounter()
+{
+	count = 0;
+	continuations = closedList;
+}
+
+bool JobCounter::isDone() const
+{
+	// The count reaches zero before the last job closes the list, and that job may still be releasing the continuations
+	return count.load() == 0 && continuations.load() == closedList;
+}
+
+
+JobDeque::JobDeque(UINT capacity)
+{
+	UINT size = 1;
+	while (size < capacity)
+		size <<= 1;
+	slots.reset(new atomic<void*>[size]);
+	mask = size - 1;
+	top = 0;
+	bottom = 0;
+}
+
+bool JobDeque::push(void *item)
+{
+	int64_t b = bottom.load(memory_order_relaxed);
+	int64_t t = top.load(memory_order_acquire);
+	if (b - t > mask)
+		return false;
+	slots[b & mask].store(item, memory_order_relaxed);
+	// Publish the item before the new bottom is seen by thieves
+	bottom.store(b + 1, memory_order_release);
+	return true;
+}
+
+void *JobDeque::pop()
+{
+	int64_t b = bottom.load(memory_order_relaxed) - 1;
+	bottom.store(b, memory_order_relaxed);
+	// The reservation of slot b must be visible before top is read, otherwise a thief and the owner could both take it
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t t = top.load(memory_order_relaxed);
+
+	void *item = nullptr;
+	if (t <= b) {
+		item = slots[b & mask].load(memory_order_relaxed);
+		if (t == b) {
+			// Last item - race the thieves for it
+			if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+				item = nullptr;
+			bottom.store(b + 1, memory_order_relaxed);
+		}
+	}
+	else
+		bottom.store(b + 1, memory_order_relaxed);
+	return item;
+}
+
+void *JobDeque::steal()
+{
+	int64_t t = top.load(memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t b = bottom.load(memory_order_acquire);
+
+	if (t >= b)
+		return nullptr;
+	void *item = slots[t & mask].load(memory_order_relaxed);
+	if (!top.compare_exchange_strong(t, t + 1, memory_order_seq_cst, memory_order_relaxed))
+		return nullptr;
+	return item;
+}
+
+
+JobSystem *JobSystem::defaultSystem = nullptr;
+
+
+JobSystem::JobSystem(UINT _numThreads)
+{
+	numThreads = _numThreads ? _numThreads : max(thread::hardware_concurrency(), 1u);
+	numInjected = 0;
+	numBackground = 0;
+	numQueued = 0;
+	numSleeping = 0;
+
+	for (UINT i = 0; i < numThreads; i++) {
+		workers.push_back(new Worker());
+		workers[i]->random = 2463534242u + i * 7919u;
+	}
+
+	// The creating thread is worker 0
+	previousSystem = currentSystem;
+	previousWorker = currentWorkerIndex;
+	currentSystem = this;
+	currentWorkerIndex = 0;
+
+	for (UINT i = 1; i < numThreads; i++)
+		workers[i]->thread = thread(&JobSystem::workerMain, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		lock_guard<mutex> guard(sleepLock);
+		stopRequested = true;
+	}
+	wake.notify_all();
+	for (UINT i = 1; i < numThreads; i++)
+		workers[i]->thread.join();
+
+	// Jobs left over (the caller did not wait for them) are not run
+	for (size_t i = 0; i < workers.size(); i++) {
+		while (Job *job = (Job*)workers[i]->deque.steal())
+			delete job;
+		delete workers[i];
+	}
+	for (size_t i = 0; i < injected.size(); i++)
+		delete injected[i];
+	for (size_t i = 0; i < background.size(); i++)
+		delete background[i];
+
+	if (currentSystem == this) {
+		currentSystem = previousSystem;
+		currentWorkerIndex = previousWorker;
+	}
+	if (defaultSystem == this)
+		defaultSystem = nullptr;
+}
+
+JobSystem *JobSystem::getDefault()
+{
+	if (!defaultSystem)
+		defaultSystem = new JobSystem();
+	return defaultSystem;
+}
+
+void JobSystem::setDefault(JobSystem *system)
+{
+	defaultSystem = system;
+}
+
+
+int JobSystem::currentWorker() const
+{
+	return currentSystem == this ? currentWorkerIndex : -1;
+}
+
+void JobSystem::addJob(JobCounter *counter)
+{
+	if (!counter)
+		return;
+	if (counter->count.load() == 0) {
+		Job *closed = closedList;
+		counter->continuations.compare_exchange_strong(closed, nullptr);
+	}
+	counter->count++;
+}
+
+void JobSystem::queue(Job *job)
+{
+	int worker = currentWorker();
+	if (worker >= 0) {
+		if (!workers[worker]->deque.push(job)) {
+			// Deque full - run the job now rather than wait for space
+			execute(job, worker);
+			return;
+		}
+	}
+	else {
+		lock_guard<mutex> guard(injectedLock);
+		injected.push_back(job);
+		numInjected++;
+	}
+
+	// Wake a sleeping worker.  Taking the lock orders this with a worker that has checked numQueued but not started waiting yet
+	numQueued++;
+	if (numSleeping.load() > 0) {
+		{ lock_guard<mutex> guard(sleepLock); }
+		wake.notify_one();
+	}
+}
+
+void JobSystem::queueBackground(Job *job)
+{
+	{
+		lock_guard<mutex> guard(backgroundLock);
+		background.push_back(job);
+		numBackground++;
+	}
+
+	numQueued++;
+	if (numSleeping.load() > 0) {
+		{ lock_guard<mutex> guard(sleepLock); }
+		wake.notify_one();
+	}
+}
+
+JobSystem::Job *JobSystem::takeBackgroundJob()
+{
+	if (numBackground.load() == 0)
+		return nullptr;
+	lock_guard<mutex> guard(backgroundLock);
+	if (background.empty())
+		return nullptr;
+	Job *job = background.front();
+	background.pop_front();
+	numBackground--;
+	numQueued--;
+	return job;
+}
+
+JobSystem::Job *JobSystem::findJob(int worker)
+{
+	Job *job = nullptr;
+	if (worker >= 0)
+		job = (Job*)workers[worker]->deque.pop();
+
+	if (!job && numInjected.load() > 0) {
+		lock_guard<mutex> guard(injectedLock);
+		if (!injected.empty()) {
+			job = injected.front();
+			injected.pop_front();
+			numInjected--;
+		}
+	}
+
+	if (!job && numThreads > 1) {
+		// Start at a random victim so thieves spread over the workers
+		uint32_t r = worker >= 0 ? workers[worker]->random : (uint32_t)(uintptr_t)&job;
+		r ^= r << 13;
+		r ^= r >> 17;
+		r ^= r << 5;
+		if (worker >= 0)
+			workers[worker]->random = r;
+		for (UINT i = 0; i < numThreads && !job; i++) {
+			UINT victim = (r + i) % numThreads;
+			if ((int)victim != worker)
+				job = (Job*)workers[victim]->deque.steal();
+		}
+		if (job && worker >= 0)
+			workers[worker]->jobsStolen.fetch_add(1, memory_order_relaxed);
+	}
+
+	if (job) {
+		numQueued--;
+		return job;
+	}
+
+	// Frame work comes first, so background jobs are only taken when there is nothing else to do
+	if (worker > 0)
+		job = takeBackgroundJob();
+	return job;
+}
+
+void JobSystem::execute(Job *job, int worker)
+{
+	job->fn();
+
+	JobCounter *counter = job->counter;
+	delete job;
+	if (worker >= 0)
+		workers[worker]->jobsRun.fetch_add(1, memory_order_relaxed);
+	if (!counter)
+		return;
+
+	// Only the job whose decrement takes the count to zero closes the continuation list.  Waiting threads see the counter done once
+	// the list is closed, so the counter is not touched after the exchange
+	Job *ready = nullptr;
+	if (counter->count.fetch_sub(1) == 1)
+		ready = counter->continuations.exchange(closedList);
+
+	while (ready && ready != closedList) {
+		Job *next = ready->next;
+		queue(ready);
+		ready = next;
+	}
+}
+
+void JobSystem::workerMain(UINT worker)
+{
+	currentSystem = this;
+	currentWorkerIndex = (int)worker;
+
+	int idle = 0;
+	while (true) {
+		Job *job = findJob((int)worker);
+		if (job) {
+			execute(job, (int)worker);
+			idle = 0;
+			continue;
+		}
+
+		// Spin briefly before sleeping - new jobs usually follow soon after a worker runs out
+		if (++idle < 64) {
+			this_thread::yield();
+			continue;
+		}
+		idle = 0;
+
+		unique_lock<mutex> guard(sleepLock);
+		if (stopRequested)
+			return;
+		numSleeping++;
+		wake.wait(guard, [this] { return stopRequested || numQueued.load() > 0; });
+		numSleeping--;
+		if (stopRequested)
+			return;
+	}
+}
+
+
+void JobSystem::run(const JobFn &fn, JobCounter *counter)
+{
+	Job *job = new Job;
+	job->fn = fn;
+	job->counter = counter;
+	addJob(counter);
+	queue(job);
+}
+
+void JobSystem::runAfter(JobCounter *dependency, const JobFn &fn, JobCounter *counter)
+{
+	Job *job = new Job;
+	job->fn = fn;
+	job->counter = counter;
+	addJob(counter);
+
+	if (dependency) {
+		Job *head = dependency->continuations.load();
+		while (head != closedList) {
+			job->next = head;
+			if (dependency->continuations.compare_exchange_weak(head, job))
+				return;
+		}
+		job->next = nullptr;
+	}
+	queue(job);
+}
+
+void JobSystem::wait(JobCounter *counter)
+{
+	int worker = currentWorker();
+	while (!counter->isDone()) {
+		Job *job = findJob(worker);
+		if (job)
+			execute(job, worker);
+		else
+			this_thread::yield();
+	}
+}
+
+void JobSystem::runBackground(const JobFn &fn, JobCounter *counter)
+{
+	Job *job = new Job;
+	job->fn = fn;
+	job->counter = counter;
+	addJob(counter);
+	queueBackground(job);
+}
+
+bool JobSystem::runBackgroundJob()
+{
+	Job *job = takeBackgroundJob();
+	if (!job)
+		return false;
+	execute(job, currentWorker());
+	return true;
+}
+
+void JobSystem::parallelFor(size_t begin, size_t end, size_t grainSize, const RangeFn &fn)
+{
+	if (end <= begin)
+		return;
+	size_t count = end - begin;
+	grainSize = max(grainSize, (size_t)1);
+
+	// A few chunks per thread so stealing can even out chunks of different cost
+	size_t numChunks = min((count + grainSize - 1) / grainSize, (size_t)numThreads * 4);
+	if (numChunks <= 1) {
+		fn(begin, end);
+		return;
+	}
+	size_t chunkSize = (count + numChunks - 1) / numChunks;
+
+	JobCounter counter;
+	for (size_t first = begin + chunkSize; first < end; first += chunkSize) {
+		size_t last = min(first + chunkSize, end);
+		run([&fn, first, last] { fn(first, last); }, &counter);
+	}
+	fn(begin, min(begin + chunkSize, end));
+	wait(&counter);
+}
+
+
+void JobSystem::reportData() const
+{
+	cout << "JobSystem: " << numThreads << " threads" << endl;
+	for (UINT i = 0; i < numThreads; i++)
+		cout << "    Worker " << i << ": Jobs run = " << workers[i]->jobsRun.load() << ", Stolen = " << workers[i]->jobsStolen.load() << endl;
+}
+
+
+void JobSystem::benchmark(UINT maxThreads)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+	if (maxThreads == 0)
+		maxThreads = max(thread::hardware_concurrency(), 1u);
+
+	// A terrain sized grid of vertices (as Terrain::init builds) and a batch of small independent jobs
+	const size_t gridSize = 1024;
+	const int numSmallJobs = 20000;
+	const int numRepeats = 5;
+	vector<float> heights(gridSize * gridSize);
+	vector<float> results(numSmallJobs);
+
+	double baseGrid = 0.0, baseJobs = 0.0;
+	cout << "JobSystem benchmark: " << gridSize << "x" << gridSize << " grid parallel-for and " << numSmallJobs << " small jobs, best of " << numRepeats << endl;
+
+	for (UINT threads = 1; threads <= maxThreads; threads++) {
+
+		JobSystem jobs(threads);
+		double bestGrid = 1e30, bestJobs = 1e30;
+
+		for (int repeat = 0; repeat < numRepeats; repeat++) {
+
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			jobs.parallelFor(0, gridSize, 8, [&](size_t first, size_t last) {
+				for (size_t i = first; i < last; i++)
+					for (size_t j = 0; j < gridSize; j++)
+						heights[i * gridSize + j] = sinf(i * 0.01f) * cosf(j * 0.01f) + sqrtf((float)(i * j));
+			});
+			bestGrid = min(bestGrid, chrono::duration<double, milli>(BenchmarkClock::now() - start).count());
+
+			start = BenchmarkClock::now();
+			JobCounter counter;
+			for (int i = 0; i < numSmallJobs; i++) {
+				jobs.run([&results, i] {
+					float x = (float)i;
+					for (int k = 0; k < 64; k++)
+						x = sqrtf(x + k);
+					results[i] = x;
+				}, &counter);
+			}
+			jobs.wait(&counter);
+			bestJobs = min(bestJobs, chrono::duration<double, milli>(BenchmarkClock::now() - start).count());
+		}
+
+		if (threads == 1) {
+			baseGrid = bestGrid;
+			baseJobs = bestJobs;
+		}
+		cout << threads << " threads: parallel-for = " << bestGrid << " ms (" << baseGrid / bestGrid << "x), small jobs = " << bestJobs << " ms (" << baseJobs / bestJobs << "x)" << endl;
+	}
+}
@@ -0,0 +1,179 @@
+//
+// JobSystem.h
+//
+
+// Work-stealing job scheduler.  Each worker thread, and the thread that creates the system (worker 0, normally the main thread), owns
+// a Chase-Lev deque: the owner pushes and pops jobs at the bottom without locking while threads that run out of work steal from the
+// top of another worker's deque, so workers mostly run their own recently queued (cache-warm) jobs and only contend when idle.
+//
+// A job can be given a JobCounter which is incremented when the job is queued and decremented when it has run.  wait() runs queued
+// jobs on the calling thread until the counter reaches zero, so the main thread takes part in the work rather than blocking, and a
+// job can wait for the jobs it queues.  runAfter() expresses a dependency - the job is only queued once another counter reaches zero.
+// parallelFor() splits an index range into chunks, runs them as jobs and waits for them.
+//
+// Jobs may be queued by worker 0, by jobs and (through a locked queue) by any other thread.  Idle workers sleep on a condition
+// variable.  A system with one thread runs every job on worker 0 inside wait().
+//
+// Long running jobs that block on I/O (asset loading) are queued with runBackground().  Worker 0 never takes them in wait() or
+// parallelFor(), so the main thread's per-frame work is not held up behind a load; other workers take them when they have nothing
+// else to do.
+#pragma once
+
+#include <d3d11_2.h>
+#include <cstdint>
+#include <memory>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+
+class JobCounter;
+
+// Chase-Lev work-stealing deque of fixed capacity (a power of 2).  push() and pop() may only be called by the owning thread, steal()
+// by any thread.  Positions are monotonic, the slot of position p is p & mask
+class JobDeque {
+
+	std::atomic<int64_t>					top;
+	std::atomic<int64_t>					bottom;
+	std::unique_ptr<std::atomic<void*>[]>	slots;
+	int64_t									mask;
+
+public:
+
+	JobDeque(UINT capacity = 4096);
+
+	// Owner only.  Returns false if the deque is full
+	bool push(void *item);
+	// Owner only.  Take the most recently pushed item (nullptr if empty or a thief took the last one)
+	void *pop();
+	// Any thread.  Take the oldest item (nullptr if empty or another thread won the race for it)
+	void *steal();
+
+	int64_t size() const { int64_t n = bottom.load() - top.load(); return n > 0 ? n : 0; };
+};
+
+
+class JobSystem {
+
+public:
+
+	typedef std::function<void()> JobFn;
+	// Process indices [begin, end)
+	typedef std::function<void(size_t begin, size_t end)> RangeFn;
+
+	struct Job {
+		JobFn								fn;
+		JobCounter							*counter = nullptr;
+		Job									*next = nullptr; // Next job waiting on the same counter (runAfter)
+	};
+
+private:
+
+	struct Worker {
+		JobDeque							deque;
+		std::thread							thread;
+		uint32_t							random = 0; // xorshift state for picking steal victims
+		// Statistics (written by the worker only)
+		std::atomic<UINT64>					jobsRun;
+		std::atomic<UINT64>					jobsStolen;
+		Worker() { jobsRun = 0; jobsStolen = 0; };
+	};
+
+	UINT									numThreads = 1;
+	std::vector<Worker*>					workers;
+
+	// Jobs queued by threads that are not workers
+	std::mutex								injectedLock;
+	std::deque<Job*>						injected;
+	std::atomic<int>						numInjected;
+
+	// Background jobs, not taken by worker 0
+	std::mutex								backgroundLock;
+	std::deque<Job*>						background;
+	std::atomic<int>						numBackground;
+
+	// Jobs queued and not yet taken.  Workers sleep while it is zero
+	std::atomic<int>						numQueued;
+	std::atomic<int>						numSleeping;
+	std::mutex								sleepLock;
+	std::condition_variable					wake;
+	bool									stopRequested = false;
+
+	// The creating thread's previous system and worker index, restored by the destructor
+	JobSystem								*previousSystem = nullptr;
+	int										previousWorker = -1;
+
+	static JobSystem						*defaultSystem;
+
+	void queue(Job *job);
+	void queueBackground(Job *job);
+	Job *takeBackgroundJob();
+	// Count a job against counter (reopening its continuation list if it had reached zero)
+	static void addJob(JobCounter *counter);
+	// Pop from the worker's own deque, then take injected jobs, then steal, then take background jobs (workers other than 0)
+	Job *findJob(int worker);
+	void execute(Job *job, int worker);
+	void workerMain(UINT worker);
+
+public:
+
+	// numThreads = 0 uses one thread per hardware thread (including the calling thread)
+	JobSystem(UINT _numThreads = 0);
+	// Call once every queued job has finished
+	~JobSystem();
+
+	// System used by the scene and models.  Created on first use if none has been set
+	static JobSystem *getDefault();
+	static void setDefault(JobSystem *system);
+
+	UINT getNumThreads() const { return numThreads; };
+	// Index of the calling thread's worker in this system or -1 (eg. to index per-worker data from a job)
+	int currentWorker() const;
+
+	// Queue a job.  counter (optional) is incremented now and decremented when the job has run
+	void run(const JobFn &fn, JobCounter *counter = nullptr);
+	// Queue a job once dependency reaches zero
+	void runAfter(JobCounter *dependency, const JobFn &fn, JobCounter *counter = nullptr);
+	// Run jobs on the calling thread until counter reaches zero
+	void wait(JobCounter *counter);
+
+	// Queue a long running job on the background queue
+	void runBackground(const JobFn &fn, JobCounter *counter = nullptr);
+	// Run one background job on the calling thread (eg. when the system has no other workers to run them).  Returns false if none
+	// was queued
+	bool runBackgroundJob();
+
+	// Call fn on chunks of [begin, end) of at least grainSize indices in parallel and return when all have been processed.  The
+	// calling thread processes the first chunk
+	void parallelFor(size_t begin, size_t end, size_t grainSize, const RangeFn &fn);
+
+	void reportData() const;
+
+	// Time a parallel-for and a batch of small jobs on systems of 1 to maxThreads threads (0 = hardware threads) and print the
+	// speed-up over one thread
+	static void benchmark(UINT maxThreads = 0);
+};
+
+
+// Counts the outstanding jobs of a group.  A counter must outlive the jobs that use it and may only gain jobs from its own jobs or
+// while it is known to be non-zero (a job added from another thread as the last job finishes could miss the continuations)
+class JobCounter {
+
+	friend class JobSystem;
+
+	std::atomic<int>						count;
+	// Lock-free stack of jobs queued by runAfter(), released when count reaches zero.  Set to a marker when closed (count is zero)
+	// by the job that took count to zero
+	std::atomic<JobSystem::Job*>			continuations;
+
+public:
+
+	JobCounter();
+
+	// The count is zero and the continuations have been released, so the counter may be destroyed
+	bool isDone() const;
+	int getCount() const { return count.load(); };
+};
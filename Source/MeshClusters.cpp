@@ -0,0 +1,368 @@
+#include "stdafx.h"
+#include "MeshClusters.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+// Cones wider than this (the cosine of the smallest angle between the axis and a triangle normal) are not worth testing - the apex
+// moves far behind the cluster and the cone rarely contains the eye
+static const float minConeSpread = 0.1f;
+
+
+static inline float dot3(const float *a, const float *b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// Bounding sphere and normal cone of the triangles indices[0, numIndices)
+static void computeClusterBounds(const uint32_t *indices, size_t numIndices, const char *positionBytes, size_t positionStride, MeshCluster *cluster)
+{
+	// Sphere centred on the box of the vertices
+	float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = 0; i < numIndices; i++) {
+		const float *p = (const float*)(positionBytes + indices[i] * positionStride);
+		for (int k = 0; k < 3; k++) {
+			minP[k] = min(minP[k], p[k]);
+			maxP[k] = max(maxP[k], p[k]);
+		}
+	}
+	float radiusSq = 0.0f;
+	for (int k = 0; k < 3; k++)
+		cluster->centre[k] = (minP[k] + maxP[k]) * 0.5f;
+	for (size_t i = 0; i < numIndices; i++) {
+		const float *p = (const float*)(positionBytes + indices[i] * positionStride);
+		float d[3] = { p[0] - cluster->centre[0], p[1] - cluster->centre[1], p[2] - cluster->centre[2] };
+		radiusSq = max(radiusSq, dot3(d, d));
+	}
+	cluster->radius = sqrt(radiusSq);
+
+	// Cone axis - the average of the triangle normals (cross(b - a, c - a) faces the viewer of a front face).  Degenerate triangles are
+	// never drawn so they do not widen the cone
+	vector<float> normals(numIndices);
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+	for (size_t t = 0; t < numIndices; t += 3) {
+		const float *a = (const float*)(positionBytes + indices[t] * positionStride);
+		const float *b = (const float*)(positionBytes + indices[t + 1] * positionStride);
+		const float *c = (const float*)(positionBytes + indices[t + 2] * positionStride);
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float *n = &normals[t];
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		float length = sqrt(dot3(n, n));
+		float scale = (length > 0.0f) ? 1.0f / length : 0.0f;
+		for (int k = 0; k < 3; k++) {
+			n[k] *= scale;
+			axis[k] += n[k];
+		}
+	}
+	float axisLength = sqrt(dot3(axis, axis));
+	cluster->coneCutoff = 2.0f;
+	for (int k = 0; k < 3; k++) {
+		cluster->coneAxis[k] = (axisLength > 0.0f) ? axis[k] / axisLength : 0.0f;
+		cluster->coneApex[k] = cluster->centre[k];
+	}
+	if (axisLength <= 0.0f)
+		return;
+
+	float minDot = 1.0f;
+	for (size_t t = 0; t < numIndices; t += 3)
+		if (dot3(&normals[t], &normals[t]) > 0.0f)
+			minDot = min(minDot, dot3(&normals[t], cluster->coneAxis));
+	if (minDot < minConeSpread)
+		return;
+
+	// Move the apex back along the axis from the centre until it is behind the plane of every triangle
+	float maxT = 0.0f;
+	for (size_t t = 0; t < numIndices; t += 3) {
+		const float *n = &normals[t];
+		if (dot3(n, n) <= 0.0f)
+			continue;
+		const float *a = (const float*)(positionBytes + indices[t] * positionStride);
+		float d[3] = { cluster->centre[0] - a[0], cluster->centre[1] - a[1], cluster->centre[2] - a[2] };
+		maxT = max(maxT, dot3(d, n) / dot3(cluster->coneAxis, n));
+	}
+	for (int k = 0; k < 3; k++)
+		cluster->coneApex[k] = cluster->centre[k] - cluster->coneAxis[k] * maxT;
+	cluster->coneCutoff = sqrt(1.0f - minDot * minDot);
+}
+
+
+size_t buildMeshClusters(uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, uint32_t indexOffset,
+	vector<MeshCluster> *clusters, size_t maxVertices, size_t maxTriangles)
+{
+	size_t numTriangles = numIndices / 3;
+	if (numTriangles == 0 || maxVertices < 3 || maxTriangles == 0)
+		return 0;
+
+	const char *positionBytes = (const char*)positions;
+
+	// Unit normal of each triangle (zero if degenerate)
+	vector<float> normals(numTriangles * 3);
+	for (size_t t = 0; t < numTriangles; t++) {
+		const float *a = (const float*)(positionBytes + indices[t * 3] * positionStride);
+		const float *b = (const float*)(positionBytes + indices[t * 3 + 1] * positionStride);
+		const float *c = (const float*)(positionBytes + indices[t * 3 + 2] * positionStride);
+		float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] }, e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float *n = &normals[t * 3];
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+		float length = sqrt(dot3(n, n));
+		for (int k = 0; k < 3 && length > 0.0f; k++)
+			n[k] /= length;
+	}
+
+	// Triangles using each vertex
+	vector<uint32_t> adjacencyStart(numVertices + 1, 0);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		adjacencyStart[indices[i] + 1]++;
+	for (size_t v = 0; v < numVertices; v++)
+		adjacencyStart[v + 1] += adjacencyStart[v];
+	vector<uint32_t> adjacency(numTriangles * 3);
+	vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < numTriangles * 3; i++)
+		adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	vector<uint32_t> result;
+	result.reserve(numTriangles * 3);
+	vector<bool> emitted(numTriangles, false);
+	vector<int> vertexCluster(numVertices, -1); // Last cluster each vertex was added to
+	vector<uint32_t> candidates;
+	size_t numAdded = 0, nextSeed = 0;
+
+	for (int clusterIndex = (int)clusters->size(); numAdded < numTriangles; clusterIndex++) {
+
+		while (emitted[nextSeed])
+			nextSeed++;
+
+		MeshCluster cluster;
+		cluster.firstIndex = indexOffset + (uint32_t)result.size();
+		size_t clusterVertices = 0, clusterTriangles = 0;
+		float normalSum[3] = { 0.0f, 0.0f, 0.0f };
+		candidates.clear();
+
+		for (size_t triangle = nextSeed; triangle != (size_t)-1;) {
+
+			// Add the triangle and make the triangles sharing its new vertices candidates
+			emitted[triangle] = true;
+			numAdded++;
+			clusterTriangles++;
+			for (int k = 0; k < 3; k++)
+				normalSum[k] += normals[triangle * 3 + k];
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = indices[triangle * 3 + k];
+				result.push_back(v);
+				if (vertexCluster[v] == clusterIndex)
+					continue;
+				vertexCluster[v] = clusterIndex;
+				clusterVertices++;
+				for (uint32_t a = adjacencyStart[v]; a < adjacencyStart[v + 1]; a++)
+					if (!emitted[adjacency[a]])
+						candidates.push_back(adjacency[a]);
+			}
+			if (clusterTriangles >= maxTriangles)
+				break;
+
+			// Next - the candidate adding the fewest vertices, then the one facing most the way the cluster faces.  Triangles turned more
+			// than 90 degrees from the cluster would make the cone useless so they start another cluster
+			triangle = (size_t)-1;
+			int bestNew = 4;
+			float bestFacing = -FLT_MAX;
+			size_t numCandidates = 0;
+			for (size_t c = 0; c < candidates.size(); c++) {
+				uint32_t candidate = candidates[c];
+				if (emitted[candidate])
+					continue;
+				candidates[numCandidates++] = candidate;
+				int newVertices = 0;
+				for (int k = 0; k < 3; k++)
+					newVertices += (vertexCluster[indices[candidate * 3 + k]] == clusterIndex) ? 0 : 1;
+				if (clusterVertices + newVertices > maxVertices)
+					continue;
+				float facing = dot3(&normals[candidate * 3], normalSum);
+				if (facing < 0.0f || newVertices > bestNew || (newVertices == bestNew && facing <= bestFacing))
+					continue;
+				triangle = candidate;
+				bestNew = newVertices;
+				bestFacing = facing;
+			}
+			candidates.resize(numCandidates);
+		}
+
+		cluster.indexCount = indexOffset + (uint32_t)result.size() - cluster.firstIndex;
+		computeClusterBounds(&result[cluster.firstIndex - indexOffset], cluster.indexCount, positionBytes, positionStride, &cluster);
+		clusters->push_back(cluster);
+	}
+
+	copy(result.begin(), result.end(), indices);
+	return clusters->size();
+}
+
+
+void setClusterCullView(const float *m, const float eye[3], bool cullBackfaces, ClusterCullView *view)
+{
+	// Planes from the columns of the model to clip matrix (clip = v M): -w <= x <= w, -w <= y <= w and 0 <= z <= w
+	for (int row = 0; row < 4; row++) {
+		const float *r = &m[row * 4];
+		view->planes[0][row] = r[3] + r[0]; // Left
+		view->planes[1][row] = r[3] - r[0]; // Right
+		view->planes[2][row] = r[3] + r[1]; // Bottom
+		view->planes[3][row] = r[3] - r[1]; // Top
+		view->planes[4][row] = r[2]; // Near
+		view->planes[5][row] = r[3] - r[2]; // Far
+	}
+	for (int p = 0; p < 6; p++) {
+		float length = sqrt(dot3(view->planes[p], view->planes[p]));
+		for (int k = 0; k < 4 && length > 0.0f; k++)
+			view->planes[p][k] /= length;
+	}
+	for (int k = 0; k < 3; k++)
+		view->eye[k] = eye[k];
+	view->cullBackfaces = cullBackfaces;
+}
+
+size_t cullMeshClusters(const MeshCluster *clusters, size_t numClusters, const ClusterCullView &view, uint32_t *visible, ClusterCullStats *stats)
+{
+	size_t numVisible = 0, numFrustumCulled = 0, numBackfaceCulled = 0, numVisibleIndices = 0;
+
+	for (size_t i = 0; i < numClusters; i++) {
+		const MeshCluster &cluster = clusters[i];
+
+		// The sphere is outside if it is wholly behind any plane
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++)
+			outside = dot3(view.planes[p], cluster.centre) + view.planes[p][3] < -cluster.radius;
+		if (outside) {
+			numFrustumCulled++;
+			continue;
+		}
+
+		// Every triangle faces away if the direction from the eye to the apex is within the cutoff of the axis
+		if (view.cullBackfaces && cluster.coneCutoff <= 1.0f) {
+			float d[3] = { cluster.coneApex[0] - view.eye[0], cluster.coneApex[1] - view.eye[1], cluster.coneApex[2] - view.eye[2] };
+			if (dot3(d, cluster.coneAxis) >= cluster.coneCutoff * sqrt(dot3(d, d))) {
+				numBackfaceCulled++;
+				continue;
+			}
+		}
+
+		visible[numVisible++] = (uint32_t)i;
+		numVisibleIndices += cluster.indexCount;
+	}
+
+	if (stats) {
+		stats->numClusters = numClusters;
+		stats->numFrustumCulled = numFrustumCulled;
+		stats->numBackfaceCulled = numBackfaceCulled;
+		stats->numVisibleIndices = numVisibleIndices;
+	}
+	return numVisible;
+}
+
+size_t compactClusterIndices(uint32_t *destination, const uint32_t *indices, const MeshCluster *clusters, const uint32_t *visible, size_t numVisible)
+{
+	// Neighbouring clusters are usually visible together, so runs of them are copied at once
+	size_t numWritten = 0;
+	for (size_t i = 0; i < numVisible;) {
+		uint32_t first = clusters[visible[i]].firstIndex;
+		uint32_t end = first + clusters[visible[i]].indexCount;
+		for (i++; i < numVisible && clusters[visible[i]].firstIndex == end; i++)
+			end += clusters[visible[i]].indexCount;
+		memcpy(destination + numWritten, indices + first, (end - first) * sizeof(uint32_t));
+		numWritten += end - first;
+	}
+	return numWritten;
+}
+
+
+void benchmarkClusterCulling(const MeshCluster *clusters, size_t numClusters, const uint32_t *indices, int numViews, int iterations)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+
+	if (numClusters == 0 || numViews <= 0 || iterations <= 0)
+		return;
+
+	// Box of the clusters
+	float minP[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maxP[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	size_t numIndices = 0;
+	for (size_t i = 0; i < numClusters; i++) {
+		for (int k = 0; k < 3; k++) {
+			minP[k] = min(minP[k], clusters[i].centre[k] - clusters[i].radius);
+			maxP[k] = max(maxP[k], clusters[i].centre[k] + clusters[i].radius);
+		}
+		numIndices = max(numIndices, (size_t)clusters[i].firstIndex + clusters[i].indexCount);
+	}
+	float centre[3] = { (minP[0] + maxP[0]) * 0.5f, (minP[1] + maxP[1]) * 0.5f, (minP[2] + maxP[2]) * 0.5f };
+	float extent[3] = { maxP[0] - centre[0], maxP[1] - centre[1], maxP[2] - centre[2] };
+	float radius = max(sqrt(dot3(extent, extent)), 1e-6f);
+
+	vector<uint32_t> visible(numClusters);
+	vector<uint32_t> compacted(numIndices);
+	double cullTime = 0.0, compactTime = 0.0;
+	double frustumCulled = 0.0, backfaceCulled = 0.0, visibleIndices = 0.0;
+
+	for (int v = 0; v < numViews; v++) {
+
+		// Eyes spiral around the model from inside its bounds to three times their radius, looking at its centre with a 60 degree view
+		float angle = 2.399963f * v, height = 1.0f - 2.0f * (v + 0.5f) / numViews, ring = sqrt(1.0f - height * height);
+		float distance = radius * (0.5f + 2.5f * (v % 4) / 3.0f);
+		float eye[3] = { centre[0] + distance * ring * cos(angle), centre[1] + distance * height, centre[2] + distance * ring * sin(angle) };
+
+		float zAxis[3] = { centre[0] - eye[0], centre[1] - eye[1], centre[2] - eye[2] };
+		float length = sqrt(dot3(zAxis, zAxis));
+		for (int k = 0; k < 3; k++)
+			zAxis[k] /= length;
+		float up[3] = { 0.0f, 1.0f, 0.0f };
+		if (fabs(zAxis[1]) > 0.99f) {
+			up[1] = 0.0f;
+			up[2] = 1.0f;
+		}
+		float xAxis[3] = { up[1] * zAxis[2] - up[2] * zAxis[1], up[2] * zAxis[0] - up[0] * zAxis[2], up[0] * zAxis[1] - up[1] * zAxis[0] };
+		length = sqrt(dot3(xAxis, xAxis));
+		for (int k = 0; k < 3; k++)
+			xAxis[k] /= length;
+		float yAxis[3] = { zAxis[1] * xAxis[2] - zAxis[2] * xAxis[1], zAxis[2] * xAxis[0] - zAxis[0] * xAxis[2], zAxis[0] * xAxis[1] - zAxis[1] * xAxis[0] };
+
+		// Left handed look at and perspective projection (as XMMatrixLookAtLH and XMMatrixPerspectiveFovLH) combined
+		float scale = 1.0f / tan(0.5f * 1.0471976f), nearZ = radius * 0.01f, farZ = radius * 10.0f, q = farZ / (farZ - nearZ);
+		float viewMatrix[16] = { xAxis[0], yAxis[0], zAxis[0], 0.0f, xAxis[1], yAxis[1], zAxis[1], 0.0f, xAxis[2], yAxis[2], zAxis[2], 0.0f,
+			-dot3(xAxis, eye), -dot3(yAxis, eye), -dot3(zAxis, eye), 1.0f };
+		float modelToClip[16];
+		for (int row = 0; row < 4; row++) {
+			const float *r = &viewMatrix[row * 4];
+			modelToClip[row * 4 + 0] = r[0] * scale;
+			modelToClip[row * 4 + 1] = r[1] * scale;
+			modelToClip[row * 4 + 2] = r[2] * q + r[3] * -q * nearZ;
+			modelToClip[row * 4 + 3] = r[2];
+		}
+
+		ClusterCullView view;
+		setClusterCullView(modelToClip, eye, true, &view);
+		ClusterCullStats stats;
+		size_t numVisible = 0;
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (int i = 0; i < iterations; i++)
+			numVisible = cullMeshClusters(clusters, numClusters, view, visible.data(), &stats);
+		cullTime += chrono::duration<double, nano>(BenchmarkClock::now() - start).count() / iterations;
+
+		start = BenchmarkClock::now();
+		for (int i = 0; i < iterations; i++)
+			compactClusterIndices(compacted.data(), indices, clusters, visible.data(), numVisible);
+		compactTime += chrono::duration<double, nano>(BenchmarkClock::now() - start).count() / iterations;
+
+		frustumCulled += (double)stats.numFrustumCulled / numClusters;
+		backfaceCulled += (double)stats.numBackfaceCulled / numClusters;
+		visibleIndices += (double)stats.numVisibleIndices / numIndices;
+	}
+
+	cout << "Cluster culling: " << numClusters << " clusters (" << numIndices / 3 / numClusters << " triangles each), " << numViews << " views - cull = "
+		<< cullTime / numViews / numClusters << " ns per cluster, compact = " << compactTime / numViews / 1000.0 << " us, culled by frustum "
+		<< 100.0 * frustumCulled / numViews << "%, by cone " << 100.0 * backfaceCulled / numViews << "%, triangles drawn " << 100.0 * visibleIndices / numViews << "%" << endl;
+}
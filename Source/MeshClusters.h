@@ -0,0 +1,69 @@
+//
+// MeshClusters.h
+//
+
+// Import time splitting of a triangle list into clusters (meshlets) of at most CLUSTER_MAX_VERTICES vertices and
+// CLUSTER_MAX_TRIANGLES triangles, and the per frame culling of the clusters on the CPU.  buildMeshClusters() grows each cluster
+// from a seed triangle through the triangles that share its vertices, preferring those that add the fewest new vertices and face the
+// same way as the cluster, so the clusters are compact and their normal cones narrow.  Each cluster keeps a bounding sphere and a
+// normal cone.  The cone's apex lies behind the plane of every triangle of the cluster, so an eye looking at the apex along a direction
+// within the cutoff of the cone's axis sees only back faces.
+//
+// cullMeshClusters() tests the clusters against the frustum planes and the eye in model space - the planes are taken from the model
+// to clip matrix, so world matrices with non-uniform scale are handled exactly - and compactClusterIndices() copies the index ranges
+// of the clusters that survive one after another, ready for a single draw.  Only the CPU is used.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define CLUSTER_MAX_VERTICES 64
+#define CLUSTER_MAX_TRIANGLES 124
+
+struct MeshCluster {
+	float								centre[3]; // Bounding sphere
+	float								radius;
+	float								coneApex[3];
+	float								coneCutoff; // Sine of the cone's half angle (greater than 1 if the cluster faces too many ways to cull)
+	float								coneAxis[3];
+	uint32_t							firstIndex; // Index range of the cluster's triangles
+	uint32_t							indexCount;
+};
+
+// Model space view the clusters are culled against
+struct ClusterCullView {
+	float								planes[6][4]; // Normalised frustum planes, a x + b y + c z + d >= 0 inside
+	float								eye[3];
+	bool								cullBackfaces = false; // Only if the clusters are drawn with back faces culled
+};
+
+struct ClusterCullStats {
+	size_t								numClusters = 0;
+	size_t								numFrustumCulled = 0;
+	size_t								numBackfaceCulled = 0;
+	size_t								numVisibleIndices = 0;
+};
+
+// Split the triangles of one mesh into clusters.  indices are reordered in place so each cluster is a contiguous range and a cluster
+// is appended to clusters for each, with firstIndex counted from indexOffset (the position of indices in the index buffer).
+// positions points at the first vertex position (3 floats) and positionStride is the size of a vertex in bytes.  The winding of the
+// triangles is kept.  Returns the number of clusters added
+size_t buildMeshClusters(uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, uint32_t indexOffset,
+	std::vector<MeshCluster> *clusters, size_t maxVertices = CLUSTER_MAX_VERTICES, size_t maxTriangles = CLUSTER_MAX_TRIANGLES);
+
+// Set up view from a model to clip space matrix (16 floats, row major, row vectors as DirectXMath) and the eye in model space.  Front
+// faces are clockwise on screen
+void setClusterCullView(const float *modelToClip, const float eye[3], bool cullBackfaces, ClusterCullView *view);
+
+// Write the indices (into clusters) of the clusters that are inside the frustum and, if view.cullBackfaces is set, not facing away
+// from the eye to visible.  Returns the number written
+size_t cullMeshClusters(const MeshCluster *clusters, size_t numClusters, const ClusterCullView &view, uint32_t *visible, ClusterCullStats *stats = nullptr);
+
+// Copy the index ranges of the visible clusters one after another into destination, which must have room for all of them.  Returns
+// the number of indices written
+size_t compactClusterIndices(uint32_t *destination, const uint32_t *indices, const MeshCluster *clusters, const uint32_t *visible, size_t numVisible);
+
+// Time cullMeshClusters and compactClusterIndices from numViews views around the clusters and report the time per cluster and the
+// fraction culled to the console
+void benchmarkClusterCulling(const MeshCluster *clusters, size_t numClusters, const uint32_t *indices, int numViews = 64, int iterations = 20);
@@ -0,0 +1,290 @@
+#include "stdafx.h"
+#include "MeshOptimiser.h"
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+
+// FIFO cache of cacheSize entries.  A vertex is cached while fewer than cacheSize misses have happened since it was last missed, so
+// the cache is simulated with a miss counter and the time of each vertex's last miss rather than a queue
+class FifoCache {
+
+	vector<UINT64>							missTime;
+	UINT64									time;
+	UINT									cacheSize;
+
+public:
+
+	FifoCache(size_t numVertices, UINT _cacheSize) : missTime(numVertices, 0), time(_cacheSize + 1), cacheSize(_cacheSize) {};
+
+	// Returns true on a miss
+	bool use(uint32_t v) {
+		if (time - missTime[v] <= cacheSize)
+			return false;
+		missTime[v] = time++;
+		return true;
+	};
+	UINT triangleMisses(const uint32_t *triangle) { return (use(triangle[0]) ? 1 : 0) + (use(triangle[1]) ? 1 : 0) + (use(triangle[2]) ? 1 : 0); };
+	// Empty the cache
+	void flush() { time += cacheSize + 1; };
+};
+
+static bool validIndices(const uint32_t *indices, size_t numIndices, size_t numVertices)
+{
+	if (!indices || numIndices % 3 != 0)
+		return false;
+	for (size_t i = 0; i < numIndices; i++)
+		if (indices[i] >= numVertices)
+			return false;
+	return true;
+}
+
+
+VertexCacheStats analyseVertexCache(const uint32_t *indices, size_t numIndices, size_t numVertices, UINT cacheSize)
+{
+	VertexCacheStats stats;
+	if (!validIndices(indices, numIndices, numVertices))
+		return stats;
+
+	FifoCache cache(numVertices, cacheSize);
+	vector<bool> used(numVertices, false);
+	for (size_t i = 0; i < numIndices; i++) {
+		if (cache.use(indices[i]))
+			stats.numTransformed++;
+		if (!used[indices[i]]) {
+			used[indices[i]] = true;
+			stats.numVertices++;
+		}
+	}
+	stats.numTriangles = numIndices / 3;
+	return stats;
+}
+
+
+void optimiseVertexCache(uint32_t *indices, size_t numIndices, size_t numVertices, UINT cacheSize)
+{
+	if (!validIndices(indices, numIndices, numVertices) || numIndices == 0)
+		return;
+
+	size_t numTriangles = numIndices / 3;
+
+	// Triangles using each vertex (adjacency[adjacencyStart[v], adjacencyStart[v + 1]))
+	vector<uint32_t> liveTriangles(numVertices, 0);
+	for (size_t i = 0; i < numIndices; i++)
+		liveTriangles[indices[i]]++;
+	vector<uint32_t> adjacencyStart(numVertices + 1, 0);
+	for (size_t v = 0; v < numVertices; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+	vector<uint32_t> adjacency(numIndices);
+	vector<uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i = 0; i < numIndices; i++)
+		adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	vector<uint64_t> cacheTime(numVertices, 0);
+	uint64_t time = cacheSize + 1;
+	vector<bool> emitted(numTriangles, false);
+	vector<uint32_t> deadEnds; // Recently emitted vertices, the next fanning vertex when the candidates have no live triangles
+	vector<uint32_t> candidates;
+	size_t cursor = 0; // Next vertex to try when there are no dead ends left
+	vector<uint32_t> result;
+	result.reserve(numIndices);
+
+	int64_t fanning = 0;
+	while (fanning >= 0) {
+
+		// Emit the live triangles around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = adjacencyStart[(size_t)fanning]; a < adjacencyStart[(size_t)fanning + 1]; a++) {
+			uint32_t t = adjacency[a];
+			if (emitted[t])
+				continue;
+			for (int k = 0; k < 3; k++) {
+				uint32_t v = indices[t * 3 + k];
+				result.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Next fanning vertex - the candidate that has been in the cache longest and will still be there after its remaining
+		// triangles have been emitted
+		fanning = -1;
+		int64_t bestPriority = -1;
+		for (size_t i = 0; i < candidates.size(); i++) {
+			uint32_t v = candidates[i];
+			if (liveTriangles[v] == 0)
+				continue;
+			int64_t priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = (int64_t)(time - cacheTime[v]);
+			if (priority > bestPriority) {
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+
+		// Dead end - fall back to a recently used vertex, then to any vertex with live triangles
+		while (fanning < 0 && !deadEnds.empty()) {
+			uint32_t v = deadEnds.back();
+			deadEnds.pop_back();
+			if (liveTriangles[v] > 0)
+				fanning = v;
+		}
+		while (fanning < 0 && cursor < numVertices) {
+			if (liveTriangles[cursor] > 0)
+				fanning = (int64_t)cursor;
+			else
+				cursor++;
+		}
+	}
+
+	memcpy(indices, result.data(), numIndices * sizeof(uint32_t));
+}
+
+
+void optimiseOverdraw(uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, UINT cacheSize, float threshold)
+{
+	if (!validIndices(indices, numIndices, numVertices) || !positions || numIndices == 0)
+		return;
+
+	size_t numTriangles = numIndices / 3;
+	FifoCache cache(numVertices, cacheSize);
+
+	// Hard boundaries - triangles that miss on all three vertices start a cache-cold run
+	vector<size_t> hardBoundaries;
+	for (size_t t = 0; t < numTriangles; t++)
+		if (cache.triangleMisses(indices + t * 3) == 3 || t == 0)
+			hardBoundaries.push_back(t);
+	hardBoundaries.push_back(numTriangles);
+
+	// Soft boundaries - split each run where the miss rate since the last split has fallen to within threshold of the run's
+	vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hardBoundaries.size(); h++) {
+		size_t start = hardBoundaries[h];
+		size_t end = hardBoundaries[h + 1];
+
+		cache.flush();
+		UINT64 runMisses = 0;
+		for (size_t t = start; t < end; t++)
+			runMisses += cache.triangleMisses(indices + t * 3);
+		double clusterThreshold = threshold * (double)runMisses / (double)(end - start);
+
+		cache.flush();
+		clusters.push_back(start);
+		UINT64 misses = 0;
+		size_t clusterTriangles = 0;
+		for (size_t t = start; t < end; t++) {
+			misses += cache.triangleMisses(indices + t * 3);
+			clusterTriangles++;
+			if (t + 1 < end && (double)misses <= clusterThreshold * clusterTriangles) {
+				clusters.push_back(t + 1);
+				cache.flush();
+				misses = 0;
+				clusterTriangles = 0;
+			}
+		}
+	}
+	size_t numClusters = clusters.size();
+	clusters.push_back(numTriangles);
+
+	// Area weighted centroid and normal of each cluster and of the mesh
+	struct Cluster {
+		double								centroid[3];
+		double								normal[3];
+		double								area;
+		double								sortKey;
+	};
+	vector<Cluster> clusterData(numClusters);
+	double meshCentroid[3] = { 0.0, 0.0, 0.0 };
+	double meshArea = 0.0;
+	const char *positionBytes = (const char*)positions;
+
+	for (size_t c = 0; c < numClusters; c++) {
+		Cluster &cluster = clusterData[c];
+		memset(&cluster, 0, sizeof(Cluster));
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+			const float *p0 = (const float*)(positionBytes + indices[t * 3] * positionStride);
+			const float *p1 = (const float*)(positionBytes + indices[t * 3 + 1] * positionStride);
+			const float *p2 = (const float*)(positionBytes + indices[t * 3 + 2] * positionStride);
+			double e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+			double e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+			double n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			double area = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5;
+			for (int k = 0; k < 3; k++) {
+				cluster.centroid[k] += area * (p0[k] + p1[k] + p2[k]) / 3.0;
+				cluster.normal[k] += n[k];
+			}
+			cluster.area += area;
+		}
+		for (int k = 0; k < 3; k++)
+			meshCentroid[k] += cluster.centroid[k];
+		meshArea += cluster.area;
+		if (cluster.area > 0.0)
+			for (int k = 0; k < 3; k++)
+				cluster.centroid[k] /= cluster.area;
+	}
+	if (meshArea > 0.0)
+		for (int k = 0; k < 3; k++)
+			meshCentroid[k] /= meshArea;
+
+	// Distance of each cluster's plane out from the mesh centroid.  The sum over a closed mesh is positive if the winding makes the
+	// normals point out, so its sign makes the order independent of the winding convention
+	double orientation = 0.0;
+	for (size_t c = 0; c < numClusters; c++) {
+		Cluster &cluster = clusterData[c];
+		double length = sqrt(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+		cluster.sortKey = 0.0;
+		if (length > 0.0)
+			for (int k = 0; k < 3; k++)
+				cluster.sortKey += (cluster.centroid[k] - meshCentroid[k]) * cluster.normal[k] / length;
+		orientation += cluster.sortKey * cluster.area;
+	}
+	double sign = orientation < 0.0 ? -1.0 : 1.0;
+
+	// Outward facing clusters first
+	vector<uint32_t> order(numClusters);
+	for (size_t c = 0; c < numClusters; c++)
+		order[c] = (uint32_t)c;
+	stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return clusterData[a].sortKey * sign > clusterData[b].sortKey * sign; });
+
+	vector<uint32_t> result;
+	result.reserve(numIndices);
+	for (size_t i = 0; i < numClusters; i++) {
+		uint32_t c = order[i];
+		result.insert(result.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+	}
+	memcpy(indices, result.data(), numIndices * sizeof(uint32_t));
+}
+
+
+void optimiseVertexFetch(void *vertices, size_t vertexSize, size_t numVertices, uint32_t *indices, size_t numIndices)
+{
+	if (!vertices || !validIndices(indices, numIndices, numVertices))
+		return;
+
+	// New index of each vertex in order of first use
+	static const uint32_t unused = 0xffffffff;
+	vector<uint32_t> remap(numVertices, unused);
+	uint32_t next = 0;
+	for (size_t i = 0; i < numIndices; i++) {
+		uint32_t &r = remap[indices[i]];
+		if (r == unused)
+			r = next++;
+		indices[i] = r;
+	}
+	for (size_t v = 0; v < numVertices; v++)
+		if (remap[v] == unused)
+			remap[v] = next++;
+
+	vector<char> original((const char*)vertices, (const char*)vertices + numVertices * vertexSize);
+	char *destination = (char*)vertices;
+	for (size_t v = 0; v < numVertices; v++)
+		memcpy(destination + remap[v] * vertexSize, original.data() + v * vertexSize, vertexSize);
+}
@@ -0,0 +1,51 @@
+//
+// MeshOptimiser.h
+//
+
+// Import time reordering of indexed triangle lists for the GPU's post-transform vertex cache, overdraw and vertex fetch.
+// optimiseVertexCache() orders the triangles with Tipsify (Sander, Nehab and Barczak 2007): it fans around one vertex at a time and
+// picks the next fanning vertex among the vertices just emitted that will still be in a FIFO cache of cacheSize entries when it is
+// used again, so each vertex is transformed about once.  optimiseOverdraw() then splits that order into clusters where the cache
+// would start cold anyway (or where a cluster's own miss rate is close to its parent's) and sorts the clusters so those facing out
+// from the centre of the mesh are drawn first and occlude the rest.  optimiseVertexFetch() finally renumbers the vertices in the
+// order the indices first use them, so the vertex buffer is read sequentially.
+//
+// The functions work on one mesh - numVertices vertices referenced by indices [0, numVertices) - and only use the CPU.
+// analyseVertexCache() measures the result with a FIFO cache: ACMR is the number of vertices transformed per triangle (0.5 is the
+// ideal for a regular grid, 3 the worst case) and ATVR the number transformed per vertex used (1 is the ideal).
+#pragma once
+
+#include <d3d11_2.h>
+#include <cstdint>
+#include <cstddef>
+
+#define DEFAULT_VERTEX_CACHE_SIZE 16
+
+struct VertexCacheStats {
+	UINT64									numTriangles = 0;
+	UINT64									numVertices = 0; // Vertices referenced by the indices
+	UINT64									numTransformed = 0; // Cache misses
+
+	// Average cache miss ratio (transformed vertices per triangle)
+	float acmr() const { return numTriangles ? (float)numTransformed / numTriangles : 0.0f; };
+	// Average transform to vertex ratio
+	float atvr() const { return numVertices ? (float)numTransformed / numVertices : 0.0f; };
+	// Accumulate the statistics of several meshes
+	void add(const VertexCacheStats &stats) { numTriangles += stats.numTriangles; numVertices += stats.numVertices; numTransformed += stats.numTransformed; };
+};
+
+// Simulate a FIFO post-transform cache of cacheSize entries drawing the triangle list
+VertexCacheStats analyseVertexCache(const uint32_t *indices, size_t numIndices, size_t numVertices, UINT cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Reorder the triangles (Tipsify) for a vertex cache of cacheSize entries.  The vertices of each triangle keep their order, so the
+// winding does not change
+void optimiseVertexCache(uint32_t *indices, size_t numIndices, size_t numVertices, UINT cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+// Reorder clusters of the triangles (after optimiseVertexCache) to reduce overdraw.  positions points at the first vertex position
+// (3 floats) and positionStride is the size of a vertex in bytes.  A cluster ends where its miss rate is within threshold of the miss
+// rate of the cache-cold run it is part of, so higher thresholds give more, smaller clusters (less overdraw, more cache misses)
+void optimiseOverdraw(uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, UINT cacheSize = DEFAULT_VERTEX_CACHE_SIZE, float threshold = 1.05f);
+
+// Reorder vertices (vertexSize bytes each) in the order the indices first use them and update the indices to match.  Vertices the
+// indices do not use are moved to the end
+void optimiseVertexFetch(void *vertices, size_t vertexSize, size_t numVertices, uint32_t *indices, size_t numIndices);
@@ -0,0 +1,408 @@
+#include "stdafx.h"
+#include "MeshSimplifier.h"
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+
+using namespace std;
+
+
+// Symmetric 4x4 matrix of the squared distance to a set of weighted planes.  Errors are divided by the total weight so they are
+// squared distances whatever the size of the triangles
+struct Quadric {
+	double									a00, a11, a22, a01, a02, a12; // A
+	double									b0, b1, b2; // b
+	double									c;
+	double									w;
+};
+
+static void quadricFromPlane(Quadric &q, double a, double b, double c, double d, double w)
+{
+	q.a00 = a * a * w;
+	q.a11 = b * b * w;
+	q.a22 = c * c * w;
+	q.a01 = a * b * w;
+	q.a02 = a * c * w;
+	q.a12 = b * c * w;
+	q.b0 = a * d * w;
+	q.b1 = b * d * w;
+	q.b2 = c * d * w;
+	q.c = d * d * w;
+	q.w = w;
+}
+
+static void quadricAdd(Quadric &q, const Quadric &r)
+{
+	q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+	q.a01 += r.a01; q.a02 += r.a02; q.a12 += r.a12;
+	q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+	q.c += r.c;
+	q.w += r.w;
+}
+
+static double quadricError(const Quadric &q, const double *p)
+{
+	double rx = q.a00 * p[0] + q.a01 * p[1] + q.a02 * p[2];
+	double ry = q.a01 * p[0] + q.a11 * p[1] + q.a12 * p[2];
+	double rz = q.a02 * p[0] + q.a12 * p[1] + q.a22 * p[2];
+	double r = p[0] * rx + p[1] * ry + p[2] * rz + 2.0 * (q.b0 * p[0] + q.b1 * p[1] + q.b2 * p[2]) + q.c;
+	return q.w > 0.0 ? fabs(r) / q.w : 0.0;
+}
+
+static void cross(double *n, const double *a, const double *b, const double *c)
+{
+	double e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	double e2[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+	n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+	n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+}
+
+
+enum VertexKind { Manifold, Border, Seam, Locked };
+
+// Triangles around each vertex of the current index list
+struct Adjacency {
+	vector<uint32_t>						start; // Triangles of v are triangles[start[v], start[v + 1])
+	vector<uint32_t>						triangles;
+
+	void build(const uint32_t *indices, size_t numIndices, size_t numVertices) {
+		start.assign(numVertices + 1, 0);
+		for (size_t i = 0; i < numIndices; i++)
+			start[indices[i] + 1]++;
+		for (size_t v = 0; v < numVertices; v++)
+			start[v + 1] += start[v];
+		triangles.resize(numIndices);
+		vector<uint32_t> fill(start.begin(), start.end() - 1);
+		for (size_t i = 0; i < numIndices; i++)
+			triangles[fill[indices[i]]++] = (uint32_t)(i / 3);
+	};
+};
+
+// True if a triangle has the directed edge a -> b
+static bool hasEdge(const Adjacency &adjacency, const uint32_t *indices, uint32_t a, uint32_t b)
+{
+	for (uint32_t i = adjacency.start[a]; i < adjacency.start[a + 1]; i++) {
+		const uint32_t *t = indices + adjacency.triangles[i] * 3;
+		for (int k = 0; k < 3; k++)
+			if (t[k] == a && t[(k + 1) % 3] == b)
+				return true;
+	}
+	return false;
+}
+
+struct Collapse {
+	uint32_t								v;
+	uint32_t								target;
+	double									error;
+	bool operator<(const Collapse &other) const { return error < other.error; };
+};
+
+
+size_t simplifyMesh(uint32_t *destination, const uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, size_t targetIndexCount, float targetError, float *resultError)
+{
+	if (resultError)
+		*resultError = 0.0f;
+	if (!destination || !indices || !positions || numIndices % 3 != 0)
+		return 0;
+	for (size_t i = 0; i < numIndices; i++)
+		if (indices[i] >= numVertices)
+			return 0;
+	memcpy(destination, indices, numIndices * sizeof(uint32_t));
+	if (numIndices <= targetIndexCount)
+		return numIndices;
+
+	// Positions scaled to the unit cube so errors are fractions of the mesh size
+	vector<double> p(numVertices * 3);
+	double minPos[3] = { DBL_MAX, DBL_MAX, DBL_MAX }, maxPos[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	for (size_t v = 0; v < numVertices; v++) {
+		const float *f = (const float*)((const char*)positions + v * positionStride);
+		for (int k = 0; k < 3; k++) {
+			p[v * 3 + k] = f[k];
+			minPos[k] = min(minPos[k], (double)f[k]);
+			maxPos[k] = max(maxPos[k], (double)f[k]);
+		}
+	}
+	double extent = max(max(maxPos[0] - minPos[0], maxPos[1] - minPos[1]), maxPos[2] - minPos[2]);
+	double scale = extent > 0.0 ? 1.0 / extent : 1.0;
+	for (size_t v = 0; v < numVertices; v++)
+		for (int k = 0; k < 3; k++)
+			p[v * 3 + k] = (p[v * 3 + k] - minPos[k]) * scale;
+
+	// Vertices at the same position form a ring through wedge (a vertex at a unique position is its own wedge)
+	vector<uint32_t> wedge(numVertices);
+	{
+		struct PositionHash {
+			size_t operator()(const uint64_t &k) const { return (size_t)(k ^ (k >> 29)); };
+		};
+		unordered_map<uint64_t, vector<uint32_t>, PositionHash> groups;
+		for (size_t v = 0; v < numVertices; v++) {
+			const uint32_t *bits = (const uint32_t*)((const char*)positions + v * positionStride);
+			uint64_t key = ((uint64_t)bits[0] * 73856093u) ^ ((uint64_t)bits[1] * 19349663u << 16) ^ ((uint64_t)bits[2] * 83492791u << 32);
+			vector<uint32_t> &group = groups[key];
+			wedge[v] = (uint32_t)v;
+			for (size_t i = 0; i < group.size(); i++) {
+				uint32_t w = group[i];
+				if (memcmp(bits, (const char*)positions + w * positionStride, 3 * sizeof(float)) == 0) {
+					wedge[v] = wedge[w];
+					wedge[w] = (uint32_t)v;
+					break;
+				}
+			}
+			group.push_back((uint32_t)v);
+		}
+	}
+
+	// Open edges (a directed edge with no opposite) and the vertex kinds
+	Adjacency adjacency;
+	adjacency.build(destination, numIndices, numVertices);
+	static const uint32_t none = 0xffffffff, several = 0xfffffffe;
+	vector<uint32_t> openIn(numVertices, none), openOut(numVertices, none);
+	for (size_t t = 0; t < numIndices / 3; t++) {
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = destination[t * 3 + k], b = destination[t * 3 + (k + 1) % 3];
+			if (hasEdge(adjacency, destination, b, a))
+				continue;
+			openOut[a] = (openOut[a] == none || openOut[a] == b) ? b : several;
+			openIn[b] = (openIn[b] == none || openIn[b] == a) ? a : several;
+		}
+	}
+	vector<VertexKind> kind(numVertices, Locked);
+	for (size_t v = 0; v < numVertices; v++) {
+		bool closed = openIn[v] == none && openOut[v] == none;
+		bool simpleBorder = openIn[v] < several && openOut[v] < several;
+		uint32_t w = wedge[v];
+		if (w == v)
+			kind[v] = closed ? Manifold : (simpleBorder ? Border : Locked);
+		else if (wedge[w] == v && simpleBorder && openIn[w] < several && openOut[w] < several) {
+			// A seam - the open edges of the twins run in opposite directions between the same positions
+			bool samePositions = memcmp(&p[openOut[v] * 3], &p[openIn[w] * 3], 3 * sizeof(double)) == 0 && memcmp(&p[openIn[v] * 3], &p[openOut[w] * 3], 3 * sizeof(double)) == 0;
+			kind[v] = samePositions ? Seam : Locked;
+		}
+	}
+
+	// Quadrics of the triangle planes, and of the planes through the border and seam edges
+	static const double edgeWeight = 10.0;
+	Quadric zero;
+	memset(&zero, 0, sizeof(Quadric));
+	vector<Quadric> quadrics(numVertices, zero);
+	for (size_t t = 0; t < numIndices / 3; t++) {
+		const uint32_t *tri = destination + t * 3;
+		double n[3];
+		cross(n, &p[tri[0] * 3], &p[tri[1] * 3], &p[tri[2] * 3]);
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length <= 0.0)
+			continue;
+		for (int k = 0; k < 3; k++)
+			n[k] /= length;
+
+		Quadric q;
+		quadricFromPlane(q, n[0], n[1], n[2], -(n[0] * p[tri[0] * 3] + n[1] * p[tri[0] * 3 + 1] + n[2] * p[tri[0] * 3 + 2]), length);
+		for (int k = 0; k < 3; k++)
+			quadricAdd(quadrics[tri[k]], q);
+
+		for (int k = 0; k < 3; k++) {
+			uint32_t a = tri[k], b = tri[(k + 1) % 3];
+			if (openOut[a] == none || hasEdge(adjacency, destination, b, a))
+				continue;
+			const double *pa = &p[a * 3], *pb = &p[b * 3];
+			double e[3] = { pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2] };
+			double edgeLength = sqrt(e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+			if (edgeLength <= 0.0)
+				continue;
+			// Plane containing the edge and perpendicular to the triangle
+			double m[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+			double mLength = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+			for (int j = 0; j < 3; j++)
+				m[j] /= mLength;
+			quadricFromPlane(q, m[0], m[1], m[2], -(m[0] * pa[0] + m[1] * pa[1] + m[2] * pa[2]), edgeLength * edgeWeight);
+			quadricAdd(quadrics[a], q);
+			quadricAdd(quadrics[b], q);
+		}
+	}
+	// Twins share their quadric
+	{
+		vector<Quadric> shared(quadrics);
+		for (size_t v = 0; v < numVertices; v++)
+			for (uint32_t w = wedge[v]; w != v; w = wedge[w])
+				quadricAdd(shared[v], quadrics[w]);
+		quadrics.swap(shared);
+	}
+
+	double errorLimit = (double)targetError * targetError;
+	double maxError = 0.0;
+	size_t count = numIndices;
+	vector<uint32_t> remap(numVertices);
+	for (size_t v = 0; v < numVertices; v++)
+		remap[v] = (uint32_t)v;
+	vector<bool> changed(numVertices);
+	vector<Collapse> collapses;
+
+	// The twin of v moves with it along a seam onto the twin of target
+	auto seamTarget = [&](uint32_t v, uint32_t target) -> uint32_t {
+		uint32_t w = wedge[v];
+		return target == openOut[v] ? openIn[w] : openOut[w];
+	};
+
+	// Would moving v to target flip one of v's triangles that survive, turn it by more than about 75 degrees or squash it to a
+	// sliver?  A sliver's normal is mostly rounding error, so it could face either way
+	auto flips = [&](uint32_t v, uint32_t target) -> bool {
+		for (uint32_t i = adjacency.start[v]; i < adjacency.start[v + 1]; i++) {
+			const uint32_t *tri = destination + adjacency.triangles[i] * 3;
+			if (tri[0] == target || tri[1] == target || tri[2] == target)
+				continue;
+			const double *c[3], *moved[3];
+			for (int k = 0; k < 3; k++) {
+				c[k] = &p[tri[k] * 3];
+				moved[k] = (tri[k] == v) ? &p[target * 3] : c[k];
+			}
+			double n0[3], n1[3];
+			cross(n0, c[0], c[1], c[2]);
+			cross(n1, moved[0], moved[1], moved[2]);
+			double d = n0[0] * n1[0] + n0[1] * n1[1] + n0[2] * n1[2];
+			double l0 = n0[0] * n0[0] + n0[1] * n0[1] + n0[2] * n0[2];
+			double l1 = n1[0] * n1[0] + n1[1] * n1[1] + n1[2] * n1[2];
+			if (d <= 0.25 * sqrt(l0 * l1) || l1 < 1e-4 * l0)
+				return true;
+		}
+		return false;
+	};
+
+	// Can v be collapsed onto its neighbour target?
+	auto allowed = [&](uint32_t v, uint32_t target) -> bool {
+		switch (kind[v]) {
+		case Manifold:
+			return true;
+		case Border:
+			return (kind[target] == Border || kind[target] == Locked) && (target == openOut[v] || target == openIn[v]);
+		case Seam:
+			if (!(kind[target] == Seam || kind[target] == Locked) || !(target == openOut[v] || target == openIn[v]))
+				return false;
+			// The twin's open edge must lead to a twin of target
+			{
+				uint32_t t = seamTarget(v, target);
+				return t < several && memcmp(&p[t * 3], &p[target * 3], 3 * sizeof(double)) == 0;
+			}
+		default:
+			return false;
+		}
+	};
+
+	// Keep the open edges of the border (or seam side) that v has been collapsed out of joined up
+	auto joinOpenEdges = [&](uint32_t v, uint32_t target) {
+		bool targetOpen = kind[target] == Border || kind[target] == Seam;
+		if (target == openOut[v]) {
+			uint32_t u = openIn[v];
+			if (u < several && (kind[u] == Border || kind[u] == Seam))
+				openOut[u] = target;
+			if (targetOpen)
+				openIn[target] = u;
+		}
+		else {
+			uint32_t x = openOut[v];
+			if (x < several && (kind[x] == Border || kind[x] == Seam))
+				openIn[x] = target;
+			if (targetOpen)
+				openOut[target] = x;
+		}
+	};
+
+	while (count > targetIndexCount) {
+
+		adjacency.build(destination, count, numVertices);
+
+		// Cheapest direction of each edge
+		collapses.clear();
+		for (size_t t = 0; t < count / 3; t++) {
+			for (int k = 0; k < 3; k++) {
+				uint32_t a = destination[t * 3 + k], b = destination[t * 3 + (k + 1) % 3];
+				Collapse best;
+				best.error = DBL_MAX;
+				if (allowed(a, b)) {
+					best.v = a;
+					best.target = b;
+					best.error = quadricError(quadrics[a], &p[b * 3]);
+				}
+				if (allowed(b, a)) {
+					double error = quadricError(quadrics[b], &p[a * 3]);
+					if (error < best.error) {
+						best.v = b;
+						best.target = a;
+						best.error = error;
+					}
+				}
+				if (best.error <= errorLimit)
+					collapses.push_back(best);
+			}
+		}
+		if (collapses.empty())
+			break;
+		sort(collapses.begin(), collapses.end());
+
+		// Collapse the cheapest edges whose neighbourhoods are untouched this pass, until enough triangles have gone
+		size_t triangleGoal = (count - targetIndexCount) / 3;
+		size_t trianglesRemoved = 0;
+		fill(changed.begin(), changed.end(), false);
+
+		for (size_t c = 0; c < collapses.size() && trianglesRemoved < triangleGoal; c++) {
+
+			uint32_t v = collapses[c].v, target = collapses[c].target;
+			bool seam = kind[v] == Seam;
+			uint32_t twin = seam ? wedge[v] : v;
+			uint32_t twinTarget = seam ? seamTarget(v, target) : target;
+
+			if (changed[v] || changed[target] || changed[twin] || changed[twinTarget])
+				continue;
+			if (flips(v, target) || (seam && flips(twin, twinTarget)))
+				continue;
+
+			remap[v] = target;
+			remap[twin] = twinTarget;
+			for (uint32_t w = target, first = target; ; ) {
+				quadricAdd(quadrics[w], quadrics[v]);
+				w = wedge[w];
+				if (w == first)
+					break;
+			}
+			if (kind[v] != Manifold) {
+				joinOpenEdges(v, target);
+				if (seam)
+					joinOpenEdges(twin, twinTarget);
+			}
+			maxError = max(maxError, collapses[c].error);
+			trianglesRemoved += (kind[v] == Manifold) ? 2 : 1;
+
+			// Lock the triangles around the collapse - their shape has changed so later collapses of this pass would be judged on the
+			// wrong positions
+			uint32_t moved[2] = { v, twin };
+			for (int m = 0; m < (seam ? 2 : 1); m++)
+				for (uint32_t i = adjacency.start[moved[m]]; i < adjacency.start[moved[m] + 1]; i++)
+					for (int k = 0; k < 3; k++)
+						changed[destination[adjacency.triangles[i] * 3 + k]] = true;
+			changed[target] = changed[twinTarget] = true;
+		}
+		if (trianglesRemoved == 0)
+			break;
+
+		// Apply the collapses and drop the triangles that have become degenerate
+		size_t written = 0;
+		for (size_t t = 0; t < count / 3; t++) {
+			uint32_t a = remap[destination[t * 3]], b = remap[destination[t * 3 + 1]], c = remap[destination[t * 3 + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			destination[written++] = a;
+			destination[written++] = b;
+			destination[written++] = c;
+		}
+		count = written;
+		for (size_t v = 0; v < numVertices; v++)
+			remap[v] = (uint32_t)v;
+	}
+
+	if (resultError)
+		*resultError = (float)sqrt(maxError);
+	return count;
+}
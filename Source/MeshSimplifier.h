@@ -0,0 +1,24 @@
+//
+// MeshSimplifier.h
+//
+
+// Level of detail generation by quadric error metric edge collapse (Garland and Heckbert 1997).  Each vertex accumulates the
+// quadric of the planes of its triangles, and edges are collapsed cheapest first onto one of their end points, so the simplified
+// triangles index the original vertices - the levels of detail of a model share its vertex buffer and only need an index range each.
+//
+// Vertices are classified by the topology around them.  Vertices inside a surface may collapse onto any neighbour, vertices on an
+// open border only along the border, and vertices on an attribute seam (two vertices at one position with different normals or
+// texture coordinates) only along the seam and together with their twin, so seams do not tear.  Anything else is locked.  Borders and
+// seams also get a quadric for the plane through the edge perpendicular to its triangle, which keeps their outline.  Collapses that
+// would flip a triangle are rejected.  Collapses are done in passes; each pass sorts the candidate edges and collapses those whose
+// neighbourhood has not been changed by an earlier collapse of the pass.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+// Write the simplified triangles of a mesh (indices [0, numVertices) into positions, positionStride bytes apart) to destination
+// (numIndices long) and return the number of indices written.  Simplification stops at targetIndexCount indices or when the next
+// collapse would move the surface by more than targetError, given as a fraction of the largest side of the mesh bounds.  resultError
+// (optional) receives the largest error of the collapses made, in the same units
+size_t simplifyMesh(uint32_t *destination, const uint32_t *indices, size_t numIndices, const float *positions, size_t positionStride, size_t numVertices, size_t targetIndexCount, float targetError, float *resultError = nullptr);
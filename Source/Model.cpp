@@ -3,8 +3,12 @@
 #include <Model.h>
 #include <Material.h>
 #include <Effect.h>
+#include <StateCache.h>
+#include <VertexCompression.h>
+#include <MeshSimplifier.h>
 #include <iostream>
 #include <exception>
+#include <chrono>
 
 #include <CoreStructures\CoreStructures.h>
 #include <CGImport3\CGModel\CGModel.h>
@@ -17,6 +21,11 @@ using namespace DirectX;
 using namespace DirectX::PackedVector;
 using namespace CoreStructures;
 
+// Simplification of a level of detail stops where a collapse would move the surface by more than this fraction of the mesh size
+static const float maxLodError = 0.05f;
+// Default levels of detail - a half, a quarter and a tenth of the triangles
+static const float defaultLodRatios[] = { 0.5f, 0.25f, 0.1f };
+static const float defaultLodScreenSizes[] = { 0.4f, 0.2f, 0.08f };
 
 void Model::load(ID3D11Device *device, Effect *_effect, const std::wstring& filename,  Material *_material) {
 
@@ -27,12 +36,22 @@ void Model::load(ID3D11Device *device, Effect *_effect, const std::wstring& file
 		material = _material;
 	material->setEmissive(XMCOLOR(1, 1, 1, 1));
 
+	// Compressed vertices read the material colours from the model cbuffer
+	XMStoreFloat4(&cBufferModelCPU->matDiffuse, XMLoadColor(&material->getColour()->diffuse));
+	XMStoreFloat4(&cBufferModelCPU->matSpecular, XMLoadColor(&material->getColour()->specular));
+	cBufferModelCPU->posOffset = XMFLOAT4(0, 0, 0, 0);
+	cBufferModelCPU->posScale = XMFLOAT4(1, 1, 1, 0);
+	markCBufferDirty();
+
+	setLodTargets(defaultLodRatios, defaultLodScreenSizes, ARRAYSIZE(defaultLodRatios));
+
 	try
 	{
 		if (!device || !inputLayout)
 			throw exception("Invalid parameters for Model instantiation");
 
-		HRESULT hr=loadModelAssimp(device, filename);
+		// Without a filename the mesh is loaded later with import() and createBuffers()
+		HRESULT hr = filename.empty() ? S_OK : loadModelAssimp(device, filename);
 
 
 		// Build the vertex input layout - this is done here since each object may load it's data into the IA differently.  This requires the compiled vertex shader bytecode.
@@ -41,21 +60,8 @@ void Model::load(ID3D11Device *device, Effect *_effect, const std::wstring& file
 		if (!SUCCEEDED(hr))
 			throw exception("Cannot create input layout interface");
 	
-		D3D11_SAMPLER_DESC linearDesc;
-
-		ZeroMemory(&linearDesc, sizeof(D3D11_SAMPLER_DESC));
-
-		linearDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
-		linearDesc.AddressU = D3D11_TEXTURE_ADDRESS_MIRROR;
-		linearDesc.AddressV = D3D11_TEXTURE_ADDRESS_MIRROR;
-		linearDesc.AddressW = D3D11_TEXTURE_ADDRESS_MIRROR;
-		linearDesc.MinLOD = 0.0f;
-		linearDesc.MaxLOD = 0.0f;
-		linearDesc.MipLODBias = 0.0f;
-		//linearDesc.MaxAnisotropy = 0; // Unused for isotropic filtering
-		linearDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
-
-		hr = device->CreateSamplerState(&linearDesc, &sampler);
+		// Shared linear mirror sampler (same description as BaseModel::createDefaultLinearSampler)
+		sampler = StateCache::getDefault(device)->getSamplerState(StateCache::defaultSamplerDesc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_MIRROR));
 	}
 	catch (exception& e)
 	{
@@ -82,6 +88,12 @@ void Model::load(ID3D11Device *device, Effect *_effect, const std::wstring& file
 
 Model::~Model() {
 
+	// Mesh imported but never created
+	free(importedVertices);
+	free(importedIndices);
+
+	if (clusterIndexBuffer)
+		clusterIndexBuffer->Release();
 }
 
 //void Model::update(ID3D11DeviceContext *context) {
@@ -90,11 +102,10 @@ void Model::render(ID3D11DeviceContext *context) {//, int mode
 
 	effect->bindPipeline(context);
 
-	context->PSSetConstantBuffers(0, 1, &cBufferModelGPU);
-	context->VSSetConstantBuffers(0, 1, &cBufferModelGPU);
+	bindCBuffer(context);
 
 	// Validate Model before rendering (see notes in constructor)
-	if (!context || !vertexBuffer || !indexBuffer || !effect)
+	if (!context || !vertexBuffer || !indexBuffer || !effect || lods.empty())
 		return;
 
 	// Set vertex layout
@@ -102,7 +113,7 @@ void Model::render(ID3D11DeviceContext *context) {//, int mode
 
 	// Set Model vertex and index buffers for IA
 	ID3D11Buffer* vertexBuffers[] = { vertexBuffer };
-	UINT vertexStrides[] = { sizeof(ExtendedVertexStruct) };
+	UINT vertexStrides[] = { vertexStride };
 	UINT vertexOffsets[] = { 0 };
 
 	context->IASetVertexBuffers(0, 1, vertexBuffers, vertexStrides, vertexOffsets);
@@ -124,13 +135,25 @@ void Model::render(ID3D11DeviceContext *context) {//, int mode
 
 
 
-	// Apply the cBuffer.
-	context->VSSetConstantBuffers(0, 1, &cBufferModelGPU);
-	context->PSSetConstantBuffers(0, 1, &cBufferModelGPU);
+	// Draw the clusters cullClusters() kept - their index ranges are copied one after another into the dynamic index buffer and drawn at
+	// once.  The buffer is written with WRITE_DISCARD, the only map deferred contexts allow
+	if (clustersCulled) {
+		if (numVisibleClusters == 0)
+			return;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		if (SUCCEEDED(context->Map(clusterIndexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+			UINT numIndices = (UINT)compactClusterIndices((uint32_t*)mapped.pData, clusterIndices.data(), clusters.data(), visibleClusters.data(), numVisibleClusters);
+			context->Unmap(clusterIndexBuffer, 0);
+			context->IASetIndexBuffer(clusterIndexBuffer, DXGI_FORMAT_R32_UINT, 0);
+			context->DrawIndexed(numIndices, 0, 0);
+			return;
+		}
+	}
 
-	// Draw Model
-	for (uint32_t indexOffset = 0, i = 0; i < numMeshes; indexOffset += indexCount[i], ++i)
-		context->DrawIndexed(indexCount[i], indexOffset, baseVertexOffset[i]);	
+	// Draw Model at the current level of detail
+	const Lod &lod = lods[currentLod];
+	for (uint32_t indexOffset = lod.firstIndex, i = 0; i < numMeshes; indexOffset += lod.indexCount[i], ++i)
+		context->DrawIndexed(lod.indexCount[i], indexOffset, 0);
 	
 
 }
@@ -256,13 +279,24 @@ HRESULT Model::loadModel(ID3D11Device *device, const std::wstring& filename)
 			// Copy mesh indices from CGPolyMesh into buffer
 			memcpy(indexPtr, R.Fv, R.n * sizeof(CGFaceVertex));
 
-			// Re-order indices to account for DirectX using the left-handed coordinate system
-			for (int k = 0; k < R.n; ++k, indexPtr += 3)
+			// Re-order indices to account for DirectX using the left-handed coordinate system, and offset them to the mesh's first vertex
+			for (int k = 0; k < R.n; ++k, indexPtr += 3) {
 				swap(indexPtr[0], indexPtr[2]);
+				indexPtr[0] += baseVertexOffset[i];
+				indexPtr[1] += baseVertexOffset[i];
+				indexPtr[2] += baseVertexOffset[i];
+			}
 		}
 	}
 
 
+	computeBounds(&_vertexBuffer[0].pos, numVertices, sizeof(ExtendedVertexStruct));
+
+	// No simplified levels of detail
+	lods.resize(1);
+	lods[0].indexCount = indexCount;
+	currentLod = 0;
+
 	//
 	// Setup DX vertex buffer interfaces
 	//
@@ -327,168 +361,629 @@ HRESULT Model::loadModel(ID3D11Device *device, const std::wstring& filename)
 
 HRESULT Model::loadModelAssimp(ID3D11Device *device, const std::wstring& filename)
 {
-	ExtendedVertexStruct *_vertexBuffer = nullptr;
-	uint32_t *_indexBuffer = nullptr;
+	HRESULT hr = import(filename);
+	if (SUCCEEDED(hr))
+		hr = createBuffers(device);
+	return hr;
+}
 
+HRESULT Model::import(const std::wstring& filename)
+{
+	ImportedMesh mesh;
 	Assimp::Importer importer;
-	std::wstring w(filename); 
-	std::string filename_string(w.begin(), w.end());
-	// Get filename extension
-	wstring ext = filename.substr(filename.length() - 4);
-	//if (0 == ext.compare(L".obj") || 0 == ext.compare(L".gsf"))// || 0 == ext.compare(L".3ds")
-	//printf("OBJ\n", ext);
 
 	try
 	{
-		const aiScene* scene = importer.ReadFile(filename_string, aiProcess_PreTransformVertices| aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace |
-			aiProcess_Triangulate |
-			aiProcess_JoinIdenticalVertices |
-			aiProcess_SortByPType);
-		//printf("Root transform=",scene->mRootNode->)
-
+		const aiScene* scene = readFile(importer, filename);
 
 		if (!scene)
+			throw exception(importer.GetErrorString());
+
+		if (scene->mNumMeshes == 0)
+			throw exception("Empty model loaded");
+
+		if (!SUCCEEDED(convertScene(scene, mirrorsX(filename), *material->getColour(), &mesh)))
+			throw exception("Cannot create vertex or index buffer");
+
+		optimiseMeshes(&mesh);
+
+		if (!SUCCEEDED(buildLods(&mesh, lodRatio, lodScreenSize, numLodTargets)))
+			throw exception("Cannot create level of detail indices");
+
+		if (useClusters)
+			buildClusters(&mesh);
+
+		if (useOccluder)
+			buildOccluder(&mesh, occluderMaxError, &importedOccluderPositions, &importedOccluderIndices);
+
+		// Bounds are taken from the full precision positions
+		BoundingSphere::CreateFromPoints(importedBounds, mesh.numVertices, &mesh.vertices[0].pos, sizeof(ExtendedVertexStruct));
+		BoundingBox::CreateFromPoints(importedBox, mesh.numVertices, &mesh.vertices[0].pos, sizeof(ExtendedVertexStruct));
+
+		void *vertexData = mesh.vertices;
+		if (vertexFormat == VERTEX_FORMAT_COMPRESSED) {
+
+			CompressedVertexStruct *compressed = (CompressedVertexStruct*)malloc(mesh.numVertices * sizeof(CompressedVertexStruct));
+
+			if (!compressed)
+				throw exception("Cannot create compressed vertex buffer");
+
+			compressVertices(mesh.vertices, mesh.numVertices, compressed, &importedPosOffset, &importedPosScale);
+			free(mesh.vertices);
+			mesh.vertices = nullptr;
+			vertexData = compressed;
+		}
+
+		// Keep the mesh for createBuffers
+		numMeshes = (uint32_t)mesh.indexCount.size();
+		indexCount = mesh.indexCount;
+		baseVertexOffset = mesh.baseVertexOffset;
+		cacheStatsImported = mesh.cacheStatsImported;
+		cacheStatsOptimised = mesh.cacheStatsOptimised;
+		importedLods.swap(mesh.lods);
+		importedClusters.swap(mesh.clusters);
+		importedVertices = vertexData;
+		importedIndices = mesh.indices;
+		numImportedVertices = mesh.numVertices;
+		numImportedIndices = mesh.numIndices;
+	}
+	catch (exception& e)
+	{
+		cout << "Model could not be instantiated due to:\n";
+		cout << e.what() << endl;
+
+		free(mesh.vertices);
+		free(mesh.indices);
+
+		return E_FAIL;
+	}
+
+	return S_OK;
+}
+
+const aiScene *Model::readFile(Assimp::Importer &importer, const std::wstring& filename)
+{
+	std::string filename_string(filename.begin(), filename.end());
+	return importer.ReadFile(filename_string, aiProcess_PreTransformVertices | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace |
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_SortByPType);
+}
+
+bool Model::mirrorsX(const std::wstring& filename)
+{
+	// OBJ & GSF files are mirrored in x for the left-handed coordinate system (might be required for other files too?)
+	if (filename.length() < 4)
+		return false;
+	const wchar_t *ext = filename.c_str() + filename.length() - 4;
+	return _wcsicmp(ext, L".obj") == 0 || _wcsicmp(ext, L".gsf") == 0;
+}
+
+HRESULT Model::convertScene(const aiScene *scene, bool flipX, const MaterialStruct &colour, ImportedMesh *mesh)
+{
+	// Sizes first so each array is allocated once.  Line and point meshes (split out by aiProcess_SortByPType) have no triangles to draw
+	uint32_t numVertices = 0;
+	uint32_t numIndices = 0;
+	for (uint32_t i = 0; i < scene->mNumMeshes; ++i)
+	{
+		const aiMesh* m = scene->mMeshes[i];
+		uint32_t numTriangleIndices = (m->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) ? m->mNumFaces * 3 : 0;
+		mesh->baseVertexOffset.push_back(numVertices);
+		mesh->vertexCount.push_back(m->mNumVertices);
+		mesh->indexCount.push_back(numTriangleIndices);
+		numVertices += m->mNumVertices;
+		numIndices += numTriangleIndices;
+	}
+
+	mesh->vertices = (ExtendedVertexStruct*)malloc(numVertices * sizeof(ExtendedVertexStruct));
+	mesh->indices = (uint32_t*)malloc(numIndices * sizeof(uint32_t));
+	if (!mesh->vertices || !mesh->indices)
+		return E_OUTOFMEMORY;
+	mesh->numVertices = numVertices;
+	mesh->numIndices = numIndices;
+
+	// Assimp stores each attribute in its own array.  Copy them into the interleaved vertices a mesh at a time (each vertex is written
+	// once however many faces use it), negating x in the SIMD registers for mirrored files
+	XMVECTOR mirror = flipX ? XMVectorSet(-1.0f, 1.0f, 1.0f, 1.0f) : XMVectorSplatOne();
+	XMVECTOR noNormal = XMVectorSet(1.0f, 1.0f, 1.0f, 0.0f);
+	XMVECTOR uvScale = XMVectorSet(1.0f, -1.0f, 0.0f, 0.0f);
+	XMVECTOR uvOffset = XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f);
+
+	for (uint32_t i = 0; i < scene->mNumMeshes; ++i)
+	{
+		const aiMesh* m = scene->mMeshes[i];
+		ExtendedVertexStruct *vptr = mesh->vertices + mesh->baseVertexOffset[i];
+		const XMFLOAT3 *positions = (const XMFLOAT3*)m->mVertices;
+		const XMFLOAT3 *normals = (const XMFLOAT3*)m->mNormals;
+		const aiVector3D *uvs = m->mTextureCoords[0];
+
+		for (uint32_t j = 0; j < m->mNumVertices; ++j, ++vptr)
+		{
+			XMStoreFloat3(&vptr->pos, XMVectorMultiply(XMLoadFloat3(&positions[j]), mirror));
+			XMStoreFloat3(&vptr->normal, normals ? XMVectorMultiply(XMLoadFloat3(&normals[j]), mirror) : noNormal);
+			if (uvs)
+				XMStoreFloat2(&vptr->texCoord, XMVectorMultiplyAdd(XMLoadFloat2((const XMFLOAT2*)&uvs[j]), uvScale, uvOffset));
+			else
+				vptr->texCoord = XMFLOAT2(0.0f, 0.0f);
+			vptr->matDiffuse = colour.diffuse;
+			vptr->matSpecular = colour.specular;
+		}
+	}
+
+	// Indices in one pass over the faces, offset to the first vertex of their mesh so they address the whole vertex buffer
+	uint32_t *indexPtr = mesh->indices;
+	for (uint32_t i = 0; i < scene->mNumMeshes; ++i)
+	{
+		if (mesh->indexCount[i] == 0)
+			continue;
+		const aiMesh* m = scene->mMeshes[i];
+		uint32_t base = mesh->baseVertexOffset[i];
+		for (uint32_t j = 0; j < m->mNumFaces; ++j, indexPtr += 3)
 		{
-			printf("Couldn't load model - Error Importing Asset");
-			return false;
+			const unsigned int *face = m->mFaces[j].mIndices;
+			indexPtr[0] = face[0] + base;
+			indexPtr[1] = face[1] + base;
+			indexPtr[2] = face[2] + base;
 		}
+	}
 
-		numMeshes = scene->mNumMeshes;
+	return S_OK;
+}
 
-		if (numMeshes == 0)
-			throw exception("Empty model loaded");
+void Model::optimiseMeshes(ImportedMesh *mesh)
+{
+	// Reorder each mesh's triangles for the vertex cache and overdraw, then its vertices into the order they are first used.  The
+	// optimiser works on one mesh at a time with indices relative to its first vertex
+	uint32_t *meshIndices = mesh->indices;
+	for (size_t i = 0; i < mesh->indexCount.size(); ++i)
+	{
+		uint32_t base = mesh->baseVertexOffset[i];
+		uint32_t meshIndexCount = mesh->indexCount[i];
+		uint32_t meshVertexCount = mesh->vertexCount[i];
+		ExtendedVertexStruct *meshVertices = mesh->vertices + base;
+
+		for (uint32_t j = 0; j < meshIndexCount; ++j)
+			meshIndices[j] -= base;
+
+		mesh->cacheStatsImported.add(analyseVertexCache(meshIndices, meshIndexCount, meshVertexCount));
+		optimiseVertexCache(meshIndices, meshIndexCount, meshVertexCount);
+		optimiseOverdraw(meshIndices, meshIndexCount, &meshVertices[0].pos.x, sizeof(ExtendedVertexStruct), meshVertexCount);
+		optimiseVertexFetch(meshVertices, sizeof(ExtendedVertexStruct), meshVertexCount, meshIndices, meshIndexCount);
+		mesh->cacheStatsOptimised.add(analyseVertexCache(meshIndices, meshIndexCount, meshVertexCount));
+
+		for (uint32_t j = 0; j < meshIndexCount; ++j)
+			meshIndices[j] += base;
+		meshIndices += meshIndexCount;
+	}
+}
 
-		uint32_t numVertices = 0;
-		uint32_t numIndices = 0;
-		//printf("Num Meshes %d\n", scene->mNumMeshes);
-		for (uint32_t k = 0; k < numMeshes; ++k)
+HRESULT Model::buildLods(ImportedMesh *mesh, const float *ratios, const float *screenSizes, int numLevels)
+{
+	mesh->lods.assign(1, Lod());
+	mesh->lods[0].indexCount = mesh->indexCount;
+
+	// Every level is simplified from level 0 a mesh at a time, with indices relative to the mesh's first vertex so they index the same
+	// vertices as level 0
+	vector<uint32_t> lodIndices;
+	vector<uint32_t> meshIndices;
+	vector<uint32_t> simplified;
+	for (int l = 0; l < numLevels; l++) {
+
+		Lod lod;
+		lod.firstIndex = mesh->numIndices + (uint32_t)lodIndices.size();
+		lod.screenSize = screenSizes[l];
+		uint32_t lodIndexCount = 0;
+		const uint32_t *sourceIndices = mesh->indices;
+
+		for (size_t i = 0; i < mesh->indexCount.size(); ++i)
 		{
-			aiMesh* mesh = scene->mMeshes[k];
-			//Store base vertex index;
-			baseVertexOffset.push_back(numVertices);
-			// Increment vertex count
-			numVertices += mesh->mNumVertices;
-			// Store num indices for current mesh
-			indexCount.push_back(mesh->mNumFaces * 3);
-			numIndices += mesh->mNumFaces * 3;
-			//printf("Mesh %d\n", k);
-			//printf("numVertices %d\n", mesh->mNumVertices);
-			//printf("numIndices %d\n", mesh->mNumFaces);
+			uint32_t base = mesh->baseVertexOffset[i];
+			uint32_t meshIndexCount = mesh->indexCount[i];
+			uint32_t meshVertexCount = mesh->vertexCount[i];
+
+			meshIndices.assign(sourceIndices, sourceIndices + meshIndexCount);
+			for (uint32_t j = 0; j < meshIndexCount; ++j)
+				meshIndices[j] -= base;
+			sourceIndices += meshIndexCount;
+
+			simplified.resize(meshIndexCount);
+			float error = 0.0f;
+			size_t targetIndexCount = (size_t)(meshIndexCount * ratios[l]) / 3 * 3;
+			size_t count = simplifyMesh(simplified.data(), meshIndices.data(), meshIndexCount, &mesh->vertices[base].pos.x, sizeof(ExtendedVertexStruct), meshVertexCount, targetIndexCount, maxLodError, &error);
+			optimiseVertexCache(simplified.data(), count, meshVertexCount);
+
+			for (size_t j = 0; j < count; ++j)
+				lodIndices.push_back(simplified[j] + base);
+			lod.indexCount.push_back((uint32_t)count);
+			lod.error = max(lod.error, error);
+			lodIndexCount += (uint32_t)count;
+		}
+
+		// Stop when the error limit keeps a level close to the one before - it would cost memory and gain little
+		const vector<uint32_t> &previous = mesh->lods.back().indexCount;
+		uint32_t previousIndexCount = 0;
+		for (size_t i = 0; i < previous.size(); ++i)
+			previousIndexCount += previous[i];
+		if (lodIndexCount > previousIndexCount * 0.9f) {
+			lodIndices.resize(lod.firstIndex - mesh->numIndices);
+			break;
+		}
+		mesh->lods.push_back(lod);
+	}
+
+	if (lodIndices.empty())
+		return S_OK;
+
+	uint32_t *indices = (uint32_t*)realloc(mesh->indices, (mesh->numIndices + lodIndices.size()) * sizeof(uint32_t));
+	if (!indices)
+		return E_OUTOFMEMORY;
+	memcpy(indices + mesh->numIndices, lodIndices.data(), lodIndices.size() * sizeof(uint32_t));
+	mesh->indices = indices;
+	mesh->numIndices += (uint32_t)lodIndices.size();
+	return S_OK;
+}
+
+void Model::buildClusters(ImportedMesh *mesh)
+{
+	// A mesh at a time with indices relative to its first vertex, as buildLods.  Level 0 is at the start of the index buffer
+	mesh->clusters.clear();
+	uint32_t *meshIndices = mesh->indices;
+	for (size_t i = 0; i < mesh->indexCount.size(); ++i)
+	{
+		uint32_t base = mesh->baseVertexOffset[i];
+		uint32_t meshIndexCount = mesh->indexCount[i];
+
+		for (uint32_t j = 0; j < meshIndexCount; ++j)
+			meshIndices[j] -= base;
+		buildMeshClusters(meshIndices, meshIndexCount, &mesh->vertices[base].pos.x, sizeof(ExtendedVertexStruct), mesh->vertexCount[i], (uint32_t)(meshIndices - mesh->indices), &mesh->clusters);
+		for (uint32_t j = 0; j < meshIndexCount; ++j)
+			meshIndices[j] += base;
+		meshIndices += meshIndexCount;
+	}
+}
+
+void Model::buildOccluder(const ImportedMesh *mesh, float maxError, vector<float> *positions, vector<uint32_t> *indices)
+{
+	positions->clear();
+	indices->clear();
+	size_t level = 0;
+	while (level + 1 < mesh->lods.size() && mesh->lods[level + 1].error <= maxError)
+		level++;
+	if (level >= mesh->lods.size())
+		return;
+
+	uint32_t numIndices = 0;
+	for (size_t i = 0; i < mesh->lods[level].indexCount.size(); ++i)
+		numIndices += mesh->lods[level].indexCount[i];
+
+	// The level indexes the whole vertex array - keep only the vertices it uses
+	vector<uint32_t> remap(mesh->numVertices, UINT32_MAX);
+	const uint32_t *levelIndices = mesh->indices + mesh->lods[level].firstIndex;
+	indices->resize(numIndices);
+	for (uint32_t i = 0; i < numIndices; ++i) {
+		uint32_t v = levelIndices[i];
+		if (remap[v] == UINT32_MAX) {
+			remap[v] = (uint32_t)(positions->size() / 3);
+			positions->push_back(mesh->vertices[v].pos.x);
+			positions->push_back(mesh->vertices[v].pos.y);
+			positions->push_back(mesh->vertices[v].pos.z);
 		}
+		(*indices)[i] = remap[v];
+	}
+}
 
-			// Create vertex buffer
-		_vertexBuffer = (ExtendedVertexStruct*)malloc(numVertices * sizeof(ExtendedVertexStruct));
+bool Model::getOccluder(OccluderMesh *mesh) const
+{
+	if (occluderIndices.empty())
+		return false;
+	mesh->positions = occluderPositions.data();
+	mesh->stride = 3 * sizeof(float);
+	mesh->numVertices = occluderPositions.size() / 3;
+	mesh->indices = occluderIndices.data();
+	mesh->numIndices = occluderIndices.size();
+	return true;
+}
+
+void Model::benchmarkImport(const std::wstring& directory)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+	const int numRepeats = 3;
+	Material material;
+	Assimp::Importer importer;
 
-			if (!_vertexBuffer)
-				throw exception("Cannot create vertex buffer");
+	// Every file in the directory Assimp can read
+	vector<wstring> filenames;
+	WIN32_FIND_DATAW findData;
+	HANDLE find = FindFirstFileW((directory + L"*").c_str(), &findData);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			wstring name(findData.cFileName);
+			size_t dot = name.find_last_of(L'.');
+			if ((findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) || dot == wstring::npos)
+				continue;
+			if (importer.IsExtensionSupported(string(name.begin() + dot, name.end())))
+				filenames.push_back(name);
+		} while (FindNextFileW(find, &findData));
+		FindClose(find);
+	}
 
-			// Create index buffer
-			_indexBuffer = (uint32_t*)malloc(numIndices * sizeof(uint32_t));
+	cout << "Model import benchmark: " << filenames.size() << " models in " << string(directory.begin(), directory.end()) << ", best of " << numRepeats << endl;
 
-			if (!_indexBuffer)
-				throw exception("Cannot create index buffer");
+	double totalRead = 0.0, totalConvert = 0.0, totalOptimise = 0.0, totalSimplify = 0.0, totalCluster = 0.0;
+	for (size_t f = 0; f < filenames.size(); f++) {
 
-			// Copy vertex data into single buffer
-			ExtendedVertexStruct *vptr = _vertexBuffer;
-			uint32_t *indexPtr = _indexBuffer;
+		wstring path = directory + filenames[f];
+		double bestRead = 1e30, bestConvert = 1e30, bestOptimise = 1e30, bestSimplify = 1e30, bestCluster = 1e30;
+		uint32_t numVertices = 0, numIndices = 0;
+		vector<MeshCluster> clusters;
+		vector<uint32_t> clusterIndices;
+		bool failed = false;
 
-			for (uint32_t i = 0; i < numMeshes; ++i) 
-			{
+		for (int repeat = 0; repeat < numRepeats && !failed; repeat++) {
 
-				aiMesh* mesh = scene->mMeshes[i];
-				//printf("Mesh %d\n", i);
-				//if (mesh->HasNormals())
-				//	printf("has normals");
-				uint32_t j = 0;
-				for ( j = 0; j < mesh->mNumFaces; ++j)		
-				{
-					const aiFace& face = mesh->mFaces[j];
-					for (int k = 0; k < 3; ++k)
-					{
-						int VIndex = baseVertexOffset[i] + face.mIndices[k];
-						aiVector3D pos = mesh->mVertices[face.mIndices[k]];
-						aiVector3D uv = mesh->mTextureCoords[0][face.mIndices[k]];
-						aiVector3D normal = mesh->HasNormals() ? mesh->mNormals[face.mIndices[k]] : aiVector3D(1.0f, 1.0f, 1.0f);
-						//Flip normal.x for OBJ & GSF (might be required for other files too?)
-						if (0 == ext.compare(L".obj") || 0 == ext.compare(L".gsf"))// || 0 == ext.compare(L".3ds")
-						{
-							normal.x = -normal.x;
-
-							
-							pos.x = -pos.x;
-						}
-						vptr[VIndex].pos = XMFLOAT3(pos.x, pos.y, pos.z);
-						vptr[VIndex].normal = XMFLOAT3(normal.x, normal.y, normal.z);
-						vptr[VIndex].texCoord = XMFLOAT2(uv.x, 1-uv.y);
-						vptr[VIndex].matDiffuse = material->getColour()->diffuse;//XMCOLOR(1.0f, 1.0f, 1.0f, 1.0f);
-						vptr[VIndex].matSpecular = material->getColour()->specular;// XMCOLOR(1.0f, 1.0f, 1.0f, 1.0f);
-						indexPtr[0] = face.mIndices[k];
-						indexPtr++;
-						/*printf("index %d = %d \n", j * 3 + k, face.mIndices[k]);*/
-					}
-				}//for each face
-				//printf("faces %d\n", j);
-			}//for each mesh
+			BenchmarkClock::time_point start = BenchmarkClock::now();
+			const aiScene *scene = readFile(importer, path);
+			bestRead = min(bestRead, chrono::duration<double, milli>(BenchmarkClock::now() - start).count());
 
-	
-			// Setup DX vertex buffer interfaces
-			D3D11_BUFFER_DESC vertexDesc;
-			D3D11_SUBRESOURCE_DATA vertexData;
+			ImportedMesh mesh;
+			start = BenchmarkClock::now();
+			failed = !scene || !SUCCEEDED(convertScene(scene, mirrorsX(path), *material.getColour(), &mesh));
+			bestConvert = min(bestConvert, chrono::duration<double, milli>(BenchmarkClock::now() - start).count());
 
-			ZeroMemory(&vertexDesc, sizeof(D3D11_BUFFER_DESC));
-			ZeroMemory(&vertexData, sizeof(D3D11_SUBRESOURCE_DATA));
+			numVertices = mesh.numVertices;
+			numIndices = mesh.numIndices;
 
-			vertexDesc.Usage = D3D11_USAGE_IMMUTABLE;
-			vertexDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-			vertexDesc.ByteWidth = numVertices * sizeof(ExtendedVertexStruct);
-			vertexData.pSysMem = _vertexBuffer;
+			if (!failed) {
+				start = BenchmarkClock::now();
+				optimiseMeshes(&mesh);
+				bestOptimise = min(bestOptimise, chrono::duration<double, milli>(BenchmarkClock::now() - start).count());
 
-			HRESULT hr = device->CreateBuffer(&vertexDesc, &vertexData, &vertexBuffer);
+				start = BenchmarkClock::now();
+				buildLods(&mesh, defaultLodRatios, defaultLodScreenSizes, ARRAYSIZE(defaultLodRatios));
+				bestSimplify = min(bestSimplify, chrono::duration<double, milli>(BenchmarkClock::now() - start).count());
 
-			if (!SUCCEEDED(hr))
-				throw exception("Vertex buffer cannot be created");
+				start = BenchmarkClock::now();
+				buildClusters(&mesh);
+				bestCluster = min(bestCluster, chrono::duration<double, milli>(BenchmarkClock::now() - start).count());
 
-			// Setup index buffer
-			D3D11_BUFFER_DESC indexDesc;
-			D3D11_SUBRESOURCE_DATA indexData;
+				clusters.swap(mesh.clusters);
+				clusterIndices.assign(mesh.indices, mesh.indices + numIndices);
+			}
 
-			ZeroMemory(&indexDesc, sizeof(D3D11_BUFFER_DESC));
-			ZeroMemory(&indexData, sizeof(D3D11_SUBRESOURCE_DATA));
+			free(mesh.vertices);
+			free(mesh.indices);
+			importer.FreeScene();
+		}
 
-			indexDesc.Usage = D3D11_USAGE_IMMUTABLE;
-			indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
-			indexDesc.ByteWidth = numIndices * sizeof(uint32_t);
-			indexData.pSysMem = _indexBuffer;
+		string name(filenames[f].begin(), filenames[f].end());
+		if (failed) {
+			cout << name << ": cannot import" << endl;
+			continue;
+		}
+		totalRead += bestRead;
+		totalConvert += bestConvert;
+		totalOptimise += bestOptimise;
+		totalSimplify += bestSimplify;
+		totalCluster += bestCluster;
+		cout << name << ": " << numVertices << " vertices, " << numIndices / 3 << " triangles, read = " << bestRead << " ms, convert = " << bestConvert
+			<< " ms (" << (numVertices ? bestConvert * 1e6 / numVertices : 0.0) << " ns per vertex), optimise = " << bestOptimise << " ms, simplify = " << bestSimplify
+			<< " ms, cluster = " << bestCluster << " ms" << endl;
+		benchmarkClusterCulling(clusters.data(), clusters.size(), clusterIndices.data());
+	}
+	cout << "Total: read = " << totalRead << " ms, convert = " << totalConvert << " ms, optimise = " << totalOptimise << " ms, simplify = " << totalSimplify
+		<< " ms, cluster = " << totalCluster << " ms" << endl;
+}
 
-			hr = device->CreateBuffer(&indexDesc, &indexData, &indexBuffer);
+HRESULT Model::importMesh(const std::wstring& filename, std::vector<ExtendedVertexStruct> *vertices, std::vector<uint32_t> *indices)
+{
+	Material material;
+	Assimp::Importer importer;
+	ImportedMesh mesh;
 
-			if (!SUCCEEDED(hr))
-				throw exception("Index buffer cannot be created");
+	const aiScene *scene = readFile(importer, filename);
+	HRESULT hr = (scene && scene->mNumMeshes > 0) ? convertScene(scene, mirrorsX(filename), *material.getColour(), &mesh) : E_FAIL;
+	if (SUCCEEDED(hr)) {
+		vertices->assign(mesh.vertices, mesh.vertices + mesh.numVertices);
+		indices->assign(mesh.indices, mesh.indices + mesh.numIndices);
+	}
+	free(mesh.vertices);
+	free(mesh.indices);
+	return hr;
+}
 
-			// Dispose of local resources
-			if (_vertexBuffer)
-			free(_vertexBuffer);
-			if (_vertexBuffer)
-			free(_indexBuffer);
+HRESULT Model::createBuffers(ID3D11Device *device)
+{
+	if (!importedVertices || !importedIndices)
+		return E_FAIL;
 
-			//printf("done\n");
+	HRESULT hr = S_OK;
 
+	try
+	{
+		bounds = importedBounds;
+		box = importedBox;
+		lods.swap(importedLods);
+		importedLods.clear();
+		currentLod = 0;
+		clusters.swap(importedClusters);
+		importedClusters.clear();
+		occluderPositions.swap(importedOccluderPositions);
+		occluderIndices.swap(importedOccluderIndices);
+		importedOccluderPositions.clear();
+		importedOccluderIndices.clear();
+
+		vertexStride = (vertexFormat == VERTEX_FORMAT_COMPRESSED) ? sizeof(CompressedVertexStruct) : sizeof(ExtendedVertexStruct);
+		if (vertexFormat == VERTEX_FORMAT_COMPRESSED) {
+			cBufferModelCPU->posOffset = XMFLOAT4(importedPosOffset.x, importedPosOffset.y, importedPosOffset.z, 0);
+			cBufferModelCPU->posScale = XMFLOAT4(importedPosScale.x, importedPosScale.y, importedPosScale.z, 0);
+			markCBufferDirty();
 		}
-		catch (exception& e)
-		{
-			cout << "Model could not be instantiated due to:\n";
-			cout << e.what() << endl;
 
-			if (_vertexBuffer)
-				free(_vertexBuffer);
+		// Setup DX vertex buffer interfaces
+		D3D11_BUFFER_DESC vertexDesc;
+		D3D11_SUBRESOURCE_DATA vertexData;
+
+		ZeroMemory(&vertexDesc, sizeof(D3D11_BUFFER_DESC));
+		ZeroMemory(&vertexData, sizeof(D3D11_SUBRESOURCE_DATA));
+
+		vertexDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		vertexDesc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
+		vertexDesc.ByteWidth = numImportedVertices * vertexStride;
+		vertexData.pSysMem = importedVertices;
+
+		hr = device->CreateBuffer(&vertexDesc, &vertexData, &vertexBuffer);
+
+		if (!SUCCEEDED(hr))
+			throw exception("Vertex buffer cannot be created");
+
+		// Setup index buffer
+		D3D11_BUFFER_DESC indexDesc;
+		D3D11_SUBRESOURCE_DATA indexData;
 
-			if (_indexBuffer)
-				free(_indexBuffer);
+		ZeroMemory(&indexDesc, sizeof(D3D11_BUFFER_DESC));
+		ZeroMemory(&indexData, sizeof(D3D11_SUBRESOURCE_DATA));
 
-			return-1;
+		indexDesc.Usage = D3D11_USAGE_IMMUTABLE;
+		indexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+		indexDesc.ByteWidth = numImportedIndices * sizeof(uint32_t);
+		indexData.pSysMem = importedIndices;
+
+		hr = device->CreateBuffer(&indexDesc, &indexData, &indexBuffer);
+
+		if (!SUCCEEDED(hr))
+			throw exception("Index buffer cannot be created");
+
+		// Level 0 in cluster order and the dynamic buffer the visible clusters are compacted into.  Without it the model is drawn whole
+		if (!clusters.empty()) {
+			uint32_t numClusterIndices = 0;
+			for (size_t i = 0; i < lods[0].indexCount.size(); i++)
+				numClusterIndices += lods[0].indexCount[i];
+			clusterIndices.assign(importedIndices, importedIndices + numClusterIndices);
+			visibleClusters.resize(clusters.size());
+
+			D3D11_BUFFER_DESC clusterIndexDesc;
+			ZeroMemory(&clusterIndexDesc, sizeof(D3D11_BUFFER_DESC));
+			clusterIndexDesc.Usage = D3D11_USAGE_DYNAMIC;
+			clusterIndexDesc.BindFlags = D3D11_BIND_INDEX_BUFFER;
+			clusterIndexDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+			clusterIndexDesc.ByteWidth = numClusterIndices * sizeof(uint32_t);
+
+			if (!SUCCEEDED(device->CreateBuffer(&clusterIndexDesc, nullptr, &clusterIndexBuffer))) {
+				cout << "Model: cluster index buffer cannot be created - drawing the model whole" << endl;
+				clusters.clear();
+				clusterIndices.clear();
+			}
 		}
+	}
+	catch (exception& e)
+	{
+		cout << "Model could not be instantiated due to:\n";
+		cout << e.what() << endl;
 
-	return 0;
+		if (vertexBuffer)
+			vertexBuffer->Release();
+		vertexBuffer = nullptr;
+	}
+
+	// Dispose of local resources
+	free(importedVertices);
+	free(importedIndices);
+	importedVertices = nullptr;
+	importedIndices = nullptr;
+
+	return hr;
+}
+
+void Model::reportMeshData(const std::string &name) const
+{
+	if (!isLoaded()) {
+		cout << name << ": not loaded" << endl;
+		return;
+	}
+	cout << name << ": " << cacheStatsOptimised.numTriangles << " triangles, " << cacheStatsOptimised.numVertices << " vertices, ACMR " << cacheStatsImported.acmr() << " -> " << cacheStatsOptimised.acmr()
+		<< ", ATVR " << cacheStatsImported.atvr() << " -> " << cacheStatsOptimised.atvr() << " (" << DEFAULT_VERTEX_CACHE_SIZE << " entry FIFO)" << endl;
+
+	cout << "  LODs:";
+	for (size_t l = 0; l < lods.size(); l++) {
+		uint32_t lodIndexCount = 0;
+		for (size_t i = 0; i < lods[l].indexCount.size(); i++)
+			lodIndexCount += lods[l].indexCount[i];
+		cout << " " << l << " = " << lodIndexCount / 3 << " triangles";
+		if (l > 0)
+			cout << " (error " << lods[l].error << ", below " << lods[l].screenSize << " of the screen)";
+		cout << (l + 1 < lods.size() ? "," : "");
+	}
+	cout << ", Current = " << currentLod << endl;
+
+	if (!clusters.empty()) {
+		cout << "  Clusters: " << clusters.size() << " (" << clusterIndices.size() / 3 / clusters.size() << " triangles each)";
+		if (clustersCulled)
+			cout << ", last frame " << numVisibleClusters << " drawn, " << clusterStats.numFrustumCulled << " outside the frustum, " << clusterStats.numBackfaceCulled
+				<< " facing away - " << clusterStats.numVisibleIndices / 3 << " of " << clusterIndices.size() / 3 << " triangles";
+		cout << endl;
+	}
+
+	if (!occluderIndices.empty())
+		cout << "  Occluder: " << occluderIndices.size() / 3 << " triangles, " << occluderPositions.size() / 3 << " vertices" << endl;
+}
+
+void Model::cullClusters(FXMMATRIX viewProj, FXMVECTOR eyePos)
+{
+	clustersCulled = false;
+	if (clusters.empty() || currentLod != 0 || !visible)
+		return;
+
+	// Cull in model space.  Back faces are only dropped if the rasteriser would drop them - the effect culls clockwise back faces and
+	// the world matrix does not mirror the model
+	XMMATRIX world = cBufferModelCPU->worldMatrix;
+	XMVECTOR determinant;
+	XMMATRIX inverseWorld = XMMatrixInverse(&determinant, world);
+	D3D11_RASTERIZER_DESC rasterizerDesc;
+	effect->getRasterizerState()->GetDesc(&rasterizerDesc);
+	bool cullBackfaces = rasterizerDesc.CullMode == D3D11_CULL_BACK && !rasterizerDesc.FrontCounterClockwise && XMVectorGetX(determinant) > 0.0f;
+
+	XMFLOAT4X4 modelToClip;
+	XMStoreFloat4x4(&modelToClip, XMMatrixMultiply(world, viewProj));
+	XMFLOAT3 eye;
+	XMStoreFloat3(&eye, XMVector3TransformCoord(eyePos, inverseWorld));
+
+	ClusterCullView view;
+	setClusterCullView(&modelToClip.m[0][0], &eye.x, cullBackfaces, &view);
+	numVisibleClusters = cullMeshClusters(clusters.data(), clusters.size(), view, visibleClusters.data(), &clusterStats);
+	clustersCulled = true;
+}
+
+void Model::setLodTargets(const float *ratios, const float *screenSizes, int numLevels)
+{
+	numLodTargets = min(numLevels, MAX_LODS - 1);
+	for (int i = 0; i < numLodTargets; i++) {
+		lodRatio[i] = ratios[i];
+		lodScreenSize[i] = screenSizes[i];
+	}
+}
+
+void Model::selectLod(FXMVECTOR eyePos, float projScale)
+{
+	if (bounds.Radius <= 0.0f)
+		return;
+
+	// Fraction of the viewport height the world space bounding sphere covers (all of it from inside the sphere)
+	BoundingSphere worldBounds;
+	bounds.Transform(worldBounds, cBufferModelCPU->worldMatrix);
+	float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(XMLoadFloat3(&worldBounds.Center), eyePos)));
+	inDrawDistance = distance < drawDistance;
+	if (lods.size() < 2)
+		return;
+	float screenSize = (distance > worldBounds.Radius) ? worldBounds.Radius * projScale / distance : 1.0f;
+
+	// Move a level at a time, and only once the size is past the threshold by the hysteresis, so a model sitting at a threshold does not
+	// pop back and forth
+	int lod = currentLod;
+	while (lod + 1 < (int)lods.size() && screenSize < lods[lod + 1].screenSize * (1.0f - lodHysteresis))
+		lod++;
+	while (lod > 0 && screenSize > lods[lod].screenSize * (1.0f + lodHysteresis))
+		lod--;
+	currentLod = lod;
 }
 
 //Model::Model(ID3D11Device *device, Effect *_effect, const std::wstring& filename, ID3D11ShaderResourceView *tex_view, Material *_material) {
@@ -14,10 +14,13 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cfloat>
 #include <CBufferStructures.h>
 #include <Utils.h>
 #include <Camera.h>
 #include <VertexStructures.h>
+#include <MeshOptimiser.h>
+#include <MeshClusters.h>
 
 #include <Assimp\include\assimp\Importer.hpp>      // C++ importer interface
 #include <Assimp\include\assimp\scene.h>           // Output data structure
@@ -27,6 +30,7 @@ class Texture;
 class Material;
 class Effect;
 #define MAX_TEXTURES 8
+#define MAX_LODS 4
 
 class Model : public BaseModel {
 	Animation *animation= nullptr;
@@ -39,17 +43,145 @@ class Model : public BaseModel {
 	ID3D11ShaderResourceView			*textureResourceViewArray[MAX_TEXTURES];
 	ID3D11SamplerState					*sampler = nullptr;
 
+	// Format import() converts the mesh to and the size of a vertex in the vertex buffer
+	VertexFormat						vertexFormat = VERTEX_FORMAT_EXTENDED;
+	UINT								vertexStride = sizeof(ExtendedVertexStruct);
+
+	// Mesh read by import() and waiting for createBuffers().  Vertices are in vertexFormat
+	void								*importedVertices = nullptr;
+	uint32_t							*importedIndices = nullptr;
+	uint32_t							numImportedVertices = 0;
+	uint32_t							numImportedIndices = 0;
+	DirectX::BoundingSphere				importedBounds;
+	DirectX::BoundingBox				importedBox;
+	// Compressed vertices: position = posOffset + quantised position * posScale
+	DirectX::XMFLOAT3					importedPosOffset = DirectX::XMFLOAT3(0, 0, 0);
+	DirectX::XMFLOAT3					importedPosScale = DirectX::XMFLOAT3(1, 1, 1);
+
+	// Post-transform vertex cache behaviour of the imported meshes before and after they were optimised
+	VertexCacheStats					cacheStatsImported;
+	VertexCacheStats					cacheStatsOptimised;
+
+	// Level of detail - a range of the index buffer holding every mesh simplified from level 0, drawn from the same vertex buffer.  A
+	// level is used while the model's bounding sphere covers less than screenSize of the viewport height
+	struct Lod {
+		uint32_t							firstIndex = 0;
+		std::vector<uint32_t>				indexCount; // Per mesh
+		float								error = 0.0f; // Largest simplification error as a fraction of the mesh size
+		float								screenSize = 1.0f;
+	};
+	std::vector<Lod>					lods;
+	std::vector<Lod>					importedLods; // Waiting for createBuffers()
+	int									currentLod = 0;
+
+	// Simplified levels import() generates - the fraction of level 0's triangles each keeps and the screen size it is used below
+	int									numLodTargets = 0;
+	float								lodRatio[MAX_LODS];
+	float								lodScreenSize[MAX_LODS];
+	// Fraction the screen size must pass a level's threshold by before the level changes
+	float								lodHysteresis = 0.1f;
+	// Beyond drawDistance from the eye the model is not drawn (an impostor stands in for it).  Updated by selectLod()
+	float								drawDistance = FLT_MAX;
+	bool								inDrawDistance = true;
+
+	// Clusters of level 0 (see MeshClusters.h), built on import if setClusterCulling() was called.  cullClusters() chooses the clusters
+	// to draw each frame and render() copies their index ranges into clusterIndexBuffer and draws them with one call
+	bool								useClusters = false;
+	std::vector<MeshCluster>			clusters;
+	std::vector<MeshCluster>			importedClusters; // Waiting for createBuffers()
+	std::vector<uint32_t>				clusterIndices; // Level 0 indices in cluster order
+	std::vector<uint32_t>				visibleClusters;
+	size_t								numVisibleClusters = 0;
+	bool								clustersCulled = false; // Set if render() draws the visible clusters rather than the level of detail
+	ClusterCullStats					clusterStats; // Last cullClusters()
+	ID3D11Buffer						*clusterIndexBuffer = nullptr; // Dynamic, sized for level 0
+
+	// Coarsest level of detail within occluderMaxError of level 0, kept in system memory as an occluder (see OcclusionCuller.h) if
+	// setOccluder() was called.  Positions are full precision and only the vertices the level uses are kept
+	bool								useOccluder = false;
+	float								occluderMaxError = 0.01f;
+	std::vector<float>					occluderPositions;
+	std::vector<uint32_t>				occluderIndices;
+	std::vector<float>					importedOccluderPositions; // Waiting for createBuffers()
+	std::vector<uint32_t>				importedOccluderIndices;
+
+	// Meshes of a file as convertScene() copies them out of Assimp.  The vertices and indices of each mesh are stored contiguously and
+	// the indices address the whole vertex array
+	struct ImportedMesh {
+		ExtendedVertexStruct				*vertices = nullptr;
+		uint32_t							*indices = nullptr;
+		uint32_t							numVertices = 0;
+		uint32_t							numIndices = 0;
+		std::vector<uint32_t>				indexCount;
+		std::vector<uint32_t>				baseVertexOffset;
+		std::vector<uint32_t>				vertexCount;
+		VertexCacheStats					cacheStatsImported;
+		VertexCacheStats					cacheStatsOptimised;
+		std::vector<Lod>					lods;
+		std::vector<MeshCluster>			clusters;
+	};
+
+	// The stages of import()
+	static const aiScene *readFile(Assimp::Importer &importer, const std::wstring& filename);
+	// True if the file format is mirrored in x (x is negated on import)
+	static bool mirrorsX(const std::wstring& filename);
+	static HRESULT convertScene(const aiScene *scene, bool flipX, const MaterialStruct &colour, ImportedMesh *mesh);
+	static void optimiseMeshes(ImportedMesh *mesh);
+	// Append the simplified levels to the indices (after optimiseMeshes) and describe every level, level 0 included, in mesh->lods
+	static HRESULT buildLods(ImportedMesh *mesh, const float *ratios, const float *screenSizes, int numLevels);
+	// Split level 0 of each mesh into clusters (reordering its indices) and describe them in mesh->clusters
+	static void buildClusters(ImportedMesh *mesh);
+	// Copy the coarsest level (after buildLods) whose error is at most maxError into a compact triangle list of positions
+	static void buildOccluder(const ImportedMesh *mesh, float maxError, std::vector<float> *positions, std::vector<uint32_t> *indices);
+
 public:
 
 	Model(ID3D11Device *device, const std::wstring& filename, Effect *_effect, Material *_materials[] = nullptr, int _numMaterials = 0, ID3D11ShaderResourceView **textures = nullptr, int numTextures = 0) : BaseModel(device, _effect, _materials, _numMaterials, textures, numTextures){ load(device, _effect, filename, NULL); }
+	// Model whose mesh is loaded later by import() and createBuffers() (see AssetLoader).  It draws nothing until then
+	Model(ID3D11Device *device, Effect *_effect, Material *_materials[] = nullptr, int _numMaterials = 0, ID3D11ShaderResourceView **textures = nullptr, int numTextures = 0) : BaseModel(device, _effect, _materials, _numMaterials, textures, numTextures){ load(device, _effect, std::wstring(), NULL); }
 	~Model();
 	void load(ID3D11Device *device, Effect *_effect, const std::wstring& filename, Material *_material);
 	HRESULT loadModel(ID3D11Device *device, const std::wstring& filename);
 	HRESULT loadModelAssimp(ID3D11Device *device, const std::wstring& filename);
+	// Import the mesh into system memory.  Any thread (the model is not drawn until createBuffers() has been called)
+	HRESULT import(const std::wstring& filename);
+	// Create the vertex and index buffers from the imported mesh and release it.  Render thread
+	HRESULT createBuffers(ID3D11Device *device);
+	bool isLoaded() const { return vertexBuffer != nullptr; };
+	// Vertex format of the mesh, chosen per model before it is imported.  The model's effect must use the matching input layout
+	void setVertexFormat(VertexFormat format) { vertexFormat = format; };
+	VertexFormat getVertexFormat() const { return vertexFormat; };
+	// Levels of detail generated on import: level i + 1 keeps ratios[i] of the triangles and is used while the model covers less than
+	// screenSizes[i] of the viewport height (both decreasing, at most MAX_LODS - 1 levels).  Chosen per model before it is imported
+	void setLodTargets(const float *ratios, const float *screenSizes, int numLevels);
+	void setLodHysteresis(float hysteresis) { lodHysteresis = hysteresis; };
+	// Choose the level of detail from the size of the model on screen.  projScale is the y scale of the projection (1 / tan(fovY / 2))
+	void selectLod(DirectX::FXMVECTOR eyePos, float projScale);
+	void setDrawDistance(float distance) { drawDistance = distance; };
+	// False if the model was beyond its draw distance at the last selectLod()
+	bool isInDrawDistance() const { return inDrawDistance; };
+	int getLod() const { return currentLod; };
+	// Build clusters of level 0 on import so it can be culled a cluster at a time.  Chosen per model before it is imported
+	void setClusterCulling(bool enable) { useClusters = enable; };
+	// Choose the clusters to draw from the view (after cull() and selectLod()).  Clusters facing away from the eye are dropped only if
+	// the effect culls back faces.  Level 0 only - other levels are drawn whole.  Safe to call for different models in parallel
+	void cullClusters(DirectX::FXMMATRIX viewProj, DirectX::FXMVECTOR eyePos);
+	int getNumLods() const { return (int)lods.size(); };
+	// Keep a level of detail no further than maxError (a fraction of the mesh size) from level 0 on import to rasterise as an occluder.
+	// Chosen per model before it is imported
+	void setOccluder(bool enable, float maxError = 0.01f) { useOccluder = enable; occluderMaxError = maxError; };
+	bool getOccluder(OccluderMesh *mesh) const;
+	// Print the vertex cache statistics and levels of detail of the import
+	void reportMeshData(const std::string &name) const;
+	// Time the import stages (Assimp read, conversion to ExtendedVertexStruct, mesh optimisation, level of detail generation and cluster
+	// building) and the cluster culling of every model file in directory
+	static void benchmarkImport(const std::wstring& directory = L"Resources\\Models\\");
+	// Read the meshes of a model file as they are imported, before optimisation or compression, for tools that work on the geometry
+	// (eg. impostor baking).  Any thread
+	static HRESULT importMesh(const std::wstring& filename, std::vector<ExtendedVertexStruct> *vertices, std::vector<uint32_t> *indices);
 	
 	void render(ID3D11DeviceContext *context);// , int mode = NORMAL);
 	void setAnimation(Animation *newAnimation){ animation = newAnimation; };
-	void setWorldMatrix(XMMATRIX newMatrix){ cBufferModelCPU->worldMatrix = newMatrix; };
 	void setTextures(int _start_slot, int _num_textures, ID3D11ShaderResourceView *_tex_view_array[]);
 	XMMATRIX getWorldMatrix(){ return  cBufferModelCPU->worldMatrix; };
 	HRESULT init(ID3D11Device *device){ return S_OK; };
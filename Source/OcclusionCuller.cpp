@@ -0,0 +1,479 @@
+#include "stdafx.h"
+#include "OcclusionCuller.h"
+#include <JobSystem.h>
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <functional>
+#include <iostream>
+
+using namespace std;
+
+static const int numTilesX = OCCLUSION_WIDTH / OCCLUSION_TILE_WIDTH;
+static const int numTilesY = OCCLUSION_HEIGHT / OCCLUSION_TILE_HEIGHT;
+static const int numBlocksX = OCCLUSION_WIDTH / OCCLUSION_BLOCK_SIZE;
+static const int numBlocksY = OCCLUSION_HEIGHT / OCCLUSION_BLOCK_SIZE;
+
+
+// c = a * b for 4x4 row major matrices
+static void multiply(const float *a, const float *b, float *c)
+{
+	for (int row = 0; row < 4; row++)
+		for (int column = 0; column < 4; column++)
+			c[row * 4 + column] = a[row * 4 + 0] * b[column] + a[row * 4 + 1] * b[4 + column] + a[row * 4 + 2] * b[8 + column] + a[row * 4 + 3] * b[12 + column];
+}
+
+// Clip space position (x, y, z, 1) * m, with the rows of m in SSE registers
+static inline __m128 transformPoint(float x, float y, float z, const __m128 *rows)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(x), rows[0]), _mm_mul_ps(_mm_set1_ps(y), rows[1])),
+		_mm_add_ps(_mm_mul_ps(_mm_set1_ps(z), rows[2]), rows[3]));
+}
+
+
+OcclusionCuller::OcclusionCuller()
+{
+	for (int i = 0; i < 16; i++)
+		viewProj[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+	bins.resize(numTilesX * numTilesY);
+	depth.assign(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 1.0f);
+	hiZ.assign(numBlocksX * numBlocksY, 1.0f);
+}
+
+void OcclusionCuller::beginFrame(const float *_viewProj)
+{
+	for (int i = 0; i < 16; i++)
+		viewProj[i] = _viewProj[i];
+	triangles.clear();
+	for (size_t i = 0; i < bins.size(); i++)
+		bins[i].clear();
+	stats = OcclusionStats();
+}
+
+void OcclusionCuller::addOccluder(const OccluderMesh &mesh, const float *world)
+{
+	if (!mesh.positions || !mesh.indices || mesh.numVertices == 0)
+		return;
+
+	float modelToClip[16];
+	multiply(world, viewProj, modelToClip);
+	__m128 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = _mm_loadu_ps(modelToClip + i * 4);
+
+	// Every vertex is transformed once, 4 components at a time
+	clipVertices.resize(mesh.numVertices * 4);
+	const uint8_t *position = (const uint8_t*)mesh.positions;
+	for (size_t i = 0; i < mesh.numVertices; i++, position += mesh.stride) {
+		const float *p = (const float*)position;
+		_mm_storeu_ps(&clipVertices[i * 4], transformPoint(p[0], p[1], p[2], rows));
+	}
+
+	for (size_t i = 0; i + 2 < mesh.numIndices; i += 3) {
+		uint32_t a = mesh.indices[i], b = mesh.indices[i + 1], c = mesh.indices[i + 2];
+		if (a < mesh.numVertices && b < mesh.numVertices && c < mesh.numVertices)
+			addTriangle(&clipVertices[a * 4], &clipVertices[b * 4], &clipVertices[c * 4]);
+	}
+	stats.numOccluders++;
+	stats.numTriangles += mesh.numIndices / 3;
+}
+
+void OcclusionCuller::addTriangle(const float *a, const float *b, const float *c)
+{
+	const float *v[3] = { a, b, c };
+
+	// Reject triangles wholly outside one of the frustum planes (far excepted - the depth test leaves them out)
+	int outside[5] = { 0, 0, 0, 0, 0 };
+	for (int i = 0; i < 3; i++) {
+		outside[0] += v[i][0] < -v[i][3];
+		outside[1] += v[i][0] > v[i][3];
+		outside[2] += v[i][1] < -v[i][3];
+		outside[3] += v[i][1] > v[i][3];
+		outside[4] += v[i][2] < 0.0f;
+	}
+	for (int i = 0; i < 5; i++)
+		if (outside[i] == 3)
+			return;
+
+	if (outside[4] == 0) {
+		setupTriangle(a, b, c);
+		return;
+	}
+
+	// Clip to the near plane (z >= 0).  One vertex in front leaves a triangle, two leave a quad split into two triangles
+	float clipped[4][4];
+	int numClipped = 0;
+	for (int i = 0; i < 3; i++) {
+		const float *p = v[i];
+		const float *q = v[(i + 1) % 3];
+		if (p[2] >= 0.0f) {
+			for (int k = 0; k < 4; k++)
+				clipped[numClipped][k] = p[k];
+			numClipped++;
+		}
+		if ((p[2] >= 0.0f) != (q[2] >= 0.0f)) {
+			float t = p[2] / (p[2] - q[2]);
+			for (int k = 0; k < 4; k++)
+				clipped[numClipped][k] = p[k] + (q[k] - p[k]) * t;
+			clipped[numClipped][2] = 0.0f;
+			numClipped++;
+		}
+	}
+	if (numClipped >= 3)
+		setupTriangle(clipped[0], clipped[1], clipped[2]);
+	if (numClipped == 4)
+		setupTriangle(clipped[0], clipped[2], clipped[3]);
+}
+
+void OcclusionCuller::setupTriangle(const float *a, const float *b, const float *c)
+{
+	const float *v[3] = { a, b, c };
+	double x[3], y[3], z[3];
+	for (int i = 0; i < 3; i++) {
+		if (!(v[i][3] > 0.0f))
+			return;
+		double invW = 1.0 / v[i][3];
+		x[i] = (v[i][0] * invW * 0.5 + 0.5) * OCCLUSION_WIDTH;
+		y[i] = (0.5 - v[i][1] * invW * 0.5) * OCCLUSION_HEIGHT;
+		z[i] = v[i][2] * invW;
+	}
+
+	// Both windings are drawn - counter clockwise triangles are turned round so the edge functions are positive inside
+	double area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+	if (!(fabs(area) > 1e-6))
+		return;
+	if (area < 0.0) {
+		swap(x[1], x[2]);
+		swap(y[1], y[2]);
+		swap(z[1], z[2]);
+		area = -area;
+	}
+
+	// Pixels whose centres lie in the bounding box
+	double minXf = min(min(x[0], x[1]), x[2]), maxXf = max(max(x[0], x[1]), x[2]);
+	double minYf = min(min(y[0], y[1]), y[2]), maxYf = max(max(y[0], y[1]), y[2]);
+	Triangle triangle;
+	triangle.minX = max((int)ceil(max(minXf, -1.0) - 0.5), 0);
+	triangle.maxX = min((int)floor(min(maxXf, OCCLUSION_WIDTH + 1.0) - 0.5), OCCLUSION_WIDTH - 1);
+	triangle.minY = max((int)ceil(max(minYf, -1.0) - 0.5), 0);
+	triangle.maxY = min((int)floor(min(maxYf, OCCLUSION_HEIGHT + 1.0) - 0.5), OCCLUSION_HEIGHT - 1);
+	if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+		return;
+
+	// Edge i runs from vertex i to vertex i + 1.  Evaluated at (px + 0.5, py + 0.5) for pixel (px, py)
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		double edgeA = -(y[j] - y[i]);
+		double edgeB = x[j] - x[i];
+		triangle.edgeA[i] = (float)edgeA;
+		triangle.edgeB[i] = (float)edgeB;
+		triangle.edgeC[i] = (y[j] - y[i]) * x[i] - (x[j] - x[i]) * y[i] + 0.5 * (edgeA + edgeB);
+	}
+
+	// Depth is linear in screen space
+	double depthA = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+	double depthB = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+	triangle.depthA = (float)depthA;
+	triangle.depthB = (float)depthB;
+	triangle.depthC = z[0] - depthA * x[0] - depthB * y[0] + 0.5 * (depthA + depthB);
+
+	uint32_t index = (uint32_t)triangles.size();
+	triangles.push_back(triangle);
+	for (int ty = triangle.minY / OCCLUSION_TILE_HEIGHT; ty <= triangle.maxY / OCCLUSION_TILE_HEIGHT; ty++)
+		for (int tx = triangle.minX / OCCLUSION_TILE_WIDTH; tx <= triangle.maxX / OCCLUSION_TILE_WIDTH; tx++) {
+			bins[ty * numTilesX + tx].push_back(index);
+			stats.numBinned++;
+		}
+	stats.numRasterised++;
+}
+
+
+void OcclusionCuller::rasteriseTile(size_t tile)
+{
+	int tileX = (int)(tile % numTilesX) * OCCLUSION_TILE_WIDTH;
+	int tileY = (int)(tile / numTilesX) * OCCLUSION_TILE_HEIGHT;
+
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 offsets = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+
+	for (int y = tileY; y < tileY + OCCLUSION_TILE_HEIGHT; y++)
+		for (int x = tileX; x < tileX + OCCLUSION_TILE_WIDTH; x += 4)
+			_mm_storeu_ps(&depth[y * OCCLUSION_WIDTH + x], one);
+
+	const vector<uint32_t> &bin = bins[tile];
+	for (size_t i = 0; i < bin.size(); i++) {
+		const Triangle &triangle = triangles[bin[i]];
+
+		// Groups of 4 pixels start on a multiple of 4 so they never cross into the next tile
+		int x0 = max(triangle.minX, tileX) & ~3;
+		int x1 = min(triangle.maxX, tileX + OCCLUSION_TILE_WIDTH - 1);
+		int y0 = max(triangle.minY, tileY);
+		int y1 = min(triangle.maxY, tileY + OCCLUSION_TILE_HEIGHT - 1);
+
+		__m128 edgeA[3], edgeStep[3];
+		for (int k = 0; k < 3; k++) {
+			edgeA[k] = _mm_mul_ps(_mm_set1_ps(triangle.edgeA[k]), offsets);
+			edgeStep[k] = _mm_set1_ps(triangle.edgeA[k] * 4.0f);
+		}
+		__m128 depthA = _mm_mul_ps(_mm_set1_ps(triangle.depthA), offsets);
+		__m128 depthStep = _mm_set1_ps(triangle.depthA * 4.0f);
+
+		for (int y = y0; y <= y1; y++) {
+
+			// Each row starts from the double constants so errors do not build up down the triangle
+			__m128 edge[3];
+			for (int k = 0; k < 3; k++)
+				edge[k] = _mm_add_ps(_mm_set1_ps((float)((double)triangle.edgeA[k] * x0 + (double)triangle.edgeB[k] * y + triangle.edgeC[k])), edgeA[k]);
+			__m128 z = _mm_add_ps(_mm_set1_ps((float)((double)triangle.depthA * x0 + (double)triangle.depthB * y + triangle.depthC)), depthA);
+
+			float *row = &depth[y * OCCLUSION_WIDTH];
+			for (int x = x0; x <= x1; x += 4) {
+				__m128 inside = _mm_cmpge_ps(_mm_min_ps(_mm_min_ps(edge[0], edge[1]), edge[2]), zero);
+				if (_mm_movemask_ps(inside)) {
+					__m128 previous = _mm_loadu_ps(row + x);
+					__m128 nearest = _mm_min_ps(previous, z);
+					_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+				}
+				for (int k = 0; k < 3; k++)
+					edge[k] = _mm_add_ps(edge[k], edgeStep[k]);
+				z = _mm_add_ps(z, depthStep);
+			}
+		}
+	}
+
+	// Farthest depth of each block in the tile
+	for (int by = tileY; by < tileY + OCCLUSION_TILE_HEIGHT; by += OCCLUSION_BLOCK_SIZE)
+		for (int bx = tileX; bx < tileX + OCCLUSION_TILE_WIDTH; bx += OCCLUSION_BLOCK_SIZE) {
+			__m128 farthest = zero;
+			for (int y = by; y < by + OCCLUSION_BLOCK_SIZE; y++)
+				for (int x = bx; x < bx + OCCLUSION_BLOCK_SIZE; x += 4)
+					farthest = _mm_max_ps(farthest, _mm_loadu_ps(&depth[y * OCCLUSION_WIDTH + x]));
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+			_mm_store_ss(&hiZ[(by / OCCLUSION_BLOCK_SIZE) * numBlocksX + bx / OCCLUSION_BLOCK_SIZE], farthest);
+		}
+}
+
+void OcclusionCuller::rasteriseTiles(size_t first, size_t last)
+{
+	for (size_t tile = first; tile < last && tile < bins.size(); tile++)
+		rasteriseTile(tile);
+}
+
+void OcclusionCuller::rasterise(JobSystem *jobs)
+{
+	jobs->parallelFor(0, bins.size(), 1, [this](size_t first, size_t last) {
+		rasteriseTiles(first, last);
+	});
+}
+
+
+bool OcclusionCuller::isOccluded(const float boxMin[3], const float boxMax[3], const float *modelToClip) const
+{
+	__m128 rows[4];
+	for (int i = 0; i < 4; i++)
+		rows[i] = _mm_loadu_ps(modelToClip + i * 4);
+
+	// Screen rectangle and nearest depth of the corners
+	float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX, nearest = FLT_MAX;
+	for (int i = 0; i < 8; i++) {
+		float corner[4];
+		_mm_storeu_ps(corner, transformPoint((i & 1) ? boxMax[0] : boxMin[0], (i & 2) ? boxMax[1] : boxMin[1], (i & 4) ? boxMax[2] : boxMin[2], rows));
+		if (corner[2] < 0.0f || !(corner[3] > 0.0f))
+			return false;
+		float invW = 1.0f / corner[3];
+		float x = (corner[0] * invW * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+		float y = (0.5f - corner[1] * invW * 0.5f) * OCCLUSION_HEIGHT;
+		minX = min(minX, x);
+		maxX = max(maxX, x);
+		minY = min(minY, y);
+		maxY = max(maxY, y);
+		nearest = min(nearest, corner[2] * invW);
+	}
+	if (maxX < 0.0f || maxY < 0.0f || minX >= OCCLUSION_WIDTH || minY >= OCCLUSION_HEIGHT)
+		return false;
+
+	// Every pixel the rectangle touches
+	int x0 = max((int)floor(minX), 0), x1 = min((int)floor(maxX), OCCLUSION_WIDTH - 1);
+	int y0 = max((int)floor(minY), 0), y1 = min((int)floor(maxY), OCCLUSION_HEIGHT - 1);
+
+	for (int by = y0 / OCCLUSION_BLOCK_SIZE; by <= y1 / OCCLUSION_BLOCK_SIZE; by++)
+		for (int bx = x0 / OCCLUSION_BLOCK_SIZE; bx <= x1 / OCCLUSION_BLOCK_SIZE; bx++) {
+
+			// The whole block is nearer than the box
+			if (hiZ[by * numBlocksX + bx] < nearest)
+				continue;
+
+			// Otherwise only the pixels of the block inside the rectangle matter
+			int px0 = max(x0, bx * OCCLUSION_BLOCK_SIZE), px1 = min(x1, bx * OCCLUSION_BLOCK_SIZE + OCCLUSION_BLOCK_SIZE - 1);
+			int py0 = max(y0, by * OCCLUSION_BLOCK_SIZE), py1 = min(y1, by * OCCLUSION_BLOCK_SIZE + OCCLUSION_BLOCK_SIZE - 1);
+			for (int y = py0; y <= py1; y++)
+				for (int x = px0; x <= px1; x++)
+					if (depth[y * OCCLUSION_WIDTH + x] >= nearest)
+						return false;
+		}
+	return true;
+}
+
+
+void OcclusionCuller::reportData() const
+{
+	cout << "OcclusionCuller: " << stats.numOccluders << " occluders, " << stats.numTriangles << " triangles (" << stats.numRasterised
+		<< " rasterised in " << stats.numBinned << " tile bins), " << OCCLUSION_WIDTH << "x" << OCCLUSION_HEIGHT << " depth in "
+		<< bins.size() << " tiles" << endl;
+}
+
+
+// Left handed look at and perspective projection (as XMMatrixLookAtLH and XMMatrixPerspectiveFovLH) combined
+static void lookAtPerspective(const float eye[3], const float target[3], float fovY, float aspect, float nearZ, float farZ, float *viewProj)
+{
+	float zAxis[3] = { target[0] - eye[0], target[1] - eye[1], target[2] - eye[2] };
+	float length = sqrt(zAxis[0] * zAxis[0] + zAxis[1] * zAxis[1] + zAxis[2] * zAxis[2]);
+	for (int k = 0; k < 3; k++)
+		zAxis[k] /= length;
+	float xAxis[3] = { zAxis[2], 0.0f, -zAxis[0] }; // up (0, 1, 0) x zAxis
+	length = sqrt(xAxis[0] * xAxis[0] + xAxis[2] * xAxis[2]);
+	for (int k = 0; k < 3; k++)
+		xAxis[k] /= length;
+	float yAxis[3] = { zAxis[1] * xAxis[2] - zAxis[2] * xAxis[1], zAxis[2] * xAxis[0] - zAxis[0] * xAxis[2], zAxis[0] * xAxis[1] - zAxis[1] * xAxis[0] };
+
+	float view[16] = { xAxis[0], yAxis[0], zAxis[0], 0.0f, xAxis[1], yAxis[1], zAxis[1], 0.0f, xAxis[2], yAxis[2], zAxis[2], 0.0f,
+		0.0f, 0.0f, 0.0f, 1.0f };
+	for (int k = 0; k < 3; k++) {
+		view[12] -= xAxis[k] * eye[k];
+		view[13] -= yAxis[k] * eye[k];
+		view[14] -= zAxis[k] * eye[k];
+	}
+	float scaleY = 1.0f / tan(0.5f * fovY), scaleX = scaleY / aspect, q = farZ / (farZ - nearZ);
+	for (int row = 0; row < 4; row++) {
+		const float *r = &view[row * 4];
+		viewProj[row * 4 + 0] = r[0] * scaleX;
+		viewProj[row * 4 + 1] = r[1] * scaleY;
+		viewProj[row * 4 + 2] = r[2] * q + r[3] * -q * nearZ;
+		viewProj[row * 4 + 3] = r[2];
+	}
+}
+
+// Append a box (12 triangles) to a triangle list
+static void addBox(const float boxMin[3], const float boxMax[3], vector<float> *positions, vector<uint32_t> *indices)
+{
+	static const uint32_t faces[36] = { 0, 2, 1, 1, 2, 3, 4, 5, 6, 5, 7, 6, 0, 1, 4, 1, 5, 4, 2, 6, 3, 3, 6, 7, 0, 4, 2, 2, 4, 6, 1, 3, 5, 3, 7, 5 };
+	uint32_t base = (uint32_t)(positions->size() / 3);
+	for (int i = 0; i < 8; i++) {
+		positions->push_back((i & 1) ? boxMax[0] : boxMin[0]);
+		positions->push_back((i & 2) ? boxMax[1] : boxMin[1]);
+		positions->push_back((i & 4) ? boxMax[2] : boxMin[2]);
+	}
+	for (int i = 0; i < 36; i++)
+		indices->push_back(base + faces[i]);
+}
+
+void benchmarkOcclusionCulling(int numBoxes, int numViews, int iterations, int numThreads)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+	if (numBoxes <= 0 || numViews <= 0 || iterations <= 0)
+		return;
+	// The scene rasterises through its job system, so the parallel times are taken on one too
+	JobSystem jobs((UINT)max(numThreads, 0));
+	numThreads = (int)jobs.getNumThreads();
+
+	// A 400 x 400 ground of 32 x 32 cells crossed by rows of walls 20 high
+	const int gridSize = 32;
+	const float groundSize = 400.0f;
+	vector<float> groundPositions;
+	vector<uint32_t> groundIndices;
+	for (int z = 0; z <= gridSize; z++)
+		for (int x = 0; x <= gridSize; x++) {
+			groundPositions.push_back((x / (float)gridSize - 0.5f) * groundSize);
+			groundPositions.push_back(0.0f);
+			groundPositions.push_back((z / (float)gridSize - 0.5f) * groundSize);
+		}
+	for (int z = 0; z < gridSize; z++)
+		for (int x = 0; x < gridSize; x++) {
+			uint32_t i = z * (gridSize + 1) + x;
+			uint32_t quad[6] = { i, i + gridSize + 1, i + 1, i + 1, i + gridSize + 1, i + gridSize + 2 };
+			groundIndices.insert(groundIndices.end(), quad, quad + 6);
+		}
+
+	vector<float> wallPositions;
+	vector<uint32_t> wallIndices;
+	for (int row = 0; row < 4; row++)
+		for (int wall = 0; wall < 4; wall++) {
+			float centreX = (wall - 1.5f) * 90.0f, centreZ = (row - 1.5f) * 90.0f;
+			float wallMin[3] = { centreX - 30.0f, 0.0f, centreZ - 1.0f }, wallMax[3] = { centreX + 30.0f, 20.0f, centreZ + 1.0f };
+			addBox(wallMin, wallMax, &wallPositions, &wallIndices);
+		}
+
+	OccluderMesh occluders[2];
+	occluders[0].positions = groundPositions.data();
+	occluders[0].numVertices = groundPositions.size() / 3;
+	occluders[0].indices = groundIndices.data();
+	occluders[0].numIndices = groundIndices.size();
+	occluders[1].positions = wallPositions.data();
+	occluders[1].numVertices = wallPositions.size() / 3;
+	occluders[1].indices = wallIndices.data();
+	occluders[1].numIndices = wallIndices.size();
+	static const float identity[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+
+	// Boxes of 1 to 6 units standing on the ground, half of them sunk below it
+	vector<float> boxes(numBoxes * 6);
+	unsigned int seed = 1;
+	for (int i = 0; i < numBoxes; i++) {
+		float r[4];
+		for (int k = 0; k < 4; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			r[k] = (seed >> 8) / 16777216.0f;
+		}
+		float size = 1.0f + 5.0f * r[2];
+		float base = (i & 1) ? -size - 1.0f : 0.0f;
+		float box[6] = { (r[0] - 0.5f) * groundSize, base, (r[1] - 0.5f) * groundSize, 0.0f, base + size * (0.5f + r[3]), 0.0f };
+		box[3] = box[0] + size;
+		box[5] = box[2] + size;
+		for (int k = 0; k < 6; k++)
+			boxes[i * 6 + k] = box[k];
+	}
+
+	OcclusionCuller culler;
+	double serialTime = 0.0, parallelTime = 0.0, testTime = 0.0, occluded = 0.0;
+	for (int v = 0; v < numViews; v++) {
+
+		// Eyes around the edge of the ground at head height, looking across it
+		float angle = 6.2831853f * v / numViews;
+		float eye[3] = { 180.0f * cos(angle), 5.0f + 10.0f * (v % 3), 180.0f * sin(angle) };
+		float target[3] = { 0.0f, 2.0f, 0.0f };
+		float viewProj[16];
+		lookAtPerspective(eye, target, 1.0471976f, (float)OCCLUSION_WIDTH / OCCLUSION_HEIGHT, 1.0f, 1000.0f, viewProj);
+
+		culler.beginFrame(viewProj);
+		for (int i = 0; i < 2; i++)
+			culler.addOccluder(occluders[i], identity);
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		for (int i = 0; i < iterations; i++)
+			culler.rasteriseTiles(0, culler.getNumTiles());
+		serialTime += chrono::duration<double, micro>(BenchmarkClock::now() - start).count() / iterations;
+
+		start = BenchmarkClock::now();
+		for (int i = 0; i < iterations; i++)
+			culler.rasterise(&jobs);
+		parallelTime += chrono::duration<double, micro>(BenchmarkClock::now() - start).count() / iterations;
+
+		size_t numOccluded = 0;
+		start = BenchmarkClock::now();
+		for (int i = 0; i < iterations; i++) {
+			numOccluded = 0;
+			for (int b = 0; b < numBoxes; b++)
+				numOccluded += culler.isOccluded(&boxes[b * 6], &boxes[b * 6 + 3], viewProj) ? 1 : 0;
+		}
+		testTime += chrono::duration<double, nano>(BenchmarkClock::now() - start).count() / iterations;
+		occluded += (double)numOccluded / numBoxes;
+	}
+
+	const OcclusionStats &stats = culler.getStats();
+	cout << "Occlusion culling: " << stats.numTriangles << " occluder triangles, " << numBoxes << " boxes, " << numViews << " views - rasterise = "
+		<< serialTime / numViews << " us on 1 thread, " << parallelTime / numViews << " us on " << numThreads << " threads, test = "
+		<< testTime / numViews / numBoxes << " ns per box, occluded " << 100.0 * occluded / numViews << "%" << endl;
+}
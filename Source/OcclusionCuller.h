@@ -0,0 +1,103 @@
+//
+// OcclusionCuller.h
+//
+
+// Software occlusion culling on the CPU.  A few low-poly occluders (a coarse copy of the terrain, a simplified level of the castle)
+// are rasterised into a small depth buffer of OCCLUSION_WIDTH x OCCLUSION_HEIGHT pixels, and the bounding boxes of the models are
+// tested against it before they are drawn.
+//
+// addOccluder() transforms the occluder's vertices to clip space, clips its triangles to the near plane and bins the screen space
+// triangles into tiles of OCCLUSION_TILE_WIDTH x OCCLUSION_TILE_HEIGHT pixels.  The tiles are independent - rasteriseTiles() fills
+// any range of them, so they can be spread across threads - and each is rasterised 4 pixels at a time with SSE2, keeping the nearest
+// depth, then reduced to the farthest depth of each OCCLUSION_BLOCK_SIZE square block.  isOccluded() projects a box, finds the blocks
+// its screen rectangle covers and reports it occluded if its nearest point lies behind every block; blocks that do not decide it are
+// tested pixel by pixel.  Depth is z / w as Direct3D stores it (0 at the near plane).
+//
+// Occluders must lie inside the geometry they stand in for, or they could hide models that are in fact visible.  They are sampled at
+// pixel centres, so a model showing less than a pixel past the edge of an occluder can still be culled.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+class JobSystem;
+
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+#define OCCLUSION_TILE_WIDTH 64
+#define OCCLUSION_TILE_HEIGHT 32
+#define OCCLUSION_BLOCK_SIZE 8
+
+// Triangle list of an occluder.  positions points at the first vertex position (3 floats) and stride is the size of a vertex in bytes
+struct OccluderMesh {
+	const float							*positions = nullptr;
+	size_t								stride = 3 * sizeof(float);
+	size_t								numVertices = 0;
+	const uint32_t						*indices = nullptr;
+	size_t								numIndices = 0;
+};
+
+struct OcclusionStats {
+	size_t								numOccluders = 0;
+	size_t								numTriangles = 0; // Occluder triangles submitted
+	size_t								numRasterised = 0; // Triangles left after near plane clipping and rejection (clipped triangles may add some)
+	size_t								numBinned = 0; // Triangle-tile pairs rasterised
+};
+
+class OcclusionCuller {
+
+	// Screen space triangle ready to rasterise.  The edge functions are positive inside and, like the plane of the depth, are evaluated
+	// at pixel centres from integer pixel coordinates.  The constants are double so triangles reaching far off screen stay exact
+	struct Triangle {
+		float							edgeA[3];
+		float							edgeB[3];
+		double							edgeC[3];
+		float							depthA;
+		float							depthB;
+		double							depthC;
+		int								minX, minY, maxX, maxY; // Pixels whose centres the bounding box covers, clamped to the screen
+	};
+
+	float								viewProj[16];
+	std::vector<Triangle>				triangles;
+	std::vector<std::vector<uint32_t> >	bins; // Triangles touching each tile
+	std::vector<float>					clipVertices; // Scratch for addOccluder()
+	std::vector<float>					depth; // Nearest occluder depth, cleared to 1
+	std::vector<float>					hiZ; // Farthest depth of each block
+	OcclusionStats						stats;
+
+	// Clip a clip space triangle to the near plane and add what is left
+	void addTriangle(const float *a, const float *b, const float *c);
+	void setupTriangle(const float *a, const float *b, const float *c);
+	void rasteriseTile(size_t tile);
+
+public:
+
+	OcclusionCuller();
+
+	// Start a frame seen through viewProj (16 floats, row major, row vectors as DirectXMath).  Clears the occluders
+	void beginFrame(const float *viewProj);
+	// Add an occluder placed in the world by world (16 floats as viewProj).  Single threaded
+	void addOccluder(const OccluderMesh &mesh, const float *world);
+
+	// Rasterise tiles [first, last) and build their blocks.  Different ranges can be rasterised in parallel, after every occluder has
+	// been added
+	size_t getNumTiles() const { return bins.size(); };
+	void rasteriseTiles(size_t first, size_t last);
+	// Rasterise every tile, a tile per job of jobs, and wait for them
+	void rasterise(JobSystem *jobs);
+
+	// True if the box (boxMin to boxMax in the space modelToClip transforms from) is behind the occluders.  Boxes crossing the near
+	// plane or outside the screen are never occluded.  Safe to call in parallel once the tiles have been rasterised
+	bool isOccluded(const float boxMin[3], const float boxMax[3], const float *modelToClip) const;
+
+	const float *getDepth() const { return depth.data(); };
+	const OcclusionStats &getStats() const { return stats; };
+	void reportData() const;
+};
+
+// Time the rasterisation of a synthetic scene (a ground grid and rows of walls) on 1 thread and on a job system of numThreads threads
+// (0 = hardware threads), and the testing of numBoxes boxes scattered over it from numViews views, and report the times and the
+// fraction occluded to the console
+void benchmarkOcclusionCulling(int numBoxes = 4096, int numViews = 16, int iterations = 20, int numThreads = 0);
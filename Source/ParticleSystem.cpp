@@ -130,14 +130,7 @@ HRESULT ParticleSystem::init(ID3D11Device *device)
 
 ParticleSystem::~ParticleSystem() {
 
-	if (vertexBuffer)
-		vertexBuffer->Release();
-	if (indexBuffer)
-		indexBuffer->Release();
-	if (inputLayout)
-		inputLayout->Release();
-
-
+	// The vertex and index buffers and the input layout are released by ~BaseModel
 }
 
 
@@ -146,8 +139,7 @@ void ParticleSystem::render(ID3D11DeviceContext *context) {
 
 
 
-	context->PSSetConstantBuffers(0, 1, &cBufferModelGPU);
-	context->VSSetConstantBuffers(0, 1, &cBufferModelGPU);
+	bindCBuffer(context);
 
 	// Validate object before rendering 
 	if (!context || !vertexBuffer || !inputLayout)
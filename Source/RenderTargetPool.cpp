@@ -0,0 +1,211 @@
+#include "stdafx.h"
+#include "RenderTargetPool.h"
+
+using namespace std;
+
+RenderTargetPool::RenderTargetPool(ID3D11Device *_device, UINT _evictAfterFrames)
+{
+	device = _device;
+	evictAfterFrames = _evictAfterFrames;
+}
+
+void RenderTargetPool::beginFrame()
+{
+	frameIndex++;
+
+	for (size_t i = 0; i < targets.size();) {
+		if (!targets[i]->inUse && frameIndex - targets[i]->lastUsedFrame > evictAfterFrames) {
+			destroyTarget(targets[i]);
+			targets.erase(targets.begin() + i);
+			numEvicted++;
+		}
+		else
+			i++;
+	}
+}
+
+PooledRenderTarget *RenderTargetPool::acquire(const RenderTargetDesc &desc)
+{
+	if (desc.width == 0 || desc.height == 0)
+		return nullptr;
+
+	for (size_t i = 0; i < targets.size(); i++) {
+		if (!targets[i]->inUse && targets[i]->desc == desc) {
+			targets[i]->inUse = true;
+			targets[i]->lastUsedFrame = frameIndex;
+			return targets[i];
+		}
+	}
+
+	PooledRenderTarget *target = new PooledRenderTarget();
+	target->desc = desc;
+	if (!SUCCEEDED(createTarget(target))) {
+		delete target;
+		return nullptr;
+	}
+	target->inUse = true;
+	target->lastUsedFrame = frameIndex;
+	targets.push_back(target);
+
+	numCreated++;
+	currentBytes += targetBytes(desc);
+	target->accounted = true;
+	peakBytes = max(peakBytes, currentBytes);
+	return target;
+}
+
+void RenderTargetPool::release(PooledRenderTarget *target)
+{
+	if (target) {
+		target->inUse = false;
+		target->lastUsedFrame = frameIndex;
+	}
+}
+
+void RenderTargetPool::releaseUnused()
+{
+	for (size_t i = 0; i < targets.size();) {
+		if (!targets[i]->inUse) {
+			destroyTarget(targets[i]);
+			targets.erase(targets.begin() + i);
+			numEvicted++;
+		}
+		else
+			i++;
+	}
+}
+
+HRESULT RenderTargetPool::createTarget(PooledRenderTarget *target)
+{
+	if (!device)
+		return E_FAIL;
+
+	const RenderTargetDesc &desc = target->desc;
+
+	// Typeless depth formats need explicit view formats
+	DXGI_FORMAT dsvFormat = desc.format;
+	DXGI_FORMAT srvFormat = desc.format;
+	if (desc.format == DXGI_FORMAT_R24G8_TYPELESS) {
+		dsvFormat = DXGI_FORMAT_D24_UNORM_S8_UINT;
+		srvFormat = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+	}
+	else if (desc.format == DXGI_FORMAT_R32_TYPELESS) {
+		dsvFormat = DXGI_FORMAT_D32_FLOAT;
+		srvFormat = DXGI_FORMAT_R32_FLOAT;
+	}
+	bool multisampled = desc.sampleCount > 1;
+
+	D3D11_TEXTURE2D_DESC texDesc;
+	texDesc.Width = desc.width;
+	texDesc.Height = desc.height;
+	texDesc.MipLevels = 1;
+	texDesc.ArraySize = 1;
+	texDesc.Format = desc.format;
+	texDesc.SampleDesc.Count = max(desc.sampleCount, 1u);
+	texDesc.SampleDesc.Quality = 0;
+	texDesc.Usage = D3D11_USAGE_DEFAULT;
+	texDesc.BindFlags = desc.bindFlags;
+	texDesc.CPUAccessFlags = 0;
+	texDesc.MiscFlags = 0;
+
+	HRESULT hr = device->CreateTexture2D(&texDesc, 0, &target->texture);
+
+	if (SUCCEEDED(hr) && (desc.bindFlags & D3D11_BIND_SHADER_RESOURCE)) {
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		ZeroMemory(&viewDesc, sizeof(viewDesc));
+		viewDesc.Format = srvFormat;
+		viewDesc.ViewDimension = multisampled ? D3D11_SRV_DIMENSION_TEXTURE2DMS : D3D11_SRV_DIMENSION_TEXTURE2D;
+		viewDesc.Texture2D.MipLevels = 1;
+		viewDesc.Texture2D.MostDetailedMip = 0;
+		hr = device->CreateShaderResourceView(target->texture, &viewDesc, &target->SRV);
+	}
+	if (SUCCEEDED(hr) && (desc.bindFlags & D3D11_BIND_RENDER_TARGET)) {
+		D3D11_RENDER_TARGET_VIEW_DESC rtvDesc;
+		ZeroMemory(&rtvDesc, sizeof(rtvDesc));
+		rtvDesc.Format = desc.format;
+		rtvDesc.ViewDimension = multisampled ? D3D11_RTV_DIMENSION_TEXTURE2DMS : D3D11_RTV_DIMENSION_TEXTURE2D;
+		hr = device->CreateRenderTargetView(target->texture, &rtvDesc, &target->RTV);
+	}
+	if (SUCCEEDED(hr) && (desc.bindFlags & D3D11_BIND_DEPTH_STENCIL)) {
+		D3D11_DEPTH_STENCIL_VIEW_DESC dsvDesc;
+		ZeroMemory(&dsvDesc, sizeof(dsvDesc));
+		dsvDesc.Format = dsvFormat;
+		dsvDesc.ViewDimension = multisampled ? D3D11_DSV_DIMENSION_TEXTURE2DMS : D3D11_DSV_DIMENSION_TEXTURE2D;
+		hr = device->CreateDepthStencilView(target->texture, &dsvDesc, &target->DSV);
+	}
+
+	// The caller deletes target
+	if (!SUCCEEDED(hr))
+		releaseResources(target);
+	return hr;
+}
+
+void RenderTargetPool::releaseResources(PooledRenderTarget *target)
+{
+	if (target->SRV)
+		target->SRV->Release();
+	if (target->RTV)
+		target->RTV->Release();
+	if (target->DSV)
+		target->DSV->Release();
+	if (target->texture)
+		target->texture->Release();
+	if (target->accounted)
+		currentBytes -= targetBytes(target->desc);
+	target->SRV = nullptr;
+	target->RTV = nullptr;
+	target->DSV = nullptr;
+	target->texture = nullptr;
+	target->accounted = false;
+}
+
+void RenderTargetPool::destroyTarget(PooledRenderTarget *target)
+{
+	releaseResources(target);
+	delete target;
+}
+
+UINT64 RenderTargetPool::targetBytes(const RenderTargetDesc &desc)
+{
+	UINT bytesPerPixel;
+	switch (desc.format) {
+	case DXGI_FORMAT_R8_UNORM:
+		bytesPerPixel = 1;
+		break;
+	case DXGI_FORMAT_R16_FLOAT:
+	case DXGI_FORMAT_R16_UNORM:
+		bytesPerPixel = 2;
+		break;
+	case DXGI_FORMAT_R16G16B16A16_FLOAT:
+	case DXGI_FORMAT_R32G32_FLOAT:
+		bytesPerPixel = 8;
+		break;
+	case DXGI_FORMAT_R32G32B32A32_FLOAT:
+		bytesPerPixel = 16;
+		break;
+	default:
+		// 32 bit colour and depth formats
+		bytesPerPixel = 4;
+		break;
+	}
+	return (UINT64)desc.width * desc.height * bytesPerPixel * max(desc.sampleCount, 1u);
+}
+
+void RenderTargetPool::reportMemoryData() const
+{
+	int numInUse = 0;
+	for (size_t i = 0; i < targets.size(); i++)
+		if (targets[i]->inUse)
+			numInUse++;
+
+	cout << "Render target pool: " << targets.size() << " targets (" << numInUse << " in use)" << endl;
+	cout << "Current VRAM = " << currentBytes / 1024 << "KB, Peak VRAM = " << peakBytes / 1024 << "KB" << endl;
+	cout << "Created = " << numCreated << ", Evicted = " << numEvicted << endl;
+}
+
+RenderTargetPool::~RenderTargetPool()
+{
+	for (size_t i = 0; i < targets.size(); i++)
+		destroyTarget(targets[i]);
+	targets.clear();
+}
@@ -0,0 +1,78 @@
+//
+// RenderTargetPool.h
+//
+
+// Pool of transient render targets (and depth buffers).  Targets are keyed by size, format, sample count and bind flags, handed out with
+// acquire() for the duration of a pass and returned with release().  Released targets are recycled by later acquires of the same key and
+// destroyed once they have gone unused for evictAfterFrames frames, so resizing or dropping an effect does not leave its targets behind.
+#pragma once
+
+#include <d3d11_2.h>
+#include <vector>
+
+struct RenderTargetDesc {
+	UINT									width = 0;
+	UINT									height = 0;
+	// Typeless depth formats (R24G8_TYPELESS, R32_TYPELESS) get matching depth and shader resource view formats
+	DXGI_FORMAT								format = DXGI_FORMAT_R8G8B8A8_UNORM;
+	UINT									sampleCount = 1;
+	UINT									bindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+
+	bool operator==(const RenderTargetDesc &d) const { return width == d.width && height == d.height && format == d.format && sampleCount == d.sampleCount && bindFlags == d.bindFlags; }
+	bool operator!=(const RenderTargetDesc &d) const { return !(*this == d); }
+};
+
+struct PooledRenderTarget {
+	RenderTargetDesc						desc;
+	ID3D11Texture2D							*texture = nullptr;
+	// Views are only created for the matching bind flags
+	ID3D11ShaderResourceView				*SRV = nullptr;
+	ID3D11RenderTargetView					*RTV = nullptr;
+	ID3D11DepthStencilView					*DSV = nullptr;
+	UINT64									lastUsedFrame = 0;
+	bool									inUse = false;
+	// Set once the target's bytes are counted in the pool's currentBytes
+	bool									accounted = false;
+};
+
+class RenderTargetPool {
+
+	ID3D11Device							*device = nullptr;
+	std::vector<PooledRenderTarget*>		targets;
+	UINT64									frameIndex = 0;
+	UINT									evictAfterFrames = 3;
+
+	// VRAM accounting (estimated from the descriptions)
+	UINT64									currentBytes = 0;
+	UINT64									peakBytes = 0;
+	UINT									numCreated = 0;
+	UINT									numEvicted = 0;
+
+	HRESULT createTarget(PooledRenderTarget *target);
+	// Release the texture and views of target (and its bytes if they were counted) without deleting target
+	void releaseResources(PooledRenderTarget *target);
+	void destroyTarget(PooledRenderTarget *target);
+
+public:
+
+	RenderTargetPool(ID3D11Device *_device, UINT _evictAfterFrames = 3);
+	~RenderTargetPool();
+
+	// Advance the frame counter and destroy targets that have not been used for evictAfterFrames frames.  Call once per frame
+	void beginFrame();
+
+	// Return a free target matching desc, creating one if necessary.  Returns nullptr if the target cannot be created
+	PooledRenderTarget *acquire(const RenderTargetDesc &desc);
+	// Return a target to the pool.  The caller must not use it afterwards
+	void release(PooledRenderTarget *target);
+
+	// Destroy all targets not currently acquired
+	void releaseUnused();
+
+	UINT64 getCurrentBytes() const { return currentBytes; };
+	UINT64 getPeakBytes() const { return peakBytes; };
+	int getNumTargets() const { return (int)targets.size(); };
+	void reportMemoryData() const;
+
+	static UINT64 targetBytes(const RenderTargetDesc &desc);
+};
@@ -15,16 +15,22 @@
 #include <Scene.h>
 
 #include <Effect.h>
+#include <ShaderPermutations.h>
+#include <CBufferLayout.h>
 #include <VertexStructures.h>
 #include <Texture.h>
 
 #include <stdlib.h>
 #include <ctime>
+#include <algorithm>
 
 using namespace std;
 using namespace DirectX;
 using namespace DirectX::PackedVector;
 
+const float Scene::treeImpostorDistance = 150.0f;
+const float Scene::treeImpostorFade = 25.0f;
+
 //
 // Methods to handle initialisation, update and rendering of the scene
 HRESULT Scene::rebuildViewport(){
@@ -60,172 +66,252 @@ HRESULT Scene::initialiseSceneResources() {
 	// Set up viewport for the main window (wndHandle) 
 	rebuildViewport();
 
+	// Map the shader pack so effects share one copy of each shader.  The permutation variants and the pack are built offline by
+	// the -buildshaders post-build step, so nothing is compiled here
+	shaderPack = ShaderPack::open("Shaders\\shaders.pack");
+	ShaderPack::setDefault(shaderPack);
+
+#if defined(_DEBUG)
+	// Check the cbuffer structs in CBufferStructures.h against the compiled shaders and write packed layouts of the members they read
+	CBufferLayout::check("Shaders\\cso\\", "Shaders\\packed_cbuffers.txt");
+#endif
+
+	// Jobs run on one thread per core with this thread as worker 0
+	jobSystem = new JobSystem();
+	JobSystem::setDefault(jobSystem);
+
+	// Pipeline states and input layouts are shared through the state cache - effects and models with equal descriptions use one object
+	stateCache = new StateCache(device);
+	StateCache::setDefault(stateCache);
+
+	// Model, camera and scene cbuffers are only uploaded when they change
+	cBufferManager = new CBufferManager(device);
+	CBufferManager::setDefault(cBufferManager);
+
+	// Dynamic vertex and index data is written to a ring buffer that is recycled as the GPU finishes each frame
+	uploadHeap = new UploadHeap(device);
+	UploadHeap::setDefault(uploadHeap);
+
+	// The scene pass is recorded as jobs on the job system's workers.  Each worker's deferred context tracks its own cbuffer bindings
+	commandRecorder = new CommandRecorder(device, jobSystem);
+	for (UINT i = 0; i < commandRecorder->getNumThreads(); i++)
+		cBufferManager->addContext(commandRecorder->getDeferredContext(i));
+
 	// Setup main effects (pipeline shaders, states etc)
 
 	// The Effect class is a helper class similar to the depricated DX9 Effect. It stores pipeline shaders, pipeline states  etc and binds them to setup the pipeline to render with a particular Effect. The constructor requires that at least shaders are provided along a description of the vertex structure.
 	Effect *basicColourEffect = new Effect(device, "Shaders\\cso\\basic_colour_vs.cso", "Shaders\\cso\\basic_colour_ps.cso", basicVertexDesc, ARRAYSIZE(basicVertexDesc));
-	Effect *basicTextureEffect = new Effect(device, "Shaders\\cso\\basic_texture_vs.cso", "Shaders\\cso\\basic_texture_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));
+	// Lit models use variants of lit_vs / lit_ps selected by feature mask.  The scene light is a point light
+	// The textured models and trees are imported with compressed vertices (VERTEX_FORMAT_COMPRESSED) so their effects use the
+	// compressedVertexDesc layout and the lit_vs variant that decodes it
+	UINT texturedFeatures = SHADER_FEATURE_TEXTURE | SHADER_FEATURE_POSITIONAL_LIGHT | SHADER_FEATURE_COMPRESSED_VERTEX;
+	Effect *basicTextureEffect = new Effect(device, ShaderPermutations::variantName("lit_vs", texturedFeatures).c_str(), ShaderPermutations::variantName("lit_ps", texturedFeatures).c_str(), compressedVertexDesc, ARRAYSIZE(compressedVertexDesc));
+	// The castle is closed, so its back faces are culled - by the rasteriser and, a cluster at a time, on the CPU (Model::cullClusters)
+	Effect *castleEffect = EffectBuilder(device).vertexShader(ShaderPermutations::variantName("lit_vs", texturedFeatures).c_str(), compressedVertexDesc, ARRAYSIZE(compressedVertexDesc)).pixelShader(ShaderPermutations::variantName("lit_ps", texturedFeatures).c_str())
+		.cullMode(D3D11_CULL_BACK).build();
 	Effect *basicLightingEffect = new Effect(device, "Shaders\\cso\\basic_lighting_vs.cso", "Shaders\\cso\\basic_colour_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));	
-	Effect *perPixelLightingEffect = new Effect(device, "Shaders\\cso\\per_pixel_lighting_vs.cso", "Shaders\\cso\\per_pixel_lighting_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));
+	UINT perPixelFeatures = SHADER_FEATURE_POSITIONAL_LIGHT | SHADER_FEATURE_SPECULAR;
+	Effect *perPixelLightingEffect = new Effect(device, ShaderPermutations::variantName("lit_vs", perPixelFeatures).c_str(), ShaderPermutations::variantName("lit_ps", perPixelFeatures).c_str(), extVertexDesc, ARRAYSIZE(extVertexDesc));
 	Effect *fullReflectionEffect = new Effect(device, "Shaders\\cso\\reflection_map_vs.cso", "Shaders\\cso\\reflection_map_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));
 	Effect *skyBoxEffect = new Effect(device, "Shaders\\cso\\sky_box_vs.cso", "Shaders\\cso\\sky_box_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));
-	Effect *waterEffect = new Effect(device, "Shaders\\cso\\ocean_vs.cso", "Shaders\\cso\\ocean_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));
 	Effect *grassEffect = new Effect(device, "Shaders\\cso\\grass_vs.cso", "Shaders\\cso\\grass_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));
-	Effect *treeEffect = new Effect(device, "Shaders\\cso\\tree_vs.cso", "Shaders\\cso\\tree_ps.cso", extVertexDesc, ARRAYSIZE(extVertexDesc));
-	Effect *fountainEffect = new Effect(device, "Shaders\\cso\\fountain_vs.cso", "Shaders\\cso\\fountain_ps.cso", particleVertexDesc, ARRAYSIZE(particleVertexDesc));
-	Effect *flareEffect = new Effect(device, "Shaders\\cso\\flare_vs.cso", "Shaders\\cso\\flare_ps.cso", flareVertexDesc, ARRAYSIZE(flareVertexDesc));
-
-	ID3D11BlendState *grassBlendingState = grassEffect->getBlendState();
-	D3D11_BLEND_DESC grassBlendDesc;
-	grassBlendingState->GetDesc(&grassBlendDesc);
-
-	grassBlendDesc.AlphaToCoverageEnable = TRUE;
-	grassBlendDesc.IndependentBlendEnable = FALSE;
-	grassBlendDesc.RenderTarget[0].BlendEnable = TRUE;
-	grassBlendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
-	grassBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
-	grassBlendingState->Release(); device->CreateBlendState(&grassBlendDesc, &grassBlendingState);
-
-	//grassEffect->setBlendState(grassBlendingState);
-	treeEffect->setBlendState(grassBlendingState);
-	waterEffect->setBlendState(grassBlendingState);
-
-	//setup and create alpha blending
-	ID3D11BlendState *fountainBlendingState = grassEffect->getBlendState();
-	D3D11_BLEND_DESC fountainBlendDesc;
-	fountainBlendingState->GetDesc(&fountainBlendDesc);
-	fountainBlendDesc.RenderTarget[0].BlendEnable = TRUE;
-	fountainBlendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_SRC_ALPHA;
-	fountainBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_INV_SRC_ALPHA;
-	fountainBlendingState->Release(); device->CreateBlendState(&fountainBlendDesc, &fountainBlendingState);
-
-	// Disable Depth Writing 
-	ID3D11DepthStencilState *depthState = fountainEffect->getDepthStencilState();
-	D3D11_DEPTH_STENCIL_DESC dssDesc;
-	depthState->GetDesc(&dssDesc);
-	dssDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ZERO;
-	device->CreateDepthStencilState(&dssDesc, &depthState); 
-
-	//Set blend and Depth states for the fountain
-	fountainEffect->setBlendState(fountainBlendingState);
-	fountainEffect->setDepthStencilState(depthState);
-
-	//Enable Alpha Blending for Flare
-	ID3D11BlendState *flareBlendState = flareEffect->getBlendState();
-	D3D11_BLEND_DESC flareBlendDesc;
-	flareBlendState->GetDesc(&flareBlendDesc);
-	flareBlendDesc.AlphaToCoverageEnable = FALSE;
-	flareBlendDesc.RenderTarget[0].BlendEnable = TRUE;
-	flareBlendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
-	flareBlendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ONE;
-
-	// Create custom flare blend state object
-	flareBlendState->Release(); device->CreateBlendState(&flareBlendDesc, &flareBlendState);
-	flareEffect->setBlendState(flareBlendState);
-
 
+	// Effects with non-default states are composed with EffectBuilder so their states come from the state cache.  Tree and water use
+	// alpha to coverage with alpha blending and share one blend state
+	Effect *waterEffect = EffectBuilder(device).vertexShader("Shaders\\cso\\ocean_vs.cso", extVertexDesc, ARRAYSIZE(extVertexDesc)).pixelShader("Shaders\\cso\\ocean_ps.cso")
+		.alphaToCoverage(TRUE).alphaBlending(D3D11_BLEND_SRC_ALPHA, D3D11_BLEND_INV_SRC_ALPHA).build();
+	UINT treeFeatures = SHADER_FEATURE_TEXTURE | SHADER_FEATURE_POSITIONAL_LIGHT | SHADER_FEATURE_SPECULAR | SHADER_FEATURE_WIND | SHADER_FEATURE_COMPRESSED_VERTEX;
+	Effect *treeEffect = EffectBuilder(device).vertexShader(ShaderPermutations::variantName("lit_vs", treeFeatures).c_str(), compressedVertexDesc, ARRAYSIZE(compressedVertexDesc)).pixelShader(ShaderPermutations::variantName("lit_ps", treeFeatures).c_str())
+		.alphaToCoverage(TRUE).alphaBlending(D3D11_BLEND_SRC_ALPHA, D3D11_BLEND_INV_SRC_ALPHA).build();
+
+	// Fountain - alpha blending with depth writes disabled
+	Effect *fountainEffect = EffectBuilder(device).vertexShader("Shaders\\cso\\fountain_vs.cso", particleVertexDesc, ARRAYSIZE(particleVertexDesc)).pixelShader("Shaders\\cso\\fountain_ps.cso")
+		.alphaBlending(D3D11_BLEND_SRC_ALPHA, D3D11_BLEND_INV_SRC_ALPHA).depthWrite(FALSE).build();
+
+	// Flare - additive blending
+	Effect *flareEffect = EffectBuilder(device).vertexShader("Shaders\\cso\\flare_vs.cso", flareInstanceDesc, ARRAYSIZE(flareInstanceDesc)).pixelShader("Shaders\\cso\\flare_ps.cso")
+		.alphaBlending(D3D11_BLEND_ONE, D3D11_BLEND_ONE).build();
+
+	// Tree impostors - alpha to coverage as the trees so the two cross fade
+	Effect *impostorEffect = EffectBuilder(device).vertexShader("Shaders\\cso\\impostor_vs.cso", impostorInstanceDesc, ARRAYSIZE(impostorInstanceDesc)).pixelShader("Shaders\\cso\\impostor_ps.cso")
+		.alphaToCoverage(TRUE).alphaBlending(D3D11_BLEND_SRC_ALPHA, D3D11_BLEND_INV_SRC_ALPHA).build();
+
+#if defined(_DEBUG)
+	// Watch the HLSL behind every effect so shader edits show up without rebuilding the .cso files or restarting.  Release builds do
+	// not start the watcher thread
+	shaderReloader = new ShaderReloader(device);
+	Effect *watchedEffects[] = { basicColourEffect, basicTextureEffect, basicLightingEffect, perPixelLightingEffect, fullReflectionEffect, skyBoxEffect,
+		waterEffect, grassEffect, treeEffect, fountainEffect, flareEffect, impostorEffect, castleEffect };
+	for (int i = 0; i < ARRAYSIZE(watchedEffects); i++)
+		shaderReloader->watchEffect(watchedEffects[i]);
+	shaderReloader->start();
+#endif
+
+
+	// Textures and models are loaded in the background and created a few per frame in renderScene.  The scene draws from the first
+	// frame with placeholder textures, and each model appears when its mesh has been loaded
+	assetLoader = new AssetLoader(device, jobSystem);
 
 	// Setup Textures
 	// The Texture class is a helper class to load textures
-	Texture* cubeDayTexture = new Texture(device, L"Resources\\Textures\\grassenvmap1024.dds");
-	Texture* waterTexture = new Texture(device, L"Resources\\Textures\\Waves.dds");
-	Texture* treeTexture = new Texture(device, L"Resources\\Textures\\tree.tif");
-	Texture* grassAlpha = new Texture(device, L"Resources\\Textures\\grassAlpha.tif");
-	Texture* grassTexture = new Texture(device, L"Resources\\Textures\\grass.png");
-	Texture* terrainHeight = new Texture(device, L"Resources\\Textures\\heightmap2.bmp");
-	Texture* terrainNormal = new Texture(device, L"Resources\\Textures\\normalmap.bmp");
-	Texture* castleTexture = new Texture(device, L"Resources\\Textures\\castle.jpg");
-	Texture* guardTexture = new Texture(device, L"Resources\\Textures\\knight_diff.jpg");
-	Texture* stoneTexture = new Texture(device, L"Resources\\Textures\\stone.jpg");
-	Texture* fountainWaterTexture = new Texture(device, L"Resources\\Textures\\fountain_water.png");
-	Texture* flare1Texture = new Texture(device, L"Resources\\Textures\\flares\\divine.png");
-	Texture* flare2Texture = new Texture(device, L"Resources\\Textures\\flares\\extendring.png");
-
-
-
-	// The BaseModel class supports multitexturing and the constructor takes a pointer to an array of shader resource views of textures. 
-	// Even if we only need 1 texture/shader resource view for an effect we still need to create an array.
-	ID3D11ShaderResourceView *skyBoxTextureArray[] = { cubeDayTexture->getShaderResourceView()};
-	ID3D11ShaderResourceView *waterTextureArray[] = { waterTexture->getShaderResourceView(), cubeDayTexture->getShaderResourceView() };
-	ID3D11ShaderResourceView *fountainWaterTextureArray[] = { fountainWaterTexture->getShaderResourceView(), cubeDayTexture->getShaderResourceView() };
-	ID3D11ShaderResourceView *grassTextureArray[] = { grassTexture->getShaderResourceView(), grassAlpha->getShaderResourceView() };
-	ID3D11ShaderResourceView *treeTextureArray[] = { treeTexture->getShaderResourceView() };
-	ID3D11ShaderResourceView *terrainTextureArray[] = { grassTexture->getShaderResourceView(), terrainHeight->getShaderResourceView(), terrainNormal->getShaderResourceView() };
-	ID3D11ShaderResourceView *castleTextureArray[] = { castleTexture->getShaderResourceView() };
-	ID3D11ShaderResourceView *guardTextureArray[] = { guardTexture->getShaderResourceView() };
-	ID3D11ShaderResourceView *stoneTextureArray[] = { stoneTexture->getShaderResourceView() };
-	ID3D11ShaderResourceView *flare1TextureArray[] = { flare1Texture->getShaderResourceView() };
-	ID3D11ShaderResourceView *flare2TextureArray[] = { flare2Texture->getShaderResourceView() };
-
+	Texture* cubeDayTexture = assetLoader->loadTexture(L"Resources\\Textures\\grassenvmap1024.dds", D3D11_SRV_DIMENSION_TEXTURECUBE);
+	Texture* waterTexture = assetLoader->loadTexture(L"Resources\\Textures\\Waves.dds");
+	Texture* treeTexture = assetLoader->loadTexture(L"Resources\\Textures\\tree.tif");
+	Texture* grassAlpha = assetLoader->loadTexture(L"Resources\\Textures\\grassAlpha.tif");
+	Texture* grassTexture = assetLoader->loadTexture(L"Resources\\Textures\\grass.png");
+	Texture* terrainHeight = assetLoader->loadTexture(L"Resources\\Textures\\heightmap2.bmp");
+	Texture* terrainNormal = assetLoader->loadTexture(L"Resources\\Textures\\normalmap.bmp");
+	Texture* castleTexture = assetLoader->loadTexture(L"Resources\\Textures\\castle.jpg");
+	Texture* guardTexture = assetLoader->loadTexture(L"Resources\\Textures\\knight_diff.jpg");
+	Texture* stoneTexture = assetLoader->loadTexture(L"Resources\\Textures\\stone.jpg");
+	Texture* fountainWaterTexture = assetLoader->loadTexture(L"Resources\\Textures\\fountain_water.png");
+	// Both flare textures are packed into one texture array so all flares can be drawn in a single call
+	vector<wstring> flareTextureFiles = { L"Resources\\Textures\\flares\\divine.png", L"Resources\\Textures\\flares\\extendring.png" };
+	Texture* flareTextures = assetLoader->loadTextureArray(flareTextureFiles);
+
+
+
+	// The BaseModel class supports multitexturing.  The asset loader sets each model's textures (placeholders until they are loaded)
+	Texture *skyBoxTextureArray[] = { cubeDayTexture };
+	Texture *waterTextureArray[] = { waterTexture, cubeDayTexture };
+	Texture *fountainWaterTextureArray[] = { fountainWaterTexture, cubeDayTexture };
+	Texture *grassTextureArray[] = { grassTexture, grassAlpha };
+	Texture *treeTextureArray[] = { treeTexture };
+	Texture *castleTextureArray[] = { castleTexture };
+	Texture *guardTextureArray[] = { guardTexture };
+	Texture *stoneTextureArray[] = { stoneTexture };
+	Texture *flareTextureArray[] = { flareTextures };
+
+	// Every model drawn by the scene pass is an entity, culled and drawn by the systems in updateScene, and the occluders they are culled
+	// against.  Entities with the same effect are drawn together in the order the effects were first added, so the sky and the lake are
+	// added first; the blended entities (ENTITY_TRANSPARENT) are drawn after all the others
+	entities = new SceneStore();
+	transforms = new TransformHierarchy();
+	occlusionCuller = new OcclusionCuller();
 
 	// Skybox
-	box = new Box(device, skyBoxEffect, NULL, 0, skyBoxTextureArray,1);
+	Box *box = new Box(device, skyBoxEffect);
+	assetLoader->bindTextures(box, skyBoxTextureArray, 1);
 	box->setWorldMatrix(box->getWorldMatrix()*XMMatrixScaling(10000, 10000, 10000));
 	box->update(context);
+	addEntity(box, skyBoxEffect, 0);
 
-	// Sphere
-	orb = new  Model(device, wstring(L"Resources\\Models\\sphere.3ds"), fullReflectionEffect, NULL, 0, skyBoxTextureArray, 1);
+	// Sphere - not a scene entity, it is drawn by the glow passes (blurUtility) after the scene
+	orb = new Model(device, fullReflectionEffect);
+	assetLoader->loadModel(orb, L"Resources\\Models\\sphere.3ds");
+	assetLoader->bindTextures(orb, skyBoxTextureArray, 1);
 	orb->setWorldMatrix(orb->getWorldMatrix()*XMMatrixScaling(5, 5, 5)*XMMatrixTranslation(0, 75, 0));
 	orb->update(context);
 
 	//Lake
-	water = new Grid(1000, 1000, device, waterEffect, NULL, 0, waterTextureArray, 2);
+	Grid *water = new Grid(1000, 1000, device, waterEffect);
+	assetLoader->bindTextures(water, waterTextureArray, 2);
 	water->setWorldMatrix(water->getWorldMatrix()*XMMatrixTranslation(-500, -10, -300));
 	water->update(context);
-
-	//Grass
-	grass = new Grid(10, 10, device, grassEffect, NULL, 0, grassTextureArray, 2);
-	grass->setWorldMatrix(grass->getWorldMatrix()*XMMatrixTranslation(-5, 0, -5));
-	grass->update(context); 
-
-	//Terrain
-	terrain = new Terrain(device, context, 1000, 1000, terrainHeight->getTexture(), terrainNormal->getTexture(), grassEffect, NULL, 0, grassTextureArray, 2);
-	terrain->setWorldMatrix(terrain->getWorldMatrix()*XMMatrixTranslation(-420, -0.5, -500)*XMMatrixScaling(2, 100, 2)*XMMatrixRotationY(XMConvertToRadians(45)));
-	terrain->update(context);
+	addEntity(water, waterEffect, 0);
+
+	//Terrain - built from the height and normal maps once they have been loaded
+	Texture *terrainMaps[] = { terrainHeight, terrainNormal };
+	assetLoader->whenReady(terrainMaps, 2, [=](ID3D11Device *device, ID3D11DeviceContext *context) {
+		if (!terrainHeight->isReady() || !terrainNormal->isReady())
+			return;
+		Terrain *terrain = new Terrain(device, context, 1000, 1000, terrainHeight->getTexture(), terrainNormal->getTexture(), grassEffect);
+		assetLoader->bindTextures(terrain, grassTextureArray, 2);
+		terrain->setWorldMatrix(terrain->getWorldMatrix()*XMMatrixTranslation(-420, -0.5, -500)*XMMatrixScaling(2, 100, 2)*XMMatrixRotationY(XMConvertToRadians(45)));
+		terrain->update(context);
+		terrain->buildOccluder(25);
+		addEntity(terrain, grassEffect, ENTITY_OCCLUDER);
+	});
 
 	//Castle
-	castle = new Model(device, wstring(L"Resources\\Models\\castle.3ds"), basicTextureEffect, NULL, 0, castleTextureArray, 1);
+	Model *castle = new Model(device, castleEffect);
+	castle->setVertexFormat(VERTEX_FORMAT_COMPRESSED);
+	castle->setClusterCulling(true);
+	castle->setOccluder(true);
+	assetLoader->loadModel(castle, L"Resources\\Models\\castle.3ds");
+	assetLoader->bindTextures(castle, castleTextureArray, 1);
 	castle->setWorldMatrix(castle->getWorldMatrix()*XMMatrixTranslation(0, 0.2, 0)*XMMatrixScaling(30, 30, 30)*XMMatrixRotationY(XMConvertToRadians(45)));
 	castle->update(context);
+	addEntity(castle, castleEffect, ENTITY_LOD | ENTITY_CLUSTERS | ENTITY_OCCLUDER);
 
 	//Guard
-	guard = new Model(device, wstring(L"Resources\\Models\\knight.3ds"), basicTextureEffect, NULL, 0, guardTextureArray, 1);
+	Model *guard = new Model(device, basicTextureEffect);
+	guard->setVertexFormat(VERTEX_FORMAT_COMPRESSED);
+	assetLoader->loadModel(guard, L"Resources\\Models\\knight.3ds");
+	assetLoader->bindTextures(guard, guardTextureArray, 1);
 	guard->setWorldMatrix(guard->getWorldMatrix()*XMMatrixTranslation(1200, 150, 0)*XMMatrixScaling(0.05, 0.05, 0.05));
 	guard->update(context);
+	guardNode = addEntity(guard, basicTextureEffect, ENTITY_LOD);
 
 	//Fountain
-	fountain = new Model(device, wstring(L"Resources\\Models\\fountainModel.obj"), basicTextureEffect, NULL, 0, stoneTextureArray, 1);
+	Model *fountain = new Model(device, basicTextureEffect);
+	fountain->setVertexFormat(VERTEX_FORMAT_COMPRESSED);
+	assetLoader->loadModel(fountain, L"Resources\\Models\\fountainModel.obj");
+	assetLoader->bindTextures(fountain, stoneTextureArray, 1);
 	fountain->setWorldMatrix(fountain->getWorldMatrix()*XMMatrixRotationY(90)*XMMatrixTranslation(8000, 150, 1)*XMMatrixScaling(0.01, 0.05, 0.01));
 	fountain->update(context);
-
-	//Fountain Water
-	fountain_water = new Grid(17, 17, device, waterEffect, NULL, 0, waterTextureArray, 2);
-	fountain_water->setWorldMatrix(fountain_water->getWorldMatrix()*XMMatrixTranslation(72, 10, -8));
-	fountain_water->update(context);
-
-	//Fountain Water Particles
-	fountain_water_part = new ParticleSystem(device, fountainEffect, NULL, 0, fountainWaterTextureArray, 2);
-	fountain_water_part->setWorldMatrix(fountain_water_part->getWorldMatrix()*XMMatrixScaling(15, 30, 15)*XMMatrixTranslation(80, 14, 1));
-	fountain_water_part->update(context);
+	addEntity(fountain, basicTextureEffect, ENTITY_LOD);
 
 	srand((unsigned)time(NULL));
 
 	// Tree
+	vector<Model*> trees;
 	for (int i = 0; i < 10; i++) {
 		float x = (rand() % 15) - 7;
 		float z = (rand() % 15) - 7;
-		Model *tree = new  Model(device, wstring(L"Resources\\Models\\tree.3ds"), treeEffect, NULL, 0, treeTextureArray, 1);
+		Model *tree = new Model(device, treeEffect);
+		tree->setVertexFormat(VERTEX_FORMAT_COMPRESSED);
+		assetLoader->loadModel(tree, L"Resources\\Models\\tree.3ds");
+		assetLoader->bindTextures(tree, treeTextureArray, 1);
 		tree->setWorldMatrix(tree->getWorldMatrix()*XMMatrixTranslation(0+x, 0.5, 15+z)*XMMatrixScaling(9, 9, 9)*XMMatrixRotationY(XMConvertToRadians(45)));
 		tree->update(context);
 		trees.push_back(tree);
+		addEntity(tree, treeEffect, ENTITY_LOD);
 	}
 
+	// Distant trees are impostors baked from the same mesh and texture, all drawn with one instanced draw
+	ImpostorBatch *treeImpostors = new ImpostorBatch((UINT)trees.size(), device, impostorEffect);
+	treeImpostors->setDistances(treeImpostorDistance, treeImpostorFade);
+	assetLoader->loadImpostors(treeImpostors, L"Resources\\Models\\tree.3ds", L"Resources\\Textures\\tree.tif");
+	for (size_t i = 0; i < trees.size(); i++) {
+		treeImpostors->addInstance(trees[i]->getWorldMatrix());
+		trees[i]->setDrawDistance(treeImpostorDistance + treeImpostorFade);
+	}
+	treeImpostorMesh = (uint32_t)models.size();
+	addEntity(treeImpostors, impostorEffect, 0);
+
+	//Fountain Water
+	Grid *fountain_water = new Grid(17, 17, device, waterEffect);
+	assetLoader->bindTextures(fountain_water, fountainWaterTextureArray, 2);
+	fountain_water->setWorldMatrix(fountain_water->getWorldMatrix()*XMMatrixTranslation(72, 10, -8));
+	fountain_water->update(context);
+	addEntity(fountain_water, waterEffect, ENTITY_TRANSPARENT);
+
+	//Fountain Water Particles
+	ParticleSystem *fountain_water_part = new ParticleSystem(device, fountainEffect);
+	assetLoader->bindTextures(fountain_water_part, fountainWaterTextureArray, 2);
+	fountain_water_part->setWorldMatrix(fountain_water_part->getWorldMatrix()*XMMatrixScaling(15, 30, 15)*XMMatrixTranslation(80, 14, 1));
+	fountain_water_part->update(context);
+	addEntity(fountain_water_part, fountainEffect, ENTITY_TRANSPARENT);
+
+#if defined(_DEBUG)
+	// The castle and trees are placed with uniform scale, so their normal matrices should come from the fast path in
+	// BaseModel::setWorldMatrix rather than a full inverse
+	if (!castle->hasUniformScale() || !trees[0]->hasUniformScale())
+		cout << "Scene: the castle or trees did not take the uniform scale normal matrix path" << endl;
+#endif
+
+	// The imported meshes listed by reportData
+	reportedMeshes.push_back(make_pair(string("castle"), castle));
+	reportedMeshes.push_back(make_pair(string("knight"), guard));
+	reportedMeshes.push_back(make_pair(string("tree"), trees[0]));
+	reportedMeshes.push_back(make_pair(string("fountain"), fountain));
+
 	//Flares
+	flareBatch = new FlareBatch(numFlares, device, flareEffect);
+	assetLoader->bindTextures(flareBatch, flareTextureArray, 1);
 	for (int i = 0; i < numFlares; i++)
-		if (randM1P1() > 0)
-			flares[i] = new Flare(XMFLOAT3(-125.0, 60.0, 70.0), XMCOLOR(randM1P1()*0.5 + 0.5, randM1P1()*0.5 + 0.5, randM1P1()*0.5 + 0.5, (float)i / numFlares), device, flareEffect, NULL, 0, flare1TextureArray, 1);
-		else
-			flares[i] = new Flare(XMFLOAT3(-125.0, 60.0, 70.0), XMCOLOR(randM1P1()*0.5 + 0.5, randM1P1()*0.5 + 0.5, randM1P1()*0.5 + 0.5, (float)i / numFlares), device, flareEffect, NULL, 0, flare2TextureArray, 1);
+		flareBatch->addFlare(XMFLOAT3(-125.0, 60.0, 70.0), XMCOLOR(randM1P1()*0.5 + 0.5, randM1P1()*0.5 + 0.5, randM1P1()*0.5 + 0.5, (float)i / numFlares), randM1P1() > 0 ? 0 : 1);
 
 	// Setup a camera
 	// The LookAtCamera is derived from the base Camera class. The constructor for the Camera class requires a valid pointer to the main DirectX device
@@ -234,6 +320,12 @@ HRESULT Scene::initialiseSceneResources() {
 	// The camera constructor and update methods also attaches the camera CBuffer to the pipeline at slot b1 for vertex and pixel shaders
 	mainCamera =  new LookAtCamera(device, XMVectorSet(0.0, 0.0, -10.0, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 1.0f), XMVectorZero());
 
+	renderTargetPool = new RenderTargetPool(device);
+	frameGraph = new FrameGraph(renderTargetPool);
+
+	// The orb glow - its pyramid levels are transients of the frame graph
+	blurUtility = new BlurUtility(device, (UINT)viewport.Width, (UINT)viewport.Height);
+
 
 	// Add a CBuffer to store light properties - you might consider creating a Light Class to manage this CBuffer
 	// Allocate 16 byte aligned block of memory for "main memory" copy of cBufferLight
@@ -245,28 +337,9 @@ HRESULT Scene::initialiseSceneResources() {
 	cBufferLightCPU->lightDiffuse = XMFLOAT4(0.7, 0.7, 0.7, 1.0);
 	cBufferLightCPU->lightSpecular = XMFLOAT4(1.0, 1.0, 1.0, 1.0);
 
-	// Create GPU resource memory copy of cBufferLight
-	// fill out description (Note if we want to update the CBuffer we need  D3D11_CPU_ACCESS_WRITE)
-	D3D11_BUFFER_DESC cbufferDesc;
-	D3D11_SUBRESOURCE_DATA cbufferInitData;
-	ZeroMemory(&cbufferDesc, sizeof(D3D11_BUFFER_DESC));
-	ZeroMemory(&cbufferInitData, sizeof(D3D11_SUBRESOURCE_DATA));
-
-	cbufferDesc.ByteWidth = sizeof(CBufferLight);
-	cbufferDesc.Usage = D3D11_USAGE_DYNAMIC;
-	cbufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
-	cbufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
-	cbufferInitData.pSysMem = cBufferLightCPU;// Initialise GPU CBuffer with data from CPU CBuffer
-
-	HRESULT hr = device->CreateBuffer(&cbufferDesc, &cbufferInitData, &cBufferLightGPU);
-
-	// We dont strictly need to call map here as the GPU CBuffer was initialised from the CPU CBuffer at creation.
-	// However if changes are made to the CPU CBuffer during update the we need to copy the data to the GPU CBuffer 
-	// using the mapCbuffer helper function provided the in Util.h   
-
-	mapCbuffer(context, cBufferLightCPU, cBufferLightGPU, sizeof(CBufferLight));
-	context->VSSetConstantBuffers(2, 1, &cBufferLightGPU);// Attach CBufferLightGPU to register b2 for the vertex shader. Not strictly needed as our vertex shader doesnt require access to this CBuffer
-	context->PSSetConstantBuffers(2, 1, &cBufferLightGPU);// Attach CBufferLightGPU to register b2 for the Pixel shader.
+	// Create GPU resource memory copy of cBufferLight (initialised from cBufferLightCPU).  The light does not move so the buffer is never
+	// mapped again unless cBufferLight is marked dirty.  The cbuffer manager binds it to register b2 at the start of each frame
+	cBufferLight = cBufferManager->add(cBufferLightCPU, sizeof(CBufferLight), 2, CBufferLayout::Static);
 
 	// Add a Cbuffer to stor world/scene properties
 	// Allocate 16 byte aligned block of memory for "main memory" copy of cBufferLight
@@ -276,47 +349,52 @@ HRESULT Scene::initialiseSceneResources() {
 	cBufferSceneCPU->windDir = XMFLOAT4(1, 0, 0, 1);
 	cBufferSceneCPU->Time = 0.0;
 	cBufferSceneCPU->grassHeight = 0.0;
+	// Used by shader variants with SHADER_FEATURE_FOG
+	cBufferSceneCPU->fogStart = 1000.0f;
+	cBufferSceneCPU->fogEnd = 8000.0f;
+	cBufferSceneCPU->fogColour = XMFLOAT4(0.7f, 0.75f, 0.8f, 1.0f);
 	
-	cbufferInitData.pSysMem = cBufferSceneCPU;// Initialise GPU CBuffer with data from CPU CBuffer
-	cbufferDesc.ByteWidth = sizeof(CBufferScene);
-
-	hr = device->CreateBuffer(&cbufferDesc, &cbufferInitData, &cBufferSceneGPU);
-
-	mapCbuffer(context, cBufferSceneCPU, cBufferSceneGPU, sizeof(CBufferScene));
-	context->VSSetConstantBuffers(3, 1, &cBufferSceneGPU);// Attach CBufferSceneGPU to register b3 for the vertex shader. Not strictly needed as our vertex shader doesnt require access to this CBuffer
-	context->PSSetConstantBuffers(3, 1, &cBufferSceneGPU);// Attach CBufferSceneGPU to register b3 for the Pixel shader
+	// Register b3, uploaded at the start of a frame when the time (or any other scene parameter) has changed
+	cBufferScene = cBufferManager->add(cBufferSceneCPU, sizeof(CBufferScene), 3, CBufferLayout::PerFrame);
 
 	return S_OK;
 }
 
-void Scene::DrawFlare(ID3D11DeviceContext *context)
+void Scene::DrawFlare(ID3D11DeviceContext *context, ID3D11ShaderResourceView *depthSRV)
 {
 	// Draw the Fire (Draw all transparent objects last)
-	if (flares) {
+	if (flareBatch) {
 
-		ID3D11RenderTargetView * tempRT[1] = { 0 };
-		ID3D11DepthStencilView *tempDS = nullptr;
-
-		// Set NULL depth buffer so we can also use the Depth Buffer as a shader resource
-		// This is OK as we dont need depth testing for the flares
-
-		ID3D11DepthStencilView * nullDSV[1]; nullDSV[0] = NULL;
-		context->OMGetRenderTargets(1, tempRT, &tempDS);
-		context->OMSetRenderTargets(1, tempRT, NULL);
-		ID3D11ShaderResourceView *depthSRV = system->getDepthStencilSRV();
+		// The frame graph binds the back buffer without a depth buffer for this pass so the depth buffer can be read in the vertex shader
 		context->VSSetShaderResources(1, 1, &depthSRV);
 
-		for (int i = 0; i < numFlares; i++)
-			flares[i]->render(context);
-
-		ID3D11ShaderResourceView * nullSRV[1]; nullSRV[0] = NULL; // Used to release depth shader resource so it is available for writing
-		context->VSSetShaderResources(1, 1, nullSRV);
-		// Return default (read and write) depth buffer view.
-		context->OMSetRenderTargets(1, tempRT, tempDS);
-
+		// All flares are drawn with a single instanced draw call
+		flareBatch->render(context);
 	}
 }
 
+TransformNode Scene::addEntity(BaseModel *model, Effect *effect, uint32_t entityFlags)
+{
+	uint32_t material = (uint32_t)(find(modelEffects.begin(), modelEffects.end(), effect) - modelEffects.begin());
+	if (material == modelEffects.size())
+		modelEffects.push_back(effect);
+	models.push_back(model);
+	XMFLOAT4X4 world;
+	XMStoreFloat4x4(&world, model->getWorldMatrix());
+	nodeEntities.push_back(entities->create((uint32_t)(models.size() - 1), material, entityFlags, &world.m[0][0]));
+
+	// The model's world matrix split into its scale, rotation and translation
+	XMVECTOR scale, rotation, translation;
+	XMMatrixDecompose(&scale, &rotation, &translation, model->getWorldMatrix());
+	TransformTRS local;
+	XMStoreFloat3((XMFLOAT3*)local.translation, translation);
+	XMStoreFloat4((XMFLOAT4*)local.rotation, rotation);
+	XMStoreFloat3((XMFLOAT3*)local.scale, scale);
+	TransformNode node = transforms->create();
+	transforms->setLocal(node, local);
+	return node;
+}
+
 // Update scene state (perform animations etc)
 HRESULT Scene::updateScene(ID3D11DeviceContext *context,Camera *camera) {
 
@@ -325,52 +403,16 @@ HRESULT Scene::updateScene(ID3D11DeviceContext *context,Camera *camera) {
 	double dT = mainClock->gameTimeDelta();
 	double gT = mainClock->gameTimeElapsed();
 
-	// If the CPU CBuffer contents are changed then the changes need to be copied to GPU CBuffer with the mapCbuffer helper function
+	// If the CPU CBuffer contents are changed then the cbuffer must be marked dirty so the cbuffer manager copies it to the GPU CBuffer
 	mainCamera->update(context);
 
 	// Update the scene time as it is needed to animate the water
-	cBufferSceneCPU->Time = gT;
-	mapCbuffer(context, cBufferSceneCPU, cBufferSceneGPU, sizeof(CBufferScene));
-	
-	return S_OK;
-}
-
-// Render scene
-HRESULT Scene::renderScene() {
-
-	ID3D11DeviceContext *context = system->getDeviceContext();
-	
-	// Validate window and D3D context
-	if (isMinimised() || !context)
-		return E_FAIL;
-	
-	// Clear the screen
-	static const FLOAT clearColor[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
-	context->ClearRenderTargetView(system->getBackBufferRTV(), clearColor);
-	context->ClearDepthStencilView(system->getDepthStencil(), D3D11_CLEAR_DEPTH | D3D11_CLEAR_STENCIL, 1.0f, 0);
-
-	// Render Scene objects
-	
-	if (box)
-		box->render(context);
-	if (orb) 
-		orb->render(context);	
-	if (water)
-		water->render(context);
-	//if (grass)
-		//grass->render(context);
-	if (terrain)
-		terrain->render(context);
-	if (castle)
-		castle->render(context);
-	if (guard)
-		guard->render(context);
-
-	for (int i = 0; i < 10; i++) {
-		if (trees[i])
-			trees[i]->render(context);
-	} 
+	if (cBufferSceneCPU->Time != (FLOAT)gT) {
+		cBufferSceneCPU->Time = (FLOAT)gT;
+		cBufferManager->markDirty(cBufferScene);
+	}
 
+	// Move the guard.  This is done before rendering as the scene is recorded on several threads which only read the models
 	float guardVelX = 0.00f;
 	float guardVelZ = 0.03f;
 	float rotation = 0;
@@ -392,22 +434,221 @@ HRESULT Scene::renderScene() {
 			gX = true;
 			rotation = XMConvertToRadians(180);
 		}
-			
+		
 	}	
-	guard->setWorldMatrix(XMMatrixRotationY(rotation)*guard->getWorldMatrix()*XMMatrixTranslation(guardX, 0, guardZ));
-	guard->update(context);
+	// The guard's heading and position are set rather than multiplied into its world matrix, so they do not drift
+	guardYaw = XMScalarModAngle(guardYaw + rotation);
+	TransformTRS guardLocal = transforms->getLocal(guardNode);
+	XMStoreFloat4((XMFLOAT4*)guardLocal.rotation, XMQuaternionRotationRollPitchYaw(0, guardYaw, 0));
+	guardLocal.translation[0] += guardX;
+	guardLocal.translation[2] += guardZ;
+	transforms->setLocal(guardNode, guardLocal);
+
+	// The systems below run over the entities (and transform nodes) in ranges of this many on the job system
+	static const size_t entitiesPerJob = 256;
+
+	// World matrices of the moved transforms, a level at a time, passed to their entities
+	transforms->sortByDepth();
+	for (size_t level = 0; level < transforms->getNumLevels(); level++) {
+		size_t levelFirst, levelLast;
+		transforms->getLevel(level, &levelFirst, &levelLast);
+		jobSystem->parallelFor(levelFirst, levelLast, entitiesPerJob, [&](size_t first, size_t last) {
+			transforms->updateNodes(first, last);
+		});
+	}
+	changedNodes.clear();
+	transforms->gatherChanged(&changedNodes);
+	for (size_t i = 0; i < changedNodes.size(); i++)
+		entities->setWorldMatrix(nodeEntities[changedNodes[i]], transforms->getWorldMatrix(changedNodes[i]));
+
+	size_t numEntities = entities->getNumEntities();
+	const uint32_t *entityMeshes = entities->getMeshes();
+	uint32_t *entityFlags = entities->getFlags();
+
+	// Pick up the bounds of the models that have finished loading
+	for (size_t i = 0; i < numEntities; i++) {
+		BaseModel *model = models[entityMeshes[i]];
+		if (!(entityFlags[i] & ENTITY_BOUNDED) && model->hasBounds()) {
+			const BoundingBox &box = model->getBox();
+			XMFLOAT3 boxMin(box.Center.x - box.Extents.x, box.Center.y - box.Extents.y, box.Center.z - box.Extents.z);
+			XMFLOAT3 boxMax(box.Center.x + box.Extents.x, box.Center.y + box.Extents.y, box.Center.z + box.Extents.z);
+			entities->setBounds(entities->getEntity(i), &boxMin.x, &boxMax.x);
+		}
+	}
+
+	// Copy the world matrices of the entities that have moved to their models, refit their world boxes and then the hierarchy
+	entityList.clear();
+	entities->gather(ENTITY_MOVED, &entityList);
+	for (size_t i = 0; i < entityList.size(); i++)
+		models[entityMeshes[entityList[i]]]->setWorldMatrix(XMLoadFloat4x4((const XMFLOAT4X4*)entities->getWorldMatrices()[entityList[i]].m));
+	jobSystem->parallelFor(0, numEntities, entitiesPerJob, [&](size_t first, size_t last) {
+		entities->updateBounds(first, last);
+	});
+	entities->refitHierarchy();
+
+	// Frustum cull.  The hierarchy finds the entities whose boxes reach into the frustum without visiting the rest
+	XMMATRIX viewProj = XMMatrixMultiply(camera->getViewMatrix(), camera->getProjMatrix());
+	XMFLOAT4X4 worldViewProj;
+	XMStoreFloat4x4(&worldViewProj, viewProj);
+	XMFLOAT3 eye;
+	XMStoreFloat3(&eye, camera->getPos());
+	ClusterCullView frustumView;
+	setClusterCullView(&worldViewProj.m[0][0], &eye.x, false, &frustumView);
+	jobSystem->parallelFor(0, numEntities, entitiesPerJob, [&](size_t first, size_t last) {
+		entities->beginCull(first, last);
+	});
+	entities->cullFrustum(frustumView.planes);
+
+	// Occlusion cull.  The occluders are rasterised into a small depth buffer on the CPU, a tile per job, and the entities still visible
+	// are tested against it
+	occlusionCuller->beginFrame(&worldViewProj.m[0][0]);
+	entityList.clear();
+	entities->gather(ENTITY_OCCLUDER, &entityList);
+	for (size_t i = 0; i < entityList.size(); i++) {
+		OccluderMesh occluder;
+		if (models[entityMeshes[entityList[i]]]->getOccluder(&occluder))
+			occlusionCuller->addOccluder(occluder, entities->getWorldMatrices()[entityList[i]].m);
+	}
+	occlusionCuller->rasterise(jobSystem);
+	jobSystem->parallelFor(0, numEntities, entitiesPerJob, [&](size_t first, size_t last) {
+		entities->cullOccluded(*occlusionCuller, &worldViewProj.m[0][0], first, last);
+	});
+
+	// Level of detail from the projected size of each visible model.  Models past their draw distance (trees replaced by impostors)
+	// are not drawn
+	XMVECTOR eyePos = camera->getPos();
+	float projScale = XMVectorGetY(camera->getProjMatrix().r[1]);
+	entityList.clear();
+	entities->gather(ENTITY_LOD | ENTITY_VISIBLE, &entityList);
+	jobSystem->parallelFor(0, entityList.size(), 4, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++) {
+			Model *model = (Model*)models[entityMeshes[entityList[i]]];
+			model->selectLod(eyePos, projScale);
+			if (!model->isInDrawDistance())
+				entityFlags[entityList[i]] &= ~ENTITY_VISIBLE;
+		}
+	});
+	jobSystem->parallelFor(0, numEntities, entitiesPerJob, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++)
+			models[entityMeshes[i]]->setVisible((entityFlags[i] & ENTITY_VISIBLE) != 0);
+	});
+
+	// Clusters of the large meshes outside the frustum or facing away from the eye
+	entityList.clear();
+	entities->gather(ENTITY_CLUSTERS | ENTITY_VISIBLE, &entityList);
+	jobSystem->parallelFor(0, entityList.size(), 1, [&](size_t first, size_t last) {
+		for (size_t i = first; i < last; i++)
+			((Model*)models[entityMeshes[entityList[i]]])->cullClusters(viewProj, eyePos);
+	});
+
+	// The visible entities in the order renderScene draws them - by material, with the blended entities last
+	visibleEntities.clear();
+	entities->gather(ENTITY_VISIBLE, &visibleEntities);
+	entities->sortByMaterial(&visibleEntities);
+	stable_partition(visibleEntities.begin(), visibleEntities.end(), [entityFlags](uint32_t i) { return (entityFlags[i] & ENTITY_TRANSPARENT) == 0; });
+
+	// The scene pass is recorded on other threads and only reads the models, so the impostor instances are uploaded here
+	if (treeImpostorMesh < models.size())
+		static_cast<ImpostorBatch*>(models[treeImpostorMesh])->uploadInstances(context);
+	
+	return S_OK;
+}
+
+// Render scene
+HRESULT Scene::renderScene() {
 
-	if (fountain)
-		fountain->render(context);
-	if (fountain_water)
-		fountain_water->render(context);
-	if (fountain_water_part)
-		fountain_water_part->render(context);
+	ID3D11DeviceContext *context = system->getDeviceContext();
+	
+	// Validate window and D3D context
+	if (isMinimised() || !context)
+		return E_FAIL;
+
+	// Swap in any shaders recompiled since the last frame
+	if (shaderReloader)
+		shaderReloader->applyReloads();
+
+	// Create the resources of assets loaded since the last frame, within the loader's frame budget
+	assetLoader->update(context);
 
-	DrawFlare(context);
+	// Evict render targets that have not been used for a few frames (eg. after a resize)
+	renderTargetPool->beginFrame();
+
+	// Upload the per-frame cbuffers that changed in updateScene and bind them once for the whole frame
+	cBufferManager->beginFrame(context);
+
+	// Declare this frame's passes.  The graph binds each pass's targets and viewport and performs the clears
+	frameGraph->reset();
+	UINT width = (UINT)viewport.Width;
+	UINT height = (UINT)viewport.Height;
+	FGResource backBuffer = frameGraph->importTexture("BackBuffer", width, height, system->getBackBufferRTV());
+	FGResource depth = frameGraph->importTexture("Depth", width, height, nullptr, system->getDepthStencil(), system->getDepthStencilSRV());
+
+	// Clear the screen
+	static const FLOAT clearColor[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+	frameGraph->addPass("Scene",
+		[&](FrameGraph::PassBuilder &builder) {
+			builder.writeColour(backBuffer, clearColor);
+			builder.writeDepth(depth, true);
+		},
+		[this, backBuffer, depth](ID3D11DeviceContext *context, const FrameGraph &graph) {
+
+		// The jobs only bind cbuffers so upload the model cbuffers that changed (eg. the guard's) on the immediate context first
+		cBufferManager->uploadDirty(context);
+
+		// Every job starts from default state - bind the pass's targets and the per-frame cbuffers
+		ID3D11RenderTargetView *renderTargetView = graph.getRTV(backBuffer);
+		ID3D11DepthStencilView *depthStencilView = graph.getDSV(depth);
+		commandRecorder->begin([this, renderTargetView, depthStencilView](ID3D11DeviceContext *deferredContext) {
+			deferredContext->OMSetRenderTargets(1, &renderTargetView, depthStencilView);
+			deferredContext->RSSetViewports(1, &viewport);
+			cBufferManager->bindFrame(deferredContext);
+		});
+
+		// Render Scene objects.  The jobs are executed in the order they are added so the draw order is unchanged.  The visible entities
+		// are split into groups, in the order updateScene sorted them so models drawn with the same effect follow each other
+		static const size_t modelsPerJob = 4;
+		for (size_t first = 0; first < visibleEntities.size(); first += modelsPerJob) {
+			size_t last = min(first + modelsPerJob, visibleEntities.size());
+			commandRecorder->addJob("Models", [this, first, last](ID3D11DeviceContext *context) {
+				const uint32_t *entityMeshes = entities->getMeshes();
+				for (size_t i = first; i < last; i++)
+					models[entityMeshes[visibleEntities[i]]]->render(context);
+			});
+		}
+
+		commandRecorder->execute(context);
+
+		// Executing the command lists cleared the immediate context state - rebind the per-frame cbuffers for the following passes
+		cBufferManager->bindFrame(context);
+	});
+
+	// The orb is drawn blurred over the scene, occluded by a copy of the scene depth
+	blurUtility->addPasses(frameGraph, backBuffer, depth, orb);
+
+	// Flares read the scene depth so they are drawn without a depth buffer bound
+	frameGraph->addPass("Flares",
+		[&](FrameGraph::PassBuilder &builder) {
+			builder.read(depth);
+			builder.writeColour(backBuffer);
+		},
+		[this, depth](ID3D11DeviceContext *context, const FrameGraph &graph) {
+		DrawFlare(context, graph.getSRV(depth));
+	});
+
+	HRESULT hr = frameGraph->compile();
+	if (SUCCEEDED(hr))
+		hr = frameGraph->execute(context);
+
+	// Fence this frame's upload heap allocations
+	uploadHeap->endFrame(context);
+
+	// Leave the main render target and depth buffer bound for anything drawn outside the graph
+	ID3D11RenderTargetView* renderTargetView = system->getBackBufferRTV();
+	context->OMSetRenderTargets(1, &renderTargetView, system->getDepthStencil());
 
 	// Present current frame to the screen
-	HRESULT hr = system->presentBackBuffer();
+	hr = system->presentBackBuffer();
 
 	return S_OK;
 }
@@ -473,6 +714,54 @@ void Scene::reportTimingData() {
 	std::cout << "Average FPS: " << mainClock->averageFPS() << std::endl;
 
 	mainClock->reportTimingData();
+
+	if (renderTargetPool)
+		renderTargetPool->reportMemoryData();
+	if (shaderPack)
+		shaderPack->reportData();
+	if (stateCache)
+		stateCache->reportData();
+	if (shaderReloader)
+		shaderReloader->reportData();
+	if (cBufferManager)
+		cBufferManager->reportData();
+	if (uploadHeap)
+		uploadHeap->reportData();
+	if (commandRecorder)
+		commandRecorder->reportData();
+	if (jobSystem)
+		jobSystem->reportData();
+	if (assetLoader)
+		assetLoader->reportData();
+
+	// Vertex cache statistics of the imported meshes (every tree uses the same mesh)
+	cout << "Meshes:" << endl;
+	for (size_t i = 0; i < reportedMeshes.size(); i++)
+		reportedMeshes[i].second->reportMeshData(reportedMeshes[i].first);
+	if (treeImpostorMesh < models.size())
+		static_cast<ImpostorBatch*>(models[treeImpostorMesh])->reportData();
+
+	if (entities) {
+		entities->reportData();
+		if (occlusionCuller)
+			occlusionCuller->reportData();
+
+		// Pick along the centre of the view and find the models within reach of the light.  The hierarchy's objects are entity ids
+		const SceneBVH &hierarchy = entities->getHierarchy();
+		XMFLOAT3 eye, direction;
+		XMStoreFloat3(&eye, mainCamera->getPos());
+		XMStoreFloat3(&direction, XMVector3Normalize(mainCamera->getLookAt() - mainCamera->getPos()));
+		SceneEntity picked;
+		float distance;
+		if (hierarchy.raycast(&eye.x, &direction.x, 1000.0f, &picked, &distance))
+			cout << "Picking: model " << entities->getMeshes()[entities->getIndex(picked)] << " at " << distance << " along the view" << endl;
+		else
+			cout << "Picking: no model along the view" << endl;
+		vector<uint32_t> litEntities;
+		const float lightRange = 100.0f;
+		hierarchy.querySphere(&cBufferLightCPU->lightVec.x, lightRange, &litEntities);
+		cout << "Light: " << litEntities.size() << " models within " << lightRange << " of the light" << endl;
+	}
 }
 
 // Private constructor
@@ -572,6 +861,42 @@ Scene* Scene::CreateScene(const LONG _width, const LONG _height, const wchar_t*
 // Destructor
 Scene::~Scene() {
 	//Clean Up
+	if (assetLoader)
+		delete assetLoader;
+	// The models are deleted after the asset loader, which may still be filling them in, and before the cbuffer manager they remove
+	// their cbuffers from
+	for (size_t i = 0; i < models.size(); i++)
+		delete models[i];
+	if (orb)
+		delete orb;
+	if (flareBatch)
+		delete flareBatch;
+	if (occlusionCuller)
+		delete occlusionCuller;
+	if (entities)
+		delete entities;
+	if (transforms)
+		delete transforms;
+	if (commandRecorder)
+		delete commandRecorder;
+	if (shaderReloader)
+		delete shaderReloader;
+	if (blurUtility)
+		delete blurUtility;
+	if (frameGraph)
+		delete frameGraph;
+	if (renderTargetPool)
+		delete renderTargetPool;
+	if (shaderPack)
+		delete shaderPack;
+	if (stateCache)
+		delete stateCache;
+	if (cBufferManager)
+		delete cBufferManager;
+	if (uploadHeap)
+		delete uploadHeap;
+	if (jobSystem)
+		delete jobSystem;
 	if (wndHandle)
 		DestroyWindow(wndHandle);
 }
@@ -596,6 +921,8 @@ HRESULT Scene::resizeResources() {
 		rebuildViewport();
 		RECT clientRect;
 		GetClientRect(wndHandle, &clientRect);
+		if (blurUtility)
+			blurUtility->setupBlurRenderTargets(clientRect.right - clientRect.left, clientRect.bottom - clientRect.top);
 		if (!isMinimised())
 			renderScene();
 	}
@@ -16,8 +16,20 @@
 #include <ParticleSystem.h>
 #include "Terrain.h"
 #include <CBufferStructures.h>
-#include <Flare.h>
+#include <FlareBatch.h>
+#include <ImpostorBatch.h>
 #include <BlurUtility.h>
+#include <FrameGraph.h>
+#include <ShaderPack.h>
+#include <StateCache.h>
+#include <ShaderReloader.h>
+#include <CBufferManager.h>
+#include <UploadHeap.h>
+#include <CommandRecorder.h>
+#include <JobSystem.h>
+#include <AssetLoader.h>
+#include <SceneStore.h>
+#include <TransformHierarchy.h>
 
 
 class Scene{// : public GUObject {
@@ -33,34 +45,73 @@ class Scene{// : public GUObject {
 	LookAtCamera							*mainCamera;
 
 	CBufferScene* cBufferSceneCPU = nullptr;
-	ID3D11Buffer *cBufferSceneGPU = nullptr;
 	CBufferLight* cBufferLightCPU = nullptr;
-	ID3D11Buffer *cBufferLightGPU = nullptr;
+	// cbuffer manager handles of the GPU copies
+	int										cBufferScene = -1;
+	int										cBufferLight = -1;
 
 
 	// Add objects to the scene
 	Triangle								*triangle = nullptr; //pointer to a Triangle the actual triangle is created in initialiseSceneResources
-	Box										*box = nullptr; //pointer to a Triangle the actual triangle is created in initialiseSceneResources
-	Model									*orb = nullptr; //pointer to a Triangle the actual triangle is created in initialiseSceneResources
-	Grid									*water = nullptr; //pointer to a Triangle the actual triangle is created in initialiseSceneResources
-	Terrain									*terrain = nullptr;
-	std::vector<Model*>							trees;
-	Grid									*grass = nullptr;
-	Model									*castle = nullptr;
-	Model									*guard = nullptr;
-	Model									*fountain = nullptr;
-	Grid									*fountain_water = nullptr;
-	ParticleSystem							*fountain_water_part = nullptr;
-
+	// Drawn by the glow passes rather than the scene pass, so it is not an entity
+	Model									*orb = nullptr;
+	// Trees further than treeImpostorDistance are drawn as impostors, fading in over treeImpostorFade where the tree meshes stop
+	static const float						treeImpostorDistance;
+	static const float						treeImpostorFade;
+	// Every model the scene pass draws is an entity of the scene store.  The mesh handle of an entity is the index of its model in
+	// models and the material handle the index of the model's effect in modelEffects.  The store's flags choose the systems run on
+	// each entity in updateScene, which leaves the entities to draw in visibleEntities
+	SceneStore								*entities = nullptr;
+	std::vector<BaseModel*>					models;
+	std::vector<Effect*>					modelEffects;
+	// Mesh handle of the tree impostor batch (owned by the scene) and the imported meshes listed by reportData
+	uint32_t								treeImpostorMesh = 0xffffffff;
+	std::vector<std::pair<std::string, Model*> >	reportedMeshes;
+	std::vector<uint32_t>					entityList; // Scratch for the systems
+	std::vector<uint32_t>					visibleEntities;
+	// Local transform of each entity.  The world matrices are brought up to date a level at a time in updateScene and copied to the
+	// entities (nodeEntities) whose matrices changed
+	TransformHierarchy						*transforms = nullptr;
+	std::vector<SceneEntity>				nodeEntities;
+	std::vector<TransformNode>				changedNodes;
+	TransformNode							guardNode = TRANSFORM_NONE;
+	// Rasterises the entities flagged ENTITY_OCCLUDER on the CPU to cull the rest against
+	OcclusionCuller							*occlusionCuller = nullptr;
+
+	// Drawn by the flare pass, which reads the scene depth, so it is not an entity
 	static const int						numFlares = 6;
-	Flare									*flares[numFlares];
+	FlareBatch								*flareBatch = nullptr;
 
 	BlurUtility								*blurUtility = nullptr;
 
+	// All compiled shaders, memory mapped from Shaders\shaders.pack
+	ShaderPack								*shaderPack = nullptr;
+	// Shared pipeline states and input layouts
+	StateCache								*stateCache = nullptr;
+	// Recompiles edited HLSL in the background; changes are swapped into the effects at the start of renderScene
+	ShaderReloader							*shaderReloader = nullptr;
+	// Owns the model, camera and scene cbuffers and uploads them only when they change
+	CBufferManager							*cBufferManager = nullptr;
+	// Ring buffer for per-frame vertex and index data (stages the flare instances when they change)
+	UploadHeap								*uploadHeap = nullptr;
+	// Records the scene pass on several threads into deferred contexts
+	CommandRecorder							*commandRecorder = nullptr;
+	// Work-stealing scheduler for start up (terrain, model imports) and per-frame work (culling)
+	JobSystem								*jobSystem = nullptr;
+	// Loads textures and models in the background, finalised a few per frame at the start of renderScene
+	AssetLoader								*assetLoader = nullptr;
+	// Transient render targets shared by the frame graph and post effects
+	RenderTargetPool						*renderTargetPool = nullptr;
+	// Passes are redeclared every frame in renderScene
+	FrameGraph								*frameGraph = nullptr;
+
 	float guardX = 0;
 	float guardZ = 0;
+	float guardYaw = 0;
 	bool gX = true;
 	float moveTimer = 0;
+	// Add model, drawn with effect, to the scene store with the given ENTITY_ flags, and return the transform node it is placed by
+	TransformNode addEntity(BaseModel *model, Effect *effect, uint32_t entityFlags);
 	// Private constructor
 	Scene(const LONG _width, const LONG _height, const wchar_t* wndClassName, const wchar_t* wndTitle, int nCmdShow, HINSTANCE hInstance, WNDPROC WndProc);
 	// Return TRUE if the window is in a minimised state, FALSE otherwise
@@ -74,7 +125,7 @@ public:
 	// Methods to handle initialisation, update and rendering of the scene
 	HRESULT rebuildViewport();
 	HRESULT initialiseSceneResources();
-	void DrawFlare(ID3D11DeviceContext * context);
+	void DrawFlare(ID3D11DeviceContext * context, ID3D11ShaderResourceView *depthSRV);
 	HRESULT updateScene(ID3D11DeviceContext *context, Camera *camera);
 	HRESULT renderScene();
 
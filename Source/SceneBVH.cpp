@@ -0,0 +1,717 @@
+#include "stdafx.h"
+#include "SceneBVH.h"
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+// Centroid bins per axis tested by the SAH build
+static const int numSplitBins = 12;
+
+
+static inline void combine(const BVHBox &a, const BVHBox &b, BVHBox *c)
+{
+	for (int k = 0; k < 3; k++) {
+		c->min[k] = min(a.min[k], b.min[k]);
+		c->max[k] = max(a.max[k], b.max[k]);
+	}
+}
+
+static inline float surfaceArea(const BVHBox &box)
+{
+	float x = box.max[0] - box.min[0], y = box.max[1] - box.min[1], z = box.max[2] - box.min[2];
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+static inline bool equal(const BVHBox &a, const BVHBox &b)
+{
+	for (int k = 0; k < 3; k++)
+		if (a.min[k] != b.min[k] || a.max[k] != b.max[k])
+			return false;
+	return true;
+}
+
+static const BVHBox emptyBox = { { FLT_MAX, FLT_MAX, FLT_MAX }, { -FLT_MAX, -FLT_MAX, -FLT_MAX } };
+
+
+int32_t SceneBVH::allocateNode()
+{
+	int32_t node;
+	if (freeList >= 0) {
+		node = freeList;
+		freeList = nodes[node].parent;
+	}
+	else {
+		node = (int32_t)nodes.size();
+		nodes.push_back(Node());
+	}
+	nodes[node].parent = -1;
+	nodes[node].child[0] = nodes[node].child[1] = -1;
+	nodes[node].height = 0;
+	nodes[node].object = 0;
+	return node;
+}
+
+void SceneBVH::freeNode(int32_t node)
+{
+	nodes[node].parent = freeList;
+	nodes[node].height = -1;
+	freeList = node;
+}
+
+void SceneBVH::clear()
+{
+	nodes.clear();
+	root = -1;
+	freeList = -1;
+	numObjects = 0;
+}
+
+
+void SceneBVH::build(const BVHBox *boxes, size_t numBoxes, const uint32_t *objects)
+{
+	clear();
+	nodes.reserve(numBoxes * 2);
+	vector<int32_t> leaves(numBoxes);
+	for (size_t i = 0; i < numBoxes; i++) {
+		leaves[i] = allocateNode();
+		nodes[leaves[i]].box = boxes[i];
+		nodes[leaves[i]].object = objects ? objects[i] : (uint32_t)i;
+	}
+	numObjects = numBoxes;
+	buildInternal(leaves);
+}
+
+void SceneBVH::rebuild()
+{
+	vector<int32_t> leaves;
+	leaves.reserve(numObjects);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i].height == 0)
+			leaves.push_back((int32_t)i);
+		else if (nodes[i].height > 0)
+			freeNode((int32_t)i);
+	}
+	buildInternal(leaves);
+}
+
+void SceneBVH::buildInternal(const vector<int32_t> &leaves)
+{
+	root = -1;
+	if (leaves.empty())
+		return;
+
+	// The boxes and centroids are copied out of the nodes so each split reads and partitions contiguous memory
+	struct Item {
+		BVHBox							box;
+		float							centre[3];
+		int32_t							leaf;
+	};
+	vector<Item> items(leaves.size());
+	for (size_t i = 0; i < leaves.size(); i++) {
+		items[i].box = nodes[leaves[i]].box;
+		for (int k = 0; k < 3; k++)
+			items[i].centre[k] = (items[i].box.min[k] + items[i].box.max[k]) * 0.5f;
+		items[i].leaf = leaves[i];
+	}
+
+	// A range of leaves waiting to be split, and the node it becomes a child of
+	struct Range {
+		size_t							first, last;
+		int32_t							parent;
+		int								side;
+	};
+	vector<Range> ranges(1);
+	ranges[0].first = 0;
+	ranges[0].last = leaves.size();
+	ranges[0].parent = -1;
+	ranges[0].side = 0;
+
+	while (!ranges.empty()) {
+		Range range = ranges.back();
+		ranges.pop_back();
+
+		int32_t node = (range.last - range.first == 1) ? items[range.first].leaf : allocateNode();
+		nodes[node].parent = range.parent;
+		if (range.parent >= 0)
+			nodes[range.parent].child[range.side] = node;
+		else
+			root = node;
+		if (range.last - range.first == 1)
+			continue;
+
+		// Bins over the extent of the centroids along each axis
+		BVHBox centroids = emptyBox;
+		for (size_t i = range.first; i < range.last; i++)
+			for (int k = 0; k < 3; k++) {
+				centroids.min[k] = min(centroids.min[k], items[i].centre[k]);
+				centroids.max[k] = max(centroids.max[k], items[i].centre[k]);
+			}
+
+		float bestCost = FLT_MAX;
+		int bestAxis = -1, bestSplit = 0;
+		for (int k = 0; k < 3; k++) {
+			float extent = centroids.max[k] - centroids.min[k];
+			if (!(extent > 0.0f))
+				continue;
+			float binScale = numSplitBins / extent;
+
+			BVHBox binBoxes[numSplitBins];
+			size_t binCounts[numSplitBins];
+			for (int b = 0; b < numSplitBins; b++) {
+				binBoxes[b] = emptyBox;
+				binCounts[b] = 0;
+			}
+			for (size_t i = range.first; i < range.last; i++) {
+				int b = min((int)((items[i].centre[k] - centroids.min[k]) * binScale), numSplitBins - 1);
+				combine(binBoxes[b], items[i].box, &binBoxes[b]);
+				binCounts[b]++;
+			}
+
+			// Areas of the bins below each split swept from the left, then the cost of each split swept from the right
+			float leftArea[numSplitBins];
+			size_t leftCount[numSplitBins];
+			BVHBox left = emptyBox;
+			size_t count = 0;
+			for (int b = 0; b < numSplitBins - 1; b++) {
+				combine(left, binBoxes[b], &left);
+				count += binCounts[b];
+				leftArea[b] = count ? surfaceArea(left) : 0.0f;
+				leftCount[b] = count;
+			}
+			BVHBox right = emptyBox;
+			count = 0;
+			for (int b = numSplitBins - 1; b > 0; b--) {
+				combine(right, binBoxes[b], &right);
+				count += binCounts[b];
+				if (count == 0 || leftCount[b - 1] == 0)
+					continue;
+				float cost = leftArea[b - 1] * leftCount[b - 1] + surfaceArea(right) * count;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = k;
+					bestSplit = b;
+				}
+			}
+		}
+
+		// Split at the best bin, or in half if every centroid is in the same place
+		size_t middle;
+		if (bestAxis >= 0) {
+			float binScale = numSplitBins / (centroids.max[bestAxis] - centroids.min[bestAxis]);
+			float minCentroid = centroids.min[bestAxis];
+			middle = partition(items.begin() + range.first, items.begin() + range.last, [&](const Item &item) {
+				return min((int)((item.centre[bestAxis] - minCentroid) * binScale), numSplitBins - 1) < bestSplit;
+			}) - items.begin();
+		}
+		else
+			middle = (range.first + range.last) / 2;
+		if (middle == range.first || middle == range.last)
+			middle = (range.first + range.last) / 2;
+
+		Range children[2];
+		children[0].first = range.first;
+		children[0].last = middle;
+		children[1].first = middle;
+		children[1].last = range.last;
+		for (int side = 0; side < 2; side++) {
+			children[side].parent = node;
+			children[side].side = side;
+			ranges.push_back(children[side]);
+		}
+	}
+
+	refit();
+}
+
+
+void SceneBVH::refit()
+{
+	if (root < 0)
+		return;
+
+	// Parents are listed before their children, so the list is refitted backwards
+	vector<int32_t> order;
+	order.reserve(nodes.size());
+	order.push_back(root);
+	for (size_t i = 0; i < order.size(); i++) {
+		const Node &node = nodes[order[i]];
+		if (node.child[0] >= 0) {
+			order.push_back(node.child[0]);
+			order.push_back(node.child[1]);
+		}
+	}
+	for (size_t i = order.size(); i-- > 0;) {
+		Node &node = nodes[order[i]];
+		if (node.child[0] < 0)
+			continue;
+		const Node &a = nodes[node.child[0]];
+		const Node &b = nodes[node.child[1]];
+		combine(a.box, b.box, &node.box);
+		node.height = 1 + max(a.height, b.height);
+	}
+}
+
+
+int32_t SceneBVH::insert(const BVHBox &box, uint32_t object)
+{
+	int32_t leaf = allocateNode();
+	nodes[leaf].box = box;
+	nodes[leaf].object = object;
+	insertLeaf(leaf);
+	numObjects++;
+	return leaf;
+}
+
+void SceneBVH::remove(int32_t proxy)
+{
+	if (proxy < 0 || proxy >= (int32_t)nodes.size() || nodes[proxy].height != 0)
+		return;
+	removeLeaf(proxy);
+	freeNode(proxy);
+	numObjects--;
+}
+
+void SceneBVH::update(int32_t proxy, const BVHBox &box)
+{
+	if (equal(nodes[proxy].box, box))
+		return;
+	nodes[proxy].box = box;
+
+	// Refit the ancestors until one already has the box of its children
+	for (int32_t node = nodes[proxy].parent; node >= 0; node = nodes[node].parent) {
+		BVHBox fitted;
+		combine(nodes[nodes[node].child[0]].box, nodes[nodes[node].child[1]].box, &fitted);
+		if (equal(fitted, nodes[node].box))
+			break;
+		nodes[node].box = fitted;
+	}
+}
+
+void SceneBVH::setBox(int32_t proxy, const BVHBox &box)
+{
+	nodes[proxy].box = box;
+}
+
+
+void SceneBVH::insertLeaf(int32_t leaf)
+{
+	if (root < 0) {
+		root = leaf;
+		nodes[leaf].parent = -1;
+		return;
+	}
+
+	// Walk down to the sibling whose enlargement costs least.  Making a new parent here costs the area of the combined box, and
+	// descending costs every ancestor's growth plus the cheaper child's
+	const BVHBox &leafBox = nodes[leaf].box;
+	int32_t sibling = root;
+	while (nodes[sibling].child[0] >= 0) {
+		const Node &node = nodes[sibling];
+		BVHBox combined;
+		combine(node.box, leafBox, &combined);
+		float combinedArea = surfaceArea(combined);
+		float cost = 2.0f * combinedArea;
+		float inheritedCost = 2.0f * (combinedArea - surfaceArea(node.box));
+
+		float childCost[2];
+		for (int side = 0; side < 2; side++) {
+			const Node &child = nodes[node.child[side]];
+			combine(child.box, leafBox, &combined);
+			childCost[side] = surfaceArea(combined) + inheritedCost;
+			if (child.child[0] >= 0)
+				childCost[side] -= surfaceArea(child.box);
+		}
+		if (cost < childCost[0] && cost < childCost[1])
+			break;
+		sibling = (childCost[0] < childCost[1]) ? node.child[0] : node.child[1];
+	}
+
+	int32_t oldParent = nodes[sibling].parent;
+	int32_t newParent = allocateNode();
+	Node &parent = nodes[newParent];
+	parent.parent = oldParent;
+	combine(nodes[sibling].box, nodes[leaf].box, &parent.box);
+	parent.height = nodes[sibling].height + 1;
+	parent.child[0] = sibling;
+	parent.child[1] = leaf;
+	nodes[sibling].parent = newParent;
+	nodes[leaf].parent = newParent;
+	if (oldParent >= 0)
+		nodes[oldParent].child[nodes[oldParent].child[0] == sibling ? 0 : 1] = newParent;
+	else
+		root = newParent;
+
+	// Refit and rebalance back up to the root
+	for (int32_t node = nodes[leaf].parent; node >= 0; node = nodes[node].parent) {
+		node = balance(node);
+		Node &n = nodes[node];
+		combine(nodes[n.child[0]].box, nodes[n.child[1]].box, &n.box);
+		n.height = 1 + max(nodes[n.child[0]].height, nodes[n.child[1]].height);
+	}
+}
+
+void SceneBVH::removeLeaf(int32_t leaf)
+{
+	if (leaf == root) {
+		root = -1;
+		return;
+	}
+
+	// The sibling takes the parent's place
+	int32_t parent = nodes[leaf].parent;
+	int32_t grandParent = nodes[parent].parent;
+	int32_t sibling = nodes[parent].child[nodes[parent].child[0] == leaf ? 1 : 0];
+	freeNode(parent);
+	nodes[sibling].parent = grandParent;
+	if (grandParent < 0) {
+		root = sibling;
+		return;
+	}
+	nodes[grandParent].child[nodes[grandParent].child[0] == parent ? 0 : 1] = sibling;
+
+	for (int32_t node = grandParent; node >= 0; node = nodes[node].parent) {
+		node = balance(node);
+		Node &n = nodes[node];
+		combine(nodes[n.child[0]].box, nodes[n.child[1]].box, &n.box);
+		n.height = 1 + max(nodes[n.child[0]].height, nodes[n.child[1]].height);
+	}
+}
+
+int32_t SceneBVH::balance(int32_t a)
+{
+	if (nodes[a].child[0] < 0 || nodes[a].height < 2)
+		return a;
+
+	int32_t b = nodes[a].child[0], c = nodes[a].child[1];
+	int difference = nodes[c].height - nodes[b].height;
+	if (difference >= -1 && difference <= 1)
+		return a;
+
+	// The taller child (up) replaces a, and a keeps the other child and the shorter of up's children
+	int upSide = (difference > 1) ? 1 : 0;
+	int32_t up = nodes[a].child[upSide];
+	int32_t other = nodes[a].child[1 - upSide];
+	int32_t f = nodes[up].child[0], g = nodes[up].child[1];
+	int32_t taller = (nodes[f].height > nodes[g].height) ? f : g;
+	int32_t shorter = (taller == f) ? g : f;
+
+	nodes[up].parent = nodes[a].parent;
+	if (nodes[up].parent >= 0) {
+		Node &parent = nodes[nodes[up].parent];
+		parent.child[parent.child[0] == a ? 0 : 1] = up;
+	}
+	else
+		root = up;
+
+	nodes[up].child[0] = a;
+	nodes[up].child[1] = taller;
+	nodes[a].parent = up;
+	nodes[a].child[0] = other;
+	nodes[a].child[1] = shorter;
+	nodes[shorter].parent = a;
+
+	combine(nodes[other].box, nodes[shorter].box, &nodes[a].box);
+	nodes[a].height = 1 + max(nodes[other].height, nodes[shorter].height);
+	combine(nodes[a].box, nodes[taller].box, &nodes[up].box);
+	nodes[up].height = 1 + max(nodes[a].height, nodes[taller].height);
+	return up;
+}
+
+
+size_t SceneBVH::queryFrustum(const float planes[6][4], vector<uint32_t> *objects) const
+{
+	if (root < 0)
+		return 0;
+	size_t numFound = 0;
+
+	// Each entry carries the planes its box is not yet known to be inside of.  Once it is inside all of them the subtree is taken
+	// without further tests
+	vector<pair<int32_t, int> > stack;
+	stack.reserve(64);
+	stack.push_back(make_pair(root, 0x3F));
+	while (!stack.empty()) {
+		int32_t index = stack.back().first;
+		int mask = stack.back().second;
+		stack.pop_back();
+		const Node &node = nodes[index];
+
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; p++) {
+			if (!(mask & (1 << p)))
+				continue;
+			const float *plane = planes[p];
+			float farthest = plane[3], nearest = plane[3];
+			for (int k = 0; k < 3; k++) {
+				farthest += plane[k] * ((plane[k] > 0.0f) ? node.box.max[k] : node.box.min[k]);
+				nearest += plane[k] * ((plane[k] > 0.0f) ? node.box.min[k] : node.box.max[k]);
+			}
+			if (farthest < 0.0f)
+				outside = true;
+			else if (nearest >= 0.0f)
+				mask &= ~(1 << p);
+		}
+		if (outside)
+			continue;
+
+		if (node.child[0] < 0) {
+			objects->push_back(node.object);
+			numFound++;
+		}
+		else {
+			stack.push_back(make_pair(node.child[1], mask));
+			stack.push_back(make_pair(node.child[0], mask));
+		}
+	}
+	return numFound;
+}
+
+size_t SceneBVH::querySphere(const float centre[3], float radius, vector<uint32_t> *objects) const
+{
+	if (root < 0)
+		return 0;
+	size_t numFound = 0;
+	float radiusSquared = radius * radius;
+
+	vector<int32_t> stack;
+	stack.reserve(64);
+	stack.push_back(root);
+	while (!stack.empty()) {
+		const Node &node = nodes[stack.back()];
+		stack.pop_back();
+
+		// Distance from the centre to the nearest point of the box
+		float distanceSquared = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			float d = max(max(node.box.min[k] - centre[k], centre[k] - node.box.max[k]), 0.0f);
+			distanceSquared += d * d;
+		}
+		if (distanceSquared > radiusSquared)
+			continue;
+
+		if (node.child[0] < 0) {
+			objects->push_back(node.object);
+			numFound++;
+		}
+		else {
+			stack.push_back(node.child[1]);
+			stack.push_back(node.child[0]);
+		}
+	}
+	return numFound;
+}
+
+bool SceneBVH::raycast(const float origin[3], const float direction[3], float maxDistance, uint32_t *object, float *distance,
+	const function<bool(uint32_t, float*)> &intersect) const
+{
+	if (root < 0)
+		return false;
+
+	// Slab test - the distance the ray enters the box, or FLT_MAX if it misses it before the nearest hit so far
+	float inverse[3];
+	for (int k = 0; k < 3; k++)
+		inverse[k] = 1.0f / direction[k];
+	float nearestHit = maxDistance;
+	bool hit = false;
+	auto entry = [&](const BVHBox &box) {
+		float tMin = 0.0f, tMax = nearestHit;
+		for (int k = 0; k < 3; k++) {
+			float t0 = (box.min[k] - origin[k]) * inverse[k];
+			float t1 = (box.max[k] - origin[k]) * inverse[k];
+			tMin = max(tMin, min(t0, t1));
+			tMax = min(tMax, max(t0, t1));
+		}
+		return (tMin <= tMax) ? tMin : FLT_MAX;
+	};
+
+	// Nearer child first, and nodes entered beyond the nearest hit are skipped when they come off the stack
+	vector<pair<int32_t, float> > stack;
+	stack.reserve(64);
+	float rootEntry = entry(nodes[root].box);
+	if (rootEntry != FLT_MAX)
+		stack.push_back(make_pair(root, rootEntry));
+	while (!stack.empty()) {
+		int32_t index = stack.back().first;
+		float enter = stack.back().second;
+		stack.pop_back();
+		if (enter > nearestHit)
+			continue;
+		const Node &node = nodes[index];
+
+		if (node.child[0] < 0) {
+			float t = enter;
+			if (intersect && (!intersect(node.object, &t) || t > nearestHit || t < 0.0f))
+				continue;
+			nearestHit = t;
+			*object = node.object;
+			hit = true;
+			continue;
+		}
+
+		float enter0 = entry(nodes[node.child[0]].box);
+		float enter1 = entry(nodes[node.child[1]].box);
+		int nearSide = (enter0 <= enter1) ? 0 : 1;
+		float nearEnter = nearSide ? enter1 : enter0, farEnter = nearSide ? enter0 : enter1;
+		if (farEnter != FLT_MAX)
+			stack.push_back(make_pair(node.child[1 - nearSide], farEnter));
+		if (nearEnter != FLT_MAX)
+			stack.push_back(make_pair(node.child[nearSide], nearEnter));
+	}
+	if (hit && distance)
+		*distance = nearestHit;
+	return hit;
+}
+
+
+float SceneBVH::getCost() const
+{
+	if (root < 0 || nodes[root].child[0] < 0)
+		return 0.0f;
+	float area = 0.0f;
+	for (size_t i = 0; i < nodes.size(); i++)
+		if (nodes[i].height > 0)
+			area += surfaceArea(nodes[i].box);
+	return area / surfaceArea(nodes[root].box);
+}
+
+void SceneBVH::reportData() const
+{
+	cout << "SceneBVH: " << numObjects << " objects, " << nodes.size() << " nodes, height " << getHeight() << ", SAH cost " << getCost() << endl;
+}
+
+
+// Random boxes of 0.5 to 10 units in a region of 2000 x 100 x 2000, the size of the scene's terrain
+static void randomBoxes(size_t numBoxes, unsigned int seed, vector<BVHBox> *boxes)
+{
+	boxes->resize(numBoxes);
+	for (size_t i = 0; i < numBoxes; i++) {
+		float r[4];
+		for (int k = 0; k < 4; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			r[k] = (seed >> 8) / 16777216.0f;
+		}
+		float size = 0.5f + 9.5f * r[3];
+		float centre[3] = { (r[0] - 0.5f) * 2000.0f, r[1] * 100.0f, (r[2] - 0.5f) * 2000.0f };
+		for (int k = 0; k < 3; k++) {
+			(*boxes)[i].min[k] = centre[k] - size * 0.5f;
+			(*boxes)[i].max[k] = centre[k] + size * 0.5f;
+		}
+	}
+}
+
+// Planes of a view from eye along the horizontal direction angle with a 60 degree field of view, out to 500 units
+static void viewPlanes(const float eye[3], float angle, float planes[6][4])
+{
+	float forward[3] = { cos(angle), 0.0f, sin(angle) }, right[3] = { sin(angle), 0.0f, -cos(angle) }, up[3] = { 0.0f, 1.0f, 0.0f };
+	float c = cos(1.0471976f * 0.5f), s = sin(1.0471976f * 0.5f);
+	float normals[6][3];
+	for (int k = 0; k < 3; k++) {
+		normals[0][k] = right[k] * c + forward[k] * s;
+		normals[1][k] = -right[k] * c + forward[k] * s;
+		normals[2][k] = up[k] * c + forward[k] * s;
+		normals[3][k] = -up[k] * c + forward[k] * s;
+		normals[4][k] = forward[k];
+		normals[5][k] = -forward[k];
+	}
+	for (int p = 0; p < 6; p++) {
+		planes[p][3] = 0.0f;
+		for (int k = 0; k < 3; k++) {
+			planes[p][k] = normals[p][k];
+			planes[p][3] -= normals[p][k] * eye[k];
+		}
+	}
+	planes[4][3] -= 1.0f;
+	planes[5][3] += 500.0f;
+}
+
+void benchmarkSceneBVH(int numObjects, int numQueries)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+	if (numObjects <= 0 || numQueries <= 0)
+		return;
+
+	// The costs at three sizes show how they grow with the number of objects
+	int sizes[3] = { max(numObjects / 100, 1), max(numObjects / 10, 1), numObjects };
+	for (int s = 0; s < 3; s++) {
+		size_t n = (size_t)sizes[s];
+		vector<BVHBox> boxes;
+		randomBoxes(n, 1, &boxes);
+		SceneBVH bvh;
+
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		SceneBVH inserted;
+		for (size_t i = 0; i < n; i++)
+			inserted.insert(boxes[i], (uint32_t)i);
+		double insertTime = chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+
+		start = BenchmarkClock::now();
+		bvh.build(boxes.data(), n);
+		double buildTime = chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+
+		// Every object moves a little and the whole tree is refitted
+		vector<BVHBox> moved(boxes);
+		for (size_t i = 0; i < n; i++)
+			for (int k = 0; k < 3; k += 2) {
+				moved[i].min[k] += 1.0f;
+				moved[i].max[k] += 1.0f;
+			}
+		start = BenchmarkClock::now();
+		for (size_t i = 0; i < n; i++)
+			bvh.setBox((int32_t)i, moved[i]);
+		bvh.refit();
+		double refitTime = chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+
+		// A few objects (like the guard) move each frame and are refitted one at a time
+		size_t numUpdates = min(n, (size_t)numQueries);
+		start = BenchmarkClock::now();
+		for (size_t i = 0; i < numUpdates; i++) {
+			size_t proxy = (i * 7919) % n;
+			bvh.update((int32_t)proxy, boxes[proxy]);
+		}
+		double updateTime = chrono::duration<double, nano>(BenchmarkClock::now() - start).count() / numUpdates;
+
+		// Queries from eyes spread over the region
+		vector<uint32_t> found;
+		found.reserve(n);
+		double frustumTime = 0.0, sphereTime = 0.0, rayTime = 0.0;
+		size_t frustumFound = 0, sphereFound = 0, raysHit = 0;
+		unsigned int seed = 7;
+		for (int q = 0; q < numQueries; q++) {
+			float r[4];
+			for (int k = 0; k < 4; k++) {
+				seed = seed * 1664525u + 1013904223u;
+				r[k] = (seed >> 8) / 16777216.0f;
+			}
+			float eye[3] = { (r[0] - 0.5f) * 2000.0f, 50.0f, (r[1] - 0.5f) * 2000.0f };
+			float angle = r[2] * 6.2831853f;
+			float planes[6][4];
+			viewPlanes(eye, angle, planes);
+
+			found.clear();
+			start = BenchmarkClock::now();
+			frustumFound += bvh.queryFrustum(planes, &found);
+			frustumTime += chrono::duration<double, micro>(BenchmarkClock::now() - start).count();
+
+			found.clear();
+			start = BenchmarkClock::now();
+			sphereFound += bvh.querySphere(eye, 50.0f, &found);
+			sphereTime += chrono::duration<double, micro>(BenchmarkClock::now() - start).count();
+
+			float direction[3] = { cos(angle), (r[3] - 0.5f) * 0.2f, sin(angle) };
+			uint32_t object;
+			float distance;
+			start = BenchmarkClock::now();
+			raysHit += bvh.raycast(eye, direction, 5000.0f, &object, &distance) ? 1 : 0;
+			rayTime += chrono::duration<double, micro>(BenchmarkClock::now() - start).count();
+		}
+
+		cout << "SceneBVH: " << n << " objects - SAH build = " << buildTime << " ms (height " << bvh.getHeight() << ", cost " << bvh.getCost()
+			<< "), insertion build = " << insertTime << " ms (height " << inserted.getHeight() << ", cost " << inserted.getCost() << "), refit all = "
+			<< refitTime << " ms, update = " << updateTime << " ns per object" << endl;
+		cout << "  Queries: frustum = " << frustumTime / numQueries << " us (" << frustumFound / numQueries << " found), sphere = " << sphereTime / numQueries
+			<< " us (" << sphereFound / numQueries << " found), ray = " << rayTime / numQueries << " us (" << 100.0 * raysHit / numQueries << "% hit)" << endl;
+	}
+}
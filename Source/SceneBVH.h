@@ -0,0 +1,93 @@
+//
+// SceneBVH.h
+//
+
+// Dynamic bounding volume hierarchy over the axis aligned boxes of the scene's objects, for frustum culling, picking and finding the
+// objects near a light without visiting every object.  Each object is a leaf holding its box and a caller chosen object value; the
+// leaf's node index is the object's proxy and stays fixed until the object is removed.
+//
+// build() constructs the tree top-down with the surface area heuristic (SAH), splitting each range of objects where the summed area
+// of the two sides' boxes weighted by their object counts is smallest, over a few bins of centroids per axis.  Objects can then be
+// inserted and removed one at a time - insert() walks down to the sibling that enlarges the tree least and, like remove(), rotates the
+// nodes on the way back up so no subtree is more than one level taller than its sibling - and a moving object is refitted with
+// update(), which enlarges or shrinks its ancestors' boxes only as far up as they change.  Many objects moved at once are cheaper to
+// set with setBox() and refit() in one pass.  rebuild() restores SAH quality if objects have moved a long way.
+//
+// The queries descend only into nodes whose boxes pass the test, so their cost grows with the height of the tree (log n) and the
+// number of objects found.  Only the CPU is used and the queries are safe to run in parallel with each other.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <functional>
+
+struct BVHBox {
+	float								min[3];
+	float								max[3];
+};
+
+class SceneBVH {
+
+	struct Node {
+		BVHBox							box;
+		int32_t							parent; // Next free node while on the free list
+		int32_t							child[2]; // -1 for a leaf
+		int32_t							height; // 0 for a leaf, -1 for a free node
+		uint32_t						object; // Leaves only
+	};
+
+	std::vector<Node>					nodes;
+	int32_t								root = -1;
+	int32_t								freeList = -1;
+	size_t								numObjects = 0;
+
+	int32_t allocateNode();
+	void freeNode(int32_t node);
+	void insertLeaf(int32_t leaf);
+	void removeLeaf(int32_t leaf);
+	// Rotate the taller grandchild above node if node's children differ in height by more than one.  Returns the node now in its place
+	int32_t balance(int32_t node);
+	// SAH build of internal nodes over the given leaves
+	void buildInternal(const std::vector<int32_t> &leaves);
+
+public:
+
+	// Replace the tree with one over boxes.  The proxy of box i is i and its object objects[i] (i if objects is null)
+	void build(const BVHBox *boxes, size_t numBoxes, const uint32_t *objects = nullptr);
+	// Rebuild the internal nodes over the current objects with the SAH.  Proxies are kept
+	void rebuild();
+	void clear();
+
+	// Add an object and return its proxy
+	int32_t insert(const BVHBox &box, uint32_t object);
+	void remove(int32_t proxy);
+	// Move an object to box and refit its ancestors
+	void update(int32_t proxy, const BVHBox &box);
+	// Move an object to box without refitting - call refit() once the moved objects have been set
+	void setBox(int32_t proxy, const BVHBox &box);
+	// Refit every internal node to its children
+	void refit();
+
+	// Append to objects the objects whose boxes are not wholly outside one of planes (a x + b y + c z + d >= 0 inside, as
+	// ClusterCullView::planes).  Returns the number appended
+	size_t queryFrustum(const float planes[6][4], std::vector<uint32_t> *objects) const;
+	// Append to objects the objects whose boxes overlap the sphere.  Returns the number appended
+	size_t querySphere(const float centre[3], float radius, std::vector<uint32_t> *objects) const;
+	// Find the nearest object hit by the ray origin + t direction for 0 <= t <= maxDistance.  intersect(object, &t), if given, tests
+	// the object itself and returns false if the ray misses it, otherwise the object's box is taken as the hit.  Returns false if
+	// nothing is hit
+	bool raycast(const float origin[3], const float direction[3], float maxDistance, uint32_t *object, float *distance,
+		const std::function<bool(uint32_t, float*)> &intersect = nullptr) const;
+
+	const BVHBox &getBox(int32_t proxy) const { return nodes[proxy].box; };
+	size_t getNumObjects() const { return numObjects; };
+	int getHeight() const { return root < 0 ? 0 : nodes[root].height; };
+	// Summed surface area of the internal nodes relative to the root's - the expected number of nodes a random ray visits
+	float getCost() const;
+	void reportData() const;
+};
+
+// Build trees over numObjects random boxes (and 1% and 10% of them) by SAH and by insertion, and time the builds, refitting after
+// every object moves, incremental updates of a few objects and the three queries.  Reports the times to the console
+void benchmarkSceneBVH(int numObjects = 100000, int numQueries = 1000);
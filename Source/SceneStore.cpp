@@ -0,0 +1,333 @@
+#include "stdafx.h"
+#include "SceneStore.h"
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <iostream>
+
+using namespace std;
+
+static const EntityMatrix identityMatrix = { { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f } };
+static const BVHBox zeroBox = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+
+
+SceneEntity SceneStore::create(uint32_t mesh, uint32_t material, uint32_t entityFlags, const float *world)
+{
+	SceneEntity entity;
+	if (freeIds != SCENE_ENTITY_NONE) {
+		entity = freeIds;
+		freeIds = indices[entity];
+	}
+	else {
+		entity = (SceneEntity)indices.size();
+		indices.push_back(0);
+	}
+	indices[entity] = (uint32_t)ids.size();
+
+	ids.push_back(entity);
+	worldMatrices.push_back(identityMatrix);
+	if (world)
+		copy(world, world + 16, worldMatrices.back().m);
+	localBoxes.push_back(zeroBox);
+	worldBoxes.push_back(zeroBox);
+	meshes.push_back(mesh);
+	materials.push_back(material);
+	flags.push_back((entityFlags & ~(ENTITY_BOUNDED | ENTITY_OCCLUDED)) | ENTITY_MOVED | ENTITY_VISIBLE);
+	proxies.push_back(-1);
+	return entity;
+}
+
+void SceneStore::destroy(SceneEntity entity)
+{
+	uint32_t index = indices[entity];
+	if (proxies[index] >= 0)
+		hierarchy.remove(proxies[index]);
+
+	// Move the last entity into the gap
+	size_t last = ids.size() - 1;
+	if (index != last) {
+		ids[index] = ids[last];
+		worldMatrices[index] = worldMatrices[last];
+		localBoxes[index] = localBoxes[last];
+		worldBoxes[index] = worldBoxes[last];
+		meshes[index] = meshes[last];
+		materials[index] = materials[last];
+		flags[index] = flags[last];
+		proxies[index] = proxies[last];
+		indices[ids[index]] = index;
+	}
+	ids.pop_back();
+	worldMatrices.pop_back();
+	localBoxes.pop_back();
+	worldBoxes.pop_back();
+	meshes.pop_back();
+	materials.pop_back();
+	flags.pop_back();
+	proxies.pop_back();
+
+	indices[entity] = freeIds;
+	freeIds = entity;
+}
+
+void SceneStore::setWorldMatrix(SceneEntity entity, const float *world)
+{
+	uint32_t index = indices[entity];
+	copy(world, world + 16, worldMatrices[index].m);
+	flags[index] |= ENTITY_MOVED;
+}
+
+void SceneStore::setBounds(SceneEntity entity, const float boxMin[3], const float boxMax[3])
+{
+	uint32_t index = indices[entity];
+	for (int k = 0; k < 3; k++) {
+		localBoxes[index].min[k] = boxMin[k];
+		localBoxes[index].max[k] = boxMax[k];
+	}
+	flags[index] |= ENTITY_BOUNDED | ENTITY_MOVED;
+}
+
+
+void SceneStore::updateBounds(size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++) {
+		if ((flags[i] & (ENTITY_BOUNDED | ENTITY_MOVED)) != (ENTITY_BOUNDED | ENTITY_MOVED))
+			continue;
+
+		// The world box is centred on the transformed centre of the model space box, and reaches as far along each axis as the
+		// transformed half extents do together
+		const float *m = worldMatrices[i].m;
+		const BVHBox &local = localBoxes[i];
+		float centre[3], extents[3];
+		for (int k = 0; k < 3; k++) {
+			centre[k] = (local.min[k] + local.max[k]) * 0.5f;
+			extents[k] = (local.max[k] - local.min[k]) * 0.5f;
+		}
+		BVHBox &world = worldBoxes[i];
+		for (int j = 0; j < 3; j++) {
+			float c = m[12 + j], e = 0.0f;
+			for (int k = 0; k < 3; k++) {
+				c += centre[k] * m[k * 4 + j];
+				e += extents[k] * fabs(m[k * 4 + j]);
+			}
+			world.min[j] = c - e;
+			world.max[j] = c + e;
+		}
+	}
+}
+
+void SceneStore::refitHierarchy()
+{
+	size_t numMoved = 0;
+	for (size_t i = 0; i < flags.size(); i++)
+		numMoved += (flags[i] & ENTITY_MOVED) ? 1 : 0;
+	if (numMoved == 0)
+		return;
+
+	if (numMoved * 4 > ids.size()) {
+
+		// Most entities are new or have moved - rebuilding the whole hierarchy with the SAH is quicker and gives a better tree than
+		// inserting or refitting them one at a time
+		vector<BVHBox> boxes;
+		vector<uint32_t> objects;
+		boxes.reserve(ids.size());
+		objects.reserve(ids.size());
+		for (size_t i = 0; i < ids.size(); i++) {
+			if (flags[i] & ENTITY_BOUNDED) {
+				proxies[i] = (int32_t)boxes.size();
+				boxes.push_back(worldBoxes[i]);
+				objects.push_back(ids[i]);
+			}
+			else
+				proxies[i] = -1;
+			flags[i] &= ~ENTITY_MOVED;
+		}
+		hierarchy.build(boxes.data(), boxes.size(), objects.data());
+		return;
+	}
+
+	for (size_t i = 0; i < flags.size(); i++) {
+		if (!(flags[i] & ENTITY_MOVED))
+			continue;
+		flags[i] &= ~ENTITY_MOVED;
+		if (!(flags[i] & ENTITY_BOUNDED))
+			continue;
+		if (proxies[i] < 0)
+			proxies[i] = hierarchy.insert(worldBoxes[i], ids[i]);
+		else
+			hierarchy.update(proxies[i], worldBoxes[i]);
+	}
+}
+
+
+void SceneStore::beginCull(size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++) {
+		uint32_t entityFlags = flags[i] & ~(ENTITY_VISIBLE | ENTITY_OCCLUDED);
+		flags[i] = (entityFlags & ENTITY_BOUNDED) ? entityFlags : entityFlags | ENTITY_VISIBLE;
+	}
+}
+
+size_t SceneStore::cullFrustum(const float planes[6][4])
+{
+	found.clear();
+	size_t numFound = hierarchy.queryFrustum(planes, &found);
+	for (size_t i = 0; i < numFound; i++)
+		flags[indices[found[i]]] |= ENTITY_VISIBLE;
+	return numFound;
+}
+
+void SceneStore::cullOccluded(const OcclusionCuller &culler, const float *viewProj, size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++) {
+		if ((flags[i] & (ENTITY_BOUNDED | ENTITY_VISIBLE)) != (ENTITY_BOUNDED | ENTITY_VISIBLE))
+			continue;
+
+		// The box is tested in model space so it stays tight under any world matrix
+		const float *world = worldMatrices[i].m;
+		float modelToClip[16];
+		for (int r = 0; r < 4; r++)
+			for (int c = 0; c < 4; c++)
+				modelToClip[r * 4 + c] = world[r * 4] * viewProj[c] + world[r * 4 + 1] * viewProj[4 + c] + world[r * 4 + 2] * viewProj[8 + c]
+					+ world[r * 4 + 3] * viewProj[12 + c];
+		if (culler.isOccluded(localBoxes[i].min, localBoxes[i].max, modelToClip))
+			flags[i] = (flags[i] & ~ENTITY_VISIBLE) | ENTITY_OCCLUDED;
+	}
+}
+
+
+size_t SceneStore::gather(uint32_t entityFlags, vector<uint32_t> *entityIndices) const
+{
+	size_t numGathered = 0;
+	for (size_t i = 0; i < flags.size(); i++) {
+		if ((flags[i] & entityFlags) == entityFlags) {
+			entityIndices->push_back((uint32_t)i);
+			numGathered++;
+		}
+	}
+	return numGathered;
+}
+
+void SceneStore::sortByMaterial(vector<uint32_t> *entityIndices) const
+{
+	const vector<uint32_t> &entityMaterials = materials, &entityMeshes = meshes;
+	sort(entityIndices->begin(), entityIndices->end(), [&](uint32_t a, uint32_t b) {
+		if (entityMaterials[a] != entityMaterials[b])
+			return entityMaterials[a] < entityMaterials[b];
+		if (entityMeshes[a] != entityMeshes[b])
+			return entityMeshes[a] < entityMeshes[b];
+		return a < b;
+	});
+}
+
+void SceneStore::reportData() const
+{
+	size_t numBounded = 0, numVisible = 0, numOccluded = 0;
+	for (size_t i = 0; i < flags.size(); i++) {
+		numBounded += (flags[i] & ENTITY_BOUNDED) ? 1 : 0;
+		numVisible += (flags[i] & ENTITY_VISIBLE) ? 1 : 0;
+		numOccluded += (flags[i] & ENTITY_OCCLUDED) ? 1 : 0;
+	}
+	cout << "SceneStore: " << ids.size() << " entities (" << numBounded << " with bounds), " << numVisible << " visible, " << numOccluded << " occluded" << endl;
+	hierarchy.reportData();
+}
+
+
+// Time fn(first, last) over numEntities entities on numThreads threads, each taking an equal range.  Returns the time in milliseconds
+template <typename Function>
+static double timeSystem(size_t numEntities, int numThreads, Function fn)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	if (numThreads <= 1)
+		fn((size_t)0, numEntities);
+	else {
+		vector<thread> threads;
+		for (int t = 0; t < numThreads; t++)
+			threads.push_back(thread(fn, numEntities * t / numThreads, numEntities * (t + 1) / numThreads));
+		for (size_t t = 0; t < threads.size(); t++)
+			threads[t].join();
+	}
+	return chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+}
+
+void benchmarkSceneStore(int numEntities, int iterations)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+	if (numEntities <= 0 || iterations <= 0)
+		return;
+	int numThreads = max((int)thread::hardware_concurrency(), 1);
+
+	int sizes[3] = { max(numEntities / 100, 1), max(numEntities / 10, 1), numEntities };
+	for (int s = 0; s < 3; s++) {
+		size_t n = (size_t)sizes[s];
+
+		// Entities of 1 to 10 units, scaled and turned about y, spread over a region of 2000 x 100 x 2000 like the terrain, with a
+		// few meshes and materials
+		SceneStore store;
+		unsigned int seed = 1;
+		for (size_t i = 0; i < n; i++) {
+			float r[5];
+			for (int k = 0; k < 5; k++) {
+				seed = seed * 1664525u + 1013904223u;
+				r[k] = (seed >> 8) / 16777216.0f;
+			}
+			float scale = 1.0f + 9.0f * r[3], angle = r[4] * 6.2831853f;
+			float world[16] = { scale * cos(angle), 0.0f, -scale * sin(angle), 0.0f, 0.0f, scale, 0.0f, 0.0f, scale * sin(angle), 0.0f, scale * cos(angle), 0.0f,
+				(r[0] - 0.5f) * 2000.0f, r[1] * 100.0f, (r[2] - 0.5f) * 2000.0f, 1.0f };
+			SceneEntity entity = store.create((uint32_t)(i % 16), (uint32_t)(i % 4), 0, world);
+			float boxMin[3] = { -0.5f, 0.0f, -0.5f }, boxMax[3] = { 0.5f, 1.0f, 0.5f };
+			store.setBounds(entity, boxMin, boxMax);
+		}
+
+		// The first frame places every entity and builds the hierarchy
+		double boundsTime = timeSystem(n, 1, [&](size_t first, size_t last) { store.updateBounds(first, last); });
+		BenchmarkClock::time_point start = BenchmarkClock::now();
+		store.refitHierarchy();
+		double buildTime = chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+
+		// Then every entity moves and the world boxes are refitted on every thread, and 1% move and refit their leaves
+		for (size_t i = 0; i < n; i++)
+			store.getFlags()[i] |= ENTITY_MOVED;
+		double boundsThreadedTime = timeSystem(n, numThreads, [&](size_t first, size_t last) { store.updateBounds(first, last); });
+		store.refitHierarchy();
+		size_t numMoving = max(n / 100, (size_t)1);
+		double moveTime = 0.0;
+		for (int it = 0; it < iterations; it++) {
+			start = BenchmarkClock::now();
+			for (size_t i = 0; i < numMoving; i++) {
+				SceneEntity entity = store.getEntity((i * 7919) % n);
+				EntityMatrix world = store.getWorldMatrices()[store.getIndex(entity)];
+				world.m[12] += (it & 1) ? -1.0f : 1.0f;
+				store.setWorldMatrix(entity, world.m);
+			}
+			store.updateBounds(0, n);
+			store.refitHierarchy();
+			moveTime += chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+		}
+
+		// Cull to a 500 unit square in the middle of the region and gather the visible entities in draw order
+		float planes[6][4] = { { 1, 0, 0, 250 }, { -1, 0, 0, 250 }, { 0, 1, 0, 1000 }, { 0, -1, 0, 1000 }, { 0, 0, 1, 250 }, { 0, 0, -1, 250 } };
+		vector<uint32_t> visible;
+		visible.reserve(n);
+		double beginTime = 0.0, frustumTime = 0.0, gatherTime = 0.0, sortTime = 0.0;
+		for (int it = 0; it < iterations; it++) {
+			beginTime += timeSystem(n, 1, [&](size_t first, size_t last) { store.beginCull(first, last); });
+			start = BenchmarkClock::now();
+			store.cullFrustum(planes);
+			frustumTime += chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+			visible.clear();
+			start = BenchmarkClock::now();
+			store.gather(ENTITY_VISIBLE, &visible);
+			gatherTime += chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+			start = BenchmarkClock::now();
+			store.sortByMaterial(&visible);
+			sortTime += chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+		}
+
+		cout << "SceneStore: " << n << " entities - bounds = " << boundsTime << " ms (" << boundsThreadedTime << " ms on " << numThreads
+			<< " threads), hierarchy build = " << buildTime << " ms, " << numMoving << " moving = " << moveTime / iterations << " ms per frame" << endl;
+		cout << "  Culling: begin = " << beginTime / iterations << " ms, frustum = " << frustumTime / iterations << " ms (" << visible.size()
+			<< " visible), gather = " << gatherTime / iterations << " ms, sort = " << sortTime / iterations << " ms" << endl;
+	}
+}
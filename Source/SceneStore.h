@@ -0,0 +1,109 @@
+//
+// SceneStore.h
+//
+
+// Data oriented store of the scene's entities.  Each component is kept in its own contiguous array - world matrices, model space and
+// world space boxes, mesh and material handles and flags - with one element per entity, so a system that needs only some of the
+// components reads just those arrays from start to end.  Entities are packed densely: destroy() moves the last entity into the gap, so
+// an entity's index into the arrays can change while its SceneEntity id stays the same.  Mesh and material handles are the caller's -
+// the scene uses them as indices into its tables of models and effects.
+//
+// The systems work on a range [first, last) of indices so they can be spread across threads like the tiles of OcclusionCuller, and
+// different ranges are safe to run in parallel.  updateBounds() refits the world boxes of the entities that have moved and
+// refitHierarchy() keeps a SceneBVH over the world boxes (its objects are entity ids) in step with them; the culling systems then leave
+// ENTITY_VISIBLE set on the entities inside the frustum and not behind the occluders.  Only the CPU is used.
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <SceneBVH.h>
+#include <OcclusionCuller.h>
+
+typedef uint32_t SceneEntity;
+#define SCENE_ENTITY_NONE 0xffffffff
+
+// Flags kept by the store
+#define ENTITY_BOUNDED		0x01 // Has a model space box (setBounds()).  Entities without one are never culled
+#define ENTITY_MOVED		0x02 // World matrix or box set since the last refitHierarchy()
+#define ENTITY_VISIBLE		0x04 // Left by the culling systems this frame
+#define ENTITY_OCCLUDED		0x08 // Inside the frustum but behind the occluders
+// Flags for the caller's systems
+#define ENTITY_OCCLUDER		0x10 // Rasterised as an occluder
+#define ENTITY_LOD			0x20 // Level of detail chosen by size on screen
+#define ENTITY_CLUSTERS		0x40 // Culled a cluster at a time
+#define ENTITY_TRANSPARENT	0x80 // Blended - drawn after the other entities
+
+// 16 floats, row major, row vectors as DirectXMath (the layout of XMFLOAT4X4)
+struct EntityMatrix {
+	float								m[16];
+};
+
+class SceneStore {
+
+	// Components, one element per entity
+	std::vector<SceneEntity>			ids;
+	std::vector<EntityMatrix>			worldMatrices;
+	std::vector<BVHBox>					localBoxes;
+	std::vector<BVHBox>					worldBoxes;
+	std::vector<uint32_t>				meshes;
+	std::vector<uint32_t>				materials;
+	std::vector<uint32_t>				flags;
+	std::vector<int32_t>				proxies; // Leaf in hierarchy, -1 until the entity has a world box
+
+	// Index of each entity id, or the next free id while the id is free
+	std::vector<uint32_t>				indices;
+	uint32_t							freeIds = SCENE_ENTITY_NONE;
+
+	SceneBVH							hierarchy;
+	std::vector<uint32_t>				found; // Scratch for cullFrustum()
+
+public:
+
+	// Add an entity placed by world (16 floats, identity if null) and return its id
+	SceneEntity create(uint32_t mesh, uint32_t material, uint32_t entityFlags = 0, const float *world = nullptr);
+	void destroy(SceneEntity entity);
+
+	size_t getNumEntities() const { return ids.size(); };
+	uint32_t getIndex(SceneEntity entity) const { return indices[entity]; };
+	SceneEntity getEntity(size_t index) const { return ids[index]; };
+
+	void setWorldMatrix(SceneEntity entity, const float *world);
+	// Set the model space box of an entity and mark it ENTITY_BOUNDED
+	void setBounds(SceneEntity entity, const float boxMin[3], const float boxMax[3]);
+
+	// The component arrays, indexed by getIndex()
+	const EntityMatrix *getWorldMatrices() const { return worldMatrices.data(); };
+	const BVHBox *getLocalBoxes() const { return localBoxes.data(); };
+	const BVHBox *getWorldBoxes() const { return worldBoxes.data(); };
+	const uint32_t *getMeshes() const { return meshes.data(); };
+	const uint32_t *getMaterials() const { return materials.data(); };
+	const uint32_t *getFlags() const { return flags.data(); };
+	uint32_t *getFlags() { return flags.data(); };
+
+	// Refit the world boxes of the moved entities in [first, last)
+	void updateBounds(size_t first, size_t last);
+	// Insert the moved entities into the hierarchy or refit their leaves, and clear ENTITY_MOVED.  Single threaded, after updateBounds()
+	void refitHierarchy();
+	const SceneBVH &getHierarchy() const { return hierarchy; };
+
+	// Clear ENTITY_VISIBLE and ENTITY_OCCLUDED of the bounded entities in [first, last) and set ENTITY_VISIBLE on the rest
+	void beginCull(size_t first, size_t last);
+	// Set ENTITY_VISIBLE on the bounded entities whose world boxes are not wholly outside one of planes (as ClusterCullView::planes),
+	// found through the hierarchy.  Single threaded, after beginCull().  Returns the number found
+	size_t cullFrustum(const float planes[6][4]);
+	// Test the model space boxes of the visible entities in [first, last) against the occluders rasterised by culler, seen through
+	// viewProj (16 floats as EntityMatrix), and move the ones behind them from ENTITY_VISIBLE to ENTITY_OCCLUDED
+	void cullOccluded(const OcclusionCuller &culler, const float *viewProj, size_t first, size_t last);
+
+	// Append the indices of the entities with every one of entityFlags set.  Returns the number appended
+	size_t gather(uint32_t entityFlags, std::vector<uint32_t> *entityIndices) const;
+	// Order entity indices by material then mesh, so entities drawn the same way are drawn together
+	void sortByMaterial(std::vector<uint32_t> *entityIndices) const;
+
+	void reportData() const;
+};
+
+// Time the systems over numEntities random entities (and 1% and 10% of them), single threaded and, for updateBounds(), on every
+// hardware thread.  Reports the times to the console
+void benchmarkSceneStore(int numEntities = 100000, int iterations = 20);
@@ -0,0 +1,371 @@
+#include "stdafx.h"
+#include "ShaderPack.h"
+#include <Utils.h>
+#include <algorithm>
+
+using namespace std;
+
+ShaderPack *ShaderPack::defaultPack = nullptr;
+
+
+ShaderPack *ShaderPack::getDefault()
+{
+	if (!defaultPack)
+		defaultPack = createLoose();
+	return defaultPack;
+}
+
+void ShaderPack::setDefault(ShaderPack *pack)
+{
+	defaultPack = pack;
+}
+
+ShaderPack *ShaderPack::createLoose()
+{
+	return new ShaderPack();
+}
+
+ShaderPack *ShaderPack::open(const char *packFilename)
+{
+	ShaderPack *pack = new ShaderPack();
+
+	HRESULT hr = pack->mapPack(packFilename);
+	if (!SUCCEEDED(hr))
+		cout << "ShaderPack: cannot open " << packFilename << ", loading .cso files" << endl;
+	return pack;
+}
+
+HRESULT ShaderPack::update(const char *packFilename, const char *csoDirectory)
+{
+	if (!packOutOfDate(packFilename, csoDirectory))
+		return S_OK;
+	return build(packFilename, csoDirectory);
+}
+
+// FNV-1a
+uint64_t ShaderPack::hashBytecode(const void *bytecode, SIZE_T size)
+{
+	const uint8_t *p = (const uint8_t*)bytecode;
+	uint64_t hash = 14695981039346656037ULL;
+	for (SIZE_T i = 0; i < size; i++) {
+		hash ^= p[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+string ShaderPack::normaliseName(const char *filename)
+{
+	string name(filename ? filename : "");
+	for (size_t i = 0; i < name.size(); i++) {
+		if (name[i] == '/')
+			name[i] = '\\';
+		else
+			name[i] = (char)tolower((unsigned char)name[i]);
+	}
+	return name;
+}
+
+bool ShaderPack::packOutOfDate(const char *packFilename, const char *csoDirectory)
+{
+	WIN32_FILE_ATTRIBUTE_DATA packData;
+	if (!GetFileAttributesExA(packFilename, GetFileExInfoStandard, &packData))
+		return true;
+
+	bool outOfDate = false;
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((string(csoDirectory) + "*.cso").c_str(), &findData);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			if (CompareFileTime(&findData.ftLastWriteTime, &packData.ftLastWriteTime) > 0)
+				outOfDate = true;
+		} while (!outOfDate && FindNextFileA(find, &findData));
+		FindClose(find);
+	}
+	return outOfDate;
+}
+
+HRESULT ShaderPack::build(const char *packFilename, const char *csoDirectory)
+{
+	vector<PackEntry> entries;
+	vector<PackBlob> packBlobs;
+	vector<char*> blobData;
+
+	// Collect the unique blobs
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA((string(csoDirectory) + "*.cso").c_str(), &findData);
+	if (find == INVALID_HANDLE_VALUE)
+		return E_FAIL;
+
+	uint32_t offset = 0;
+	do {
+		string name = normaliseName((string(csoDirectory) + findData.cFileName).c_str());
+		if (name.size() >= packNameLength) {
+			cout << "ShaderPack: name too long for pack, " << name << " will be loaded from file" << endl;
+			continue;
+		}
+
+		char *bytecode = nullptr;
+		uint32_t size = 0;
+		try {
+			size = LoadShader(name.c_str(), &bytecode);
+		}
+		catch (exception &) {
+			continue;
+		}
+		uint64_t hash = hashBytecode(bytecode, size);
+
+		uint32_t blob = (uint32_t)packBlobs.size();
+		for (uint32_t i = 0; i < packBlobs.size(); i++)
+			if (packBlobs[i].hash == hash && packBlobs[i].size == size && memcmp(blobData[i], bytecode, size) == 0)
+				blob = i;
+
+		if (blob == packBlobs.size()) {
+			PackBlob packBlob;
+			packBlob.hash = hash;
+			packBlob.offset = offset;
+			packBlob.size = size;
+			packBlobs.push_back(packBlob);
+			blobData.push_back(bytecode);
+			offset += (size + 15) & ~15;
+		}
+		else
+			free(bytecode);
+
+		PackEntry entry;
+		ZeroMemory(&entry, sizeof(PackEntry));
+		strncpy_s(entry.name, name.c_str(), packNameLength - 1);
+		entry.blob = blob;
+		entries.push_back(entry);
+
+	} while (FindNextFileA(find, &findData));
+	FindClose(find);
+
+	// Write header, TOC and data.  Blob offsets are relative to the start of the (16 byte aligned) data section
+	PackHeader header;
+	header.magic = packMagic;
+	header.version = packVersion;
+	header.numEntries = (uint32_t)entries.size();
+	header.numBlobs = (uint32_t)packBlobs.size();
+
+	size_t tocBytes = sizeof(PackHeader) + sizeof(PackEntry) * entries.size() + sizeof(PackBlob) * packBlobs.size();
+	size_t dataStart = (tocBytes + 15) & ~15;
+	static const char padding[16] = { 0 };
+
+	HRESULT hr = S_OK;
+	ofstream out(packFilename, ios::out | ios::binary | ios::trunc);
+	if (out.is_open()) {
+		out.write((const char*)&header, sizeof(PackHeader));
+		if (!entries.empty())
+			out.write((const char*)&entries[0], sizeof(PackEntry) * entries.size());
+		if (!packBlobs.empty())
+			out.write((const char*)&packBlobs[0], sizeof(PackBlob) * packBlobs.size());
+		out.write(padding, dataStart - tocBytes);
+		for (size_t i = 0; i < packBlobs.size(); i++) {
+			out.write(blobData[i], packBlobs[i].size);
+			out.write(padding, ((packBlobs[i].size + 15) & ~15) - packBlobs[i].size);
+		}
+		if (!out.good())
+			hr = E_FAIL;
+		out.close();
+	}
+	else
+		hr = E_FAIL;
+
+	for (size_t i = 0; i < blobData.size(); i++)
+		free(blobData[i]);
+
+	cout << "ShaderPack: built " << packFilename << " (" << entries.size() << " shaders, " << packBlobs.size() << " unique)" << endl;
+	return hr;
+}
+
+HRESULT ShaderPack::mapPack(const char *packFilename)
+{
+	file = CreateFileA(packFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return E_FAIL;
+
+	LARGE_INTEGER fileSize;
+	if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart >= (LONGLONG)sizeof(PackHeader))
+		mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping)
+		view = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!view) {
+		unmapPack();
+		return E_FAIL;
+	}
+
+	// Validate the whole table of contents against the file size before trusting any offsets, so a damaged pack leaves no blobs
+	// pointing into it
+	const PackHeader *header = (const PackHeader*)view;
+	bool valid = header->magic == packMagic && header->version == packVersion;
+	size_t tocBytes = sizeof(PackHeader) + sizeof(PackEntry) * (size_t)header->numEntries + sizeof(PackBlob) * (size_t)header->numBlobs;
+	size_t dataStart = (tocBytes + 15) & ~15;
+	valid = valid && (LONGLONG)dataStart <= fileSize.QuadPart;
+
+	const PackEntry *entries = (const PackEntry*)(view + sizeof(PackHeader));
+	const PackBlob *packBlobs = (const PackBlob*)(entries + header->numEntries);
+	for (uint32_t i = 0; valid && i < header->numBlobs; i++)
+		valid = (LONGLONG)(dataStart + packBlobs[i].offset + packBlobs[i].size) <= fileSize.QuadPart;
+	for (uint32_t i = 0; valid && i < header->numEntries; i++)
+		valid = entries[i].blob < header->numBlobs;
+	if (!valid) {
+		unmapPack();
+		return E_FAIL;
+	}
+
+	lock_guard<mutex> guard(lock);
+	vector<int> packToBlob(header->numBlobs);
+	for (uint32_t i = 0; i < header->numBlobs; i++)
+		packToBlob[i] = addBlob(packBlobs[i].hash, view + dataStart + packBlobs[i].offset, packBlobs[i].size, nullptr);
+	for (uint32_t i = 0; i < header->numEntries; i++) {
+		string name(entries[i].name, strnlen(entries[i].name, packNameLength));
+		nameToBlob[name] = packToBlob[entries[i].blob];
+	}
+
+	return S_OK;
+}
+
+void ShaderPack::unmapPack()
+{
+	if (view)
+		UnmapViewOfFile(view);
+	if (mapping)
+		CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+	view = nullptr;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+}
+
+int ShaderPack::addBlob(uint64_t hash, const void *bytecode, SIZE_T size, char *ownedBytecode)
+{
+	// Share identical bytecode
+	for (size_t i = 0; i < blobs.size(); i++) {
+		if (blobs[i].hash == hash && blobs[i].size == size && memcmp(blobs[i].bytecode, bytecode, size) == 0) {
+			if (ownedBytecode)
+				free(ownedBytecode);
+			return (int)i;
+		}
+	}
+
+	Blob blob;
+	blob.hash = hash;
+	blob.bytecode = bytecode;
+	blob.size = size;
+	blob.ownedBytecode = ownedBytecode;
+	blobs.push_back(blob);
+	return (int)blobs.size() - 1;
+}
+
+int ShaderPack::findBlob(const char *filename)
+{
+	numLookups++;
+	string name = normaliseName(filename);
+
+	map<string, int>::iterator i = nameToBlob.find(name);
+	if (i != nameToBlob.end())
+		return i->second;
+
+	// Not in the pack - load the loose file once
+	char *bytecode = nullptr;
+	uint32_t size = 0;
+	try {
+		size = LoadShader(filename, &bytecode);
+	}
+	catch (exception &e) {
+		cout << e.what() << " (" << filename << ")" << endl;
+		return -1;
+	}
+	numFileLoads++;
+
+	int blob = addBlob(hashBytecode(bytecode, size), bytecode, size, bytecode);
+	nameToBlob[name] = blob;
+	return blob;
+}
+
+bool ShaderPack::getBytecode(const char *filename, const void **bytecode, SIZE_T *size)
+{
+	lock_guard<mutex> guard(lock);
+	int blob = findBlob(filename);
+	if (blob < 0)
+		return false;
+
+	if (bytecode)
+		*bytecode = blobs[blob].bytecode;
+	if (size)
+		*size = blobs[blob].size;
+	return true;
+}
+
+template <class T> HRESULT ShaderPack::getShader(const char *filename, T **shader, const void **bytecode, SIZE_T *size, const function<HRESULT(const void*, SIZE_T, T**)> &create)
+{
+	lock_guard<mutex> guard(lock);
+	int blob = findBlob(filename);
+	if (blob < 0 || !shader)
+		return E_FAIL;
+
+	Blob &b = blobs[blob];
+	if (!b.shader) {
+		T *newShader = nullptr;
+		HRESULT hr = create(b.bytecode, b.size, &newShader);
+		if (!SUCCEEDED(hr))
+			return hr;
+		b.shader = newShader;
+		numShaderObjects++;
+	}
+
+	*shader = static_cast<T*>(b.shader);
+	(*shader)->AddRef();
+	if (bytecode)
+		*bytecode = b.bytecode;
+	if (size)
+		*size = b.size;
+	return S_OK;
+}
+
+HRESULT ShaderPack::createVertexShader(ID3D11Device *device, const char *filename, ID3D11VertexShader **shader, const void **bytecode, SIZE_T *size)
+{
+	return getShader<ID3D11VertexShader>(filename, shader, bytecode, size, [=](const void *b, SIZE_T s, ID3D11VertexShader **out) { return device->CreateVertexShader(b, s, NULL, out); });
+}
+
+HRESULT ShaderPack::createPixelShader(ID3D11Device *device, const char *filename, ID3D11PixelShader **shader, const void **bytecode, SIZE_T *size)
+{
+	return getShader<ID3D11PixelShader>(filename, shader, bytecode, size, [=](const void *b, SIZE_T s, ID3D11PixelShader **out) { return device->CreatePixelShader(b, s, NULL, out); });
+}
+
+HRESULT ShaderPack::createGeometryShader(ID3D11Device *device, const char *filename, ID3D11GeometryShader **shader, const void **bytecode, SIZE_T *size)
+{
+	return getShader<ID3D11GeometryShader>(filename, shader, bytecode, size, [=](const void *b, SIZE_T s, ID3D11GeometryShader **out) { return device->CreateGeometryShader(b, s, NULL, out); });
+}
+
+HRESULT ShaderPack::createHullShader(ID3D11Device *device, const char *filename, ID3D11HullShader **shader, const void **bytecode, SIZE_T *size)
+{
+	return getShader<ID3D11HullShader>(filename, shader, bytecode, size, [=](const void *b, SIZE_T s, ID3D11HullShader **out) { return device->CreateHullShader(b, s, NULL, out); });
+}
+
+HRESULT ShaderPack::createDomainShader(ID3D11Device *device, const char *filename, ID3D11DomainShader **shader, const void **bytecode, SIZE_T *size)
+{
+	return getShader<ID3D11DomainShader>(filename, shader, bytecode, size, [=](const void *b, SIZE_T s, ID3D11DomainShader **out) { return device->CreateDomainShader(b, s, NULL, out); });
+}
+
+void ShaderPack::reportData() const
+{
+	lock_guard<mutex> guard(lock);
+	cout << "ShaderPack: " << nameToBlob.size() << " shaders, " << blobs.size() << " unique blobs" << (view ? " (mapped)" : " (loose files)") << endl;
+	cout << "Lookups = " << numLookups << ", File loads = " << numFileLoads << ", Shader objects = " << numShaderObjects << endl;
+}
+
+ShaderPack::~ShaderPack()
+{
+	for (size_t i = 0; i < blobs.size(); i++) {
+		if (blobs[i].shader)
+			blobs[i].shader->Release();
+		if (blobs[i].ownedBytecode)
+			free(blobs[i].ownedBytecode);
+	}
+	unmapPack();
+	if (defaultPack == this)
+		defaultPack = nullptr;
+}
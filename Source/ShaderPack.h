@@ -0,0 +1,119 @@
+//
+// ShaderPack.h
+//
+
+// Shader bytecode library.  Compiled shaders (.cso) are packed into a single file holding a table of contents (shader name -> blob)
+// and the unique bytecode blobs, identified by a 64 bit content hash.  The pack is memory mapped once and lookups return pointers
+// straight into the mapping.  Shader objects are created once per unique blob and shared, so identical bytecode loaded under
+// different names (or by several effects) creates a single D3D shader object.  Shaders not found in the pack (or all shaders if no
+// pack exists) are loaded from their .cso file once and kept, so they are deduplicated in the same way.  Lookups are serialised by a
+// lock, as shaders are also loaded by the shader reloader's thread and the recording threads.
+#pragma once
+
+#include <d3d11_2.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <mutex>
+
+class ShaderPack {
+
+	static const uint32_t					packMagic = 0x4B415053; // 'SPAK'
+	static const uint32_t					packVersion = 1;
+	static const int						packNameLength = 60;
+
+	// On disk layout: PackHeader, PackEntry[numEntries], PackBlob[numBlobs], bytecode (each blob 16 byte aligned)
+	struct PackHeader {
+		uint32_t							magic;
+		uint32_t							version;
+		uint32_t							numEntries;
+		uint32_t							numBlobs;
+	};
+	struct PackEntry {
+		// Normalised shader path (lower case, '\' separators) eg. shaders\cso\basic_colour_ps.cso
+		char								name[packNameLength];
+		uint32_t							blob;
+	};
+	struct PackBlob {
+		uint64_t							hash;
+		uint32_t							offset;
+		uint32_t							size;
+	};
+
+	// Unique bytecode blob and the shader object created from it (if any)
+	struct Blob {
+		uint64_t							hash = 0;
+		const void							*bytecode = nullptr;
+		SIZE_T								size = 0;
+		// Set for blobs loaded from loose .cso files (freed with the pack), nullptr for blobs in the mapping
+		char								*ownedBytecode = nullptr;
+		ID3D11DeviceChild					*shader = nullptr;
+	};
+
+	// Memory mapped pack file
+	HANDLE									file = INVALID_HANDLE_VALUE;
+	HANDLE									mapping = NULL;
+	const uint8_t							*view = nullptr;
+
+	// blobs, nameToBlob and the statistics are guarded by lock
+	mutable std::mutex						lock;
+	std::vector<Blob>						blobs;
+	std::map<std::string, int>				nameToBlob;
+
+	// Statistics
+	UINT									numLookups = 0;
+	UINT									numFileLoads = 0;
+	UINT									numShaderObjects = 0;
+
+	static ShaderPack						*defaultPack;
+
+	ShaderPack() {};
+	// Map the pack and validate its whole table of contents before publishing any of its blobs.  A pack that fails is unmapped
+	HRESULT mapPack(const char *packFilename);
+	void unmapPack();
+	// Return the blob index for the given shader, loading the .cso if it is not already known.  Returns -1 on failure.  Called
+	// with lock held
+	int findBlob(const char *filename);
+	int addBlob(uint64_t hash, const void *bytecode, SIZE_T size, char *ownedBytecode);
+
+	// Find or create the shader object for a blob.  create is only called the first time a blob is used
+	template <class T> HRESULT getShader(const char *filename, T **shader, const void **bytecode, SIZE_T *size, const std::function<HRESULT(const void*, SIZE_T, T**)> &create);
+
+	static std::string normaliseName(const char *filename);
+	static bool packOutOfDate(const char *packFilename, const char *csoDirectory);
+
+public:
+
+	~ShaderPack();
+
+	// Open a pack written by build() (see the -buildshaders step in main.cpp).  The pack is never rebuilt at runtime; if it cannot
+	// be mapped the returned ShaderPack loads shaders from their .cso files
+	static ShaderPack *open(const char *packFilename);
+	// Open a pack that only loads loose .cso files
+	static ShaderPack *createLoose();
+	// Write a pack containing every .cso file in csoDirectory
+	static HRESULT build(const char *packFilename, const char *csoDirectory);
+	// Rebuild the pack if it is missing or older than any .cso file in csoDirectory
+	static HRESULT update(const char *packFilename, const char *csoDirectory);
+
+	// Pack used by Effect and other shader loading code.  A loose pack is created on first use if none has been set
+	static ShaderPack *getDefault();
+	static void setDefault(ShaderPack *pack);
+
+	// Zero-copy bytecode lookup.  The returned pointer is valid for the lifetime of the pack
+	bool getBytecode(const char *filename, const void **bytecode, SIZE_T *size);
+
+	// Shared shader objects.  The caller receives a reference (AddRef'd) and must Release it.  bytecode and size are optional and
+	// return the blob (eg. for CreateInputLayout)
+	HRESULT createVertexShader(ID3D11Device *device, const char *filename, ID3D11VertexShader **shader, const void **bytecode = nullptr, SIZE_T *size = nullptr);
+	HRESULT createPixelShader(ID3D11Device *device, const char *filename, ID3D11PixelShader **shader, const void **bytecode = nullptr, SIZE_T *size = nullptr);
+	HRESULT createGeometryShader(ID3D11Device *device, const char *filename, ID3D11GeometryShader **shader, const void **bytecode = nullptr, SIZE_T *size = nullptr);
+	HRESULT createHullShader(ID3D11Device *device, const char *filename, ID3D11HullShader **shader, const void **bytecode = nullptr, SIZE_T *size = nullptr);
+	HRESULT createDomainShader(ID3D11Device *device, const char *filename, ID3D11DomainShader **shader, const void **bytecode = nullptr, SIZE_T *size = nullptr);
+
+	void reportData() const;
+
+	static uint64_t hashBytecode(const void *bytecode, SIZE_T size);
+};
@@ -0,0 +1,140 @@
+#include "stdafx.h"
+#include "ShaderPermutations.h"
+#include <fstream>
+
+using namespace std;
+
+
+// Permutation families and the features each reads
+const ShaderPermutations::Family ShaderPermutations::families[] = {
+	{ "lit_vs", "vs_5_0", SHADER_FEATURE_INSTANCING | SHADER_FEATURE_WIND | SHADER_FEATURE_COMPRESSED_VERTEX },
+	{ "lit_ps", "ps_5_0", SHADER_FEATURE_TEXTURE | SHADER_FEATURE_ALPHA_TEST | SHADER_FEATURE_POSITIONAL_LIGHT | SHADER_FEATURE_SPECULAR | SHADER_FEATURE_FOG }
+};
+const int ShaderPermutations::numFamilies = ARRAYSIZE(families);
+
+// Define for each feature bit (bit i -> featureDefines[i])
+const char *ShaderPermutations::featureDefines[] = {
+	"FEATURE_TEXTURE",
+	"FEATURE_ALPHA_TEST",
+	"FEATURE_POSITIONAL_LIGHT",
+	"FEATURE_SPECULAR",
+	"FEATURE_FOG",
+	"FEATURE_INSTANCING",
+	"FEATURE_WIND",
+	"FEATURE_COMPRESSED_VERTEX"
+};
+const int ShaderPermutations::numFeatures = ARRAYSIZE(featureDefines);
+
+
+const ShaderPermutations::Family *ShaderPermutations::findFamily(const string &name)
+{
+	for (int i = 0; i < numFamilies; i++)
+		if (name == families[i].name)
+			return &families[i];
+	return nullptr;
+}
+
+string ShaderPermutations::variantName(const char *family, UINT features, const char *csoDirectory)
+{
+	const Family *f = findFamily(family);
+	if (f)
+		features &= f->features;
+	char suffix[16];
+	sprintf_s(suffix, sizeof(suffix), "_%02x.cso", features);
+	return string(csoDirectory) + family + suffix;
+}
+
+const ShaderPermutations::Family *ShaderPermutations::parseVariantName(const string &csoPath, UINT *features)
+{
+	// <directory>\<family>_<hex>.cso
+	size_t start = csoPath.find_last_of("\\/");
+	start = (start == string::npos) ? 0 : start + 1;
+	size_t dot = csoPath.find_last_of('.');
+	size_t underscore = csoPath.find_last_of('_');
+	if (dot == string::npos || underscore == string::npos || underscore < start || dot < underscore)
+		return nullptr;
+
+	const Family *family = findFamily(csoPath.substr(start, underscore - start));
+	if (!family)
+		return nullptr;
+
+	string hex = csoPath.substr(underscore + 1, dot - underscore - 1);
+	if (hex.empty() || hex.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+		return nullptr;
+	*features = (UINT)strtoul(hex.c_str(), nullptr, 16) & family->features;
+	return family;
+}
+
+vector<string> ShaderPermutations::defines(UINT features)
+{
+	vector<string> d;
+	for (int i = 0; i < numFeatures; i++)
+		if (features & (1u << i))
+			d.push_back(featureDefines[i]);
+	return d;
+}
+
+
+// Newest last write time of the files matching pattern (0 if none)
+static ULONGLONG newestFileTime(const string &pattern)
+{
+	ULONGLONG newest = 0;
+	WIN32_FIND_DATAA findData;
+	HANDLE find = FindFirstFileA(pattern.c_str(), &findData);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			ULONGLONG t = ((ULONGLONG)findData.ftLastWriteTime.dwHighDateTime << 32) | findData.ftLastWriteTime.dwLowDateTime;
+			if (t > newest)
+				newest = t;
+		} while (FindNextFileA(find, &findData));
+		FindClose(find);
+	}
+	return newest;
+}
+
+HRESULT ShaderPermutations::build(const char *hlslDirectory, const char *csoDirectory, const ShaderReloader::CompileFn &compile)
+{
+	// Variants depend on their family source and shared includes, so any newer source file rebuilds them
+	ULONGLONG newestSource = max(newestFileTime(string(hlslDirectory) + "*.hlsl"), newestFileTime(string(hlslDirectory) + "*.hlsli"));
+
+	HRESULT result = S_OK;
+	int numCompiled = 0;
+	int numVariants = 0;
+
+	for (int i = 0; i < numFamilies; i++) {
+
+		const Family &family = families[i];
+		string source = string(hlslDirectory) + family.name + ".hlsl";
+
+		// Enumerate every subset of the family's feature bits
+		UINT subset = 0;
+		do {
+			numVariants++;
+			string cso = variantName(family.name, subset, csoDirectory);
+
+			WIN32_FILE_ATTRIBUTE_DATA csoData;
+			bool upToDate = GetFileAttributesExA(cso.c_str(), GetFileExInfoStandard, &csoData) &&
+				(((ULONGLONG)csoData.ftLastWriteTime.dwHighDateTime << 32) | csoData.ftLastWriteTime.dwLowDateTime) >= newestSource;
+
+			if (!upToDate) {
+				vector<char> bytecode;
+				string errors;
+				HRESULT hr = compile(source, family.profile, defines(subset), bytecode, errors);
+				if (SUCCEEDED(hr) && !bytecode.empty()) {
+					ofstream out(cso, ios::binary);
+					out.write(&bytecode[0], bytecode.size());
+					numCompiled++;
+				}
+				else {
+					cout << "ShaderPermutations: " << cso << " failed to compile" << endl << errors << endl;
+					result = E_FAIL;
+				}
+			}
+			subset = (subset - family.features) & family.features;
+		} while (subset != 0);
+	}
+
+	if (numCompiled)
+		cout << "ShaderPermutations: compiled " << numCompiled << " of " << numVariants << " variants" << endl;
+	return result;
+}
@@ -0,0 +1,62 @@
+//
+// ShaderPermutations.h
+//
+
+// Shader permutations.  A permutation family is one HLSL source (eg. lit_ps.hlsl) whose optional features are selected at compile
+// time with FEATURE_* defines rather than with runtime branches.  build() compiles every combination of a family's feature bits to
+// its own .cso (<family>_<features in hex>.cso), and only recompiles variants older than the shader sources.  It is run offline by
+// the -buildshaders post-build step, which then writes the shader pack.  At runtime a feature mask selects the variant through
+// variantName(), which is then loaded like any other shader (through the ShaderPack).  Feature bits are shared by all families so one mask can select both the vertex and pixel shader of an effect.
+#pragma once
+
+#include <d3d11_2.h>
+#include <string>
+#include <vector>
+#include <ShaderReloader.h>
+
+// Feature bits.  Keep in step with Shaders\hlsl\shader_features.hlsli
+enum ShaderFeature {
+	SHADER_FEATURE_TEXTURE = 0x01,				// Sample the diffuse texture instead of the material colour
+	SHADER_FEATURE_ALPHA_TEST = 0x02,			// Discard fragments with alpha < 0.9
+	SHADER_FEATURE_POSITIONAL_LIGHT = 0x04,		// Light is a point light (lightVec.w = 1)
+	SHADER_FEATURE_SPECULAR = 0x08,				// Add the specular term
+	SHADER_FEATURE_FOG = 0x10,					// Linear distance fog
+	SHADER_FEATURE_INSTANCING = 0x20,			// World matrix from the per instance stream (extInstancedVertexDesc)
+	SHADER_FEATURE_WIND = 0x40,					// Vertices sway in the wind
+	SHADER_FEATURE_COMPRESSED_VERTEX = 0x80		// CompressedVertexStruct input (compressedVertexDesc)
+};
+
+class ShaderPermutations {
+
+public:
+
+	struct Family {
+		const char							*name; // Source is <name>.hlsl
+		const char							*profile;
+		UINT								features; // Feature bits the family reads
+	};
+
+private:
+
+	static const Family						families[];
+	static const int						numFamilies;
+	static const char						*featureDefines[];
+	static const int						numFeatures;
+
+public:
+
+	static const Family *findFamily(const std::string &name);
+
+	// .cso path of the variant of family with the given features.  Bits the family does not read are dropped
+	static std::string variantName(const char *family, UINT features, const char *csoDirectory = "Shaders\\cso\\");
+
+	// Family and features of a variant .cso path.  Returns nullptr if the path is not a permutation variant
+	static const Family *parseVariantName(const std::string &csoPath, UINT *features);
+
+	// FEATURE_* define names for the bits set in features
+	static std::vector<std::string> defines(UINT features);
+
+	// Compile the variants of every family that are missing or older than any .hlsl / .hlsli file in hlslDirectory.  Returns E_FAIL
+	// if any variant fails to compile (the other variants are still written)
+	static HRESULT build(const char *hlslDirectory, const char *csoDirectory, const ShaderReloader::CompileFn &compile = ShaderReloader::compileHLSL);
+};
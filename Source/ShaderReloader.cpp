@@ -0,0 +1,353 @@
+#include "stdafx.h"
+#include "ShaderReloader.h"
+#include <Effect.h>
+#include <StateCache.h>
+#include <ShaderPack.h>
+#include <ShaderPermutations.h>
+#include <d3dcompiler.h>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+
+ShaderReloader::ShaderReloader(ID3D11Device *_device, const char *_hlslDirectory, DWORD _pollInterval, const CompileFn &_compile, const FileTimeFn &_fileTime)
+{
+	device = _device;
+	hlslDirectory = _hlslDirectory;
+	pollInterval = _pollInterval;
+	compile = _compile;
+	fileTime = _fileTime;
+}
+
+ShaderReloader::~ShaderReloader()
+{
+	stop();
+}
+
+
+HRESULT ShaderReloader::compileHLSL(const string &hlslPath, const char *profile, const vector<string> &defines, vector<char> &bytecode, string &errors)
+{
+	UINT flags = D3DCOMPILE_ENABLE_STRICTNESS;
+#if defined(_DEBUG)
+	flags |= D3DCOMPILE_DEBUG;
+#endif
+	ID3DBlob *code = nullptr;
+	ID3DBlob *errorBlob = nullptr;
+	wstring widePath(hlslPath.begin(), hlslPath.end());
+
+	// Null terminated macro list
+	vector<D3D_SHADER_MACRO> macros;
+	for (size_t i = 0; i < defines.size(); i++) {
+		D3D_SHADER_MACRO m = { defines[i].c_str(), "1" };
+		macros.push_back(m);
+	}
+	D3D_SHADER_MACRO end = { nullptr, nullptr };
+	macros.push_back(end);
+
+	HRESULT hr = D3DCompileFromFile(widePath.c_str(), &macros[0], D3D_COMPILE_STANDARD_FILE_INCLUDE, "main", profile, flags, 0, &code, &errorBlob);
+
+	if (errorBlob) {
+		errors.assign((const char*)errorBlob->GetBufferPointer(), errorBlob->GetBufferSize());
+		errorBlob->Release();
+	}
+	if (code) {
+		const char *p = (const char*)code->GetBufferPointer();
+		bytecode.assign(p, p + code->GetBufferSize());
+		code->Release();
+	}
+	return hr;
+}
+
+bool ShaderReloader::lastWriteTime(const string &path, uint64_t *writeTime)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+	*writeTime = ((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+	return true;
+}
+
+const char *ShaderReloader::profileForStage(Stage stage)
+{
+	switch (stage) {
+	case VertexStage: return "vs_5_0";
+	case PixelStage: return "ps_5_0";
+	default: return "gs_5_0";
+	}
+}
+
+
+void ShaderReloader::findDependencies(const string &source, vector<string> &dependencies) const
+{
+	if (find(dependencies.begin(), dependencies.end(), source) != dependencies.end())
+		return;
+	dependencies.push_back(source);
+
+	ifstream file(source);
+	if (!file.is_open())
+		return;
+
+	size_t slash = source.find_last_of("\\/");
+	string directory = (slash == string::npos) ? string() : source.substr(0, slash + 1);
+
+	// Look for #include "file" or #include <file>
+	string line;
+	while (getline(file, line)) {
+		size_t p = line.find_first_not_of(" \t");
+		if (p == string::npos || line.compare(p, 8, "#include") != 0)
+			continue;
+		size_t open = line.find_first_of("\"<", p + 8);
+		if (open == string::npos)
+			continue;
+		size_t close = line.find_first_of("\">", open + 1);
+		if (close == string::npos)
+			continue;
+		findDependencies(directory + line.substr(open + 1, close - open - 1), dependencies);
+	}
+}
+
+void ShaderReloader::addSource(const string &csoPath, Stage stage)
+{
+	if (csoPath.empty())
+		return;
+	lock_guard<mutex> guard(lock);
+	if (sources.find(csoPath) != sources.end())
+		return;
+
+	// Permutation variants are compiled from their family source, other shaders from the .hlsl with the same name as the .cso
+	ShaderSource s;
+	UINT features = 0;
+	const ShaderPermutations::Family *family = ShaderPermutations::parseVariantName(csoPath, &features);
+	if (family) {
+		s.file = hlslDirectory + family->name + ".hlsl";
+		s.defines = ShaderPermutations::defines(features);
+	}
+	else {
+		size_t start = csoPath.find_last_of("\\/");
+		start = (start == string::npos) ? 0 : start + 1;
+		size_t end = csoPath.find_last_of('.');
+		if (end == string::npos || end < start)
+			end = csoPath.size();
+		s.file = hlslDirectory + csoPath.substr(start, end - start) + ".hlsl";
+	}
+	s.stage = stage;
+	findDependencies(s.file, s.dependencies);
+	sources[csoPath] = s;
+}
+
+
+void ShaderReloader::watchEffect(Effect *effect)
+{
+	if (!effect)
+		return;
+	WatchedEffect w;
+	w.effect = effect;
+	w.sources[VertexStage] = effect->getVertexShaderPath();
+	w.sources[PixelStage] = effect->getPixelShaderPath();
+	w.sources[GeometryStage] = effect->getGeometryShaderPath();
+	for (int i = 0; i < NumStages; i++)
+		addSource(w.sources[i], (Stage)i);
+	effects.push_back(w);
+}
+
+void ShaderReloader::unwatchEffect(Effect *effect)
+{
+	for (size_t i = 0; i < effects.size(); i++) {
+		if (effects[i].effect == effect) {
+			effects.erase(effects.begin() + i);
+			return;
+		}
+	}
+}
+
+
+void ShaderReloader::poll()
+{
+	// Work on a copy so the render thread can add sources while shaders compile
+	map<string, ShaderSource> current;
+	{
+		lock_guard<mutex> guard(lock);
+		current = sources;
+	}
+
+	// Find the files that changed since the last poll.  Files seen for the first time only record their time
+	set<string> checked;
+	set<string> changed;
+	for (map<string, ShaderSource>::iterator i = current.begin(); i != current.end(); ++i) {
+		for (size_t j = 0; j < i->second.dependencies.size(); j++) {
+			const string &file = i->second.dependencies[j];
+			if (!checked.insert(file).second)
+				continue;
+			uint64_t writeTime;
+			if (!fileTime(file, &writeTime))
+				continue;
+			map<string, uint64_t>::iterator t = fileTimes.find(file);
+			if (t == fileTimes.end())
+				fileTimes[file] = writeTime;
+			else if (t->second != writeTime) {
+				t->second = writeTime;
+				changed.insert(file);
+			}
+		}
+	}
+	if (changed.empty())
+		return;
+
+	// Recompile every shader that depends on a changed file
+	for (map<string, ShaderSource>::iterator i = current.begin(); i != current.end(); ++i) {
+
+		bool dirty = false;
+		for (size_t j = 0; j < i->second.dependencies.size() && !dirty; j++)
+			dirty = changed.count(i->second.dependencies[j]) > 0;
+		if (!dirty)
+			continue;
+
+		// The edit may have added or removed includes
+		const ShaderSource &source = i->second;
+		vector<string> dependencies;
+		findDependencies(source.file, dependencies);
+
+		CompiledShader compiled;
+		compiled.key = i->first;
+		compiled.stage = source.stage;
+		string errors;
+		HRESULT hr = compile(source.file, profileForStage(source.stage), source.defines, compiled.bytecode, errors);
+
+		lock_guard<mutex> guard(lock);
+		sources[i->first].dependencies = dependencies;
+		numCompiles++;
+		if (!SUCCEEDED(hr) || compiled.bytecode.empty()) {
+			numFailedCompiles++;
+			cout << "ShaderReloader: " << i->first << " failed to compile, keeping the current shader" << endl << errors << endl;
+			continue;
+		}
+		cout << "ShaderReloader: recompiled " << i->first << endl;
+
+		// A newer compile of the same shader replaces one that has not been applied yet
+		size_t k = 0;
+		while (k < pending.size() && pending[k].key != compiled.key)
+			k++;
+		if (k < pending.size())
+			pending[k] = compiled;
+		else
+			pending.push_back(compiled);
+	}
+}
+
+void ShaderReloader::watcherMain()
+{
+	unique_lock<mutex> guard(lock);
+	while (!stopRequested) {
+		guard.unlock();
+		poll();
+		guard.lock();
+		wake.wait_for(guard, chrono::milliseconds(pollInterval), [this] { return stopRequested; });
+	}
+}
+
+void ShaderReloader::start()
+{
+	if (watcher.joinable())
+		return;
+	stopRequested = false;
+	watcher = thread(&ShaderReloader::watcherMain, this);
+}
+
+void ShaderReloader::stop()
+{
+	if (!watcher.joinable())
+		return;
+	{
+		lock_guard<mutex> guard(lock);
+		stopRequested = true;
+	}
+	wake.notify_all();
+	watcher.join();
+}
+
+
+int ShaderReloader::applyReloads()
+{
+	vector<CompiledShader> ready;
+	{
+		lock_guard<mutex> guard(lock);
+		ready.swap(pending);
+	}
+	if (ready.empty())
+		return 0;
+
+	StateCache *stateCache = StateCache::getDefault(device);
+	set<Effect*> changedEffects;
+
+	for (size_t i = 0; i < ready.size(); i++) {
+
+		const CompiledShader &c = ready[i];
+		const void *bytecode = &c.bytecode[0];
+		SIZE_T size = c.bytecode.size();
+		uint64_t hash = ShaderPack::hashBytecode(bytecode, size);
+
+		ID3D11VertexShader *VS = nullptr;
+		ID3D11PixelShader *PS = nullptr;
+		ID3D11GeometryShader *GS = nullptr;
+		HRESULT hr = E_FAIL;
+		switch (c.stage) {
+		case VertexStage: hr = device->CreateVertexShader(bytecode, size, nullptr, &VS); break;
+		case PixelStage: hr = device->CreatePixelShader(bytecode, size, nullptr, &PS); break;
+		default: hr = device->CreateGeometryShader(bytecode, size, nullptr, &GS); break;
+		}
+		if (!SUCCEEDED(hr)) {
+			cout << "ShaderReloader: cannot create shader object for " << c.key << endl;
+			continue;
+		}
+
+		for (size_t j = 0; j < effects.size(); j++) {
+
+			WatchedEffect &w = effects[j];
+			if (w.sources[c.stage] != c.key)
+				continue;
+			Effect *effect = w.effect;
+
+			if (c.stage == VertexStage) {
+				// The new shader may have a different input signature so the layout is rebuilt.  Models keep the layout they were
+				// created with, so a changed vertex format still needs a restart
+				ID3D11InputLayout *layout = stateCache->getInputLayout(effect->getVertexDesc(), effect->getNumVertexElements(), bytecode, size);
+				if (!layout) {
+					cout << "ShaderReloader: " << c.key << " does not match the effect's vertex description, keeping the current shader" << endl;
+					continue;
+				}
+				VS->AddRef();
+				effect->setVertexShader(VS, hash);
+				effect->setVSInputLayout(layout, StateCache::hashDesc(effect->getVertexDesc(), effect->getNumVertexElements()));
+			}
+			else if (c.stage == PixelStage) {
+				PS->AddRef();
+				effect->setPixelShader(PS, hash);
+			}
+			else {
+				GS->AddRef();
+				effect->setGeometryShader(GS, hash);
+			}
+			changedEffects.insert(effect);
+			numSwaps++;
+		}
+
+		// Each effect holds its own reference
+		if (VS)
+			VS->Release();
+		if (PS)
+			PS->Release();
+		if (GS)
+			GS->Release();
+	}
+	return (int)changedEffects.size();
+}
+
+
+void ShaderReloader::reportData() const
+{
+	lock_guard<mutex> guard(lock);
+	cout << "ShaderReloader: " << sources.size() << " shaders watched in " << effects.size() << " effects" << endl;
+	cout << "Compiles = " << numCompiles << ", Failed = " << numFailedCompiles << ", Shader swaps = " << numSwaps << endl;
+}
@@ -0,0 +1,124 @@
+//
+// ShaderReloader.h
+//
+
+// Hot shader reload.  A watcher thread polls the HLSL source of every watched effect (and the files they #include) and recompiles
+// a shader off the render thread when it or one of its includes changes.  Shader objects are created, and swapped into the
+// affected Effects, by applyReloads() which the render thread calls at a frame boundary so effects never change while a frame is
+// being recorded.  A failed compile prints the compiler errors and keeps the current shader.  The compiler is passed in as a
+// function so the watching, dependency tracking and swap logic can run with a stub compiler.  Permutation variants (see
+// ShaderPermutations) are recompiled from their family source with the variant's FEATURE_* defines.
+#pragma once
+
+#include <d3d11_2.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class Effect;
+
+class ShaderReloader {
+
+public:
+
+	// Compile an HLSL file (entry point main) for the given profile (eg. vs_5_0) with each of defines set to 1.  Returns the bytecode
+	// or the compiler errors
+	typedef std::function<HRESULT(const std::string &hlslPath, const char *profile, const std::vector<std::string> &defines, std::vector<char> &bytecode, std::string &errors)> CompileFn;
+
+	// Returns the last write time of a file, or false if the file cannot be read
+	typedef std::function<bool(const std::string &path, uint64_t *writeTime)> FileTimeFn;
+
+private:
+
+	enum Stage { VertexStage, PixelStage, GeometryStage, NumStages };
+
+	// A watched shader - its HLSL file, defines and the files it depends on (the HLSL file and everything it #includes, directly or not)
+	struct ShaderSource {
+		std::string							file;
+		std::vector<std::string>			defines;
+		Stage								stage;
+		std::vector<std::string>			dependencies;
+	};
+
+	// Compiled on the watcher thread, waiting for applyReloads()
+	struct CompiledShader {
+		std::string							key;
+		Stage								stage;
+		std::vector<char>					bytecode;
+	};
+
+	// Keys (.cso path) of an effect's watched shaders (empty if the stage is not watched)
+	struct WatchedEffect {
+		Effect								*effect;
+		std::string							sources[NumStages];
+	};
+
+	ID3D11Device							*device = nullptr;
+	std::string								hlslDirectory;
+	CompileFn								compile;
+	FileTimeFn								fileTime;
+	DWORD									pollInterval;
+
+	// Shared with the watcher thread (guarded by lock)
+	mutable std::mutex						lock;
+	// Keyed by .cso path
+	std::map<std::string, ShaderSource>		sources;
+	std::vector<CompiledShader>				pending;
+
+	// Watcher thread only
+	std::map<std::string, uint64_t>			fileTimes;
+
+	// Render thread only
+	std::vector<WatchedEffect>				effects;
+
+	std::thread								watcher;
+	std::condition_variable					wake;
+	bool									stopRequested = false;
+
+	// Statistics
+	UINT									numCompiles = 0;
+	UINT									numFailedCompiles = 0;
+	UINT									numSwaps = 0;
+
+	// Find the source of a .cso path in hlslDirectory (eg. Shaders\cso\ocean_vs.cso -> Shaders\hlsl\ocean_vs.hlsl, or the family
+	// source and defines for a permutation variant) and start watching it
+	void addSource(const std::string &csoPath, Stage stage);
+	// Collect source and the files it #includes (resolved relative to the including file)
+	void findDependencies(const std::string &source, std::vector<std::string> &dependencies) const;
+	void watcherMain();
+
+	static const char *profileForStage(Stage stage);
+
+public:
+
+	ShaderReloader(ID3D11Device *_device, const char *_hlslDirectory = "Shaders\\hlsl\\", DWORD _pollInterval = 250, const CompileFn &_compile = compileHLSL, const FileTimeFn &_fileTime = lastWriteTime);
+	~ShaderReloader();
+
+	// Watch the shaders of an effect created from .cso files (Effect::getVertexShaderPath etc).  The effect must be unwatched (or
+	// the reloader destroyed) before the effect is deleted
+	void watchEffect(Effect *effect);
+	void unwatchEffect(Effect *effect);
+
+	// Start / stop the watcher thread
+	void start();
+	void stop();
+
+	// Check every watched file once and compile the shaders that changed (the watcher thread calls this every pollInterval ms)
+	void poll();
+
+	// Render thread, between frames: create the recompiled shaders and swap them into the watched effects.  Returns the number of
+	// effects changed
+	int applyReloads();
+
+	void reportData() const;
+
+	// Default compiler (D3DCompileFromFile) and file time query
+	static HRESULT compileHLSL(const std::string &hlslPath, const char *profile, const std::vector<std::string> &defines, std::vector<char> &bytecode, std::string &errors);
+	static bool lastWriteTime(const std::string &path, uint64_t *writeTime);
+};
@@ -0,0 +1,305 @@
+#include "stdafx.h"
+#include "StateCache.h"
+
+using namespace std;
+
+StateCache *StateCache::defaultCache = nullptr;
+
+
+StateCache::StateCache(ID3D11Device *_device)
+{
+	device = _device;
+}
+
+StateCache *StateCache::getDefault(ID3D11Device *device)
+{
+	if (!defaultCache)
+		defaultCache = new StateCache(device);
+	return defaultCache;
+}
+
+void StateCache::setDefault(StateCache *cache)
+{
+	defaultCache = cache;
+}
+
+
+// Copy the members of a depth stencil description into a zeroed struct so the padding after the stencil masks hashes and compares
+// consistently
+static D3D11_DEPTH_STENCIL_DESC normalisedDesc(const D3D11_DEPTH_STENCIL_DESC &desc)
+{
+	D3D11_DEPTH_STENCIL_DESC n;
+	ZeroMemory(&n, sizeof(D3D11_DEPTH_STENCIL_DESC));
+	n.DepthEnable = desc.DepthEnable;
+	n.DepthWriteMask = desc.DepthWriteMask;
+	n.DepthFunc = desc.DepthFunc;
+	n.StencilEnable = desc.StencilEnable;
+	n.StencilReadMask = desc.StencilReadMask;
+	n.StencilWriteMask = desc.StencilWriteMask;
+	n.FrontFace = desc.FrontFace;
+	n.BackFace = desc.BackFace;
+	return n;
+}
+
+// The same for a blend description, which has padding after each render target's write mask
+static D3D11_BLEND_DESC normalisedDesc(const D3D11_BLEND_DESC &desc)
+{
+	D3D11_BLEND_DESC n;
+	ZeroMemory(&n, sizeof(D3D11_BLEND_DESC));
+	n.AlphaToCoverageEnable = desc.AlphaToCoverageEnable;
+	n.IndependentBlendEnable = desc.IndependentBlendEnable;
+	for (int i = 0; i < 8; i++) {
+		const D3D11_RENDER_TARGET_BLEND_DESC &rt = desc.RenderTarget[i];
+		n.RenderTarget[i].BlendEnable = rt.BlendEnable;
+		n.RenderTarget[i].SrcBlend = rt.SrcBlend;
+		n.RenderTarget[i].DestBlend = rt.DestBlend;
+		n.RenderTarget[i].BlendOp = rt.BlendOp;
+		n.RenderTarget[i].SrcBlendAlpha = rt.SrcBlendAlpha;
+		n.RenderTarget[i].DestBlendAlpha = rt.DestBlendAlpha;
+		n.RenderTarget[i].BlendOpAlpha = rt.BlendOpAlpha;
+		n.RenderTarget[i].RenderTargetWriteMask = rt.RenderTargetWriteMask;
+	}
+	return n;
+}
+
+uint64_t StateCache::hash(const void *data, SIZE_T size, uint64_t seed)
+{
+	const uint8_t *p = (const uint8_t*)data;
+	uint64_t h = seed;
+	for (SIZE_T i = 0; i < size; i++) {
+		h ^= p[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+uint64_t StateCache::hashDesc(const D3D11_BLEND_DESC &desc)
+{
+	D3D11_BLEND_DESC n = normalisedDesc(desc);
+	return hash(&n, sizeof(D3D11_BLEND_DESC));
+}
+
+uint64_t StateCache::hashDesc(const D3D11_DEPTH_STENCIL_DESC &desc)
+{
+	D3D11_DEPTH_STENCIL_DESC n = normalisedDesc(desc);
+	return hash(&n, sizeof(D3D11_DEPTH_STENCIL_DESC));
+}
+
+uint64_t StateCache::hashDesc(const D3D11_RASTERIZER_DESC &desc)
+{
+	return hash(&desc, sizeof(D3D11_RASTERIZER_DESC));
+}
+
+uint64_t StateCache::hashDesc(const D3D11_SAMPLER_DESC &desc)
+{
+	return hash(&desc, sizeof(D3D11_SAMPLER_DESC));
+}
+
+uint64_t StateCache::hashDesc(const D3D11_INPUT_ELEMENT_DESC elements[], UINT numElements)
+{
+	// Semantic names are hashed by content rather than by pointer
+	uint64_t h = hash(&numElements, sizeof(UINT));
+	for (UINT i = 0; i < numElements; i++) {
+		const D3D11_INPUT_ELEMENT_DESC &e = elements[i];
+		h = hash(e.SemanticName, strlen(e.SemanticName), h);
+		h = hash(&e.SemanticIndex, sizeof(UINT), h);
+		h = hash(&e.Format, sizeof(DXGI_FORMAT), h);
+		h = hash(&e.InputSlot, sizeof(UINT), h);
+		h = hash(&e.AlignedByteOffset, sizeof(UINT), h);
+		h = hash(&e.InputSlotClass, sizeof(D3D11_INPUT_CLASSIFICATION), h);
+		h = hash(&e.InstanceDataStepRate, sizeof(UINT), h);
+	}
+	return h;
+}
+
+
+template <class Desc, class State> State *StateCache::getState(StateTable<Desc, State> &table, const Desc &desc, const function<HRESULT(const Desc*, State**)> &create)
+{
+	lock_guard<mutex> guard(lock);
+	table.numRequests++;
+
+	vector<pair<Desc, State*> > &bucket = table.states[hashDesc(desc)];
+	for (size_t i = 0; i < bucket.size(); i++) {
+		if (memcmp(&bucket[i].first, &desc, sizeof(Desc)) == 0) {
+			bucket[i].second->AddRef();
+			return bucket[i].second;
+		}
+	}
+
+	State *state = nullptr;
+	if (!device || !SUCCEEDED(create(&desc, &state)))
+		return nullptr;
+
+	bucket.push_back(pair<Desc, State*>(desc, state));
+	table.numStates++;
+
+	// One reference is kept by the cache
+	state->AddRef();
+	return state;
+}
+
+ID3D11BlendState *StateCache::getBlendState(const D3D11_BLEND_DESC &desc)
+{
+	return getState<D3D11_BLEND_DESC, ID3D11BlendState>(blendStates, normalisedDesc(desc), [this](const D3D11_BLEND_DESC *d, ID3D11BlendState **s) { return device->CreateBlendState(d, s); });
+}
+
+ID3D11DepthStencilState *StateCache::getDepthStencilState(const D3D11_DEPTH_STENCIL_DESC &desc)
+{
+	return getState<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>(depthStencilStates, normalisedDesc(desc), [this](const D3D11_DEPTH_STENCIL_DESC *d, ID3D11DepthStencilState **s) { return device->CreateDepthStencilState(d, s); });
+}
+
+ID3D11RasterizerState *StateCache::getRasterizerState(const D3D11_RASTERIZER_DESC &desc)
+{
+	return getState<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>(rasterizerStates, desc, [this](const D3D11_RASTERIZER_DESC *d, ID3D11RasterizerState **s) { return device->CreateRasterizerState(d, s); });
+}
+
+ID3D11SamplerState *StateCache::getSamplerState(const D3D11_SAMPLER_DESC &desc)
+{
+	return getState<D3D11_SAMPLER_DESC, ID3D11SamplerState>(samplerStates, desc, [this](const D3D11_SAMPLER_DESC *d, ID3D11SamplerState **s) { return device->CreateSamplerState(d, s); });
+}
+
+ID3D11InputLayout *StateCache::getInputLayout(const D3D11_INPUT_ELEMENT_DESC elements[], UINT numElements, const void *VSBytecode, SIZE_T VSBytes)
+{
+	lock_guard<mutex> guard(lock);
+	numLayoutRequests++;
+
+	// A layout is only valid for vertex shaders with the same input signature, so the bytecode is part of the key
+	uint64_t signatureHash = hash(VSBytecode, VSBytes);
+	uint64_t key = hashDesc(elements, numElements) ^ (signatureHash * 31);
+
+	vector<pair<LayoutKey, ID3D11InputLayout*> > &bucket = inputLayouts[key];
+	for (size_t i = 0; i < bucket.size(); i++) {
+
+		const LayoutKey &k = bucket[i].first;
+		bool match = k.signatureHash == signatureHash && k.elements.size() == numElements;
+		for (UINT j = 0; j < numElements && match; j++) {
+			const D3D11_INPUT_ELEMENT_DESC &a = k.elements[j];
+			const D3D11_INPUT_ELEMENT_DESC &b = elements[j];
+			match = k.semanticNames[j] == b.SemanticName && a.SemanticIndex == b.SemanticIndex && a.Format == b.Format && a.InputSlot == b.InputSlot &&
+				a.AlignedByteOffset == b.AlignedByteOffset && a.InputSlotClass == b.InputSlotClass && a.InstanceDataStepRate == b.InstanceDataStepRate;
+		}
+		if (match) {
+			bucket[i].second->AddRef();
+			return bucket[i].second;
+		}
+	}
+
+	ID3D11InputLayout *layout = nullptr;
+	if (!device || !SUCCEEDED(device->CreateInputLayout(elements, numElements, VSBytecode, VSBytes, &layout)))
+		return nullptr;
+
+	LayoutKey k;
+	k.signatureHash = signatureHash;
+	k.elements.assign(elements, elements + numElements);
+	for (UINT j = 0; j < numElements; j++)
+		k.semanticNames.push_back(elements[j].SemanticName);
+	bucket.push_back(pair<LayoutKey, ID3D11InputLayout*>(k, layout));
+	numLayouts++;
+
+	layout->AddRef();
+	return layout;
+}
+
+
+D3D11_RASTERIZER_DESC StateCache::defaultRasterizerDesc()
+{
+	D3D11_RASTERIZER_DESC RSdesc;
+	ZeroMemory(&RSdesc, sizeof(D3D11_RASTERIZER_DESC));
+	RSdesc.FillMode = D3D11_FILL_SOLID;
+	RSdesc.CullMode = D3D11_CULL_NONE;  //disable culling
+	RSdesc.FrontCounterClockwise = FALSE;
+	RSdesc.DepthBias = 0;
+	RSdesc.SlopeScaledDepthBias = 0.0f;
+	RSdesc.DepthBiasClamp = 0.0f;
+	RSdesc.DepthClipEnable = TRUE;
+	RSdesc.ScissorEnable = FALSE;
+	RSdesc.MultisampleEnable = TRUE;
+	RSdesc.AntialiasedLineEnable = FALSE;
+	return RSdesc;
+}
+
+D3D11_DEPTH_STENCIL_DESC StateCache::defaultDepthStencilDesc()
+{
+	D3D11_DEPTH_STENCIL_DESC dsDesc;
+	ZeroMemory(&dsDesc, sizeof(D3D11_DEPTH_STENCIL_DESC));
+	dsDesc.DepthEnable = TRUE;
+	dsDesc.DepthWriteMask = D3D11_DEPTH_WRITE_MASK_ALL;
+	dsDesc.DepthFunc = D3D11_COMPARISON_LESS_EQUAL;		//render all objects in the scene
+	dsDesc.StencilEnable = FALSE;
+	dsDesc.StencilReadMask = D3D11_DEFAULT_STENCIL_READ_MASK;
+	dsDesc.StencilWriteMask = D3D11_DEFAULT_STENCIL_WRITE_MASK;
+	dsDesc.FrontFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	dsDesc.FrontFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.FrontFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.FrontFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.BackFace.StencilFunc = D3D11_COMPARISON_ALWAYS;
+	dsDesc.BackFace.StencilDepthFailOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.BackFace.StencilPassOp = D3D11_STENCIL_OP_KEEP;
+	dsDesc.BackFace.StencilFailOp = D3D11_STENCIL_OP_KEEP;
+	return dsDesc;
+}
+
+D3D11_BLEND_DESC StateCache::defaultBlendDesc()
+{
+	D3D11_BLEND_DESC blendDesc;
+	ZeroMemory(&blendDesc, sizeof(D3D11_BLEND_DESC));
+	blendDesc.AlphaToCoverageEnable = FALSE; // Use pixel coverage info from rasteriser (default FALSE)
+	blendDesc.IndependentBlendEnable = FALSE; // The following array of render target blend properties uses the blend properties from RenderTarget[0] for ALL render targets
+	blendDesc.RenderTarget[0].BlendEnable = TRUE;
+	blendDesc.RenderTarget[0].SrcBlend = D3D11_BLEND_ONE;
+	blendDesc.RenderTarget[0].DestBlend = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].BlendOp = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].SrcBlendAlpha = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].DestBlendAlpha = D3D11_BLEND_ZERO;
+	blendDesc.RenderTarget[0].BlendOpAlpha = D3D11_BLEND_OP_ADD;
+	blendDesc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
+	return blendDesc;
+}
+
+D3D11_SAMPLER_DESC StateCache::defaultSamplerDesc(D3D11_FILTER filter, D3D11_TEXTURE_ADDRESS_MODE addressMode)
+{
+	D3D11_SAMPLER_DESC samplerDesc;
+	ZeroMemory(&samplerDesc, sizeof(D3D11_SAMPLER_DESC));
+	samplerDesc.Filter = filter;
+	samplerDesc.AddressU = addressMode;
+	samplerDesc.AddressV = addressMode;
+	samplerDesc.AddressW = addressMode;
+	samplerDesc.MinLOD = 0.0f;
+	samplerDesc.MaxLOD = 0.0f;
+	samplerDesc.MipLODBias = 0.0f;
+	samplerDesc.ComparisonFunc = D3D11_COMPARISON_ALWAYS;
+	return samplerDesc;
+}
+
+
+void StateCache::reportData() const
+{
+	cout << "State cache (requests / unique objects)" << endl;
+	cout << "Blend = " << blendStates.numRequests << " / " << blendStates.numStates << endl;
+	cout << "DepthStencil = " << depthStencilStates.numRequests << " / " << depthStencilStates.numStates << endl;
+	cout << "Rasterizer = " << rasterizerStates.numRequests << " / " << rasterizerStates.numStates << endl;
+	cout << "Sampler = " << samplerStates.numRequests << " / " << samplerStates.numStates << endl;
+	cout << "InputLayout = " << numLayoutRequests << " / " << numLayouts << endl;
+}
+
+template <class Desc, class State> void StateCache::releaseStates(StateTable<Desc, State> &table)
+{
+	for (typename map<uint64_t, vector<pair<Desc, State*> > >::iterator i = table.states.begin(); i != table.states.end(); ++i)
+		for (size_t j = 0; j < i->second.size(); j++)
+			i->second[j].second->Release();
+	table.states.clear();
+}
+
+StateCache::~StateCache()
+{
+	releaseStates(blendStates);
+	releaseStates(depthStencilStates);
+	releaseStates(rasterizerStates);
+	releaseStates(samplerStates);
+	for (map<uint64_t, vector<pair<LayoutKey, ID3D11InputLayout*> > >::iterator i = inputLayouts.begin(); i != inputLayouts.end(); ++i)
+		for (size_t j = 0; j < i->second.size(); j++)
+			i->second[j].second->Release();
+	inputLayouts.clear();
+	if (defaultCache == this)
+		defaultCache = nullptr;
+}
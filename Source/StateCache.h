@@ -0,0 +1,81 @@
+//
+// StateCache.h
+//
+
+// Cache of immutable pipeline state objects.  Each D3D11_*_DESC is hashed and only the first request for a given description creates
+// a state object; later requests share it.  Every get* call returns a new reference (AddRef'd) which the caller must Release, so states
+// can be handed to Effect (which releases its states) exactly as if they had been created directly.  Input layouts are cached on the
+// vertex description together with the vertex shader bytecode they are validated against.  Requests are serialised by a lock so
+// models can be created on several threads (see JobSystem).
+#pragma once
+
+#include <d3d11_2.h>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <string>
+#include <functional>
+#include <mutex>
+
+class StateCache {
+
+	// Hash -> (description, state) list.  Descriptions are compared on a hash match to rule out collisions
+	template <class Desc, class State> struct StateTable {
+		std::map<uint64_t, std::vector<std::pair<Desc, State*> > >	states;
+		UINT									numRequests = 0;
+		UINT									numStates = 0;
+	};
+
+	struct LayoutKey {
+		std::vector<D3D11_INPUT_ELEMENT_DESC>	elements;
+		std::vector<std::string>				semanticNames;
+		uint64_t								signatureHash;
+	};
+
+	ID3D11Device							*device = nullptr;
+	std::mutex								lock;
+	StateTable<D3D11_BLEND_DESC, ID3D11BlendState>					blendStates;
+	StateTable<D3D11_DEPTH_STENCIL_DESC, ID3D11DepthStencilState>	depthStencilStates;
+	StateTable<D3D11_RASTERIZER_DESC, ID3D11RasterizerState>		rasterizerStates;
+	StateTable<D3D11_SAMPLER_DESC, ID3D11SamplerState>				samplerStates;
+	std::map<uint64_t, std::vector<std::pair<LayoutKey, ID3D11InputLayout*> > >	inputLayouts;
+	UINT									numLayoutRequests = 0;
+	UINT									numLayouts = 0;
+
+	static StateCache						*defaultCache;
+
+	template <class Desc, class State> State *getState(StateTable<Desc, State> &table, const Desc &desc, const std::function<HRESULT(const Desc*, State**)> &create);
+	template <class Desc, class State> void releaseStates(StateTable<Desc, State> &table);
+
+public:
+
+	StateCache(ID3D11Device *_device);
+	~StateCache();
+
+	// Cache used by Effect and models.  Created for the given device on first use if none has been set
+	static StateCache *getDefault(ID3D11Device *device);
+	static void setDefault(StateCache *cache);
+
+	// Shared state objects (AddRef'd - the caller must Release).  Returns nullptr if the state cannot be created
+	ID3D11BlendState *getBlendState(const D3D11_BLEND_DESC &desc);
+	ID3D11DepthStencilState *getDepthStencilState(const D3D11_DEPTH_STENCIL_DESC &desc);
+	ID3D11RasterizerState *getRasterizerState(const D3D11_RASTERIZER_DESC &desc);
+	ID3D11SamplerState *getSamplerState(const D3D11_SAMPLER_DESC &desc);
+	ID3D11InputLayout *getInputLayout(const D3D11_INPUT_ELEMENT_DESC elements[], UINT numElements, const void *VSBytecode, SIZE_T VSBytes);
+
+	// Default descriptions used by Effect::initDefaultStates - start from these rather than calling GetDesc on an existing state
+	static D3D11_RASTERIZER_DESC defaultRasterizerDesc();
+	static D3D11_DEPTH_STENCIL_DESC defaultDepthStencilDesc();
+	static D3D11_BLEND_DESC defaultBlendDesc();
+	static D3D11_SAMPLER_DESC defaultSamplerDesc(D3D11_FILTER filter, D3D11_TEXTURE_ADDRESS_MODE addressMode);
+
+	// Hashes (FNV-1a) of state descriptions.  Padding in D3D11_DEPTH_STENCIL_DESC is excluded
+	static uint64_t hash(const void *data, SIZE_T size, uint64_t seed = 14695981039346656037ULL);
+	static uint64_t hashDesc(const D3D11_BLEND_DESC &desc);
+	static uint64_t hashDesc(const D3D11_DEPTH_STENCIL_DESC &desc);
+	static uint64_t hashDesc(const D3D11_RASTERIZER_DESC &desc);
+	static uint64_t hashDesc(const D3D11_SAMPLER_DESC &desc);
+	static uint64_t hashDesc(const D3D11_INPUT_ELEMENT_DESC elements[], UINT numElements);
+
+	void reportData() const;
+};
@@ -71,8 +71,7 @@ HRESULT System::setupDeviceDependentResources(HWND hwnd) {
 			defaultAdapter,
 			D3D_DRIVER_TYPE_UNKNOWN, // Specify TYPE_UNKNOWN since we're specifying our own adapter 'defaultAdapter'
 			NULL,
-			D3D11_CREATE_DEVICE_DEBUG |
-			D3D11_CREATE_DEVICE_SINGLETHREADED |
+			D3D11_CREATE_DEVICE_DEBUG | // Not D3D11_CREATE_DEVICE_SINGLETHREADED - the scene is recorded into deferred contexts on several threads
 			D3D11_CREATE_DEVICE_BGRA_SUPPORT, // Needed for D2D interop
 			dxFeatureLevels,
 			2,
@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include "Terrain.h"
 #include "Effect.h"
+#include "JobSystem.h"
+#include <cfloat>
 using namespace std;
 using namespace DirectX;
 using namespace DirectX::PackedVector;
@@ -75,33 +77,38 @@ HRESULT Terrain::init(ID3D11Device *device, ID3D11DeviceContext* context, int _w
 		numInd = ((width - 1) * 2 * 3)*(height - 1);
 		indices = (UINT*)malloc(sizeof(UINT)*numInd);
 
-		for (int i = 0; i < height; i++)
-		{
-			for (int j = 0; j < width; j++)
+		// Rows are independent so they are built in parallel on the job system
+		JobSystem *jobSystem = JobSystem::getDefault();
+		jobSystem->parallelFor(0, height, 16, [&](size_t firstRow, size_t lastRow) {
+			for (int i = (int)firstRow; i < (int)lastRow; i++)
 			{
+				for (int j = 0; j < width; j++)
+				{
 
-				vertices[(i*width) + j].pos.x = j;
-				vertices[(i*width) + j].pos.z = i;
-				////vertices[(i*width) + j].pos.y = ((float)Result[(i*1024) + j])/10.0;
+					vertices[(i*width) + j].pos.x = j;
+					vertices[(i*width) + j].pos.z = i;
+					////vertices[(i*width) + j].pos.y = ((float)Result[(i*1024) + j])/10.0;
 
-				vertices[(i*width) + j].texCoord.x = (float)j / width;
-				vertices[(i*width) + j].texCoord.y = (float)i / height;
-				int xi = (int)(vertices[(i*width) + j].texCoord.x*texWidth);
-				int zi = (int)(vertices[(i*width) + j].texCoord.y*texHeight);
-				vertices[(i*width) + j].pos.y = (((float)Result[xi * texWidth * 4 + zi * 4]) / 255.0) * 1;
-				////cout << "Y=" << vertices[(i*width) + j].pos.y << endl;
+					vertices[(i*width) + j].texCoord.x = (float)j / width;
+					vertices[(i*width) + j].texCoord.y = (float)i / height;
+					int xi = (int)(vertices[(i*width) + j].texCoord.x*texWidth);
+					int zi = (int)(vertices[(i*width) + j].texCoord.y*texHeight);
+					vertices[(i*width) + j].pos.y = (((float)Result[xi * texWidth * 4 + zi * 4]) / 255.0) * 1;
+					////cout << "Y=" << vertices[(i*width) + j].pos.y << endl;
 
-				vertices[(i*width) + j].normal.z =  ((((float)ResultNorms[xi * texWidth * 4 + zi * 4]) / 255.0)*2.0 - 1.0);
-				vertices[(i*width) + j].normal.x = ((((float)ResultNorms[xi * texWidth * 4 + zi * 4 + 1]) / 255.0)*2.0 - 1.0);
-				vertices[(i*width) + j].normal.y = ((((float)ResultNorms[xi * texWidth * 4 + zi * 4 + 2]) / 255.0)*2.0 - 1.0)*1;
-				//
+					vertices[(i*width) + j].normal.z =  ((((float)ResultNorms[xi * texWidth * 4 + zi * 4]) / 255.0)*2.0 - 1.0);
+					vertices[(i*width) + j].normal.x = ((((float)ResultNorms[xi * texWidth * 4 + zi * 4 + 1]) / 255.0)*2.0 - 1.0);
+					vertices[(i*width) + j].normal.y = ((((float)ResultNorms[xi * texWidth * 4 + zi * 4 + 2]) / 255.0)*2.0 - 1.0)*1;
+					//
 
-				vertices[(i*width) + j].matDiffuse = material->getColour()->diffuse;
-				vertices[(i*width) + j].matSpecular = material->getColour()->specular;
+					vertices[(i*width) + j].matDiffuse = material->getColour()->diffuse;
+					vertices[(i*width) + j].matSpecular = material->getColour()->specular;
 
 
+				}
 			}
-		}
+		});
+		computeBounds(&vertices[0].pos, width*height, sizeof(ExtendedVertexStruct));
 		//vertices[(75 * width) + 75].pos.y = 10;
 		//Copy the matrices into the  vertex buffer
 		D3D11_BUFFER_DESC vertexDesc;
@@ -121,19 +128,21 @@ HRESULT Terrain::init(ID3D11Device *device, ID3D11DeviceContext* context, int _w
 		context->Unmap(grassHeightStage, 0);
 
 
-		for (int i = 0; i < height - 1; i++)
-		{
-			for (int j = 0; j < width - 1; j++)
+		jobSystem->parallelFor(0, height - 1, 16, [&](size_t firstRow, size_t lastRow) {
+			for (int i = (int)firstRow; i < (int)lastRow; i++)
 			{
-				indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 0] = (i*width) + j;
-				indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 2] = (i*width) + j + 1;
-				indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 1] = ((i + 1)*width) + j;
-
-				indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 3] = (i*width) + j + 1;
-				indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 5] = ((i + 1)*width) + j + 1;;
-				indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 4] = ((i + 1)*width) + j;
+				for (int j = 0; j < width - 1; j++)
+				{
+					indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 0] = (i*width) + j;
+					indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 2] = (i*width) + j + 1;
+					indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 1] = ((i + 1)*width) + j;
+
+					indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 3] = (i*width) + j + 1;
+					indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 5] = ((i + 1)*width) + j + 1;;
+					indices[(i*(width - 1) * 2 * 3) + (j * 2 * 3) + 4] = ((i + 1)*width) + j;
+				}
 			}
-		}
+		});
 
 
 		D3D11_BUFFER_DESC indexDesc;
@@ -215,6 +224,51 @@ float Terrain::CalculateYValue(float x, float z)
 	return ((float)finalHeight);
 }
 
+void Terrain::buildOccluder(int cellSize)
+{
+	occluderPositions.clear();
+	occluderIndices.clear();
+	if (!vertices || cellSize <= 0 || width < 2 || height < 2)
+		return;
+
+	// Grid lines every cellSize vertices, the last on the edge of the terrain
+	int numX = (width - 2) / cellSize + 2;
+	int numZ = (height - 2) / cellSize + 2;
+	for (int i = 0; i < numZ; i++) {
+		int z = min(i * cellSize, height - 1);
+		for (int j = 0; j < numX; j++) {
+			int x = min(j * cellSize, width - 1);
+			float lowest = FLT_MAX;
+			for (int zi = max(z - cellSize, 0); zi <= min(z + cellSize, height - 1); zi++)
+				for (int xi = max(x - cellSize, 0); xi <= min(x + cellSize, width - 1); xi++)
+					lowest = min(lowest, vertices[zi * width + xi].pos.y);
+			occluderPositions.push_back((float)x);
+			occluderPositions.push_back(lowest);
+			occluderPositions.push_back((float)z);
+		}
+	}
+
+	// Same winding as the terrain's own triangles
+	for (int i = 0; i < numZ - 1; i++)
+		for (int j = 0; j < numX - 1; j++) {
+			uint32_t corner = i * numX + j;
+			uint32_t quad[6] = { corner, corner + numX, corner + 1, corner + 1, corner + numX, corner + numX + 1 };
+			occluderIndices.insert(occluderIndices.end(), quad, quad + 6);
+		}
+}
+
+bool Terrain::getOccluder(OccluderMesh *mesh) const
+{
+	if (occluderIndices.empty())
+		return false;
+	mesh->positions = occluderPositions.data();
+	mesh->stride = 3 * sizeof(float);
+	mesh->numVertices = occluderPositions.size() / 3;
+	mesh->indices = occluderIndices.data();
+	mesh->numIndices = occluderIndices.size();
+	return true;
+}
+
 Terrain::~Terrain()
 {
 }
@@ -222,8 +276,7 @@ Terrain::~Terrain()
 
 void Terrain::render(ID3D11DeviceContext *context) {
 
-	context->PSSetConstantBuffers(0, 1, &cBufferModelGPU);
-	context->VSSetConstantBuffers(0, 1, &cBufferModelGPU);
+	bindCBuffer(context);
 
 	// Validate object before rendering 
 	if (!context || !vertexBuffer || !inputLayout)
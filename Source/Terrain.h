@@ -3,6 +3,7 @@
 #include "CBufferStructures.h"
 #include "VertexStructures.h"
 #include "Camera.h"
+#include <vector>
 class Effect;
 class Material;
 //#include <DirectXMath.h>
@@ -12,15 +13,22 @@ class Terrain : public BaseModel
 
 	int width, height;
 	UINT numInd = 0;
+	// Coarse grid below the surface rasterised as an occluder (see buildOccluder)
+	std::vector<float> occluderPositions;
+	std::vector<uint32_t> occluderIndices;
 public:
 	Terrain(ID3D11Device *device, ID3D11DeviceContext*context, int width, int height, ID3D11Texture2D*tex_height, ID3D11Texture2D*tex_normal,  Effect *_effect, Material *_materials[] = nullptr, int _numMaterials = 0, ID3D11ShaderResourceView **textures = nullptr, int numTextures = 0) : BaseModel(device, _effect, _materials, _numMaterials, textures, numTextures){ init(device, context,width,height, tex_height, tex_normal); };
-	ExtendedVertexStruct *vertices;
-	UINT*indices;
+	ExtendedVertexStruct *vertices = nullptr;
+	UINT*indices = nullptr;
 	//Terrain(UINT widthl, UINT heightl, ID3D11DeviceContext *context, ID3D11Device *device, Effect *_effect,
 	//	ID3D11ShaderResourceView *tex_view, Material *_material, ID3D11Texture2D *tex_height, ID3D11Texture2D *tex_normal);
 
 	float CalculateYValue(float x, float z);
 	float CalculateYValueWorld(float x, float z);
+	// Build a grid of cellSize x cellSize quads to stand in for the terrain as an occluder.  Each grid vertex takes the lowest height of
+	// the cells around it so the grid never rises above the surface
+	void buildOccluder(int cellSize);
+	bool getOccluder(OccluderMesh *mesh) const;
 	void render(ID3D11DeviceContext *context);
 	HRESULT init(ID3D11Device *device){ return S_OK; };
 	HRESULT init(ID3D11Device *device, ID3D11DeviceContext* context,int _width,int _height, ID3D11Texture2D*tex_height, ID3D11Texture2D*tex_normal);
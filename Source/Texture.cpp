@@ -4,6 +4,8 @@
 #include <exception>
 #include <DirectXTK\DDSTextureLoader.h>
 #include <DirectXTK\WICTextureLoader.h>
+#include <wincodec.h>
+#include <fstream>
 
 using namespace std;
 using namespace DirectX;
@@ -33,6 +35,254 @@ Texture::Texture(ID3D11Device *device, const std::wstring& filename)
 	texture = static_cast<ID3D11Texture2D*>(resource);
 }
 
+Texture::Texture(ID3D11Device *device, ID3D11DeviceContext *context, const std::vector<std::wstring>& filenames)
+{
+	SRV = nullptr;
+	texture = nullptr;
+
+	try
+	{
+		if (!device || !context || filenames.empty())
+			throw exception("Invalid parameters for texture array instantiation");
+
+		D3D11_TEXTURE2D_DESC arrayDesc;
+
+		for (UINT i = 0; i < filenames.size(); i++) {
+
+			// Load each slice as a standalone texture then copy it into the array
+			ID3D11Resource *resource = nullptr;
+			ID3D11ShaderResourceView *sliceSRV = nullptr;
+			wstring ext = filenames[i].substr(filenames[i].length() - 4);
+			HRESULT hr;
+
+			if (0 == ext.compare(L".dds"))
+				hr = CreateDDSTextureFromFile(device, filenames[i].c_str(), &resource, &sliceSRV);
+			else
+				hr = CreateWICTextureFromFile(device, filenames[i].c_str(), &resource, &sliceSRV);
+
+			if (!SUCCEEDED(hr))
+				throw exception("Cannot load texture array slice");
+
+			ID3D11Texture2D *slice = static_cast<ID3D11Texture2D*>(resource);
+			D3D11_TEXTURE2D_DESC sliceDesc;
+			slice->GetDesc(&sliceDesc);
+
+			if (i == 0) {
+
+				// The first slice defines the size and format of the whole array
+				arrayDesc = sliceDesc;
+				arrayDesc.ArraySize = (UINT)filenames.size();
+				arrayDesc.Usage = D3D11_USAGE_DEFAULT;
+				arrayDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+				arrayDesc.CPUAccessFlags = 0;
+				arrayDesc.MiscFlags = 0;
+				hr = device->CreateTexture2D(&arrayDesc, 0, &texture);
+			}
+			else if (sliceDesc.Width != arrayDesc.Width || sliceDesc.Height != arrayDesc.Height || sliceDesc.Format != arrayDesc.Format || sliceDesc.MipLevels != arrayDesc.MipLevels)
+				hr = E_INVALIDARG;
+
+			if (SUCCEEDED(hr))
+				for (UINT mip = 0; mip < arrayDesc.MipLevels; mip++)
+					context->CopySubresourceRegion(texture, D3D11CalcSubresource(mip, i, arrayDesc.MipLevels), 0, 0, 0, slice, mip, NULL);
+
+			sliceSRV->Release();
+			slice->Release();
+
+			if (!SUCCEEDED(hr))
+				throw exception("Texture array slices must share size, format and mip count");
+		}
+
+		// Setup shader resource view over every slice of the array
+		D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+		ZeroMemory(&viewDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+		viewDesc.Format = arrayDesc.Format;
+		viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+		viewDesc.Texture2DArray.MostDetailedMip = 0;
+		viewDesc.Texture2DArray.MipLevels = arrayDesc.MipLevels;
+		viewDesc.Texture2DArray.FirstArraySlice = 0;
+		viewDesc.Texture2DArray.ArraySize = arrayDesc.ArraySize;
+
+		HRESULT hr = device->CreateShaderResourceView(texture, &viewDesc, &SRV);
+		if (!SUCCEEDED(hr))
+			throw exception("Cannot create texture array shader resource view");
+	}
+	catch (exception& e)
+	{
+		cout << "Texture array was not loaded:\n";
+		cout << e.what() << endl;
+	}
+}
+
+Texture::Texture(const std::vector<std::wstring>& _filenames, ID3D11ShaderResourceView *placeholder)
+{
+	filenames = _filenames;
+	SRV = placeholder;
+	texture = nullptr;
+	ready = false;
+}
+
+
+// Decode an image file to 32 bit RGBA with WIC (the conversion CreateWICTextureFromFile makes for most formats)
+static HRESULT decodeWIC(const wstring &filename, vector<uint8_t> &data, UINT *width, UINT *height)
+{
+	// Job threads have not initialised COM.  The main thread already has (single threaded) so this fails there but WIC still works
+	HRESULT coHr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+	IWICImagingFactory *factory = nullptr;
+	IWICBitmapDecoder *decoder = nullptr;
+	IWICBitmapFrameDecode *frame = nullptr;
+	IWICFormatConverter *converter = nullptr;
+
+	HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory));
+	if (SUCCEEDED(hr))
+		hr = factory->CreateDecoderFromFilename(filename.c_str(), NULL, GENERIC_READ, WICDecodeMetadataCacheOnDemand, &decoder);
+	if (SUCCEEDED(hr))
+		hr = decoder->GetFrame(0, &frame);
+	if (SUCCEEDED(hr))
+		hr = frame->GetSize(width, height);
+	if (SUCCEEDED(hr))
+		hr = factory->CreateFormatConverter(&converter);
+	if (SUCCEEDED(hr))
+		hr = converter->Initialize(frame, GUID_WICPixelFormat32bppRGBA, WICBitmapDitherTypeNone, NULL, 0.0, WICBitmapPaletteTypeCustom);
+	if (SUCCEEDED(hr)) {
+		data.resize(*width * *height * 4);
+		hr = converter->CopyPixels(NULL, *width * 4, (UINT)data.size(), &data[0]);
+	}
+
+	if (converter)
+		converter->Release();
+	if (frame)
+		frame->Release();
+	if (decoder)
+		decoder->Release();
+	if (factory)
+		factory->Release();
+	if (SUCCEEDED(coHr))
+		CoUninitialize();
+	return hr;
+}
+
+HRESULT Texture::decode()
+{
+	images.resize(filenames.size());
+
+	try
+	{
+		for (size_t i = 0; i < filenames.size(); i++) {
+
+			Image &image = images[i];
+			wstring ext = filenames[i].substr(filenames[i].length() - 4);
+
+			if (0 == ext.compare(L".dds")) {
+				// DDS data is already in its GPU format - only the file read is done here
+				ifstream file(filenames[i], ios::binary | ios::ate);
+				if (!file.is_open())
+					throw exception("Cannot open texture file");
+				image.data.resize((size_t)file.tellg());
+				if (image.data.empty())
+					throw exception("Empty texture file");
+				file.seekg(0);
+				file.read((char*)&image.data[0], image.data.size());
+				image.dds = true;
+			}
+			else if (!SUCCEEDED(decodeWIC(filenames[i], image.data, &image.width, &image.height)))
+				throw exception("Cannot decode texture file");
+		}
+
+		if (images.size() > 1)
+			for (size_t i = 0; i < images.size(); i++)
+				if (images[i].dds || images[i].width != images[0].width || images[i].height != images[0].height)
+					throw exception("Texture array slices must be equally sized and not DDS files");
+	}
+	catch (exception& e)
+	{
+		cout << "Texture was not loaded:\n";
+		cout << e.what() << endl;
+		images.clear();
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+const uint8_t *Texture::getImage(size_t slice, UINT *width, UINT *height) const
+{
+	if (slice >= images.size() || images[slice].dds || images[slice].data.empty())
+		return nullptr;
+	*width = images[slice].width;
+	*height = images[slice].height;
+	return &images[slice].data[0];
+}
+
+HRESULT Texture::create(ID3D11Device *device)
+{
+	if (images.empty())
+		return E_FAIL;
+
+	ID3D11Resource *resource = nullptr;
+	ID3D11ShaderResourceView *view = nullptr;
+	HRESULT hr;
+
+	if (images[0].dds)
+		hr = CreateDDSTextureFromMemory(device, &images[0].data[0], images[0].data.size(), &resource, &view);
+	else {
+
+		// One mip level and RGBA, as CreateWICTextureFromFile without a context makes
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(D3D11_TEXTURE2D_DESC));
+		desc.Width = images[0].width;
+		desc.Height = images[0].height;
+		desc.MipLevels = 1;
+		desc.ArraySize = (UINT)images.size();
+		desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		vector<D3D11_SUBRESOURCE_DATA> initData(images.size());
+		for (size_t i = 0; i < images.size(); i++) {
+			initData[i].pSysMem = &images[i].data[0];
+			initData[i].SysMemPitch = images[i].width * 4;
+			initData[i].SysMemSlicePitch = 0;
+		}
+
+		ID3D11Texture2D *texture2D = nullptr;
+		hr = device->CreateTexture2D(&desc, &initData[0], &texture2D);
+		resource = texture2D;
+
+		if (SUCCEEDED(hr)) {
+			D3D11_SHADER_RESOURCE_VIEW_DESC viewDesc;
+			ZeroMemory(&viewDesc, sizeof(D3D11_SHADER_RESOURCE_VIEW_DESC));
+			viewDesc.Format = desc.Format;
+			if (images.size() > 1) {
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2DARRAY;
+				viewDesc.Texture2DArray.MipLevels = 1;
+				viewDesc.Texture2DArray.ArraySize = desc.ArraySize;
+			}
+			else {
+				viewDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+				viewDesc.Texture2D.MipLevels = 1;
+			}
+			hr = device->CreateShaderResourceView(texture2D, &viewDesc, &view);
+		}
+	}
+
+	images.clear();
+
+	if (!SUCCEEDED(hr)) {
+		cout << "Texture was not loaded:\n";
+		cout << "Cannot create texture" << endl;
+		if (resource)
+			resource->Release();
+		return hr;
+	}
+
+	// The placeholder view belongs to the loader
+	texture = static_cast<ID3D11Texture2D*>(resource);
+	SRV = view;
+	ready = true;
+	return S_OK;
+}
+
 Texture::~Texture()
 {
 }
@@ -13,9 +13,36 @@ class Texture
 	ID3D11ShaderResourceView				*SRV = nullptr;
 	ID3D11DepthStencilView					*DSV = nullptr;
 	ID3D11RenderTargetView					*RTV = nullptr;
+
+	// Image read by decode() and waiting for create().  DDS files are kept as the file contents, other formats are decoded to RGBA
+	struct Image {
+		std::vector<uint8_t>				data;
+		UINT								width = 0;
+		UINT								height = 0;
+		bool								dds = false;
+	};
+	std::vector<std::wstring>				filenames;
+	std::vector<Image>						images;
+	bool									ready = true;
+
 public:
 
 	Texture(ID3D11Device *device, const std::wstring& filename);
+	// Load a set of equally sized textures into the slices of a single Texture2DArray
+	Texture(ID3D11Device *device, ID3D11DeviceContext *context, const std::vector<std::wstring>& filenames);
+	// Texture loaded in two stages (see AssetLoader) - placeholder is the view until create() succeeds.  Several files make a texture
+	// array (one slice per file)
+	Texture(const std::vector<std::wstring>& _filenames, ID3D11ShaderResourceView *placeholder);
+
+	// Read and decode the files into system memory.  Any thread
+	HRESULT decode();
+	// Create the texture and its view from the decoded images and release them.  Render thread
+	HRESULT create(ID3D11Device *device);
+	// False while the view is a placeholder
+	bool isReady() const { return ready; };
+	// RGBA pixels of a slice between decode() and create() (nullptr for DDS files or if the slice has not been decoded)
+	const uint8_t *getImage(size_t slice, UINT *width, UINT *height) const;
+
 	ID3D11ShaderResourceView *getShaderResourceView(){ return SRV; };
 	ID3D11Texture2D *getTexture() { return texture; };
 	~Texture();
@@ -0,0 +1,273 @@
+#include "stdafx.h"
+#include "TransformHierarchy.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+#include <chrono>
+#include <thread>
+#include <iostream>
+
+using namespace std;
+
+// Node flags
+#define TRANSFORM_DIRTY		0x01 // A local component was set since the last update
+#define TRANSFORM_CHANGED	0x02 // The world matrix changed in the last update
+
+static const TransformTRS identityTRS = { { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f }, { 1.0f, 1.0f, 1.0f } };
+static const float identityMatrix[16] = { 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f };
+
+
+// Rows of the local matrix - scale, then rotation, then translation - as XMMatrixAffineTransformation builds them
+static inline void localRows(const TransformTRS &local, __m128 rows[4])
+{
+	float x = local.rotation[0], y = local.rotation[1], z = local.rotation[2], w = local.rotation[3];
+	float xx = x * x, yy = y * y, zz = z * z, xy = x * y, xz = x * z, yz = y * z, xw = x * w, yw = y * w, zw = z * w;
+	rows[0] = _mm_mul_ps(_mm_setr_ps(1.0f - 2.0f * (yy + zz), 2.0f * (xy + zw), 2.0f * (xz - yw), 0.0f), _mm_set1_ps(local.scale[0]));
+	rows[1] = _mm_mul_ps(_mm_setr_ps(2.0f * (xy - zw), 1.0f - 2.0f * (xx + zz), 2.0f * (yz + xw), 0.0f), _mm_set1_ps(local.scale[1]));
+	rows[2] = _mm_mul_ps(_mm_setr_ps(2.0f * (xz + yw), 2.0f * (yz - xw), 1.0f - 2.0f * (xx + yy), 0.0f), _mm_set1_ps(local.scale[2]));
+	rows[3] = _mm_setr_ps(local.translation[0], local.translation[1], local.translation[2], 1.0f);
+}
+
+// row times the matrix whose rows are parent
+static inline __m128 transformRow(__m128 row, const __m128 parent[4])
+{
+	__m128 x = _mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), y = _mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1));
+	__m128 z = _mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), w = _mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3));
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, parent[0]), _mm_mul_ps(y, parent[1])), _mm_add_ps(_mm_mul_ps(z, parent[2]), _mm_mul_ps(w, parent[3])));
+}
+
+
+TransformNode TransformHierarchy::create(TransformNode parent)
+{
+	TransformNode node = (TransformNode)parents.size();
+	locals.push_back(identityTRS);
+	parents.push_back(parent);
+	flags.push_back(TRANSFORM_DIRTY);
+	worldMatrices.insert(worldMatrices.end(), identityMatrix, identityMatrix + 16);
+	orderChanged = true;
+	return node;
+}
+
+void TransformHierarchy::setParent(TransformNode node, TransformNode parent)
+{
+	for (TransformNode ancestor = parent; ancestor != TRANSFORM_NONE; ancestor = parents[ancestor])
+		if (ancestor == node)
+			throw exception("TransformHierarchy: a node cannot be moved below itself or its descendants");
+	parents[node] = parent;
+	flags[node] |= TRANSFORM_DIRTY;
+	orderChanged = true;
+}
+
+void TransformHierarchy::setLocal(TransformNode node, const TransformTRS &local)
+{
+	locals[node] = local;
+	flags[node] |= TRANSFORM_DIRTY;
+}
+
+void TransformHierarchy::setTranslation(TransformNode node, const float translation[3])
+{
+	copy(translation, translation + 3, locals[node].translation);
+	flags[node] |= TRANSFORM_DIRTY;
+}
+
+void TransformHierarchy::setRotation(TransformNode node, const float rotation[4])
+{
+	copy(rotation, rotation + 4, locals[node].rotation);
+	flags[node] |= TRANSFORM_DIRTY;
+}
+
+void TransformHierarchy::setScale(TransformNode node, const float scale[3])
+{
+	copy(scale, scale + 3, locals[node].scale);
+	flags[node] |= TRANSFORM_DIRTY;
+}
+
+
+void TransformHierarchy::sortByDepth()
+{
+	if (!orderChanged)
+		return;
+	orderChanged = false;
+
+	// Depth of every node, found by walking up to the first ancestor whose depth is known
+	size_t numNodes = parents.size();
+	vector<uint32_t> depths(numNodes, 0xffffffff);
+	vector<TransformNode> path;
+	size_t numLevels = 0;
+	for (TransformNode node = 0; node < numNodes; node++) {
+		TransformNode ancestor = node;
+		while (ancestor != TRANSFORM_NONE && depths[ancestor] == 0xffffffff) {
+			path.push_back(ancestor);
+			ancestor = parents[ancestor];
+		}
+		uint32_t depth = (ancestor == TRANSFORM_NONE) ? 0 : depths[ancestor] + 1;
+		while (!path.empty()) {
+			depths[path.back()] = depth++;
+			path.pop_back();
+		}
+		numLevels = max(numLevels, (size_t)depths[node] + 1);
+	}
+
+	// Counting sort by depth, keeping the nodes of each depth in creation order
+	levelStarts.assign(numLevels + 1, 0);
+	for (size_t i = 0; i < numNodes; i++)
+		levelStarts[depths[i] + 1]++;
+	for (size_t level = 0; level < numLevels; level++)
+		levelStarts[level + 1] += levelStarts[level];
+	order.resize(numNodes);
+	vector<size_t> next(levelStarts.begin(), levelStarts.end() - 1);
+	for (TransformNode node = 0; node < numNodes; node++)
+		order[next[depths[node]]++] = node;
+}
+
+void TransformHierarchy::updateNodes(size_t first, size_t last)
+{
+	for (size_t i = first; i < last; i++) {
+		TransformNode node = order[i];
+		TransformNode parent = parents[node];
+		if (!(flags[node] & TRANSFORM_DIRTY) && (parent == TRANSFORM_NONE || !(flags[parent] & TRANSFORM_CHANGED))) {
+			flags[node] = 0;
+			continue;
+		}
+
+		__m128 rows[4];
+		localRows(locals[node], rows);
+		float *world = &worldMatrices[node * 16];
+		if (parent != TRANSFORM_NONE) {
+			const float *parentWorld = &worldMatrices[parent * 16];
+			__m128 parentRows[4] = { _mm_loadu_ps(parentWorld), _mm_loadu_ps(parentWorld + 4), _mm_loadu_ps(parentWorld + 8), _mm_loadu_ps(parentWorld + 12) };
+			for (int r = 0; r < 4; r++)
+				rows[r] = transformRow(rows[r], parentRows);
+		}
+		for (int r = 0; r < 4; r++)
+			_mm_storeu_ps(world + r * 4, rows[r]);
+		flags[node] = TRANSFORM_CHANGED;
+	}
+}
+
+void TransformHierarchy::update()
+{
+	sortByDepth();
+	updateNodes(0, order.size());
+}
+
+size_t TransformHierarchy::gatherChanged(vector<TransformNode> *nodes) const
+{
+	size_t numChanged = 0;
+	for (size_t i = 0; i < flags.size(); i++) {
+		if (flags[i] & TRANSFORM_CHANGED) {
+			nodes->push_back((TransformNode)i);
+			numChanged++;
+		}
+	}
+	return numChanged;
+}
+
+
+void benchmarkTransformHierarchy(int numNodes, int depth, int iterations)
+{
+	typedef chrono::high_resolution_clock BenchmarkClock;
+	if (numNodes <= 0 || depth <= 0 || iterations <= 0)
+		return;
+	int numThreads = max((int)thread::hardware_concurrency(), 1);
+
+	// Trees of depth levels.  A quarter of the nodes are roots and the rest are shared evenly by the levels below, each node's parent
+	// picked at random from the level above.  The nodes have random translations, rotations about y and (a quarter of them)
+	// non-uniform scales
+	TransformHierarchy hierarchy;
+	size_t numRoots = max((size_t)numNodes / 4, (size_t)1);
+	size_t levelFirst = 0, levelSize = 0;
+	unsigned int seed = 1;
+	for (int level = 0; level < depth; level++) {
+		size_t size = (level == 0) ? numRoots : ((size_t)numNodes - numRoots) * level / max(depth - 1, 1) - ((size_t)numNodes - numRoots) * (level - 1) / max(depth - 1, 1);
+		size_t first = hierarchy.getNumNodes();
+		for (size_t i = 0; i < size; i++) {
+			float r[5];
+			for (int k = 0; k < 5; k++) {
+				seed = seed * 1664525u + 1013904223u;
+				r[k] = (seed >> 8) / 16777216.0f;
+			}
+			TransformNode parent = (level == 0) ? TRANSFORM_NONE : (TransformNode)(levelFirst + min((size_t)(r[0] * levelSize), levelSize - 1));
+			TransformNode node = hierarchy.create(parent);
+			float angle = r[1] * 3.1415927f;
+			TransformTRS local = { { (r[2] - 0.5f) * 100.0f, r[3] * 10.0f, (r[4] - 0.5f) * 100.0f }, { 0.0f, sin(angle), 0.0f, cos(angle) },
+				{ 1.0f, (node % 4 == 0) ? 2.0f : 1.0f, 1.0f } };
+			hierarchy.setLocal(node, local);
+		}
+		levelFirst = first;
+		levelSize = size;
+	}
+
+	// First update of every node
+	BenchmarkClock::time_point start = BenchmarkClock::now();
+	hierarchy.update();
+	double firstTime = chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+
+	// Every node moves
+	double allTime = 0.0, threadedTime = 0.0, fewTime = 0.0;
+	size_t numFewChanged = 0;
+	for (int it = 0; it < iterations; it++) {
+		float lift[3] = { 0.0f, (float)it, 0.0f };
+		for (TransformNode node = 0; node < hierarchy.getNumNodes(); node++)
+			hierarchy.setTranslation(node, lift);
+		start = BenchmarkClock::now();
+		hierarchy.update();
+		allTime += chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+
+		// The same with each level split across the threads
+		for (TransformNode node = 0; node < hierarchy.getNumNodes(); node++)
+			hierarchy.setTranslation(node, lift);
+		start = BenchmarkClock::now();
+		hierarchy.sortByDepth();
+		for (size_t level = 0; level < hierarchy.getNumLevels(); level++) {
+			size_t first, last;
+			hierarchy.getLevel(level, &first, &last);
+			vector<thread> threads;
+			for (int t = 0; t < numThreads; t++)
+				threads.push_back(thread(&TransformHierarchy::updateNodes, &hierarchy, first + (last - first) * t / numThreads, first + (last - first) * (t + 1) / numThreads));
+			for (size_t t = 0; t < threads.size(); t++)
+				threads[t].join();
+		}
+		threadedTime += chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+
+		// 1% of the roots move, carrying their subtrees
+		for (size_t i = 0; i < max(numRoots / 100, (size_t)1); i++) {
+			TransformNode root = (TransformNode)((i * 7919) % numRoots);
+			float translation[3] = { (float)it, 0.0f, 0.0f };
+			hierarchy.setTranslation(root, translation);
+		}
+		start = BenchmarkClock::now();
+		hierarchy.update();
+		fewTime += chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+		vector<TransformNode> changed;
+		numFewChanged = hierarchy.gatherChanged(&changed);
+	}
+
+	// Composing each world matrix from the node's ancestors' matrices, as the world matrices were built before
+	vector<float> composed(hierarchy.getNumNodes() * 16);
+	start = BenchmarkClock::now();
+	for (int it = 0; it < iterations; it++) {
+		for (TransformNode node = 0; node < hierarchy.getNumNodes(); node++) {
+			float *world = &composed[node * 16];
+			copy(identityMatrix, identityMatrix + 16, world);
+			for (TransformNode ancestor = node; ancestor != TRANSFORM_NONE; ancestor = hierarchy.getParent(ancestor)) {
+				__m128 rows[4], worldRows[4];
+				localRows(hierarchy.getLocal(ancestor), rows);
+				for (int r = 0; r < 4; r++)
+					worldRows[r] = transformRow(_mm_loadu_ps(world + r * 4), rows);
+				for (int r = 0; r < 4; r++)
+					_mm_storeu_ps(world + r * 4, worldRows[r]);
+			}
+		}
+	}
+	double composeTime = chrono::duration<double, milli>(BenchmarkClock::now() - start).count();
+	float maxDifference = 0.0f;
+	for (TransformNode node = 0; node < hierarchy.getNumNodes(); node++)
+		for (int k = 0; k < 16; k++)
+			maxDifference = max(maxDifference, fabs(composed[node * 16 + k] - hierarchy.getWorldMatrix(node)[k]));
+
+	cout << "TransformHierarchy: " << hierarchy.getNumNodes() << " nodes in " << hierarchy.getNumLevels() << " levels - first update = " << firstTime
+		<< " ms, all moved = " << allTime / iterations << " ms (" << threadedTime / iterations << " ms on " << numThreads << " threads), "
+		<< max(numRoots / 100, (size_t)1) << " roots moved = " << fewTime / iterations << " ms (" << numFewChanged << " nodes changed)" << endl;
+	cout << "  Composed from ancestors = " << composeTime / iterations << " ms (largest difference " << maxDifference << ")" << endl;
+}
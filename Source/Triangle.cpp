@@ -120,8 +120,5 @@ void Triangle::render(ID3D11DeviceContext *context) {
 
 Triangle::~Triangle() {
 
-	if (vertexBuffer)
-		vertexBuffer->Release();
-	if (inputLayout)
-		inputLayout->Release();
+	// The vertex and index buffers and the input layout are released by ~BaseModel
 }
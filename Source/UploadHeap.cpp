@@ -0,0 +1,233 @@
+#include "stdafx.h"
+#include "UploadHeap.h"
+#include <thread>
+
+using namespace std;
+
+
+bool UploadRing::allocate(UINT size, UINT alignment, UINT *offset, bool *wrapped)
+{
+	if (wrapped)
+		*wrapped = false;
+	if (size == 0 || size > capacity)
+		return false;
+
+	UINT64 start = (head + alignment - 1) & ~(UINT64)(alignment - 1);
+	UINT64 position = start % capacity;
+	bool wrap = position + size > capacity;
+	if (wrap) {
+		// Skip the end of the ring so the allocation is contiguous
+		start += capacity - position;
+		position = 0;
+	}
+	if (start + size - tail > capacity)
+		return false;
+
+	bytesWasted += start - head;
+	bytesAllocated += size;
+	head = start + size;
+	peakUsed = max(peakUsed, head - tail);
+	numAllocations++;
+	if (wrap)
+		numWraps++;
+
+	*offset = (UINT)position;
+	if (wrapped)
+		*wrapped = wrap;
+	return true;
+}
+
+UINT64 UploadRing::endFrame()
+{
+	frames.push_back(make_pair(frameIndex, head));
+	return frameIndex++;
+}
+
+void UploadRing::retire(UINT64 completedFrame)
+{
+	while (!frames.empty() && frames.front().first <= completedFrame) {
+		tail = frames.front().second;
+		frames.pop_front();
+	}
+}
+
+
+UploadHeap *UploadHeap::defaultHeap = nullptr;
+
+
+UploadHeap::UploadHeap(ID3D11Device *_device, UINT capacity, UINT bindFlags, UINT _maxFramesInFlight) : ring(capacity)
+{
+	device = _device;
+	maxFramesInFlight = max(_maxFramesInFlight, 1u);
+
+	if (!device) {
+		cpuMemory.resize(capacity);
+		return;
+	}
+
+	D3D11_BUFFER_DESC bufferDesc;
+	ZeroMemory(&bufferDesc, sizeof(D3D11_BUFFER_DESC));
+	bufferDesc.ByteWidth = capacity;
+	bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+	bufferDesc.BindFlags = bindFlags;
+	bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+	if (!SUCCEEDED(device->CreateBuffer(&bufferDesc, NULL, &buffer)))
+		cout << "UploadHeap: cannot create " << capacity << " byte upload buffer" << endl;
+}
+
+UploadHeap::~UploadHeap()
+{
+	for (size_t i = 0; i < fences.size(); i++)
+		if (fences[i].second)
+			fences[i].second->Release();
+	for (size_t i = 0; i < freeQueries.size(); i++)
+		freeQueries[i]->Release();
+	if (buffer)
+		buffer->Release();
+	if (defaultHeap == this)
+		defaultHeap = nullptr;
+}
+
+UploadHeap *UploadHeap::getDefault(ID3D11Device *device)
+{
+	if (!defaultHeap)
+		defaultHeap = new UploadHeap(device);
+	return defaultHeap;
+}
+
+void UploadHeap::setDefault(UploadHeap *heap)
+{
+	defaultHeap = heap;
+}
+
+
+uint8_t *UploadHeap::map(ID3D11DeviceContext *context)
+{
+	if (mapped)
+		return mapped;
+	if (!device) {
+		mapped = &cpuMemory[0];
+		return mapped;
+	}
+	if (!buffer || !context)
+		return nullptr;
+
+	// Nothing written since the last map is in use by the GPU (the fences guarantee it) so the buffer does not need renaming.  Only the
+	// first map discards, which tells the driver the initial contents are undefined
+	D3D11_MAPPED_SUBRESOURCE res;
+	HRESULT hr = context->Map(buffer, 0, discardOnMap ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE, 0, &res);
+	if (!SUCCEEDED(hr))
+		return nullptr;
+	discardOnMap = false;
+	mapped = (uint8_t*)res.pData;
+	return mapped;
+}
+
+void UploadHeap::unmap(ID3D11DeviceContext *context)
+{
+	if (!mapped)
+		return;
+	if (device && buffer && context)
+		context->Unmap(buffer, 0);
+	mapped = nullptr;
+}
+
+bool UploadHeap::retireFrames(ID3D11DeviceContext *context, bool wait)
+{
+	bool retired = false;
+
+	while (!fences.empty()) {
+
+		UINT64 frame = fences.front().first;
+		ID3D11Query *query = fences.front().second;
+
+		bool complete;
+		if (query) {
+			// Only flush the command buffer when waiting
+			HRESULT hr = context->GetData(query, nullptr, 0, wait ? 0 : D3D11_ASYNC_GETDATA_DONOTFLUSH);
+			while (wait && hr == S_FALSE) {
+				this_thread::yield();
+				hr = context->GetData(query, nullptr, 0, 0);
+			}
+			complete = (hr == S_OK) || (wait && !SUCCEEDED(hr));
+		}
+		else {
+			// No fence (system memory backend or the query could not be created) - assume the GPU is at most maxFramesInFlight behind
+			complete = wait || ring.getFrameIndex() - frame > maxFramesInFlight;
+		}
+		if (!complete)
+			break;
+
+		ring.retire(frame);
+		if (query)
+			freeQueries.push_back(query);
+		fences.pop_front();
+		retired = true;
+
+		// Having waited for one frame the rest are only retired if they have already completed
+		wait = false;
+	}
+	return retired;
+}
+
+
+bool UploadHeap::allocate(ID3D11DeviceContext *context, UINT size, UINT alignment, Allocation *allocation)
+{
+	UINT offset;
+	while (!ring.allocate(size, alignment, &offset)) {
+		// The ring is full of data the GPU may still be reading - wait for the oldest frame.  Only giving up counts as an overflow
+		if (size == 0 || size > ring.getCapacity() || !retireFrames(context, true)) {
+			numOverflows++;
+			return false;
+		}
+		numStalls++;
+	}
+
+	uint8_t *memory = map(context);
+	if (!memory)
+		return false;
+
+	allocation->data = memory + offset;
+	allocation->buffer = buffer;
+	allocation->offset = offset;
+	allocation->size = size;
+	frameBytes += size;
+	return true;
+}
+
+void UploadHeap::endFrame(ID3D11DeviceContext *context)
+{
+	unmap(context);
+
+	UINT64 frame = ring.endFrame();
+
+	ID3D11Query *query = nullptr;
+	if (device && context) {
+		if (!freeQueries.empty()) {
+			query = freeQueries.back();
+			freeQueries.pop_back();
+		}
+		else {
+			D3D11_QUERY_DESC queryDesc;
+			ZeroMemory(&queryDesc, sizeof(D3D11_QUERY_DESC));
+			queryDesc.Query = D3D11_QUERY_EVENT;
+			if (!SUCCEEDED(device->CreateQuery(&queryDesc, &query)))
+				query = nullptr;
+		}
+		if (query)
+			context->End(query);
+	}
+	fences.push_back(make_pair(frame, query));
+
+	lastFrameBytes = frameBytes;
+	frameBytes = 0;
+	retireFrames(context, false);
+}
+
+
+void UploadHeap::reportData() const
+{
+	cout << "UploadHeap: " << ring.getCapacity() / 1024 << " KB, Peak used = " << ring.getPeakUsed() / 1024 << " KB, Last frame = " << lastFrameBytes << " bytes" << endl;
+	cout << "Allocations = " << ring.getNumAllocations() << ", Wraps = " << ring.getNumWraps() << ", Overflows = " << numOverflows << ", Stalls = " << numStalls << ", Wasted = " << ring.getBytesWasted() << " bytes" << endl;
+}
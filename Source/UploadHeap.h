@@ -0,0 +1,130 @@
+//
+// UploadHeap.h
+//
+
+// Ring buffer upload heap for dynamic vertex and index data.  Writers allocate a range of one large dynamic buffer and fill it in
+// place through the returned pointer, so there is no CPU side copy and no per-object dynamic buffer.  The buffer is mapped with
+// D3D11_MAP_WRITE_NO_OVERWRITE (WRITE_DISCARD only the first time) which promises the driver that no range the GPU may still read is
+// written.  That promise is kept with a fence per frame: endFrame() issues an event query and closes the frame's range of the ring,
+// and a range is only reused once the query of the frame that wrote it has completed.  Allocations are therefore valid until the
+// end of the frame they were made in.
+//
+// UploadRing is the allocator on its own (monotonic head / tail positions, wrap and overflow handling) and UploadHeap constructed
+// without a device uses system memory and retires frames after maxFramesInFlight frames, so the allocator can be run without D3D.
+#pragma once
+
+#include <d3d11_2.h>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class UploadRing {
+
+	UINT64									capacity = 0;
+	// Total bytes allocated (head) and released (tail) since creation.  The ring offset of a position is position % capacity
+	UINT64									head = 0;
+	UINT64									tail = 0;
+	// Frame index and head position at the end of each frame not yet retired
+	std::deque<std::pair<UINT64, UINT64> >	frames;
+	UINT64									frameIndex = 0;
+
+	// Statistics
+	UINT64									bytesAllocated = 0;
+	UINT64									bytesWasted = 0; // Alignment padding and the unused end of the ring skipped on wrap
+	UINT64									peakUsed = 0;
+	UINT									numAllocations = 0;
+	UINT									numWraps = 0;
+
+public:
+
+	// capacity must be a multiple of the largest alignment used
+	UploadRing(UINT _capacity) { capacity = _capacity; };
+
+	// Reserve size bytes aligned to alignment (a power of 2) and return the ring offset.  Allocations never straddle the end of the
+	// ring.  Returns false if the space is still owned by frames that have not been retired
+	bool allocate(UINT size, UINT alignment, UINT *offset, bool *wrapped = nullptr);
+
+	// Close the current frame and return its index
+	UINT64 endFrame();
+	// Release the space of every frame up to and including completedFrame
+	void retire(UINT64 completedFrame);
+
+	UINT64 getCapacity() const { return capacity; };
+	UINT64 getUsed() const { return head - tail; };
+	UINT64 getFrameIndex() const { return frameIndex; };
+	// Index of the oldest frame not yet retired (the current frame if every closed frame has been retired)
+	UINT64 getOldestFrame() const { return frames.empty() ? frameIndex : frames.front().first; };
+	bool hasPendingFrames() const { return !frames.empty(); };
+
+	UINT64 getBytesAllocated() const { return bytesAllocated; };
+	UINT64 getBytesWasted() const { return bytesWasted; };
+	UINT64 getPeakUsed() const { return peakUsed; };
+	UINT getNumAllocations() const { return numAllocations; };
+	UINT getNumWraps() const { return numWraps; };
+};
+
+
+class UploadHeap {
+
+public:
+
+	struct Allocation {
+		void								*data = nullptr; // Write the data here (write only - do not read)
+		ID3D11Buffer						*buffer = nullptr; // Bind buffer at offset (nullptr with the system memory backend)
+		UINT								offset = 0;
+		UINT								size = 0;
+	};
+
+private:
+
+	ID3D11Device							*device = nullptr;
+	ID3D11Buffer							*buffer = nullptr;
+	// System memory backend (no device)
+	std::vector<uint8_t>					cpuMemory;
+	UploadRing								ring;
+	UINT									maxFramesInFlight;
+
+	// Current mapping (allocations are written through it until unmap)
+	uint8_t									*mapped = nullptr;
+	bool									discardOnMap = true;
+
+	// Event query issued at the end of each frame that has not completed yet
+	std::deque<std::pair<UINT64, ID3D11Query*> >	fences;
+	std::vector<ID3D11Query*>				freeQueries;
+
+	// Statistics
+	UINT64									frameBytes = 0;
+	UINT64									lastFrameBytes = 0;
+	UINT									numStalls = 0; // Waits for the GPU to free space, whether or not the allocation then fitted
+	UINT									numOverflows = 0; // Allocations that failed after any stalls
+
+	static UploadHeap						*defaultHeap;
+
+	uint8_t *map(ID3D11DeviceContext *context);
+	// Retire frames whose fence has completed.  If wait is set, block until the oldest outstanding fence completes.  Returns true if
+	// any frame was retired
+	bool retireFrames(ID3D11DeviceContext *context, bool wait);
+
+public:
+
+	// Without a device the heap uses system memory (for testing the ring allocation without D3D)
+	UploadHeap(ID3D11Device *_device, UINT capacity = 4 * 1024 * 1024, UINT bindFlags = D3D11_BIND_VERTEX_BUFFER | D3D11_BIND_INDEX_BUFFER, UINT _maxFramesInFlight = 3);
+	~UploadHeap();
+
+	// Heap used for dynamic geometry.  Created for the given device on first use if none has been set
+	static UploadHeap *getDefault(ID3D11Device *device);
+	static void setDefault(UploadHeap *heap);
+
+	// Reserve size bytes and map them for writing.  If the ring is full the call waits for the GPU to finish the oldest frame; it
+	// returns false only if size exceeds the heap or nothing can be freed.  The mapping stays open for further allocations and must be
+	// closed with unmap() before drawing with the data.  The allocation is valid until the end of the frame
+	bool allocate(ID3D11DeviceContext *context, UINT size, UINT alignment, Allocation *allocation);
+	void unmap(ID3D11DeviceContext *context);
+
+	// Close the frame: unmap, issue its fence and retire the frames the GPU has finished.  Call once per frame after the last draw
+	void endFrame(ID3D11DeviceContext *context);
+
+	const UploadRing &getRing() const { return ring; };
+	UINT64 getLastFrameBytes() const { return lastFrameBytes; };
+	void reportData() const;
+};
@@ -29,65 +29,43 @@ float randM1P1()
 	return r / 6;
 }
 
-// Helper to load a compiled shader
+// Helper to load a compiled shader.  The caller owns *bytecode and must free() it.  Effects should use ShaderPack instead, which
+// loads each shader once and shares it
 uint32_t LoadShader(const char *filename, char **bytecode)
 {
-
-	ifstream	*fp = nullptr;
-	uint32_t shaderBytes = -1;
+	uint32_t shaderBytes = 0;
 	cout << "loading shader" << endl;
 
-	try
-	{
-		// Validate parameters
-		if (!filename)
-			throw exception("loadCSO: Invalid parameters");
-
-		// Open file
-		fp = new ifstream(filename, ios::in | ios::binary);
-
-		if (!fp->is_open())
-			throw exception("loadCSO: Cannot open file");
-
-		// Get file size
-		fp->seekg(0, ios::end);
-		shaderBytes = (uint32_t)fp->tellg();
-
-		// Create blob object to store bytecode (exceptions propagate up if any occur)
-		//memBlock = new DXBlob(size);
-		cout << "allocating shader memory bytes = " << shaderBytes << endl;
-		*bytecode = (char*)malloc(shaderBytes);
-		// Read binary data into blob object
-		fp->seekg(0, ios::beg);
-		fp->read(*bytecode, shaderBytes);
-
-		// Close file and release local resources
-		fp->close();
-		delete fp;
-
-		// Return DXBlob - ownership implicity passed to caller
-		//*bytecode = memBlock;
-		cout << "Done: shader memory bytes = " << shaderBytes << endl;
+	// Validate parameters
+	if (!filename || !bytecode)
+		throw exception("loadCSO: Invalid parameters");
+	*bytecode = nullptr;
+
+	// Open file
+	ifstream fp(filename, ios::in | ios::binary);
+
+	if (!fp.is_open())
+		throw exception("loadCSO: Cannot open file");
+
+	// Get file size
+	fp.seekg(0, ios::end);
+	shaderBytes = (uint32_t)fp.tellg();
+
+	cout << "allocating shader memory bytes = " << shaderBytes << endl;
+	*bytecode = (char*)malloc(shaderBytes);
+	if (!*bytecode)
+		throw exception("loadCSO: Cannot allocate shader memory");
+
+	// Read binary data
+	fp.seekg(0, ios::beg);
+	fp.read(*bytecode, shaderBytes);
+	if (!fp) {
+		free(*bytecode);
+		*bytecode = nullptr;
+		throw exception("loadCSO: Cannot read file");
 	}
-	catch (exception& e)
-	{
-		cout << e.what() << endl;
 
-		// Cleanup local resources
-		if (fp) {
-
-			if (fp->is_open())
-				fp->close();
-
-			delete fp;
-		}
-
-		if (bytecode)
-			delete bytecode;
-
-		// Re-throw exception
-		throw;
-	}
+	// Ownership of the bytecode is passed to the caller (the file is closed by the ifstream destructor)
+	cout << "Done: shader memory bytes = " << shaderBytes << endl;
 	return shaderBytes;
 }
-
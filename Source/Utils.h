@@ -3,4 +3,6 @@
 
 float randM1P1();
 HRESULT mapCbuffer(ID3D11DeviceContext *context, void *cBufferExtSrcL, ID3D11Buffer *cBufferExtL,int buffSize);
+// Constant buffer ByteWidth must be a multiple of 16 bytes
+inline UINT cbufferByteWidth(UINT size) { return (size + 15) & ~15u; }
 uint32_t LoadShader(const char *filename, char **bytecode);
@@ -0,0 +1,78 @@
+#include "stdafx.h"
+#include "VertexCompression.h"
+#include <DirectXPackedVector.h>
+#include <cmath>
+#include <cfloat>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+
+static float signNotZero(float v)
+{
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+XMFLOAT2 encodeOctahedral(const XMFLOAT3 &normal)
+{
+	// Project onto the octahedron |x| + |y| + |z| = 1
+	float l1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (l1 <= 0.0f)
+		return XMFLOAT2(0.0f, 0.0f);
+	float x = normal.x / l1;
+	float y = normal.y / l1;
+
+	// Fold the lower hemisphere over the diagonals
+	if (normal.z < 0.0f) {
+		float foldedX = (1.0f - fabsf(y)) * signNotZero(x);
+		float foldedY = (1.0f - fabsf(x)) * signNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+	return XMFLOAT2(x, y);
+}
+
+XMFLOAT3 decodeOctahedral(const XMFLOAT2 &encoded)
+{
+	XMFLOAT3 n(encoded.x, encoded.y, 1.0f - fabsf(encoded.x) - fabsf(encoded.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&n)));
+	return n;
+}
+
+
+void compressVertices(const ExtendedVertexStruct *vertices, size_t numVertices, CompressedVertexStruct *compressed, XMFLOAT3 *posOffset, XMFLOAT3 *posScale)
+{
+	// Bounds of the mesh
+	XMVECTOR minPos = XMVectorReplicate(FLT_MAX);
+	XMVECTOR maxPos = XMVectorReplicate(-FLT_MAX);
+	for (size_t i = 0; i < numVertices; i++) {
+		XMVECTOR p = XMLoadFloat3(&vertices[i].pos);
+		minPos = XMVectorMin(minPos, p);
+		maxPos = XMVectorMax(maxPos, p);
+	}
+	if (numVertices == 0)
+		minPos = maxPos = XMVectorZero();
+
+	// A flat axis (eg. a grid) keeps a non-zero scale so the division below is defined
+	XMVECTOR extent = XMVectorMax(XMVectorSubtract(maxPos, minPos), XMVectorReplicate(FLT_MIN));
+	XMVECTOR invExtent = XMVectorReciprocal(extent);
+	XMStoreFloat3(posOffset, minPos);
+	XMStoreFloat3(posScale, extent);
+
+	for (size_t i = 0; i < numVertices; i++) {
+		const ExtendedVertexStruct &v = vertices[i];
+		CompressedVertexStruct &c = compressed[i];
+
+		// XMStoreUShortN4 saturates to [0, 1] and rounds to the nearest of the 65536 steps
+		XMVECTOR p = XMVectorMultiply(XMVectorSubtract(XMLoadFloat3(&v.pos), minPos), invExtent);
+		XMStoreUShortN4(&c.pos, XMVectorSetW(p, 0.0f));
+
+		XMFLOAT2 n = encodeOctahedral(v.normal);
+		XMStoreShortN2(&c.normal, XMLoadFloat2(&n));
+
+		XMStoreHalf2(&c.texCoord, XMLoadFloat2(&v.texCoord));
+	}
+}
@@ -0,0 +1,21 @@
+//
+// VertexCompression.h
+//
+
+// Conversion of imported ExtendedVertexStructs to CompressedVertexStructs (VERTEX_FORMAT_COMPRESSED).  Positions are quantised to 16
+// bits per axis relative to the axis aligned bounds of the mesh, which are returned so the model can pass them to lit_vs in its
+// cbuffer (posOffset, posScale).  Normals use the octahedral encoding - the unit sphere is projected onto an octahedron which is
+// unfolded onto a square - so 2 x 16 bits keep the error well below a degree.  The material colours are not stored per vertex.
+#pragma once
+
+#include <DirectXMath.h>
+#include <VertexStructures.h>
+
+// Compress numVertices vertices into compressed (numVertices long).  posOffset and posScale decode the positions:
+// pos = posOffset + (quantised / 65535) * posScale
+void compressVertices(const ExtendedVertexStruct *vertices, size_t numVertices, CompressedVertexStruct *compressed, DirectX::XMFLOAT3 *posOffset, DirectX::XMFLOAT3 *posScale);
+
+// Octahedral encoding of a normal in [-1, 1]^2 (the normal need not be unit length but must not be zero)
+DirectX::XMFLOAT2 encodeOctahedral(const DirectX::XMFLOAT3 &normal);
+// Unit vector from its octahedral encoding (matches decodeOctahedral in lit_vs.hlsl)
+DirectX::XMFLOAT3 decodeOctahedral(const DirectX::XMFLOAT2 &encoded);
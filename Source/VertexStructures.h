@@ -34,6 +34,41 @@ static const D3D11_INPUT_ELEMENT_DESC extVertexDesc[] = {
 	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 };
 
+// ExtendedVertexStruct in slot 0 with a per instance world matrix in slot 1 (lit_vs variants with SHADER_FEATURE_INSTANCING)
+static const D3D11_INPUT_ELEMENT_DESC extInstancedVertexDesc[] = {
+	{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "DIFFUSE", 0, DXGI_FORMAT_B8G8R8A8_UNORM, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "SPECULAR", 0, DXGI_FORMAT_B8G8R8A8_UNORM, 0, 28, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 32, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "WORLD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD", 1, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD", 2, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 32, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+	{ "WORLD", 3, DXGI_FORMAT_R32G32B32A32_FLOAT, 1, 48, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+};
+
+// Vertex formats a Model can be imported to.  The model's effect must use the matching input layout (and lit_vs variant)
+enum VertexFormat {
+	VERTEX_FORMAT_EXTENDED,		// ExtendedVertexStruct (40 bytes)
+	VERTEX_FORMAT_COMPRESSED	// CompressedVertexStruct (16 bytes), lit_vs with SHADER_FEATURE_COMPRESSED_VERTEX
+};
+
+// Compressed ExtendedVertexStruct (see VertexCompression.h).  The position is quantised to 16 bits per axis within the mesh bounds,
+// the normal is octahedral encoded in 2 x 16 bits and the texture coordinates are half floats.  The material colours, which are the
+// same for every vertex of a model, are read from the model cbuffer with the bounds used to decode the position
+struct CompressedVertexStruct {
+	DirectX::PackedVector::XMUSHORTN4	pos; // (pos - posOffset) / posScale, w unused
+	DirectX::PackedVector::XMSHORTN2	normal;
+	DirectX::PackedVector::XMHALF2		texCoord;
+};
+
+// Vertex input descriptor based on CompressedVertexStruct
+static const D3D11_INPUT_ELEMENT_DESC compressedVertexDesc[] = {
+	{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+	{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 }
+};
+
 struct ParticleVertexStruct {
 	DirectX::XMFLOAT3 pos;
 	DirectX::XMFLOAT3 posL;
@@ -50,15 +85,32 @@ static const D3D11_INPUT_ELEMENT_DESC particleVertexDesc[] = {
 	{ "DATA", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 36, D3D11_INPUT_PER_VERTEX_DATA, 0 }
 };
 
-struct FlareVertexStruct {
+// Per-instance data for a single flare in a FlareBatch
+struct FlareInstanceStruct {
 	DirectX::XMFLOAT3 pos;
-	DirectX::XMFLOAT3 posL;
 	DirectX::PackedVector::XMCOLOR		colour;
+	UINT slice; // Texture array slice used by this flare
 };
 
-// Vertex input descriptor based on Flare VertexStruct
-static const D3D11_INPUT_ELEMENT_DESC flareVertexDesc[] = {
-{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-{ "LPOS", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 }
-};
\ No newline at end of file
+// Vertex input descriptor for FlareBatch - slot 0 holds the shared quad corners, slot 1 holds FlareInstanceStruct per instance
+static const D3D11_INPUT_ELEMENT_DESC flareInstanceDesc[] = {
+{ "LPOS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 1, 12, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+{ "SLICE", 0, DXGI_FORMAT_R32_UINT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+};
+// Per-instance data of an impostor in an ImpostorBatch - where the model's origin is and how it is scaled and turned about the
+// vertical axis
+struct ImpostorInstanceStruct {
+	DirectX::XMFLOAT3					pos; // World position of the model's origin
+	FLOAT								scale;
+	DirectX::XMFLOAT2					axis; // World (x, z) direction of the model's x axis
+};
+
+// Vertex input descriptor for ImpostorBatch - slot 0 holds the shared quad corners, slot 1 holds ImpostorInstanceStruct per instance
+static const D3D11_INPUT_ELEMENT_DESC impostorInstanceDesc[] = {
+{ "LPOS", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+{ "SCALE", 0, DXGI_FORMAT_R32_FLOAT, 1, 12, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+{ "AXIS", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 }
+};
@@ -8,6 +8,15 @@
 #include <exception>
 #include <CGDConsole.h>
 #include <Scene.h>
+#include <JobSystem.h>
+#include <Model.h>
+#include <OcclusionCuller.h>
+#include <SceneBVH.h>
+#include <SceneStore.h>
+#include <TransformHierarchy.h>
+#include <ImageBlur.h>
+#include <ShaderPermutations.h>
+#include <ShaderPack.h>
 
 using namespace std;
 
@@ -30,6 +39,18 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCm
 	if (!SUCCEEDED(CoInitialize(NULL)))
 		return 0;
 
+	// -buildshaders compiles the shader permutation variants and writes the shader pack, then exits.  Run by the post-build step
+	// (no console is created so the output goes to the build log) so the application only loads the pack
+	if (lpCmdLine && _tcsstr(lpCmdLine, _T("-buildshaders"))) {
+		HRESULT hr = ShaderPermutations::build("Shaders\\hlsl\\", "Shaders\\cso\\");
+		if (SUCCEEDED(hr))
+			hr = ShaderPack::update("Shaders\\shaders.pack", "Shaders\\cso\\");
+		if (!SUCCEEDED(hr))
+			cout << "error: cannot build the shader permutations or Shaders\\shaders.pack" << endl;
+		CoUninitialize();
+		return SUCCEEDED(hr) ? 0 : 1;
+	}
+
 	try
 	{
 		// 1.3 Initialise debug console
@@ -41,6 +62,69 @@ int APIENTRY _tWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCm
 		// Since we have to create the console before any memory report can be generated we have +1 malloc error so compensate for this.  debugConsole must be released once the final memory report is given!
 		compensate_free_count(1);
 
+		// -benchmarkjobs times the job system on 1 to N threads and exits
+		if (lpCmdLine && _tcsstr(lpCmdLine, _T("-benchmarkjobs"))) {
+			JobSystem::benchmark();
+			cout << "Press any key to exit" << endl;
+			_getch();
+			CoUninitialize();
+			return 0;
+		}
+
+		// -benchmarkimport times the import of every model in Resources\Models and exits
+		if (lpCmdLine && _tcsstr(lpCmdLine, _T("-benchmarkimport"))) {
+			Model::benchmarkImport();
+			cout << "Press any key to exit" << endl;
+			_getch();
+			CoUninitialize();
+			return 0;
+		}
+
+		// -benchmarkocclusion times the software occlusion culler on a synthetic scene and exits
+		if (lpCmdLine && _tcsstr(lpCmdLine, _T("-benchmarkocclusion"))) {
+			benchmarkOcclusionCulling();
+			cout << "Press any key to exit" << endl;
+			_getch();
+			CoUninitialize();
+			return 0;
+		}
+
+		// -benchmarkbvh times building, refitting and querying the scene bounding volume hierarchy at up to 100k objects and exits
+		if (lpCmdLine && _tcsstr(lpCmdLine, _T("-benchmarkbvh"))) {
+			benchmarkSceneBVH();
+			cout << "Press any key to exit" << endl;
+			_getch();
+			CoUninitialize();
+			return 0;
+		}
+
+		// -benchmarkscene times the scene store's systems at up to 100k entities and exits
+		if (lpCmdLine && _tcsstr(lpCmdLine, _T("-benchmarkscene"))) {
+			benchmarkSceneStore();
+			cout << "Press any key to exit" << endl;
+			_getch();
+			CoUninitialize();
+			return 0;
+		}
+
+		// -benchmarktransforms times updating a transform hierarchy of 100k nodes and exits
+		if (lpCmdLine && _tcsstr(lpCmdLine, _T("-benchmarktransforms"))) {
+			benchmarkTransformHierarchy();
+			cout << "Press any key to exit" << endl;
+			_getch();
+			CoUninitialize();
+			return 0;
+		}
+
+		// -benchmarkblur checks the CPU image blur against the GPU blur kernel and times it on a 1920 x 1080 image and exits
+		if (lpCmdLine && _tcsstr(lpCmdLine, _T("-benchmarkblur"))) {
+			benchmarkImageBlur();
+			cout << "Press any key to exit" << endl;
+			_getch();
+			CoUninitialize();
+			return 0;
+		}
+
 		cout << "Hello DirectX 11...\n\n";
 
 		// 1.4 Create main application controller object (singleton)